@@ -153,6 +153,9 @@ static int print_deref( LDAP *ld, LDAPControl *ctrl );
 #ifdef LDAP_CONTROL_X_WHATFAILED
 static int print_whatfailed( LDAP *ld, LDAPControl *ctrl );
 #endif
+#ifdef LDAP_CONTROL_X_EXPLAIN
+static int print_explain( LDAP *ld, LDAPControl *ctrl );
+#endif
 
 static struct tool_ctrls_t {
 	const char	*oid;
@@ -176,6 +179,9 @@ static struct tool_ctrls_t {
 #endif
 #ifdef LDAP_CONTROL_X_WHATFAILED
 	{ LDAP_CONTROL_X_WHATFAILED,			TOOL_ALL,	print_whatfailed },
+#endif
+#ifdef LDAP_CONTROL_X_EXPLAIN
+	{ LDAP_CONTROL_X_EXPLAIN,			TOOL_SEARCH,	print_explain },
 #endif
 	{ NULL,						0,		NULL }
 };
@@ -2330,6 +2336,29 @@ print_whatfailed( LDAP *ld, LDAPControl *ctrl )
 }
 #endif
 
+#ifdef LDAP_CONTROL_X_EXPLAIN
+static int
+print_explain( LDAP *ld, LDAPControl *ctrl )
+{
+	char *ptr, *end, *eol;
+
+	tool_write_ldif( LDIF_PUT_COMMENT, " explain:", NULL, 0 );
+
+	/* the plan is plain text, one step per line */
+	ptr = ctrl->ldctl_value.bv_val;
+	end = ptr + ctrl->ldctl_value.bv_len;
+	for ( ; ptr < end; ptr = eol + 1 ) {
+		eol = memchr( ptr, '\n', end - ptr );
+		if ( eol == NULL ) {
+			eol = end;
+		}
+		tool_write_ldif( LDIF_PUT_COMMENT, NULL, ptr, eol - ptr );
+	}
+
+	return 0;
+}
+#endif
+
 #ifdef LDAP_CONTROL_AUTHZID_RESPONSE
 static int
 print_authzid( LDAP *ld, LDAPControl *ctrl )
@@ -226,6 +226,33 @@ ldap_pvt_thread_pool_submit LDAP_P((
 	ldap_pvt_thread_start_t *start,
 	void *arg ));
 
+#ifndef LDAP_PVT_THREAD_H_DONE
+/* number of task classes, see ldap_pvt_thread_pool_classweight() */
+#define LDAP_PVT_THREAD_POOL_CLASSES	8
+#define LDAP_PVT_THREAD_POOL_MAXWEIGHT	1024
+#endif /* !LDAP_PVT_THREAD_H_DONE */
+
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_class LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int tclass,
+	ldap_pvt_thread_start_t *start,
+	void *arg ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_submit_batch LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start,
+	void **args,
+	int *classes,
+	int nargs ));
+
+LDAP_F( int )
+ldap_pvt_thread_pool_classweight LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int tclass,
+	int weight ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_retract LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
@@ -260,6 +287,23 @@ ldap_pvt_thread_pool_query LDAP_P((
 	ldap_pvt_thread_pool_t *pool,
 	ldap_pvt_thread_pool_param_t param, void *value ));
 
+#ifndef LDAP_PVT_THREAD_H_DONE
+/* per-queue counters, see ldap_pvt_thread_pool_qstats() */
+typedef struct ldap_pvt_thread_poolq_stats_s {
+	int lpq_open;			/* threads */
+	int lpq_active;			/* running tasks */
+	int lpq_pending;		/* queued tasks */
+	unsigned long lpq_tasks;	/* tasks started so far */
+	unsigned long lpq_stolen;	/* ...by threads of other queues */
+	double lpq_wait;		/* seconds those tasks spent queued */
+} ldap_pvt_thread_poolq_stats_t;
+#endif /* !LDAP_PVT_THREAD_H_DONE */
+
+LDAP_F( int )
+ldap_pvt_thread_pool_qstats LDAP_P((
+	ldap_pvt_thread_pool_t *pool,
+	int queue, ldap_pvt_thread_poolq_stats_t *stats ));
+
 LDAP_F( int )
 ldap_pvt_thread_pool_pausing LDAP_P((
 	ldap_pvt_thread_pool_t *pool ));
@@ -166,6 +166,29 @@ ldap_pvt_thread_pool_submit (
 	return(0);
 }
 
+int
+ldap_pvt_thread_pool_submit_class (
+	ldap_pvt_thread_pool_t *pool,
+	int tclass,
+	ldap_pvt_thread_start_t *start_routine, void *arg )
+{
+	(start_routine)(NULL, arg);
+	return(0);
+}
+
+int
+ldap_pvt_thread_pool_submit_batch (
+	ldap_pvt_thread_pool_t *pool,
+	ldap_pvt_thread_start_t *start_routine, void **args,
+	int *classes, int nargs )
+{
+	int i;
+
+	for ( i = 0; i < nargs; i++ )
+		(start_routine)(NULL, args[i]);
+	return(nargs);
+}
+
 int
 ldap_pvt_thread_pool_retract (
 	ldap_pvt_thread_pool_t *pool,
@@ -188,6 +211,20 @@ ldap_pvt_thread_pool_query( ldap_pvt_thread_pool_t *tpool,
 	return(-1);
 }
 
+int
+ldap_pvt_thread_pool_classweight( ldap_pvt_thread_pool_t *tpool,
+	int tclass, int weight )
+{
+	return(0);
+}
+
+int
+ldap_pvt_thread_pool_qstats( ldap_pvt_thread_pool_t *tpool,
+	int queue, ldap_pvt_thread_poolq_stats_t *stats )
+{
+	return(-1);
+}
+
 int
 ldap_pvt_thread_pool_backload (
 	ldap_pvt_thread_pool_t *pool )
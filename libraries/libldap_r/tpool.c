@@ -54,6 +54,16 @@ typedef struct ldap_int_tpool_key_s {
 /* (Theoretical) max number of pending requests */
 #define MAX_PENDING (INT_MAX/2)	/* INT_MAX - (room to avoid overflow) */
 
+/* Task classes are served in proportion to their weights by stride
+ * scheduling: each time a class is served its pass advances by
+ * STRIDE_ONE/weight, and the pending class with the lowest pass is
+ * served next.
+ */
+#define STRIDE_ONE	(1UL << 16)
+
+/* a < b for passes, which may wrap around */
+#define PASS_LT(a, b)	((long)((a) - (b)) < 0)
+
 /* pool->ltp_pause values */
 enum { NOT_PAUSED = 0, WANT_PAUSE = 1, PAUSED = 2 };
 
@@ -92,6 +102,8 @@ typedef struct ldap_int_thread_task_s {
 	} ltt_next;
 	ldap_pvt_thread_start_t *ltt_start_routine;
 	void *ltt_arg;
+	struct timeval ltt_queued;	/* when it was submitted */
+	int ltt_class;
 } ldap_int_thread_task_t;
 
 typedef LDAP_STAILQ_HEAD(tcq, ldap_int_thread_task_s) ldap_int_tpool_plist_t;
@@ -111,15 +123,19 @@ struct ldap_int_thread_poolq_s {
 	 */
 	ldap_pvt_thread_cond_t ltp_cond;
 
-	/* ltp_pause == 0 ? &ltp_pending_list : &empty_pending_list,
+	/* ltp_pause == 0 ? ltp_pending_list : empty_pending_list,
 	 * maintaned to reduce work for pool_wrapper()
 	 */
 	ldap_int_tpool_plist_t *ltp_work_list;
 
-	/* pending tasks, and unused task objects */
-	ldap_int_tpool_plist_t ltp_pending_list;
+	/* pending tasks of each class, and unused task objects */
+	ldap_int_tpool_plist_t ltp_pending_list[LDAP_PVT_THREAD_POOL_CLASSES];
 	LDAP_SLIST_HEAD(tcl, ldap_int_thread_task_s) ltp_free_list;
 
+	/* stride scheduling state of the classes */
+	unsigned long ltp_pass[LDAP_PVT_THREAD_POOL_CLASSES];
+	unsigned long ltp_vtime;	/* pass of the last class served */
+
 	/* Max number of threads in this queue */
 	int ltp_max_count;
 
@@ -130,6 +146,11 @@ struct ldap_int_thread_poolq_s {
 	int ltp_active_count;		/* Active, not paused/idle tasks */
 	int ltp_open_count;			/* Number of threads, negated when ltp_pause */
 	int ltp_starting;			/* Currently starting threads */
+
+	/* statistics of tasks submitted to this queue */
+	unsigned long ltp_ntasks;	/* started */
+	unsigned long ltp_nstolen;	/* started by another queue's thread */
+	double ltp_wait;			/* total seconds spent pending */
 };
 
 struct ldap_int_thread_pool_s {
@@ -174,10 +195,12 @@ struct ldap_int_thread_pool_s {
 
 	/* Max pending + paused + idle tasks, negated when ltp_finishing */
 	int ltp_max_pending;
+
+	/* STRIDE_ONE / weight of each task class */
+	unsigned long ltp_stride[LDAP_PVT_THREAD_POOL_CLASSES];
 };
 
-static ldap_int_tpool_plist_t empty_pending_list =
-	LDAP_STAILQ_HEAD_INITIALIZER(empty_pending_list);
+static ldap_int_tpool_plist_t empty_pending_list[LDAP_PVT_THREAD_POOL_CLASSES];
 
 static int ldap_int_has_thread_pool = 0;
 static LDAP_STAILQ_HEAD(tpq, ldap_int_thread_pool_s)
@@ -196,6 +219,10 @@ static ldap_int_thread_userctx_t ldap_int_main_thrctx;
 int
 ldap_int_thread_pool_startup ( void )
 {
+	int i;
+
+	for (i=0; i<LDAP_PVT_THREAD_POOL_CLASSES; i++)
+		LDAP_STAILQ_INIT(&empty_pending_list[i]);
 	ldap_int_main_thrctx.ltu_id = ldap_pvt_thread_self();
 	ldap_pvt_thread_key_create( &ldap_tpool_key );
 	return ldap_pvt_thread_mutex_init(&ldap_pvt_thread_pool_mutex);
@@ -225,7 +252,7 @@ ldap_pvt_thread_pool_init_q (
 {
 	ldap_pvt_thread_pool_t pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, j, rc, rem_thr, rem_pend;
 
 	/* multiple pools are currently not supported (ITS#4943) */
 	assert(!ldap_int_has_thread_pool);
@@ -241,6 +268,9 @@ ldap_pvt_thread_pool_init_q (
 
 	if (pool == NULL) return(-1);
 
+	for (i=0; i<LDAP_PVT_THREAD_POOL_CLASSES; i++)
+		pool->ltp_stride[i] = STRIDE_ONE;
+
 	pool->ltp_wqs = LDAP_MALLOC(numqs * sizeof(struct ldap_int_thread_poolq_s *));
 	if (pool->ltp_wqs == NULL) {
 		LDAP_FREE(pool);
@@ -294,8 +324,9 @@ fail:
 		rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 		if (rc != 0)
 			return(rc);
-		LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		for (j=0; j<LDAP_PVT_THREAD_POOL_CLASSES; j++)
+			LDAP_STAILQ_INIT(&pq->ltp_pending_list[j]);
+		pq->ltp_work_list = pq->ltp_pending_list;
 		LDAP_SLIST_INIT(&pq->ltp_free_list);
 
 		pq->ltp_max_count = max_threads / numqs;
@@ -353,11 +384,142 @@ ldap_int_poolq_hash(
 	return i;
 }
 
+/* Queue a task on pq.  pq must be locked. */
+static void
+ldap_int_poolq_enqueue(
+	struct ldap_int_thread_poolq_s *pq,
+	ldap_int_thread_task_t *task )
+{
+	int c = task->ltt_class;
+
+	if ( LDAP_STAILQ_EMPTY( &pq->ltp_pending_list[c] ) &&
+		PASS_LT( pq->ltp_pass[c], pq->ltp_vtime ))
+	{
+		/* no credit for the time the class was idle */
+		pq->ltp_pass[c] = pq->ltp_vtime;
+	}
+	pq->ltp_pending_count++;
+	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list[c], task, ltt_next.q);
+}
+
+/* Take the next task to run off pq, NULL if none or paused.
+ * pq must be locked.
+ */
+static ldap_int_thread_task_t *
+ldap_int_poolq_dequeue(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	ldap_int_tpool_plist_t *work_list = pq->ltp_work_list;
+	ldap_int_thread_task_t *task;
+	struct timeval now;
+	int i, c = -1;
+
+	for ( i = 0; i < LDAP_PVT_THREAD_POOL_CLASSES; i++ ) {
+		if ( !LDAP_STAILQ_EMPTY( &work_list[i] ) &&
+			( c < 0 || PASS_LT( pq->ltp_pass[i], pq->ltp_pass[c] )))
+			c = i;
+	}
+	if ( c < 0 )
+		return NULL;
+
+	task = LDAP_STAILQ_FIRST( &work_list[c] );
+	LDAP_STAILQ_REMOVE_HEAD( &work_list[c], ltt_next.q );
+	pq->ltp_pending_count--;
+	pq->ltp_vtime = pq->ltp_pass[c];
+	pq->ltp_pass[c] += pool->ltp_stride[c];
+
+	gettimeofday( &now, NULL );
+	pq->ltp_wait += (double)(now.tv_sec - task->ltt_queued.tv_sec) +
+		(now.tv_usec - task->ltt_queued.tv_usec) / 1000000.0;
+	pq->ltp_ntasks++;
+
+	return task;
+}
+
+/* Take a task from the backlog of some other queue, one that has more
+ * pending tasks than idle threads.  Called by a thread of pq that has
+ * nothing to do, with pq locked; other queues are only trylocked so
+ * two idle threads can't deadlock stealing from each other.
+ */
+static ldap_int_thread_task_t *
+ldap_int_poolq_steal(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	ldap_int_thread_task_t *task = NULL;
+	int i, j;
+
+	if ( pool->ltp_numqs < 2 || pool->ltp_pause )
+		return NULL;
+
+	for ( i = 0; i < pool->ltp_numqs; i++ )
+		if ( pool->ltp_wqs[i] == pq ) break;
+
+	for ( j = 1; j < pool->ltp_numqs && task == NULL; j++ ) {
+		vq = pool->ltp_wqs[(i + j) % pool->ltp_numqs];
+		if ( vq->ltp_pending_count == 0 )
+			continue;
+		if ( ldap_pvt_thread_mutex_trylock( &vq->ltp_mutex ))
+			continue;
+		if ( vq->ltp_pending_count >
+			vq->ltp_open_count - vq->ltp_active_count - vq->ltp_starting &&
+			( task = ldap_int_poolq_dequeue( pool, vq )) != NULL )
+		{
+			vq->ltp_nstolen++;
+		}
+		ldap_pvt_thread_mutex_unlock( &vq->ltp_mutex );
+	}
+
+	return task;
+}
+
+/* pq has more pending tasks than idle threads and may not start
+ * another one; wake an idle thread of another queue to steal from it.
+ * Only a hint, the other queues are not locked.  pq must be locked.
+ */
+static void
+ldap_int_poolq_wake_thief(
+	struct ldap_int_thread_pool_s *pool,
+	struct ldap_int_thread_poolq_s *pq )
+{
+	struct ldap_int_thread_poolq_s *vq;
+	int i;
+
+	if ( pool->ltp_numqs < 2 ||
+		pq->ltp_pending_count <=
+			pq->ltp_open_count - pq->ltp_active_count - pq->ltp_starting ||
+		pq->ltp_open_count < pq->ltp_max_count )
+		return;
+
+	for ( i = 0; i < pool->ltp_numqs; i++ ) {
+		vq = pool->ltp_wqs[i];
+		if ( vq != pq && vq->ltp_open_count > vq->ltp_active_count ) {
+			ldap_pvt_thread_cond_signal( &vq->ltp_cond );
+			break;
+		}
+	}
+}
+
 /* Submit a task to be performed by the thread pool */
 int
 ldap_pvt_thread_pool_submit (
 	ldap_pvt_thread_pool_t *tpool,
 	ldap_pvt_thread_start_t *start_routine, void *arg )
+{
+	return ldap_pvt_thread_pool_submit_class( tpool, 0,
+		start_routine, arg );
+}
+
+/* Submit a task of the given class.  Pending tasks of the classes
+ * are started in proportion to the classes' weights.
+ */
+int
+ldap_pvt_thread_pool_submit_class (
+	ldap_pvt_thread_pool_t *tpool,
+	int tclass,
+	ldap_pvt_thread_start_t *start_routine, void *arg )
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
@@ -365,7 +527,7 @@ ldap_pvt_thread_pool_submit (
 	ldap_pvt_thread_t thr;
 	int i, j;
 
-	if (tpool == NULL)
+	if (tpool == NULL || tclass < 0 || tclass >= LDAP_PVT_THREAD_POOL_CLASSES)
 		return(-1);
 
 	pool = *tpool;
@@ -403,9 +565,10 @@ ldap_pvt_thread_pool_submit (
 
 	task->ltt_start_routine = start_routine;
 	task->ltt_arg = arg;
+	task->ltt_class = tclass;
+	gettimeofday( &task->ltt_queued, NULL );
 
-	pq->ltp_pending_count++;
-	LDAP_STAILQ_INSERT_TAIL(&pq->ltp_pending_list, task, ltt_next.q);
+	ldap_int_poolq_enqueue(pq, task);
 
 	if (pool->ltp_pause)
 		goto done;
@@ -434,7 +597,7 @@ ldap_pvt_thread_pool_submit (
 				/* let pool_destroy know there are no more threads */
 				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
 
-				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list, ltt_next.q)
+				LDAP_STAILQ_FOREACH(ptr, &pq->ltp_pending_list[tclass], ltt_next.q)
 					if (ptr == task) break;
 				if (ptr == task) {
 					/* no open threads, task not handled, so
@@ -442,7 +605,7 @@ ldap_pvt_thread_pool_submit (
 					 * report the error.
 					 */
 					pq->ltp_pending_count--;
-					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list, task,
+					LDAP_STAILQ_REMOVE(&pq->ltp_pending_list[tclass], task,
 						ldap_int_thread_task_s, ltt_next.q);
 					LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, task,
 						ltt_next.l);
@@ -455,6 +618,7 @@ ldap_pvt_thread_pool_submit (
 		}
 	}
 	ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+	ldap_int_poolq_wake_thief(pool, pq);
 
  done:
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
@@ -465,6 +629,132 @@ ldap_pvt_thread_pool_submit (
 	return(-1);
 }
 
+/* Submit a batch of tasks sharing one start routine.  Each queue's
+ * mutex is taken once for as many tasks as it will accept, rather
+ * than once per task.  classes[n] is the class of args[n], or all
+ * are of class 0 if classes is NULL.  Returns the number of leading
+ * args that were queued, or -1 for invalid parameters.
+ */
+int
+ldap_pvt_thread_pool_submit_batch (
+	ldap_pvt_thread_pool_t *tpool,
+	ldap_pvt_thread_start_t *start_routine, void **args,
+	int *classes, int nargs )
+{
+	struct ldap_int_thread_pool_s *pool;
+	struct ldap_int_thread_poolq_s *pq;
+	ldap_int_thread_task_t *task, *first[LDAP_PVT_THREAD_POOL_CLASSES];
+	ldap_pvt_thread_t thr;
+	struct timeval now;
+	int i, j, c, n = 0, queued;
+
+	if (tpool == NULL || args == NULL || nargs < 0)
+		return(-1);
+
+	pool = *tpool;
+
+	if (pool == NULL)
+		return(-1);
+
+	for ( i = 0; classes != NULL && i < nargs; i++ ) {
+		if ( classes[i] < 0 || classes[i] >= LDAP_PVT_THREAD_POOL_CLASSES )
+			return(-1);
+	}
+
+	if ( pool->ltp_numqs > 1 && nargs > 0 )
+		i = ldap_int_poolq_hash( pool, args[0] );
+	else
+		i = 0;
+
+	gettimeofday( &now, NULL );
+
+	j = i;
+	while ( n < nargs ) {
+		pq = pool->ltp_wqs[i];
+		ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+
+		for ( c = 0; c < LDAP_PVT_THREAD_POOL_CLASSES; c++ )
+			first[c] = NULL;
+		queued = 0;
+		while ( n < nargs && pq->ltp_pending_count < pq->ltp_max_pending ) {
+			task = LDAP_SLIST_FIRST(&pq->ltp_free_list);
+			if (task) {
+				LDAP_SLIST_REMOVE_HEAD(&pq->ltp_free_list, ltt_next.l);
+			} else {
+				task = (ldap_int_thread_task_t *) LDAP_MALLOC(sizeof(*task));
+				if (task == NULL)
+					break;
+			}
+
+			c = classes ? classes[n] : 0;
+			task->ltt_start_routine = start_routine;
+			task->ltt_arg = args[n++];
+			task->ltt_queued = now;
+			task->ltt_class = c;
+
+			ldap_int_poolq_enqueue(pq, task);
+			if ( first[c] == NULL )
+				first[c] = task;
+			queued++;
+		}
+
+		if ( queued && !pool->ltp_pause ) {
+			/* open as many threads as the new tasks can use */
+			while (pq->ltp_open_count < pq->ltp_active_count+pq->ltp_pending_count &&
+				pq->ltp_open_count < pq->ltp_max_count)
+			{
+				pq->ltp_starting++;
+				pq->ltp_open_count++;
+
+				if (0 != ldap_pvt_thread_create(
+					&thr, 1, ldap_int_thread_pool_wrapper, pq))
+				{
+					pq->ltp_starting--;
+					pq->ltp_open_count--;
+					break;
+				}
+			}
+
+			if (pq->ltp_open_count == 0) {
+				/* no open threads at all, so nothing will handle
+				 * this round of tasks; back them out and stop.
+				 */
+				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+				for ( c = 0; c < LDAP_PVT_THREAD_POOL_CLASSES; c++ ) {
+					while ( first[c] ) {
+						task = LDAP_STAILQ_NEXT(first[c], ltt_next.q);
+						LDAP_STAILQ_REMOVE(&pq->ltp_pending_list[c], first[c],
+							ldap_int_thread_task_s, ltt_next.q);
+						LDAP_SLIST_INSERT_HEAD(&pq->ltp_free_list, first[c],
+							ltt_next.l);
+						pq->ltp_pending_count--;
+						first[c] = task;
+					}
+				}
+				n -= queued;
+				ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+				break;
+			}
+
+			if ( queued > 1 )
+				ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
+			else
+				ldap_pvt_thread_cond_signal(&pq->ltp_cond);
+			ldap_int_poolq_wake_thief(pool, pq);
+		}
+		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+		if ( n < nargs ) {
+			i++;
+			i %= pool->ltp_numqs;
+			if ( i == j )
+				break;
+		}
+	}
+
+	return(n);
+}
+
 static void *
 no_task( void *ctx, void *arg )
 {
@@ -497,16 +787,18 @@ ldap_pvt_thread_pool_retract (
 	pq = pool->ltp_wqs[i];
 
 	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
-	LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list, ltt_next.q)
-		if (task->ltt_start_routine == start_routine &&
-			task->ltt_arg == arg) {
-			/* Could LDAP_STAILQ_REMOVE the task, but that
-			 * walks ltp_pending_list again to find it.
-			 */
-			task->ltt_start_routine = no_task;
-			task->ltt_arg = NULL;
-			break;
-		}
+	for (i=0, task=NULL; i<LDAP_PVT_THREAD_POOL_CLASSES && task == NULL; i++) {
+		LDAP_STAILQ_FOREACH(task, &pq->ltp_pending_list[i], ltt_next.q)
+			if (task->ltt_start_routine == start_routine &&
+				task->ltt_arg == arg) {
+				/* Could LDAP_STAILQ_REMOVE the task, but that
+				 * walks ltp_pending_list again to find it.
+				 */
+				task->ltt_start_routine = no_task;
+				task->ltt_arg = NULL;
+				break;
+			}
+	}
 	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 	return task != NULL;
 }
@@ -520,7 +812,7 @@ ldap_pvt_thread_pool_queues(
 {
 	struct ldap_int_thread_pool_s *pool;
 	struct ldap_int_thread_poolq_s *pq;
-	int i, rc, rem_thr, rem_pend;
+	int i, j, rc, rem_thr, rem_pend;
 
 	if (numqs < 1 || tpool == NULL)
 		return(-1);
@@ -556,8 +848,9 @@ ldap_pvt_thread_pool_queues(
 			rc = ldap_pvt_thread_cond_init(&pq->ltp_cond);
 			if (rc != 0)
 				return(rc);
-			LDAP_STAILQ_INIT(&pq->ltp_pending_list);
-			pq->ltp_work_list = &pq->ltp_pending_list;
+			for (j=0; j<LDAP_PVT_THREAD_POOL_CLASSES; j++)
+				LDAP_STAILQ_INIT(&pq->ltp_pending_list[j]);
+			pq->ltp_work_list = pq->ltp_pending_list;
 			LDAP_SLIST_INIT(&pq->ltp_free_list);
 		}
 	}
@@ -730,6 +1023,59 @@ ldap_pvt_thread_pool_query(
 	return ( count == -1 ? -1 : 0 );
 }
 
+/* Inspect one queue of the pool.  -1 if there is no such queue. */
+int
+ldap_pvt_thread_pool_qstats(
+	ldap_pvt_thread_pool_t *tpool,
+	int queue,
+	ldap_pvt_thread_poolq_stats_t *stats )
+{
+	struct ldap_int_thread_pool_s	*pool;
+	struct ldap_int_thread_poolq_s	*pq;
+
+	if ( tpool == NULL || (pool = *tpool) == NULL || stats == NULL ||
+		queue < 0 || queue >= pool->ltp_numqs ) {
+		return -1;
+	}
+
+	pq = pool->ltp_wqs[queue];
+	ldap_pvt_thread_mutex_lock(&pq->ltp_mutex);
+	stats->lpq_open = pq->ltp_open_count;
+	if (stats->lpq_open < 0)
+		stats->lpq_open = -stats->lpq_open;
+	stats->lpq_active = pq->ltp_active_count;
+	stats->lpq_pending = pq->ltp_pending_count;
+	stats->lpq_tasks = pq->ltp_ntasks;
+	stats->lpq_stolen = pq->ltp_nstolen;
+	stats->lpq_wait = pq->ltp_wait;
+	ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
+
+	return 0;
+}
+
+/* Set the weight of a task class, 1 to LDAP_PVT_THREAD_POOL_MAXWEIGHT.
+ * When several classes have tasks pending, each is started at a rate
+ * proportional to its weight.  Classes weigh 1 by default.
+ */
+int
+ldap_pvt_thread_pool_classweight(
+	ldap_pvt_thread_pool_t *tpool,
+	int tclass,
+	int weight )
+{
+	struct ldap_int_thread_pool_s	*pool;
+
+	if ( tpool == NULL || (pool = *tpool) == NULL ||
+		tclass < 0 || tclass >= LDAP_PVT_THREAD_POOL_CLASSES ||
+		weight < 1 || weight > LDAP_PVT_THREAD_POOL_MAXWEIGHT ) {
+		return -1;
+	}
+
+	/* read by the queues without locking, any value will do */
+	pool->ltp_stride[tclass] = STRIDE_ONE / weight;
+	return 0;
+}
+
 /*
  * true if pool is pausing; does not lock any mutex to check.
  * 0 if not pause, 1 if pause, -1 if error or no pool.
@@ -807,9 +1153,12 @@ ldap_pvt_thread_pool_destroy ( ldap_pvt_thread_pool_t *tpool, int run_pending )
 		if (pq->ltp_max_pending > 0)
 			pq->ltp_max_pending = -pq->ltp_max_pending;
 		if (!run_pending) {
-			while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list)) != NULL) {
-				LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list, ltt_next.q);
-				LDAP_FREE(task);
+			int j;
+			for (j=0; j<LDAP_PVT_THREAD_POOL_CLASSES; j++) {
+				while ((task = LDAP_STAILQ_FIRST(&pq->ltp_pending_list[j])) != NULL) {
+					LDAP_STAILQ_REMOVE_HEAD(&pq->ltp_pending_list[j], ltt_next.q);
+					LDAP_FREE(task);
+				}
 			}
 			pq->ltp_pending_count = 0;
 		}
@@ -853,7 +1202,6 @@ ldap_int_thread_pool_wrapper (
 	struct ldap_int_thread_poolq_s *pq = xpool;
 	struct ldap_int_thread_pool_s *pool = pq->ltp_pool;
 	ldap_int_thread_task_t *task;
-	ldap_int_tpool_plist_t *work_list;
 	ldap_int_thread_userctx_t ctx, *kctx;
 	unsigned i, keyslot, hash;
 	int pool_lock = 0, freeme = 0;
@@ -894,8 +1242,9 @@ ldap_int_thread_pool_wrapper (
 	pq->ltp_active_count++;
 
 	for (;;) {
-		work_list = pq->ltp_work_list; /* help the compiler a bit */
-		task = LDAP_STAILQ_FIRST(work_list);
+		task = ldap_int_poolq_dequeue(pool, pq);
+		if (task == NULL)
+			task = ldap_int_poolq_steal(pool, pq);
 		if (task == NULL) {	/* paused or no pending tasks */
 			if (--(pq->ltp_active_count) < 1) {
 				if (pool->ltp_pause) {
@@ -939,8 +1288,11 @@ ldap_int_thread_pool_wrapper (
 				} else
 					ldap_pvt_thread_cond_wait(&pq->ltp_cond, &pq->ltp_mutex);
 
-				work_list = pq->ltp_work_list;
-				task = LDAP_STAILQ_FIRST(work_list);
+				if (pool_lock)
+					continue;	/* still paused */
+				task = ldap_int_poolq_dequeue(pool, pq);
+				if (task == NULL)
+					task = ldap_int_poolq_steal(pool, pq);
 			} while (task == NULL);
 
 			if (pool_lock) {
@@ -951,8 +1303,6 @@ ldap_int_thread_pool_wrapper (
 			pq->ltp_active_count++;
 		}
 
-		LDAP_STAILQ_REMOVE_HEAD(work_list, ltt_next.q);
-		pq->ltp_pending_count--;
 		ldap_pvt_thread_mutex_unlock(&pq->ltp_mutex);
 
 		task->ltt_start_routine(&ctx, task->ltt_arg);
@@ -1094,7 +1444,7 @@ handle_pause( ldap_pvt_thread_pool_t *tpool, int pause_type )
 			 * and do not finish threads in ldap_pvt_thread_pool_wrapper() */
 			pq->ltp_open_count = -pq->ltp_open_count;
 			/* Hide pending tasks from ldap_pvt_thread_pool_wrapper() */
-			pq->ltp_work_list = &empty_pending_list;
+			pq->ltp_work_list = empty_pending_list;
 
 			if (pq->ltp_active_count > 0)
 				pool->ltp_active_queues++;
@@ -1181,7 +1531,7 @@ ldap_pvt_thread_pool_resume (
 		pq = pool->ltp_wqs[i];
 		if (pq->ltp_open_count <= 0) /* true when paused, but be paranoid */
 			pq->ltp_open_count = -pq->ltp_open_count;
-		pq->ltp_work_list = &pq->ltp_pending_list;
+		pq->ltp_work_list = pq->ltp_pending_list;
 		ldap_pvt_thread_cond_broadcast(&pq->ltp_cond);
 	}
 	ldap_pvt_thread_cond_broadcast(&pool->ltp_cond);
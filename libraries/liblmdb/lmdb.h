@@ -287,6 +287,17 @@ typedef void (MDB_rel_func)(MDB_val *item, void *oldptr, void *newptr, void *rel
 #define MDB_NORDAHEAD	0x800000
 	/** don't initialize malloc'd memory before writing to datafile */
 #define MDB_NOMEMINIT	0x1000000
+	/** back a writable mmap with huge pages if the OS supports it */
+#define MDB_HUGEPAGE	0x2000000
+/** @} */
+
+/**	@defgroup	mdb_warmup	Warmup Flags
+ *	@{
+ */
+	/** warm all pages in use, not just the branch pages */
+#define MDB_WARMDATA	0x01
+	/** lock the warmed pages in memory */
+#define MDB_WARMLOCK	0x02
 /** @} */
 
 /**	@defgroup	mdb_dbi_open	Database Flags
@@ -587,6 +598,11 @@ int  mdb_env_create(MDB_env **env);
 	 *		caller is expected to overwrite all of the memory that was
 	 *		reserved in that case.
 	 *		This flag may be changed at any time using #mdb_env_set_flags().
+	 *	<li>#MDB_HUGEPAGE
+	 *		With #MDB_WRITEMAP, ask the OS to back the map with huge pages,
+	 *		which cuts the TLB misses of random reads in a large map. The
+	 *		advice is only taken where the OS supports huge pages for file
+	 *		mappings, and the option is ignored where it has no such advice.
 	 * </ul>
 	 * @param[in] mode The UNIX permissions to set on created files and semaphores.
 	 * This parameter is ignored on Windows.
@@ -693,6 +709,40 @@ int  mdb_env_stat(MDB_env *env, MDB_stat *stat);
 	 */
 int  mdb_env_info(MDB_env *env, MDB_envinfo *stat);
 
+	/** @brief Pre-fault pages of the memory map.
+	 *
+	 * After a restart the map is cold, and until the OS has read the
+	 * pages back in most lookups stall on page faults. This function
+	 * reads the branch pages of the main database and of all named
+	 * databases, which every lookup goes through, in a single pass.
+	 * The pages of sub-databases of #MDB_DUPSORT databases are not included.
+	 * It uses a read-only transaction, so it must not be called from a
+	 * thread that has a transaction of its own.
+	 * @param[in] env An environment handle returned by #mdb_env_create()
+	 * @param[in] flags Special options for this operation.
+	 * This parameter must be set to 0 or by bitwise OR'ing together one
+	 * or more of the values described here.
+	 * <ul>
+	 *	<li>#MDB_WARMDATA
+	 *		Read all the pages in use, in file order, instead of
+	 *		just the branch pages.
+	 *	<li>#MDB_WARMLOCK
+	 *		Also lock the pages in memory, so that the OS cannot evict
+	 *		them. The locks last until the environment is closed or the
+	 *		map is resized; since pages that get rewritten move, call this
+	 *		again now and then to lock the current branch pages. Locking
+	 *		is limited by the process's locked memory limit; the pages
+	 *		are still read if it is exceeded.
+	 * </ul>
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>ENOMEM - the pages could not be locked.
+	 *	<li>EPERM - the process may not lock memory.
+	 * </ul>
+	 */
+int  mdb_env_warmup(MDB_env *env, unsigned int flags);
+
 	/** @brief Flush the data buffers to disk.
 	 *
 	 * Data is always written to disk when #mdb_txn_commit() is called,
@@ -1315,6 +1365,34 @@ int  mdb_put(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data,
 	 */
 int  mdb_del(MDB_txn *txn, MDB_dbi dbi, MDB_val *key, MDB_val *data);
 
+	/** @brief Delete a range of keys from a database.
+	 *
+	 * This function removes all the keys from \b low up to but not including
+	 * \b high, with all their duplicate data items if the database supports
+	 * sorted duplicates. Instead of deleting the items one at a time, the
+	 * pages of every subtree of the B-tree that lies within the range are
+	 * freed as a whole, so that the cost grows with the number of pages
+	 * rather than with the number of items. Only the items in the pages at
+	 * the edges of the range are deleted one by one.
+	 * Cursors open on the database in this transaction must be repositioned
+	 * before they are used again. The main database may only be used
+	 * if it contains no named databases.
+	 * @param[in] txn A transaction handle returned by #mdb_txn_begin()
+	 * @param[in] dbi A database handle returned by #mdb_dbi_open()
+	 * @param[in] low The first key to delete, or NULL to start at the first key
+	 * @param[in] high The key to stop at, or NULL to delete up to the last key
+	 * @param[out] countp If non-NULL, the number of data items deleted
+	 * @return A non-zero error value on failure and 0 on success. Some possible
+	 * errors are:
+	 * <ul>
+	 *	<li>#MDB_INCOMPATIBLE - the range holds a named database.
+	 *	<li>EACCES - an attempt was made to write in a read-only transaction.
+	 *	<li>EINVAL - an invalid parameter was specified.
+	 * </ul>
+	 */
+int  mdb_del_range(MDB_txn *txn, MDB_dbi dbi, MDB_val *low, MDB_val *high,
+			    size_t *countp);
+
 	/** @brief Create a cursor handle.
 	 *
 	 * A cursor is associated with a specific transaction and database.
@@ -3798,6 +3798,13 @@ mdb_env_map(MDB_env *env, void *addr)
 #endif /* POSIX_MADV_RANDOM */
 #endif /* MADV_RANDOM */
 	}
+#ifdef MADV_HUGEPAGE
+	/* Only writable file maps may get huge pages, where supported.
+	 * It is just advice, failures are harmless.
+	 */
+	if ((flags & (MDB_HUGEPAGE|MDB_WRITEMAP)) == (MDB_HUGEPAGE|MDB_WRITEMAP))
+		madvise(env->me_map, env->me_mapsize, MADV_HUGEPAGE);
+#endif
 #endif /* _WIN32 */
 
 	/* Can happen because the address argument to mmap() is just a
@@ -4515,7 +4522,7 @@ fail:
 	 */
 #define	CHANGEABLE	(MDB_NOSYNC|MDB_NOMETASYNC|MDB_MAPASYNC|MDB_NOMEMINIT)
 #define	CHANGELESS	(MDB_FIXEDMAP|MDB_NOSUBDIR|MDB_RDONLY|MDB_WRITEMAP| \
-	MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD)
+	MDB_NOTLS|MDB_NOLOCK|MDB_NORDAHEAD|MDB_HUGEPAGE)
 
 #if VALID_FLAGS & PERSISTENT_FLAGS & (CHANGEABLE|CHANGELESS)
 # error "Persistent DB flags & env flags overlap, but both go in mm_flags"
@@ -7933,6 +7940,213 @@ mdb_del(MDB_txn *txn, MDB_dbi dbi,
 	return mdb_del0(txn, dbi, key, data, 0);
 }
 
+	/** Free all the pages of a subtree, for #mdb_del_range().
+	 * @param[in] mc A cursor on the database.
+	 * @param[in] pg The root page of the subtree.
+	 * @param[in,out] st Tally of what was freed: items, branch,
+	 *	leaf and overflow pages.
+	 * @return 0 on success, non-zero on failure.
+	 */
+static int
+mdb_range_free(MDB_cursor *mc, pgno_t pg, size_t *st)
+{
+	MDB_txn *txn = mc->mc_txn;
+	MDB_page *mp, *omp;
+	MDB_node *ni;
+	MDB_db *db;
+	unsigned int i, n;
+	int rc;
+
+	if ((rc = mdb_page_get(txn, pg, &mp, NULL)) != 0)
+		return rc;
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		for (i=0; i<n; i++) {
+			rc = mdb_range_free(mc, NODEPGNO(NODEPTR(mp, i)), st);
+			if (rc)
+				return rc;
+		}
+		st[1]++;
+	} else {
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if (ni->mn_flags & F_BIGDATA) {
+				memcpy(&pg, NODEDATA(ni), sizeof(pg));
+				if ((rc = mdb_page_get(txn, pg, &omp, NULL)) != 0)
+					return rc;
+				mdb_cassert(mc, IS_OVERFLOW(omp));
+				rc = mdb_midl_append_range(&txn->mt_free_pgs,
+					pg, omp->mp_pages);
+				if (rc)
+					return rc;
+				st[3] += omp->mp_pages;
+				st[0]++;
+			} else if (ni->mn_flags & F_DUPDATA) {
+				if (ni->mn_flags & F_SUBDATA) {
+					/* the sub-DB's pages count in its own record */
+					db = NODEDATA(ni);
+					st[0] += db->md_entries;
+					mdb_xcursor_init1(mc, ni);
+					rc = mdb_drop0(&mc->mc_xcursor->mx_cursor, 0);
+					if (rc)
+						return rc;
+				} else {
+					st[0] += NUMKEYS((MDB_page *)NODEDATA(ni));
+				}
+			} else if (ni->mn_flags & F_SUBDATA) {
+				/* a named DB, only mdb_drop() may remove it */
+				return MDB_INCOMPATIBLE;
+			} else {
+				st[0]++;
+			}
+		}
+		st[2]++;
+	}
+	return mdb_midl_append(&txn->mt_free_pgs, mp->mp_pgno);
+}
+
+	/** Position a cursor on the first key of a range. */
+static int
+mdb_range_seek(MDB_cursor *mc, MDB_val *low, MDB_val *key)
+{
+	MDB_val data;
+
+	/* the last position may be gone, don't let mdb_cursor_set() use it */
+	mc->mc_flags &= ~(C_INITIALIZED|C_EOF|C_DEL);
+	if (!low)
+		return mdb_cursor_first(mc, key, &data);
+	*key = *low;
+	return mdb_cursor_set(mc, key, &data, MDB_SET_RANGE, NULL);
+}
+
+int
+mdb_del_range(MDB_txn *txn, MDB_dbi dbi, MDB_val *low, MDB_val *high,
+	size_t *countp)
+{
+	MDB_cursor mc;
+	MDB_xcursor mx;
+	MDB_val key, sep, first;
+	MDB_page *mp;
+	MDB_node *ni;
+	size_t st[4], count = 0, dups;
+	unsigned int flags;
+	pgno_t pg;
+	int rc, lvl;
+
+	if (dbi == FREE_DBI || !TXN_DBI_EXIST(txn, dbi))
+		return EINVAL;
+
+	if (txn->mt_flags & (MDB_TXN_RDONLY|MDB_TXN_ERROR))
+		return (txn->mt_flags & MDB_TXN_RDONLY) ? EACCES : MDB_BAD_TXN;
+
+	flags = (txn->mt_dbs[dbi].md_flags & MDB_DUPSORT) ? MDB_NODUPDATA : 0;
+	first.mv_data = malloc(ENV_MAXKEY(txn->mt_env));
+	if (!first.mv_data)
+		return ENOMEM;
+	mdb_cursor_init(&mc, txn, dbi, &mx);
+
+	/* First free the subtrees that lie within the range. At the start
+	 * of each leaf page, find the largest subtree that begins there and
+	 * whose next sibling's separator key is not above high.
+	 */
+	rc = mdb_range_seek(&mc, low, &key);
+	while (rc == MDB_SUCCESS && mc.mc_top > 0) {
+		if (high && mc.mc_dbx->md_cmp(&key, high) >= 0)
+			break;
+		lvl = mc.mc_top;
+		if (!mc.mc_ki[mc.mc_top]) {
+			for (lvl = mc.mc_top - 1; lvl > 0 && !mc.mc_ki[lvl]; lvl--) ;
+			for (; lvl < mc.mc_top; lvl++) {
+				mp = mc.mc_pg[lvl];
+				if (mc.mc_ki[lvl] + 1u < NUMKEYS(mp)) {
+					if (!high)
+						break;
+					ni = NODEPTR(mp, mc.mc_ki[lvl] + 1);
+					MDB_GET_KEY2(ni, sep);
+					if (mc.mc_dbx->md_cmp(&sep, high) <= 0)
+						break;
+				} else if (!high && NUMKEYS(mp) > 1) {
+					break;
+				}
+			}
+		}
+		if (lvl == mc.mc_top) {
+			/* not the start of a subtree in the range, try the next page */
+			rc = mdb_cursor_sibling(&mc, 1);
+			if (rc == MDB_SUCCESS) {
+				ni = NODEPTR(mc.mc_pg[mc.mc_top], 0);
+				MDB_GET_KEY2(ni, key);
+			}
+			continue;
+		}
+
+		memcpy(first.mv_data, key.mv_data, key.mv_size);
+		first.mv_size = key.mv_size;
+		if ((rc = mdb_page_spill(&mc, NULL, NULL)) != 0)
+			break;
+		/* only the pages above the subtree get written */
+		mc.mc_snum = lvl + 1;
+		if ((rc = mdb_cursor_touch(&mc)) != 0)
+			break;
+		mp = mc.mc_pg[lvl];
+		pg = NODEPGNO(NODEPTR(mp, mc.mc_ki[lvl]));
+		memset(st, 0, sizeof(st));
+		if ((rc = mdb_range_free(&mc, pg, st)) != 0)
+			goto fail;
+		mdb_node_del(&mc, 0);
+		if (!mc.mc_ki[lvl]) {
+			/* the first key of a branch page is always empty */
+			sep.mv_size = 0;
+			sep.mv_data = NULL;
+			if ((rc = mdb_update_key(&mc, &sep)) != 0)
+				goto fail;
+		}
+		mc.mc_db->md_entries -= st[0];
+		mc.mc_db->md_branch_pages -= st[1];
+		mc.mc_db->md_leaf_pages -= st[2];
+		mc.mc_db->md_overflow_pages -= st[3];
+		count += st[0];
+		/* keep the cursor consistent through the rebalance,
+		 * as in mdb_del0()
+		 */
+		mc.mc_next = txn->mt_cursors[dbi];
+		txn->mt_cursors[dbi] = &mc;
+		rc = mdb_rebalance(&mc);
+		txn->mt_cursors[dbi] = mc.mc_next;
+		if (rc)
+			goto fail;
+		rc = mdb_range_seek(&mc, &first, &key);
+	}
+
+	/* Then delete what is left one key at a time */
+	while (rc == MDB_SUCCESS || rc == MDB_NOTFOUND) {
+		rc = mdb_range_seek(&mc, low, &key);
+		if (rc || (high && mc.mc_dbx->md_cmp(&key, high) >= 0))
+			break;
+		dups = 1;
+		if (flags && (rc = mdb_cursor_count(&mc, &dups)) != 0)
+			break;
+		mc.mc_next = txn->mt_cursors[dbi];
+		txn->mt_cursors[dbi] = &mc;
+		rc = mdb_cursor_del(&mc, flags);
+		txn->mt_cursors[dbi] = mc.mc_next;
+		if (rc)
+			break;
+		count += dups;
+	}
+	if (rc == MDB_NOTFOUND)
+		rc = MDB_SUCCESS;
+	free(first.mv_data);
+	if (countp)
+		*countp = count;
+	return rc;
+
+fail:
+	txn->mt_flags |= MDB_TXN_ERROR;
+	free(first.mv_data);
+	return rc;
+}
+
 static int
 mdb_del0(MDB_txn *txn, MDB_dbi dbi,
 	MDB_val *key, MDB_val *data, unsigned flags)
@@ -9075,6 +9289,103 @@ mdb_env_info(MDB_env *env, MDB_envinfo *arg)
 	return MDB_SUCCESS;
 }
 
+	/** State of #mdb_env_warmup() */
+typedef struct mdb_warm {
+	MDB_txn		*mw_txn;
+	unsigned int	mw_flags;
+	int			mw_rc;		/**< first locking error */
+} mdb_warm;
+
+	/** Lock pages of the map in memory, until the first failure. */
+static void ESECT
+mdb_warm_lock(mdb_warm *mw, void *addr, size_t len)
+{
+	if (!(mw->mw_flags & MDB_WARMLOCK) || mw->mw_rc)
+		return;
+#ifdef _WIN32
+	if (!VirtualLock(addr, len))
+		mw->mw_rc = ErrCode();
+#else
+	if (mlock(addr, len))
+		mw->mw_rc = ErrCode();
+#endif
+}
+
+	/** Read the branch pages of a tree. In the main DB, also
+	 *	read the leaves, to find and read the trees of named DBs.
+	 */
+static int ESECT
+mdb_warm_tree(mdb_warm *mw, pgno_t pg, int main)
+{
+	MDB_page *mp;
+	MDB_node *ni;
+	MDB_db db;
+	unsigned int i, n;
+	int rc;
+
+	if (pg == P_INVALID)
+		return MDB_SUCCESS;
+	rc = mdb_page_get(mw->mw_txn, pg, &mp, NULL);
+	if (rc)
+		return rc;
+	/* reading the header faults the page in */
+	n = NUMKEYS(mp);
+	if (IS_BRANCH(mp)) {
+		mdb_warm_lock(mw, mp, mw->mw_txn->mt_env->me_psize);
+		for (i=0; i<n; i++) {
+			rc = mdb_warm_tree(mw, NODEPGNO(NODEPTR(mp, i)), main);
+			if (rc)
+				return rc;
+		}
+	} else if (main && !IS_LEAF2(mp)) {
+		mdb_warm_lock(mw, mp, mw->mw_txn->mt_env->me_psize);
+		for (i=0; i<n; i++) {
+			ni = NODEPTR(mp, i);
+			if ((ni->mn_flags & (F_SUBDATA|F_DUPDATA)) != F_SUBDATA)
+				continue;
+			memcpy(&db, NODEDATA(ni), sizeof(db));
+			rc = mdb_warm_tree(mw, db.md_root, 0);
+			if (rc)
+				return rc;
+		}
+	}
+	return MDB_SUCCESS;
+}
+
+int ESECT
+mdb_env_warmup(MDB_env *env, unsigned int flags)
+{
+	mdb_warm mw;
+	int rc;
+
+	if (env == NULL || (flags & ~(MDB_WARMDATA|MDB_WARMLOCK)))
+		return EINVAL;
+
+	rc = mdb_txn_begin(env, NULL, MDB_RDONLY, &mw.mw_txn);
+	if (rc)
+		return rc;
+	mw.mw_flags = flags;
+	mw.mw_rc = MDB_SUCCESS;
+
+	if (flags & MDB_WARMDATA) {
+		size_t len = (size_t)mw.mw_txn->mt_next_pgno * env->me_psize;
+		volatile char *p;
+		char c;
+#ifdef MADV_WILLNEED
+		/* let the OS read ahead of us */
+		madvise(env->me_map, len, MADV_WILLNEED);
+#endif
+		for (p = env->me_map; p < env->me_map + len; p += env->me_psize)
+			c = *p;
+		(void)c;
+		mdb_warm_lock(&mw, env->me_map, len);
+	} else {
+		rc = mdb_warm_tree(&mw, mw.mw_txn->mt_dbs[MAIN_DBI].md_root, 1);
+	}
+	mdb_txn_abort(mw.mw_txn);
+	return rc ? rc : mw.mw_rc;
+}
+
 /** Set the default comparison functions for a database.
  * Called immediately after a database is opened to set the defaults.
  * The user can then override them with #mdb_set_compare() or
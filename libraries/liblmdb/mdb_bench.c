@@ -0,0 +1,580 @@
+/* mdb_bench.c - memory-mapped database benchmark tool */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+typedef unsigned long long u64;
+
+typedef struct flagbit {
+	int bit;
+	char *name;
+} flagbit;
+
+static flagbit envflags[] = {
+	{ MDB_WRITEMAP, "writemap" },
+	{ MDB_NOMETASYNC, "nometasync" },
+	{ MDB_NOSYNC, "nosync" },
+	{ MDB_MAPASYNC, "mapasync" },
+	{ MDB_NORDAHEAD, "nordahead" },
+	{ MDB_NOMEMINIT, "nomeminit" },
+	{ 0, NULL }
+};
+
+static char *prog;
+static char *envpath;
+static MDB_env *env;
+static MDB_dbi maindbi, dupdbi, bigdbi;
+static size_t count = 100000;		/* records per workload */
+static int keysize = 16;
+static int valsize = 100;
+static int bigsize = 65536;
+static int ndups = 10;
+static int batch = 1000;		/* puts per write txn */
+static int nreaders = 4;
+static int seconds = 10;
+static u64 seed = 1;
+static char *valbuf;
+
+/* Latencies of one workload, in nanoseconds */
+typedef struct lats {
+	u64 *ns;
+	size_t n, max;
+} lats;
+
+static u64 now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u64)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void lat_add(lats *l, u64 ns)
+{
+	if (l->n == l->max) {
+		l->max = l->max ? l->max * 2 : 65536;
+		l->ns = realloc(l->ns, l->max * sizeof(u64));
+		if (!l->ns) {
+			fprintf(stderr, "%s: out of memory\n", prog);
+			exit(EXIT_FAILURE);
+		}
+	}
+	l->ns[l->n++] = ns;
+}
+
+static void lat_merge(lats *to, lats *from)
+{
+	size_t i;
+	for (i=0; i<from->n; i++)
+		lat_add(to, from->ns[i]);
+	free(from->ns);
+	memset(from, 0, sizeof(*from));
+}
+
+static int cmpu64(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+	return x < y ? -1 : x > y;
+}
+
+static double pct(lats *l, double p)
+{
+	size_t i = (size_t)(p * (l->n - 1) / 100.0 + 0.5);
+	return l->ns[i] / 1000.0;
+}
+
+/* xorshift64*, one state per thread */
+static u64 rnd(u64 *s)
+{
+	*s ^= *s >> 12;
+	*s ^= *s << 25;
+	*s ^= *s >> 27;
+	return *s * 2685821657736338717ULL;
+}
+
+/* Keys are zero-padded decimal numbers, so that their order is numeric */
+static void mkkey(MDB_val *key, char *buf, u64 n)
+{
+	snprintf(buf, keysize + 1, "%0*llu", keysize, n);
+	key->mv_data = buf;
+	key->mv_size = keysize;
+}
+
+/* Report the size of the data file, the pages in use, and how much of
+ * the file is in the page cache.
+ */
+static void growth(void)
+{
+	char path[4096];
+	struct stat st;
+	MDB_envinfo mei;
+	MDB_stat mst;
+	size_t resident = 0, npages;
+	int fd;
+
+	mdb_env_info(env, &mei);
+	mdb_env_stat(env, &mst);
+	snprintf(path, sizeof(path), "%s/data.mdb", envpath);
+	if (stat(path, &st))
+		return;
+	npages = (st.st_size + mst.ms_psize - 1) / mst.ms_psize;
+	fd = open(path, O_RDONLY);
+	if (fd >= 0 && st.st_size) {
+		void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (map != MAP_FAILED) {
+			long ps = sysconf(_SC_PAGESIZE);
+			size_t i, n = (st.st_size + ps - 1) / ps;
+			unsigned char *vec = malloc(n);
+			if (vec && !mincore(map, st.st_size, (void *)vec)) {
+				for (i=0; i<n; i++)
+					if (vec[i] & 1)
+						resident++;
+				resident *= ps;
+			}
+			free(vec);
+			munmap(map, st.st_size);
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+	printf("  file %.1f MB, %zu pages, %zu in use, %.1f MB in page cache\n",
+		st.st_size / 1048576.0, npages, (size_t)mei.me_last_pgno + 1,
+		resident / 1048576.0);
+}
+
+static void report(const char *name, lats *l, u64 elapsed, size_t bytes)
+{
+	double secs = elapsed / 1e9;
+
+	printf("%-12s %10zu ops %8.3f s %12.0f ops/s", name, l->n, secs,
+		secs > 0 ? l->n / secs : 0);
+	if (bytes)
+		printf(" %8.1f MB/s", secs > 0 ? bytes / 1048576.0 / secs : 0);
+	putchar('\n');
+	if (l->n) {
+		qsort(l->ns, l->n, sizeof(u64), cmpu64);
+		printf("  latency us: p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+			pct(l, 50), pct(l, 90), pct(l, 99), pct(l, 99.9),
+			l->ns[l->n-1] / 1000.0);
+	}
+	free(l->ns);
+	memset(l, 0, sizeof(*l));
+}
+
+/* Put count records, in key order or in random order. A put that
+ * completes a batch also counts the commit.
+ */
+static void fill(const char *name, MDB_dbi dbi, int random, int vsize,
+	unsigned int flags)
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	char kbuf[64];
+	lats l = {0};
+	u64 s = seed, t0, t1, start;
+	size_t i;
+	int rc, n = 0;
+
+	data.mv_size = vsize;
+	data.mv_data = valbuf;
+	start = now();
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_cursor_open(txn, dbi, &mc));
+	if (flags & MDB_APPEND) {
+		MDB_stat mst;
+		/* appending only works on an empty database */
+		E(mdb_stat(txn, dbi, &mst));
+		if (mst.ms_entries)
+			flags &= ~MDB_APPEND;
+	}
+	for (i=0; i<count; i++) {
+		t0 = now();
+		mkkey(&key, kbuf, random ? rnd(&s) % count : i);
+		E(mdb_cursor_put(mc, &key, &data, flags));
+		if (++n == batch) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+			E(mdb_cursor_open(txn, dbi, &mc));
+			n = 0;
+		}
+		t1 = now();
+		lat_add(&l, t1 - t0);
+	}
+	E(mdb_txn_commit(txn));
+	report(name, &l, now() - start, count * (keysize + vsize));
+	growth();
+}
+
+/* Read count records, in key order with a cursor or at random */
+static void readdb(const char *name, MDB_dbi dbi, int random)
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	char kbuf[64];
+	lats l = {0};
+	u64 s = seed ^ 0x5555, t0, start;
+	size_t i, bytes = 0, found = 0;
+	int rc;
+
+	start = now();
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	E(mdb_cursor_open(txn, dbi, &mc));
+	for (i=0; i<count; i++) {
+		t0 = now();
+		if (random) {
+			mkkey(&key, kbuf, rnd(&s) % count);
+			rc = mdb_get(txn, dbi, &key, &data);
+		} else {
+			rc = mdb_cursor_get(mc, &key, &data, MDB_NEXT);
+		}
+		lat_add(&l, now() - t0);
+		if (rc == MDB_NOTFOUND) {
+			if (!random)
+				break;
+			continue;
+		}
+		CHECK(rc == MDB_SUCCESS, "mdb_get");
+		found++;
+		bytes += key.mv_size + data.mv_size;
+	}
+	mdb_cursor_close(mc);
+	mdb_txn_abort(txn);
+	report(name, &l, now() - start, bytes);
+	printf("  %zu of %zu found\n", found, i);
+}
+
+/* count / ndups keys with ndups sorted duplicates each */
+static void dupfill(void)
+{
+	MDB_txn *txn;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	char kbuf[64], dbuf[64];
+	lats l = {0};
+	u64 s = seed, t0, start;
+	size_t i, nkeys = count / ndups ? count / ndups : 1;
+	int rc, n = 0;
+
+	start = now();
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_cursor_open(txn, dupdbi, &mc));
+	for (i=0; i<count; i++) {
+		t0 = now();
+		mkkey(&key, kbuf, rnd(&s) % nkeys);
+		data.mv_size = snprintf(dbuf, sizeof(dbuf), "%016llx", rnd(&s));
+		data.mv_data = dbuf;
+		E(mdb_cursor_put(mc, &key, &data, 0));
+		if (++n == batch) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+			E(mdb_cursor_open(txn, dupdbi, &mc));
+			n = 0;
+		}
+		lat_add(&l, now() - t0);
+	}
+	E(mdb_txn_commit(txn));
+	report("dupsort", &l, now() - start, 0);
+	growth();
+}
+
+typedef struct reader {
+	pthread_t thr;
+	lats l;
+	size_t found;
+	u64 seed;
+} reader;
+
+static volatile int stop;
+
+static void *readthr(void *arg)
+{
+	reader *r = arg;
+	MDB_txn *txn;
+	MDB_val key, data;
+	char kbuf[64];
+	u64 t0;
+	int rc, n = 0;
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	while (!stop) {
+		t0 = now();
+		mkkey(&key, kbuf, rnd(&r->seed) % count);
+		rc = mdb_get(txn, maindbi, &key, &data);
+		lat_add(&r->l, now() - t0);
+		if (rc == MDB_SUCCESS)
+			r->found++;
+		/* move on to newer snapshots now and then */
+		if (++n == batch) {
+			mdb_txn_reset(txn);
+			E(mdb_txn_renew(txn));
+			n = 0;
+		}
+	}
+	mdb_txn_abort(txn);
+	return NULL;
+}
+
+/* Readers doing random gets while one writer does random puts */
+static void mixed(void)
+{
+	reader *rs;
+	MDB_txn *txn;
+	MDB_val key, data;
+	char kbuf[64];
+	lats l = {0}, rl = {0};
+	u64 s = seed ^ 0xaaaa, t0, start, end;
+	int i, rc, n = 0;
+
+	rs = calloc(nreaders, sizeof(reader));
+	stop = 0;
+	start = now();
+	end = start + (u64)seconds * 1000000000ULL;
+	for (i=0; i<nreaders; i++) {
+		rs[i].seed = seed + i + 1;
+		pthread_create(&rs[i].thr, NULL, readthr, &rs[i]);
+	}
+	data.mv_size = valsize;
+	data.mv_data = valbuf;
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	while ((t0 = now()) < end) {
+		mkkey(&key, kbuf, rnd(&s) % count);
+		E(mdb_put(txn, maindbi, &key, &data, 0));
+		if (++n == batch) {
+			E(mdb_txn_commit(txn));
+			E(mdb_txn_begin(env, NULL, 0, &txn));
+			n = 0;
+		}
+		lat_add(&l, now() - t0);
+	}
+	E(mdb_txn_commit(txn));
+	stop = 1;
+	for (i=0; i<nreaders; i++) {
+		pthread_join(rs[i].thr, NULL);
+		lat_merge(&rl, &rs[i].l);
+	}
+	end = now() - start;
+	report("mixed-write", &l, end, 0);
+	report("mixed-read", &rl, end, 0);
+	free(rs);
+	growth();
+}
+
+static volatile int pinning;
+
+static void *pinthr(void *arg)
+{
+	MDB_txn *txn;
+	int rc;
+
+	E(mdb_txn_begin(env, NULL, MDB_RDONLY, &txn));
+	pinning = 1;
+	while (!stop)
+		usleep(10000);
+	mdb_txn_abort(txn);
+	return NULL;
+}
+
+/* Random overwrites while a reader keeps an old snapshot open, so that
+ * the pages it sees cannot be reused.
+ */
+static void pinned(void)
+{
+	pthread_t thr;
+
+	stop = 0;
+	pinning = 0;
+	pthread_create(&thr, NULL, pinthr, NULL);
+	while (!pinning)
+		usleep(1000);
+	printf("pinned: a reader holds the snapshot\n");
+	growth();
+	seed ^= 0x1234;
+	fill("pinned", maindbi, 1, valsize, 0);
+	seed ^= 0x1234;
+	stop = 1;
+	pthread_join(thr, NULL);
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: %s dbpath [-V] [-w workload[,...]] [-n count] [-k keysize]\n"
+		"\t[-v valsize] [-L bigsize] [-d dups] [-b batch] [-r readers] [-t seconds]\n"
+		"\t[-m mapsize] [-f flag[,...]] [-s seed]\n"
+		"workloads: fillseq fillrandom readseq readrandom dupsort bigval mixed pinned\n"
+		"flags: writemap nometasync nosync mapasync nordahead nomeminit\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char *argv[])
+{
+	int i, rc;
+	MDB_txn *txn;
+	MDB_stat mst;
+	char deflt[] = "fillseq,readseq,readrandom,fillrandom,dupsort,bigval,mixed,pinned";
+	char *workloads = deflt;
+	char *w, *next;
+	size_t mapsize = 1UL << 30;
+	unsigned int flags = 0;
+
+	prog = argv[0];
+
+	if (argc < 2) {
+		usage();
+	}
+
+	/* -w: workloads to run, in order
+	 * -n: records per workload
+	 * -k: key size
+	 * -v: value size
+	 * -L: value size of bigval
+	 * -d: duplicates per key of dupsort
+	 * -b: puts per write txn
+	 * -r: reader threads of mixed
+	 * -t: duration of mixed in seconds
+	 * -m: map size
+	 * -f: environment flags
+	 * -s: random seed
+	 * -V: print version and exit
+	 */
+	while ((i = getopt(argc, argv, "b:d:f:k:L:m:n:r:s:t:v:Vw:")) != EOF) {
+		switch(i) {
+		case 'V':
+			printf("%s\n", MDB_VERSION_STRING);
+			exit(0);
+			break;
+		case 'b':
+			batch = atoi(optarg);
+			break;
+		case 'd':
+			ndups = atoi(optarg);
+			break;
+		case 'f':
+			for (w = strtok(optarg, ","); w; w = strtok(NULL, ",")) {
+				int j;
+				for (j=0; envflags[j].bit; j++)
+					if (!strcmp(w, envflags[j].name))
+						break;
+				if (!envflags[j].bit)
+					usage();
+				flags |= envflags[j].bit;
+			}
+			break;
+		case 'k':
+			keysize = atoi(optarg);
+			break;
+		case 'L':
+			bigsize = atoi(optarg);
+			break;
+		case 'm':
+			mapsize = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			count = strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			nreaders = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoull(optarg, NULL, 0);
+			if (!seed)
+				seed = 1;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'v':
+			valsize = atoi(optarg);
+			break;
+		case 'w':
+			workloads = optarg;
+			break;
+		default:
+			usage();
+		}
+	}
+
+	if (optind != argc - 1)
+		usage();
+	if (keysize < 8 || keysize > 32 || valsize < 0 || bigsize < 0 ||
+		batch < 1 || ndups < 1 || nreaders < 1 || seconds < 1 || !count)
+		usage();
+
+	envpath = argv[optind];
+	valbuf = malloc(valsize > bigsize ? valsize : bigsize);
+	memset(valbuf, 'x', valsize > bigsize ? valsize : bigsize);
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, mapsize));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_set_maxreaders(env, nreaders + 4));
+	E(mdb_env_open(env, envpath, flags, 0664));
+
+	E(mdb_txn_begin(env, NULL, 0, &txn));
+	E(mdb_dbi_open(txn, "main", MDB_CREATE, &maindbi));
+	E(mdb_dbi_open(txn, "dups", MDB_CREATE|MDB_DUPSORT, &dupdbi));
+	E(mdb_dbi_open(txn, "big", MDB_CREATE, &bigdbi));
+	E(mdb_txn_commit(txn));
+
+	mdb_env_stat(env, &mst);
+	printf("%s: %zu records, keys %d bytes, values %d bytes, %d puts per txn, page size %u\n",
+		MDB_VERSION_STRING, count, keysize, valsize, batch, mst.ms_psize);
+
+	for (w = workloads; w; w = next) {
+		next = strchr(w, ',');
+		if (next)
+			*next++ = '\0';
+		if (!strcmp(w, "fillseq"))
+			fill(w, maindbi, 0, valsize, MDB_APPEND);
+		else if (!strcmp(w, "fillrandom"))
+			fill(w, maindbi, 1, valsize, 0);
+		else if (!strcmp(w, "readseq"))
+			readdb(w, maindbi, 0);
+		else if (!strcmp(w, "readrandom"))
+			readdb(w, maindbi, 1);
+		else if (!strcmp(w, "dupsort"))
+			dupfill();
+		else if (!strcmp(w, "bigval"))
+			fill(w, bigdbi, 1, bigsize, 0);
+		else if (!strcmp(w, "mixed"))
+			mixed();
+		else if (!strcmp(w, "pinned"))
+			pinned();
+		else {
+			fprintf(stderr, "%s: unknown workload %s\n", prog, w);
+			rc = EINVAL;
+			break;
+		}
+		fflush(stdout);
+	}
+
+	mdb_env_close(env);
+	return rc ? EXIT_FAILURE : EXIT_SUCCESS;
+}
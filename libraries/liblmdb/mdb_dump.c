@@ -27,6 +27,8 @@
 #endif
 
 #define PRINT	1
+#define BINARY	2
+#define CHECKSUM	4
 static int mode;
 
 typedef struct flagbit {
@@ -91,6 +93,68 @@ static void byte(MDB_val *v)
 	putchar('\n');
 }
 
+static unsigned int crctab[256];
+
+static void crcinit(void)
+{
+	unsigned int c;
+	int i, j;
+
+	for (i=0; i<256; i++) {
+		c = i;
+		for (j=0; j<8; j++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crctab[i] = c;
+	}
+}
+
+static unsigned int crc32(unsigned int crc, const void *buf, size_t len)
+{
+	const unsigned char *c = buf;
+
+	crc = ~crc;
+	while (len--)
+		crc = crctab[(crc ^ *c++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put32(unsigned char *c, unsigned int u)
+{
+	c[0] = u >> 24;
+	c[1] = u >> 16;
+	c[2] = u >> 8;
+	c[3] = u;
+}
+
+/* Binary records: 4-byte key and data lengths in network byte order,
+ * the key, the data, and with checksums, a CRC32 of all of these.
+ * A zero key length ends the database.
+ */
+static int binary(MDB_val *key, MDB_val *data)
+{
+	unsigned char hdr[8], sum[4];
+	unsigned int crc;
+
+	if (data->mv_size > 0xffffffffU)
+		return MDB_BAD_VALSIZE;
+	put32(hdr, key->mv_size);
+	put32(hdr+4, data->mv_size);
+	if (fwrite(hdr, sizeof(hdr), 1, stdout) != 1 ||
+		fwrite(key->mv_data, key->mv_size, 1, stdout) != 1 ||
+		(data->mv_size &&
+		fwrite(data->mv_data, data->mv_size, 1, stdout) != 1))
+		return errno ? errno : EIO;
+	if (mode & CHECKSUM) {
+		crc = crc32(0, hdr, sizeof(hdr));
+		crc = crc32(crc, key->mv_data, key->mv_size);
+		crc = crc32(crc, data->mv_data, data->mv_size);
+		put32(sum, crc);
+		if (fwrite(sum, sizeof(sum), 1, stdout) != 1)
+			return errno ? errno : EIO;
+	}
+	return MDB_SUCCESS;
+}
+
 /* Dump in BDB-compatible format */
 static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 {
@@ -111,7 +175,10 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 	if (rc) return rc;
 
 	printf("VERSION=3\n");
-	printf("format=%s\n", mode & PRINT ? "print" : "bytevalue");
+	printf("format=%s\n", mode & BINARY ? "binary" :
+		mode & PRINT ? "print" : "bytevalue");
+	if (mode & CHECKSUM)
+		printf("checksum=crc32\n");
 	if (name)
 		printf("database=%s\n", name);
 	printf("type=btree\n");
@@ -138,7 +205,11 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 			rc = EINTR;
 			break;
 		}
-		if (mode & PRINT) {
+		if (mode & BINARY) {
+			rc = binary(&key, &data);
+			if (rc)
+				break;
+		} else if (mode & PRINT) {
 			text(&key);
 			text(&data);
 		} else {
@@ -146,7 +217,12 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 			byte(&data);
 		}
 	}
-	printf("DATA=END\n");
+	if (mode & BINARY) {
+		unsigned char end[4] = {0};
+		fwrite(end, sizeof(end), 1, stdout);
+	} else {
+		printf("DATA=END\n");
+	}
 	if (rc == MDB_NOTFOUND)
 		rc = MDB_SUCCESS;
 
@@ -155,7 +231,7 @@ static int dumpit(MDB_txn *txn, MDB_dbi dbi, char *name)
 
 static void usage(char *prog)
 {
-	fprintf(stderr, "usage: %s dbpath [-V] [-f output] [-l] [-n] [-p] [-a|-s subdb]\n", prog);
+	fprintf(stderr, "usage: %s dbpath [-V] [-f output] [-l] [-n] [-p|-b [-c]] [-a|-s subdb]\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -178,11 +254,13 @@ int main(int argc, char *argv[])
 	 * -s: dump only the named subDB
 	 * -n: use NOSUBDIR flag on env_open
 	 * -p: use printable characters
+	 * -b: use binary format
+	 * -c: add checksums to binary format
 	 * -f: write to file instead of stdout
 	 * -V: print version and exit
 	 * (default) dump only the main DB
 	 */
-	while ((i = getopt(argc, argv, "af:lnps:V")) != EOF) {
+	while ((i = getopt(argc, argv, "abcf:lnps:V")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
@@ -209,6 +287,12 @@ int main(int argc, char *argv[])
 		case 'p':
 			mode |= PRINT;
 			break;
+		case 'b':
+			mode |= BINARY;
+			break;
+		case 'c':
+			mode |= CHECKSUM;
+			break;
 		case 's':
 			if (alldbs)
 				usage(prog);
@@ -222,6 +306,13 @@ int main(int argc, char *argv[])
 	if (optind != argc - 1)
 		usage(prog);
 
+	if ((mode & BINARY) && (mode & PRINT))
+		usage(prog);
+	if ((mode & CHECKSUM) && !(mode & BINARY))
+		usage(prog);
+	if (mode & CHECKSUM)
+		crcinit();
+
 #ifdef SIGPIPE
 	signal(SIGPIPE, dumpsig);
 #endif
@@ -21,11 +21,15 @@
 
 #define PRINT	1
 #define NOHDR	2
+#define BINARY	4
+#define CHECKSUM	8
+#define APPEND	16
 static int mode;
 
 static char *subname = NULL;
 
 static size_t lineno;
+static size_t recno;
 static int version;
 
 static int flags;
@@ -37,6 +41,7 @@ static int Eof;
 static MDB_envinfo info;
 
 static MDB_val kbuf, dbuf;
+static MDB_val prevk;
 
 #ifdef _WIN32
 #define Z	"I"
@@ -82,11 +87,20 @@ static void readhdr(void)
 		} else if (!strncmp(dbuf.mv_data, "format=", STRLENOF("format="))) {
 			if (!strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "print", STRLENOF("print")))
 				mode |= PRINT;
+			else if (!strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "binary", STRLENOF("binary")))
+				mode |= BINARY;
 			else if (strncmp((char *)dbuf.mv_data+STRLENOF("FORMAT="), "bytevalue", STRLENOF("bytevalue"))) {
 				fprintf(stderr, "%s: line %" Z "d: unsupported FORMAT %s\n",
 					prog, lineno, (char *)dbuf.mv_data+STRLENOF("FORMAT="));
 				exit(EXIT_FAILURE);
 			}
+		} else if (!strncmp(dbuf.mv_data, "checksum=", STRLENOF("checksum="))) {
+			if (strncmp((char *)dbuf.mv_data+STRLENOF("checksum="), "crc32", STRLENOF("crc32")))  {
+				fprintf(stderr, "%s: line %" Z "d: unsupported checksum %s\n",
+					prog, lineno, (char *)dbuf.mv_data+STRLENOF("checksum="));
+				exit(EXIT_FAILURE);
+			}
+			mode |= CHECKSUM;
 		} else if (!strncmp(dbuf.mv_data, "database=", STRLENOF("database="))) {
 			ptr = memchr(dbuf.mv_data, '\n', dbuf.mv_size);
 			if (ptr) *ptr = '\0';
@@ -274,9 +288,97 @@ badend:
 	return 0;
 }
 
+static unsigned int crctab[256];
+
+static void crcinit(void)
+{
+	unsigned int c;
+	int i, j;
+
+	for (i=0; i<256; i++) {
+		c = i;
+		for (j=0; j<8; j++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+		crctab[i] = c;
+	}
+}
+
+static unsigned int crc32(unsigned int crc, const void *buf, size_t len)
+{
+	const unsigned char *c = buf;
+
+	crc = ~crc;
+	while (len--)
+		crc = crctab[(crc ^ *c++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static unsigned int get32(unsigned char *c)
+{
+	return (unsigned int)c[0] << 24 | c[1] << 16 | c[2] << 8 | c[3];
+}
+
+/* Read a record of the binary format written by mdb_dump -b */
+static int readbin(MDB_val *key, MDB_val *data)
+{
+	unsigned char hdr[8], sum[4];
+	size_t klen, dlen;
+
+	if (fread(hdr, 4, 1, stdin) != 1)
+		goto badend;
+	klen = get32(hdr);
+	if (!klen)
+		return EOF;
+	recno++;
+	if (fread(hdr+4, 4, 1, stdin) != 1)
+		goto badend;
+	dlen = get32(hdr+4);
+	if (klen > kbuf.mv_size) {
+		fprintf(stderr, "%s: record %" Z "d: key too long\n",
+			prog, recno);
+		return MDB_BAD_VALSIZE;
+	}
+	if (dlen > dbuf.mv_size) {
+		void *ptr = realloc(dbuf.mv_data, dlen);
+		if (!ptr) {
+			fprintf(stderr, "%s: record %" Z "d: out of memory, data too long\n",
+				prog, recno);
+			return ENOMEM;
+		}
+		dbuf.mv_data = ptr;
+		dbuf.mv_size = dlen;
+	}
+	if (fread(kbuf.mv_data, klen, 1, stdin) != 1 ||
+		(dlen && fread(dbuf.mv_data, dlen, 1, stdin) != 1))
+		goto badend;
+	if (mode & CHECKSUM) {
+		unsigned int crc;
+		if (fread(sum, sizeof(sum), 1, stdin) != 1)
+			goto badend;
+		crc = crc32(0, hdr, sizeof(hdr));
+		crc = crc32(crc, kbuf.mv_data, klen);
+		crc = crc32(crc, dbuf.mv_data, dlen);
+		if (crc != get32(sum)) {
+			fprintf(stderr, "%s: record %" Z "d: checksum mismatch\n",
+				prog, recno);
+			return MDB_CORRUPTED;
+		}
+	}
+	key->mv_data = kbuf.mv_data;
+	key->mv_size = klen;
+	data->mv_data = dbuf.mv_data;
+	data->mv_size = dlen;
+	return 0;
+
+badend:
+	fprintf(stderr, "%s: record %" Z "d: unexpected end of input\n",
+		prog, recno);
+	return MDB_CORRUPTED;
+}
+
 static void usage(void)
 {
-	fprintf(stderr, "usage: %s dbpath [-V] [-f input] [-n] [-s name] [-N] [-T]\n", prog);
+	fprintf(stderr, "usage: %s dbpath [-V] [-a] [-B batch] [-f input] [-n] [-s name] [-N] [-T]\n", prog);
 	exit(EXIT_FAILURE);
 }
 
@@ -289,7 +391,7 @@ int main(int argc, char *argv[])
 	MDB_dbi dbi;
 	char *envname;
 	int envflags = 0, putflags = 0;
-	int dohdr = 0;
+	int dohdr = 0, batchmax = 100;
 
 	prog = argv[0];
 
@@ -297,19 +399,29 @@ int main(int argc, char *argv[])
 		usage();
 	}
 
-	/* -f: load file instead of stdin
+	/* -a: append records in input order
+	 * -B: commit every batch records
+	 * -f: load file instead of stdin
 	 * -n: use NOSUBDIR flag on env_open
 	 * -s: load into named subDB
 	 * -N: use NOOVERWRITE on puts
 	 * -T: read plaintext
 	 * -V: print version and exit
 	 */
-	while ((i = getopt(argc, argv, "f:ns:NTV")) != EOF) {
+	while ((i = getopt(argc, argv, "aB:f:ns:NTV")) != EOF) {
 		switch(i) {
 		case 'V':
 			printf("%s\n", MDB_VERSION_STRING);
 			exit(0);
 			break;
+		case 'a':
+			mode |= APPEND;
+			break;
+		case 'B':
+			batchmax = atoi(optarg);
+			if (batchmax < 1)
+				usage();
+			break;
 		case 'f':
 			if (freopen(optarg, "r", stdin) == NULL) {
 				fprintf(stderr, "%s: %s: reopen: %s\n",
@@ -369,16 +481,25 @@ int main(int argc, char *argv[])
 
 	kbuf.mv_size = mdb_env_get_maxkeysize(env) * 2 + 2;
 	kbuf.mv_data = malloc(kbuf.mv_size);
+	prevk.mv_data = malloc(kbuf.mv_size);
+	crcinit();
 
 	while(!Eof) {
 		MDB_val key, data;
 		int batch = 0;
-		flags = 0;
 
 		if (!dohdr) {
 			dohdr = 1;
-		} else if (!(mode & NOHDR))
-			readhdr();
+		} else {
+			/* the first header was read above */
+			flags = 0;
+			if (!(mode & NOHDR)) {
+				mode &= ~(BINARY|CHECKSUM);
+				readhdr();
+				if (feof(stdin))
+					break;
+			}
+		}
 		
 		rc = mdb_txn_begin(env, NULL, 0, &txn);
 		if (rc) {
@@ -398,24 +519,51 @@ int main(int argc, char *argv[])
 			goto txn_abort;
 		}
 
+		prevk.mv_size = 0;
 		while(1) {
-			rc = readline(&key, &kbuf);
-			if (rc == EOF)
-				break;
-			if (rc)
-				goto txn_abort;
+			int appflag = 0;
 
-			rc = readline(&data, &dbuf);
-			if (rc)
-				goto txn_abort;
-			
-			rc = mdb_cursor_put(mc, &key, &data, putflags);
+			if (mode & BINARY) {
+				rc = readbin(&key, &data);
+				if (rc == EOF) {
+					rc = 0;
+					break;
+				}
+				if (rc)
+					goto txn_abort;
+			} else {
+				rc = readline(&key, &kbuf);
+				if (rc == EOF)
+					break;
+				if (rc)
+					goto txn_abort;
+
+				rc = readline(&data, &dbuf);
+				if (rc)
+					goto txn_abort;
+			}
+
+			/* the input is in database order */
+			if (mode & APPEND) {
+				appflag = MDB_APPEND;
+				if (flags & MDB_DUPSORT) {
+					if (prevk.mv_size == key.mv_size &&
+						!memcmp(prevk.mv_data, key.mv_data, key.mv_size)) {
+						appflag = MDB_APPENDDUP;
+					} else {
+						memcpy(prevk.mv_data, key.mv_data, key.mv_size);
+						prevk.mv_size = key.mv_size;
+					}
+				}
+			}
+
+			rc = mdb_cursor_put(mc, &key, &data, putflags|appflag);
 			if (rc == MDB_KEYEXIST && putflags)
 				continue;
 			if (rc)
 				goto txn_abort;
 			batch++;
-			if (batch == 100) {
+			if (batch == batchmax) {
 				rc = mdb_txn_commit(txn);
 				if (rc) {
 					fprintf(stderr, "%s: line %" Z "d: txn_commit: %s\n",
@@ -0,0 +1,136 @@
+/* mtest7.c - memory-mapped database tester/toy */
+/*
+ * Copyright 2011-2015 Howard Chu, Symas Corp.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/* Tests for range deletes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lmdb.h"
+
+#define E(expr) CHECK((rc = (expr)) == MDB_SUCCESS, #expr)
+#define CHECK(test, msg) ((test) ? (void)0 : ((void)fprintf(stderr, \
+	"%s:%d: %s: %s\n", __FILE__, __LINE__, msg, mdb_strerror(rc)), abort()))
+
+#define COUNT	100000
+#define NDUPS	5
+
+char present[COUNT];
+
+/* Delete [lo, hi) from the DB and check the result against present[] */
+static void
+delrange(MDB_txn *txn, MDB_dbi dbi, long lo, long hi, int dups)
+{
+	MDB_cursor *cursor;
+	MDB_val key, data, klo, khi;
+	MDB_stat mst;
+	size_t count, expect = 0, before, n;
+	long i, last = -1;
+	int rc;
+
+	E(mdb_stat(txn, dbi, &mst));
+	before = mst.ms_entries;
+	klo.mv_size = khi.mv_size = sizeof(long);
+	klo.mv_data = &lo;
+	khi.mv_data = &hi;
+	E(mdb_del_range(txn, dbi, lo < 0 ? NULL : &klo,
+		hi < 0 ? NULL : &khi, &count));
+	if (lo < 0) lo = 0;
+	if (hi < 0 || hi > COUNT) hi = COUNT;
+	for (i=lo; i<hi; i++) {
+		expect += present[i] * dups;
+		present[i] = 0;
+	}
+	printf("Deleted [%ld,%ld): %zu items\n", lo, hi, count);
+	E(mdb_stat(txn, dbi, &mst));
+	CHECK(count == expect, "count");
+	CHECK(mst.ms_entries == before - count, "ms_entries");
+
+	E(mdb_cursor_open(txn, dbi, &cursor));
+	expect = 0;
+	while ((rc = mdb_cursor_get(cursor, &key, &data, MDB_NEXT_NODUP)) == 0) {
+		i = *(long *)key.mv_data;
+		CHECK(i > last && present[i], "leftover key");
+		if (dups > 1) {
+			E(mdb_cursor_count(cursor, &n));
+			CHECK((int)n == dups, "dup count");
+		}
+		last = i;
+		expect++;
+	}
+	CHECK(rc == MDB_NOTFOUND, "mdb_cursor_get");
+	mdb_cursor_close(cursor);
+	for (i=0, n=0; i<COUNT; i++)
+		n += present[i];
+	CHECK(expect == n, "key count");
+}
+
+int main(int argc,char * argv[])
+{
+	int i, j, rc, dups;
+	MDB_env *env;
+	MDB_dbi dbi;
+	MDB_val key, data;
+	MDB_txn *txn;
+	long kval;
+	char sval[256];
+
+	srand(time(NULL));
+
+	E(mdb_env_create(&env));
+	E(mdb_env_set_mapsize(env, 104857600));
+	E(mdb_env_set_maxdbs(env, 4));
+	E(mdb_env_open(env, "./testdb", MDB_NOSYNC, 0664));
+
+	for (dups = 0; dups <= NDUPS; dups += NDUPS) {
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		E(mdb_dbi_open(txn, dups ? "id7d" : "id7", MDB_CREATE|MDB_INTEGERKEY|
+			(dups ? MDB_DUPSORT : 0), &dbi));
+		E(mdb_drop(txn, dbi, 0));
+		key.mv_size = sizeof(long);
+		key.mv_data = &kval;
+		memset(sval, 'x', sizeof(sval));
+		printf("Adding %d keys%s\n", COUNT, dups ? " with duplicates" : "");
+		for (kval=0; kval<COUNT; kval++) {
+			present[kval] = rand() % 8 != 0;
+			if (!present[kval])
+				continue;
+			for (j=0; j<(dups ? dups : 1); j++) {
+				sprintf(sval, "%03x %08lx", j, kval);
+				data.mv_size = dups ? 12 : 12 + rand() % sizeof(sval);
+				data.mv_data = sval;
+				E(mdb_put(txn, dbi, &key, &data, 0));
+			}
+		}
+		E(mdb_txn_commit(txn));
+
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		for (i=0; i<8; i++) {
+			long lo = rand() % COUNT;
+			delrange(txn, dbi, lo, lo + rand() % (i & 1 ? COUNT/4 : 200),
+				dups ? dups : 1);
+		}
+		delrange(txn, dbi, -1, rand() % COUNT, dups ? dups : 1);
+		delrange(txn, dbi, rand() % COUNT, -1, dups ? dups : 1);
+		E(mdb_txn_commit(txn));
+
+		E(mdb_txn_begin(env, NULL, 0, &txn));
+		delrange(txn, dbi, -1, -1, dups ? dups : 1);
+		E(mdb_txn_commit(txn));
+	}
+	mdb_dbi_close(env, dbi);
+	mdb_env_close(env);
+
+	return 0;
+}
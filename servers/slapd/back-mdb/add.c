@@ -365,6 +365,11 @@ mdb_add(Operation *op, SlapReply *rs )
 	}
 
 	if ( moi == &opinfo ) {
+		if ( !op->o_noop && overlay_precommit( op, rs )) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "overlay pre-commit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if ( op->o_noop ) {
@@ -87,6 +87,187 @@ mdb_attr_mask(
 	return i < 0 ? NULL : mdb->mi_attrs[i];
 }
 
+/* Split a composite index name "attr1+attr2[+...]" into its
+ * AttributeDescriptions. Returns the number of components, or
+ * -1 if the name is not a valid composite.
+ */
+int
+mdb_comp_parse(
+	const char *name,
+	AttributeDescription **descs,
+	const char **text )
+{
+	char **comps;
+	int i, n = -1;
+
+	comps = ldap_str2charray( name, "+" );
+	if ( comps == NULL ) {
+		*text = "no attributes specified";
+		return -1;
+	}
+
+	for ( i = 0; comps[i] != NULL; i++ ) {
+		int j;
+
+		if ( i == MDB_COMP_MAXATTRS ) {
+			*text = "too many attributes in composite index";
+			goto done;
+		}
+		descs[i] = NULL;
+		if ( slap_str2ad( comps[i], &descs[i], text ) != LDAP_SUCCESS )
+			goto done;
+		for ( j = 0; j < i; j++ ) {
+			if ( descs[j] == descs[i] ) {
+				*text = "duplicate attribute in composite index";
+				goto done;
+			}
+		}
+	}
+	if ( i < 2 ) {
+		*text = "composite index needs at least two attributes";
+		goto done;
+	}
+	n = i;
+
+done:
+	ldap_charray_free( comps );
+	return n;
+}
+
+CompInfo *
+mdb_comp_find(
+	struct mdb_info *mdb,
+	AttributeDescription **descs,
+	int ndescs )
+{
+	int i, j;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( ci->ci_nattrs != ndescs )
+			continue;
+		for ( j = 0; j < ndescs; j++ ) {
+			if ( ci->ci_descs[j] != descs[j] )
+				break;
+		}
+		if ( j == ndescs )
+			return ci;
+	}
+	return NULL;
+}
+
+static int
+mdb_comp_index_config(
+	struct mdb_info	*mdb,
+	const char		*fname,
+	int			lineno,
+	const char	*name,
+	slap_mask_t	mask,
+	struct		config_reply_s *c_reply )
+{
+	AttributeDescription *descs[MDB_COMP_MAXATTRS];
+	const char *text;
+	CompInfo *ci;
+	char *ptr;
+	int i, n;
+
+	n = mdb_comp_parse( name, descs, &text );
+	if ( n < 0 ) {
+		if ( c_reply ) {
+			snprintf(c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\": %s", name, text );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		return LDAP_PARAM_ERROR;
+	}
+
+	/* Composite keys are built from equality keys only */
+	if ( !IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ) ||
+		( mask & ( SLAP_INDEX_PRESENT|SLAP_INDEX_APPROX|SLAP_INDEX_SUBSTR|
+			MDB_INDEX_ENTRYID )))
+	{
+		if ( c_reply ) {
+			snprintf(c_reply->msg, sizeof(c_reply->msg),
+				"composite index \"%s\" only supports eq", name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		return LDAP_INAPPROPRIATE_MATCHING;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		AttributeDescription *ad = descs[i];
+
+		if( ad == slap_schema.si_ad_entryDN || slap_ad_is_binary( ad ) ||
+			!( ad->ad_type->sat_equality
+				&& ad->ad_type->sat_equality->smr_indexer
+				&& ad->ad_type->sat_equality->smr_filter ) )
+		{
+			if ( c_reply ) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"equality index of attribute \"%s\" disallowed",
+					ad->ad_cname.bv_val );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			return LDAP_INAPPROPRIATE_MATCHING;
+		}
+	}
+
+	Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
+		name, mask, 0 );
+
+	ci = mdb_comp_find( mdb, descs, n );
+	if ( ci ) {
+		if ( ( mdb->mi_flags & MDB_IS_OPEN ) &&
+			( ci->ci_indexmask & MDB_INDEX_DELETING ) )
+		{
+			/* Same handling as for a plain attribute index */
+			ci->ci_indexmask &= ~MDB_INDEX_DELETING;
+			if ( ci->ci_newmask )
+				ci->ci_indexmask = ci->ci_newmask;
+			ci->ci_newmask = mask;
+			return LDAP_SUCCESS;
+		}
+		if ( c_reply ) {
+			snprintf(c_reply->msg, sizeof(c_reply->msg),
+				"duplicate index definition for attr \"%s\"", name );
+			fprintf( stderr, "%s: line %d: %s\n",
+				fname, lineno, c_reply->msg );
+		}
+		return LDAP_PARAM_ERROR;
+	}
+
+	ci = ch_calloc( 1, sizeof(CompInfo) );
+	ci->ci_nattrs = n;
+	for ( i = 0; i < n; i++ ) {
+		ci->ci_descs[i] = descs[i];
+		ci->ci_name.bv_len += descs[i]->ad_cname.bv_len + 1;
+	}
+	ci->ci_name.bv_len--;
+	ptr = ci->ci_name.bv_val = ch_malloc( ci->ci_name.bv_len + 1 );
+	for ( i = 0; i < n; i++ ) {
+		if ( i )
+			*ptr++ = '+';
+		ptr = lutil_strcopy( ptr, descs[i]->ad_cname.bv_val );
+	}
+
+	if ( mdb->mi_flags & MDB_IS_OPEN ) {
+		ci->ci_indexmask = 0;
+		ci->ci_newmask = mask;
+	} else {
+		ci->ci_indexmask = mask;
+		ci->ci_newmask = 0;
+	}
+
+	mdb->mi_comps = ch_realloc( mdb->mi_comps, ( mdb->mi_ncomps+1 ) *
+		sizeof( CompInfo * ));
+	mdb->mi_comps[mdb->mi_ncomps++] = ci;
+
+	return LDAP_SUCCESS;
+}
+
 /* Open all un-opened index DB handles */
 int
 mdb_attr_dbs_open(
@@ -110,7 +291,8 @@ mdb_attr_dbs_open(
 				cr->msg, 0, 0 );
 			return rc;
 		}
-		dbis = ch_calloc( 1, mdb->mi_nattrs * sizeof(MDB_dbi) );
+		dbis = ch_calloc( 1, ( mdb->mi_nattrs + mdb->mi_ncomps ) *
+			sizeof(MDB_dbi) );
 	} else {
 		rc = 0;
 	}
@@ -122,7 +304,7 @@ mdb_attr_dbs_open(
 	for ( i=0; i<mdb->mi_nattrs; i++ ) {
 		if ( mdb->mi_attrs[i]->ai_dbi )	/* already open */
 			continue;
-		rc = mdb_dbi_open( txn, mdb->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
+		rc = mdb_subdb_open( mdb, txn, mdb->mi_attrs[i]->ai_desc->ad_type->sat_cname.bv_val,
 			flags, &mdb->mi_attrs[i]->ai_dbi );
 		if ( rc ) {
 			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
@@ -140,6 +322,25 @@ mdb_attr_dbs_open(
 			dbis[i] = mdb->mi_attrs[i]->ai_dbi;
 	}
 
+	for ( i=0; !rc && i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( ci->ci_dbi )	/* already open */
+			continue;
+		rc = mdb_subdb_open( mdb, txn, ci->ci_name.bv_val, flags, &ci->ci_dbi );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"mdb_dbi_open(%s) failed: %s (%d).",
+				be->be_suffix[0].bv_val, ci->ci_name.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_attr_dbs) ": %s\n",
+				cr->msg, 0, 0 );
+			break;
+		}
+		if ( dbis )
+			dbis[mdb->mi_nattrs+i] = ci->ci_dbi;
+	}
+
 	/* Only commit if this is our txn */
 	if ( tx0 == NULL ) {
 		if ( !rc ) {
@@ -163,6 +364,12 @@ mdb_attr_dbs_open(
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
 			}
+			for ( i=0; i<mdb->mi_ncomps; i++ ) {
+				if ( dbis[mdb->mi_nattrs+i] ) {
+					mdb->mi_comps[i]->ci_dbi = 0;
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
+			}
 			mdb_attr_flush( mdb );
 		}
 		ch_free( dbis );
@@ -182,6 +389,11 @@ mdb_attr_dbs_close(
 			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_attrs[i]->ai_dbi );
 			mdb->mi_attrs[i]->ai_dbi = 0;
 		}
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		if ( mdb->mi_comps[i]->ci_dbi ) {
+			mdb_dbi_close( mdb->mi_dbenv, mdb->mi_comps[i]->ci_dbi );
+			mdb->mi_comps[i]->ci_dbi = 0;
+		}
 }
 
 int
@@ -228,6 +440,13 @@ mdb_attr_index_config(
 
 		for ( i = 0; indexes[i] != NULL; i++ ) {
 			slap_mask_t index;
+
+			/* backend-specific: DN equality keyed by entry ID */
+			if ( strcasecmp( indexes[i], "entryid" ) == 0 ) {
+				mask |= MDB_INDEX_ENTRYID|SLAP_INDEX_EQUALITY;
+				continue;
+			}
+
 			rc = slap_str2index( indexes[i], &index );
 
 			if( rc != LDAP_SUCCESS ) {
@@ -273,6 +492,14 @@ mdb_attr_index_config(
 			continue;
 		}
 
+		if ( strchr( attrs[i], '+' ) ) {
+			rc = mdb_comp_index_config( mdb, fname, lineno,
+				attrs[i], mask, c_reply );
+			if ( rc != LDAP_SUCCESS )
+				goto done;
+			continue;
+		}
+
 #ifdef LDAP_COMP_MATCH
 		if ( is_component_reference( attrs[i] ) ) {
 			rc = extract_component_reference( attrs[i], &cr );
@@ -372,6 +599,19 @@ fail:
 			goto fail;
 		}
 
+		if( ( mask & MDB_INDEX_ENTRYID ) &&
+			ad->ad_type->sat_equality != slap_schema.si_mr_distinguishedNameMatch )
+		{
+			if (c_reply) {
+				snprintf(c_reply->msg, sizeof(c_reply->msg),
+					"entryid index of attribute \"%s\" disallowed", attrs[i] );
+				fprintf( stderr, "%s: line %d: %s\n",
+					fname, lineno, c_reply->msg );
+			}
+			rc = LDAP_INAPPROPRIATE_MATCHING;
+			goto fail;
+		}
+
 		Debug( LDAP_DEBUG_CONFIG, "index %s 0x%04lx\n",
 			ad->ad_cname.bv_val, mask, 0 ); 
 
@@ -470,11 +710,16 @@ mdb_attr_index_unparser( void *v1, void *v2 )
 
 	slap_index2bvlen( ai->ai_indexmask, &bv );
 	if ( bv.bv_len ) {
+		ber_len_t ixlen = bv.bv_len;
 		bv.bv_len += ai->ai_desc->ad_cname.bv_len + 1;
+		if ( ai->ai_indexmask & MDB_INDEX_ENTRYID )
+			bv.bv_len += STRLENOF(",entryid");
 		ptr = ch_malloc( bv.bv_len+1 );
 		bv.bv_val = lutil_strcopy( ptr, ai->ai_desc->ad_cname.bv_val );
 		*bv.bv_val++ = ' ';
 		slap_index2bv( ai->ai_indexmask, &bv );
+		if ( ai->ai_indexmask & MDB_INDEX_ENTRYID )
+			strcpy( bv.bv_val + ixlen, ",entryid" );
 		bv.bv_val = ptr;
 		ber_bvarray_add( bva, &bv );
 	}
@@ -495,6 +740,15 @@ mdb_attr_index_unparse( struct mdb_info *mdb, BerVarray *bva )
 	}
 	for ( i=0; i<mdb->mi_nattrs; i++ )
 		mdb_attr_index_unparser( mdb->mi_attrs[i], bva );
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		AttributeDescription ad = { NULL, NULL };
+		AttrInfo ai = { &ad };
+
+		ad.ad_cname = ci->ci_name;
+		ai.ai_indexmask = ci->ci_indexmask;
+		mdb_attr_index_unparser( &ai, bva );
+	}
 }
 
 void
@@ -506,6 +760,13 @@ mdb_attr_info_free( AttrInfo *ai )
 	free( ai );
 }
 
+void
+mdb_comp_info_free( CompInfo *ci )
+{
+	ch_free( ci->ci_name.bv_val );
+	ch_free( ci );
+}
+
 void
 mdb_attr_index_destroy( struct mdb_info *mdb )
 {
@@ -515,6 +776,11 @@ mdb_attr_index_destroy( struct mdb_info *mdb )
 		mdb_attr_info_free( mdb->mi_attrs[i] );
 
 	free( mdb->mi_attrs );
+
+	for ( i=0; i<mdb->mi_ncomps; i++ )
+		mdb_comp_info_free( mdb->mi_comps[i] );
+
+	free( mdb->mi_comps );
 }
 
 void mdb_attr_index_free( struct mdb_info *mdb, AttributeDescription *ad )
@@ -530,6 +796,49 @@ void mdb_attr_index_free( struct mdb_info *mdb, AttributeDescription *ad )
 	}
 }
 
+/* Drop the DBIs of deleted composite indexes, nothing else uses them */
+void mdb_comp_drop( struct mdb_info *mdb )
+{
+	MDB_txn *txn;
+	int i, rc;
+
+	if ( !mdb->mi_dbenv )
+		return;
+
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		if (( mdb->mi_comps[i]->ci_indexmask & MDB_INDEX_DELETING ) &&
+			mdb->mi_comps[i]->ci_dbi )
+			break;
+	}
+	if ( i == mdb->mi_ncomps )
+		return;
+
+	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_comp_drop) ": txn_begin failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+		return;
+	}
+	for ( ; i<mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+
+		if ( !( ci->ci_indexmask & MDB_INDEX_DELETING ) || !ci->ci_dbi )
+			continue;
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_comp_drop) ": dropping index %s\n",
+			ci->ci_name.bv_val, 0, 0 );
+		mdb_drop( txn, ci->ci_dbi, 1 );
+		ci->ci_dbi = 0;
+	}
+	rc = mdb_txn_commit( txn );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_comp_drop) ": txn_commit failed: %s (%d)\n",
+			mdb_strerror(rc), rc, 0 );
+	}
+}
+
 void mdb_attr_flush( struct mdb_info *mdb )
 {
 	int i;
@@ -544,6 +853,17 @@ void mdb_attr_flush( struct mdb_info *mdb )
 			i--;
 		}
 	}
+
+	for ( i=0; i<mdb->mi_ncomps; i++ ) {
+		if ( mdb->mi_comps[i]->ci_indexmask & MDB_INDEX_DELETING ) {
+			int j;
+			mdb_comp_info_free( mdb->mi_comps[i] );
+			mdb->mi_ncomps--;
+			for (j=i; j<mdb->mi_ncomps; j++)
+				mdb->mi_comps[j] = mdb->mi_comps[j+1];
+			i--;
+		}
+	}
 }
 
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn )
@@ -47,6 +47,19 @@ LDAP_BEGIN_DECL
 /* Default to 10MB max */
 #define DEFAULT_MAPSIZE	(10*1048576)
 
+/* Seconds a paged search's candidate list is kept between pages */
+#define DEFAULT_PAGEDCACHE_TTL	60
+
+/* Online indexing: workers, entries per write txn, and the delay in
+ * milliseconds waiting for the write lock that counts as contention
+ */
+#define DEFAULT_ONLINEINDEX_WORKERS	2
+#define DEFAULT_ONLINEINDEX_TXNSIZE	256
+#define DEFAULT_ONLINEINDEX_THROTTLE	10
+
+/* Threads reading the hot pages back at startup */
+#define DEFAULT_WARMSTART_THREADS	4
+
 #define MDB_MONITOR_IDX
 
 typedef struct mdb_monitor_t {
@@ -57,12 +70,74 @@ typedef struct mdb_monitor_t {
 /* From ldap_rq.h */
 struct re_s;
 
+/* Online indexing pass in progress, see config.c */
+struct mdb_oi_state;
+
+/* Candidate list saved between the pages of a paged search */
+typedef struct mdb_pagedcache {
+	struct mdb_pagedcache	*pc_next;
+	unsigned long	pc_connid;
+	PagedResultsCookie	pc_cookie;
+	time_t		pc_time;
+	int			pc_scope;
+	struct berval	pc_base;
+	struct berval	pc_filter;
+	ID			pc_ids[1];	/* variable length */
+} mdb_pagedcache;
+
+/* One filter component of an explained search */
+typedef struct mdb_explain_step {
+	int			es_depth;
+	const char	*es_index;	/* index used, NULL if none */
+	struct berval	es_filter;
+	ID			es_count;	/* candidates of this component */
+	ID			es_first;
+	ID			es_last;
+	ID			es_after;	/* candidates after merging into the parent */
+	int			es_list;	/* AND, OR or NOT */
+	int			es_range;
+	int			es_merged;
+} mdb_explain_step;
+
+#define MDB_EXPLAIN_BASE	0
+#define MDB_EXPLAIN_CANDIDATES	1
+#define MDB_EXPLAIN_ENTRIES	2
+#define MDB_EXPLAIN_NPHASES	3
+
+/* Search plan collected for the explain control */
+typedef struct mdb_explain {
+	int			me_depth;
+	int			me_cur;
+	int			me_last;
+	int			me_nsteps;
+	int			me_maxsteps;
+	mdb_explain_step	*me_steps;
+	int			me_reused;
+	ID			me_ncand;
+	int			me_crange;
+	const char	*me_scope;
+	unsigned long	me_scopechecks;
+	unsigned long	me_scopeusec;
+	struct timeval	me_scopetv;
+	unsigned long	me_decoded;
+	unsigned long	me_matched;
+	int			me_phase;
+	struct timeval	me_tv;
+	unsigned long	me_usec[MDB_EXPLAIN_NPHASES];
+} mdb_explain;
+
 struct mdb_info {
 	MDB_env		*mi_dbenv;
+	struct mdb_info	*mi_next;	/* all mdb databases, see init.c */
 
 	/* DB_ENV parameters */
 	char		*mi_dbenv_home;
+	struct berval	mi_prefix;	/* of our subdbs in a shared env */
 	uint32_t	mi_dbenv_flags;
+/* envflags handled here, never passed to LMDB */
+#define	MDB_ENVF_WARMUP	0x40000000
+#define	MDB_ENVF_MLOCK	0x20000000
+#define	MDB_ENVF_LOCAL	(MDB_ENVF_WARMUP|MDB_ENVF_MLOCK)
 	int			mi_dbenv_mode;
 
 	size_t		mi_mapsize;
@@ -72,6 +147,8 @@ struct mdb_info {
 	slap_mask_t	mi_defaultmask;
 	int			mi_nattrs;
 	struct mdb_attrinfo		**mi_attrs;
+	int			mi_ncomps;
+	struct mdb_compinfo		**mi_comps;
 	void		*mi_search_stack;
 	int			mi_search_stack_depth;
 	int			mi_readers;
@@ -81,6 +158,21 @@ struct mdb_info {
 	uint32_t	mi_txn_cp_kbyte;
 	struct re_s		*mi_txn_cp_task;
 	struct re_s		*mi_index_task;
+	struct mdb_oi_state	*mi_oi_state;
+	int			mi_oi_workers;
+	int			mi_oi_txnsize;
+	int			mi_oi_throttle;
+	ID			mi_oi_resume;
+
+	int			mi_ws_min;
+	int			mi_ws_threads;
+	struct re_s		*mi_ws_task;
+
+	int			mi_pc_max;
+	int			mi_pc_ttl;
+	int			mi_pc_num;
+	mdb_pagedcache	*mi_pc_list;
+	ldap_pvt_thread_mutex_t	mi_pc_mutex;
 
 	mdb_monitor_t	mi_monitor;
 
@@ -95,10 +187,13 @@ struct mdb_info {
 #define	MDB_DEL_INDEX	0x08
 #define	MDB_RE_OPEN		0x10
 #define	MDB_NEED_UPGRADE	0x20
+#define	MDB_DNHASH		0x40
 
 	int mi_numads;
 
 	MDB_dbi	mi_dbis[MDB_NDB];
+	MDB_dbi	mi_dnhash;
+	MDB_dbi	mi_idxstate;
 	AttributeDescription *mi_ads[MDB_MAXADS];
 	int mi_adxs[MDB_MAXADS];
 };
@@ -150,6 +245,19 @@ typedef struct mdb_attrinfo {
 	MDB_dbi ai_dbi;
 } AttrInfo;
 
+/* Maximum number of attributes in a composite index */
+#define MDB_COMP_MAXATTRS	4
+
+/* for composite (multi-attribute) equality indexes */
+typedef struct mdb_compinfo {
+	struct berval ci_name;	/* "attr1+attr2", also the DBI name */
+	int ci_nattrs;
+	AttributeDescription *ci_descs[MDB_COMP_MAXATTRS];
+	slap_mask_t ci_indexmask;
+	slap_mask_t ci_newmask;
+	MDB_dbi ci_dbi;
+} CompInfo;
+
 /* tool threaded indexer state */
 typedef struct mdb_attrixinfo {
 	OpExtra ai_oe;
@@ -161,6 +269,14 @@ typedef struct mdb_attrixinfo {
 /* These flags must not clash with SLAP_INDEX flags or ops in slap.h! */
 #define	MDB_INDEX_DELETING	0x8000U	/* index is being modified */
 #define	MDB_INDEX_UPDATE_OP	0x03	/* performing an index update */
+#define	MDB_INDEX_ENTRYID	0x10000UL	/* key DN values by entry ID */
+
+/* Prefix of equality keys holding an entry ID instead of a hash. The
+ * ID is stored aligned, so the key never needs the ALIGNER padding
+ * applied to short keys.
+ */
+#define	MDB_ENTRYID_PREFIX	'#'
+#define	MDB_ENTRYID_KEYLEN	(2*sizeof(ID))
 
 /* For slapindex to record which attrs in an entry belong to which
  * index database 
@@ -34,13 +34,18 @@ enum {
 	MDB_CHKPT = 1,
 	MDB_DIRECTORY,
 	MDB_DBNOSYNC,
+	MDB_DNHASH_CF,
 	MDB_ENVFLAGS,
 	MDB_INDEX,
 	MDB_MAXREADERS,
 	MDB_MAXSIZE,
 	MDB_MODE,
+	MDB_ONLINEINDEX,
+	MDB_PAGEDCACHE,
 	MDB_SSTACK,
-	MDB_MAXENTSZ
+	MDB_MAXENTSZ,
+	MDB_SUBDBPREFIX,
+	MDB_WARMSTART
 };
 
 static ConfigTable mdbcfg[] = {
@@ -57,12 +62,16 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:1.4 NAME 'olcDbNoSync' "
 			"DESC 'Disable synchronous database writes' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
+	{ "dnhash", NULL, 1, 2, 0, ARG_ON_OFF|ARG_MAGIC|MDB_DNHASH_CF,
+		mdb_cf_gen, "( OLcfgDbAt:12.5 NAME 'olcDbDnHash' "
+			"DESC 'Maintain a direct lookup table for full DNs' "
+			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
 	{ "envflags", "flags", 2, 0, 0, ARG_MAGIC|MDB_ENVFLAGS,
 		mdb_cf_gen, "( OLcfgDbAt:12.3 NAME 'olcDbEnvFlags' "
 			"DESC 'Database environment flags' "
 			"EQUALITY caseIgnoreMatch "
 			"SYNTAX OMsDirectoryString )", NULL, NULL },
-	{ "index", "attr> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
+	{ "index", "attr[+attr...]> <[pres,eq,approx,sub]", 2, 3, 0, ARG_MAGIC|MDB_INDEX,
 		mdb_cf_gen, "( OLcfgDbAt:0.2 NAME 'olcDbIndex' "
 		"DESC 'Attribute index parameters' "
 		"EQUALITY caseIgnoreMatch "
@@ -83,10 +92,27 @@ static ConfigTable mdbcfg[] = {
 		mdb_cf_gen, "( OLcfgDbAt:0.3 NAME 'olcDbMode' "
 		"DESC 'Unix permissions of database files' "
 		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "onlineindex", "workers> <entries> <msec", 3, 4, 0, ARG_MAGIC|MDB_ONLINEINDEX,
+		mdb_cf_gen, "( OLcfgDbAt:12.7 NAME 'olcDbOnlineIndex' "
+		"DESC 'Online indexing workers, entries per transaction, and write lock wait in msec that slows it down' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "pagedcache", "num> <seconds", 2, 3, 0, ARG_MAGIC|MDB_PAGEDCACHE,
+		mdb_cf_gen, "( OLcfgDbAt:12.6 NAME 'olcDbPagedCache' "
+		"DESC 'Number of paged search candidate lists to keep, and for how long' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "searchstack", "depth", 2, 2, 0, ARG_INT|ARG_MAGIC|MDB_SSTACK,
 		mdb_cf_gen, "( OLcfgDbAt:1.9 NAME 'olcDbSearchStack' "
 		"DESC 'Depth of search stack in IDLs' "
 		"SYNTAX OMsInteger SINGLE-VALUE )", NULL, NULL },
+	{ "subdbprefix", "name", 2, 2, 0, ARG_STRING|ARG_MAGIC|MDB_SUBDBPREFIX,
+		mdb_cf_gen, "( OLcfgDbAt:12.9 NAME 'olcDbSubDbPrefix' "
+		"DESC 'Name prefix of the subdbs of this database in an environment shared with other databases' "
+		"EQUALITY caseExactMatch "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "warmstart", "min> <threads", 2, 3, 0, ARG_MAGIC|MDB_WARMSTART,
+		mdb_cf_gen, "( OLcfgDbAt:12.8 NAME 'olcDbWarmStart' "
+		"DESC 'Minutes between records of the hot pages, and threads reading them back on startup' "
+		"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ NULL, NULL, 0, 0, 0, ARG_IGNORED,
 		NULL, NULL, NULL, NULL }
 };
@@ -98,9 +124,11 @@ static ConfigOCs mdbocs[] = {
 		"DESC 'MDB backend configuration' "
 		"SUP olcDatabaseConfig "
 		"MUST olcDbDirectory "
-		"MAY ( olcDbCheckpoint $ olcDbEnvFlags $ "
+		"MAY ( olcDbCheckpoint $ olcDbDnHash $ olcDbEnvFlags $ "
 		"olcDbNoSync $ olcDbIndex $ olcDbMaxReaders $ olcDbMaxSize $ "
-		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize ) )",
+		"olcDbMode $ olcDbSearchStack $ olcDbMaxEntrySize $ "
+		"olcDbPagedCache $ olcDbOnlineIndex $ olcDbSubDbPrefix $ "
+		"olcDbWarmStart ) )",
 		 	Cft_Database, mdbcfg },
 	{ NULL, 0, NULL }
 };
@@ -111,6 +139,9 @@ static slap_verbmasks mdb_envflags[] = {
 	{ BER_BVC("writemap"),	MDB_WRITEMAP },
 	{ BER_BVC("mapasync"),	MDB_MAPASYNC },
 	{ BER_BVC("nordahead"),	MDB_NORDAHEAD },
+	{ BER_BVC("hugepage"),	MDB_HUGEPAGE },
+	{ BER_BVC("warmup"),	MDB_ENVF_WARMUP },
+	{ BER_BVC("mlock"),	MDB_ENVF_MLOCK },
 	{ BER_BVNULL, 0 }
 };
 
@@ -128,12 +159,186 @@ mdb_checkpoint( void *ctx, void *arg )
 	return NULL;
 }
 
-/* reindex entries on the fly */
+/* Online indexing hands out the IDs of id2entry to its workers in
+ * chunks of this many IDs.
+ */
+#define MDB_OI_CHUNK	1024
+
+/* Key of the resume point in the index state table. The other keys
+ * are index names, which never start with '#'.
+ */
+static struct berval mdb_oi_nextkey = BER_BVC("#next");
+
+typedef struct mdb_oi_state {
+	ldap_pvt_thread_mutex_t	os_mutex;
+	ldap_pvt_thread_mutex_t	os_wmutex;	/* one worker writes at a time */
+	BackendDB	*os_be;
+	struct re_s	*os_task;
+	ID			os_next;	/* first ID of the next chunk */
+	int			os_eof;		/* no IDs left at os_next */
+	int			os_restart;	/* an index was added, start over */
+	int			os_save;	/* the pending index masks must be saved */
+	int			os_error;
+	int			os_nworkers;
+	int			os_started;
+	int			os_active;
+	unsigned long	os_count;
+	time_t		os_logtime;
+	ID			*os_pos;	/* next ID of each worker's chunk, 0 if none */
+	ID			*os_end;	/* end of each worker's chunk */
+} mdb_oi_state;
+
+/* Record the indexes being built, with the mask that was complete
+ * before, so that a restart can pick up where this pass left off.
+ */
+static int
+mdb_oi_save_masks( struct mdb_info *mdb, MDB_txn *txn )
+{
+	MDB_val key, data;
+	int i, rc = 0;
+
+	for ( i = 0; i < mdb->mi_nattrs && !rc; i++ ) {
+		AttrInfo *ai = mdb->mi_attrs[i];
+		if ( ai->ai_indexmask & MDB_INDEX_DELETING || !ai->ai_newmask )
+			continue;
+		key.mv_data = ai->ai_desc->ad_cname.bv_val;
+		key.mv_size = ai->ai_desc->ad_cname.bv_len;
+		data.mv_data = &ai->ai_indexmask;
+		data.mv_size = sizeof( ai->ai_indexmask );
+		rc = mdb_put( txn, mdb->mi_idxstate, &key, &data, 0 );
+	}
+	for ( i = 0; i < mdb->mi_ncomps && !rc; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		if ( ci->ci_indexmask & MDB_INDEX_DELETING || !ci->ci_newmask )
+			continue;
+		key.mv_data = ci->ci_name.bv_val;
+		key.mv_size = ci->ci_name.bv_len;
+		data.mv_data = &ci->ci_indexmask;
+		data.mv_size = sizeof( ci->ci_indexmask );
+		rc = mdb_put( txn, mdb->mi_idxstate, &key, &data, 0 );
+	}
+	return rc;
+}
+
+/* Save the point below which all entries are indexed. Every worker
+ * stores it with its own batch, so it only covers committed work.
+ */
+static int
+mdb_oi_save_progress( struct mdb_info *mdb, MDB_txn *txn,
+	mdb_oi_state *st, int slot, ID pos )
+{
+	MDB_val key, data;
+	ID next;
+	int i, save, rc = 0;
+
+	ldap_pvt_thread_mutex_lock( &st->os_mutex );
+	next = st->os_next;
+	for ( i = 0; i < st->os_nworkers; i++ ) {
+		ID p = i == slot ? pos : st->os_pos[i];
+		if ( p && p < next )
+			next = p;
+	}
+	save = st->os_save;
+	st->os_save = 0;
+	ldap_pvt_thread_mutex_unlock( &st->os_mutex );
+
+	if ( save )
+		rc = mdb_oi_save_masks( mdb, txn );
+	if ( rc == 0 ) {
+		key.mv_data = mdb_oi_nextkey.bv_val;
+		key.mv_size = mdb_oi_nextkey.bv_len;
+		data.mv_data = &next;
+		data.mv_size = sizeof( next );
+		rc = mdb_put( txn, mdb->mi_idxstate, &key, &data, 0 );
+	}
+	if ( rc ) {
+		/* try again with the next batch */
+		ldap_pvt_thread_mutex_lock( &st->os_mutex );
+		st->os_save |= save;
+		ldap_pvt_thread_mutex_unlock( &st->os_mutex );
+	}
+	return rc;
+}
+
+/* Touch the pages of an entry so that they are read in before the
+ * write txn needs them.
+ */
+static void
+mdb_oi_touch( MDB_val *data )
+{
+	volatile unsigned char *ptr = data->mv_data;
+	size_t i;
+	unsigned char c = 0;
+
+	for ( i = 0; i < data->mv_size; i += 4096 )
+		c ^= ptr[i];
+	(void)c;
+}
+
+/* The last worker to finish marks the new indexes usable, unless the
+ * pass was interrupted; the saved state then resumes it.
+ */
+static void
+mdb_oi_finish( mdb_oi_state *st )
+{
+	BackendDB *be = st->os_be;
+	struct mdb_info *mdb = be->be_private;
+	MDB_txn *txn;
+	int i, rc;
+
+	if ( st->os_error || slapd_shutdown ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"interrupted after %lu entries, will resume on restart\n",
+			be->be_suffix[0].bv_val, st->os_count, 0 );
+	} else {
+		for ( i = 0; i < mdb->mi_nattrs; i++ ) {
+			if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
+			mdb->mi_attrs[ i ]->ai_newmask = 0;
+		}
+		for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+			if ( mdb->mi_comps[ i ]->ci_indexmask & MDB_INDEX_DELETING
+				|| mdb->mi_comps[ i ]->ci_newmask == 0 )
+			{
+				continue;
+			}
+			mdb->mi_comps[ i ]->ci_indexmask = mdb->mi_comps[ i ]->ci_newmask;
+			mdb->mi_comps[ i ]->ci_newmask = 0;
+		}
+
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		if ( rc == 0 ) {
+			mdb_drop( txn, mdb->mi_idxstate, 0 );
+			rc = mdb_txn_commit( txn );
+		}
+		Debug( LDAP_DEBUG_STATS,
+			LDAP_XSTRING(mdb_online_index) ": database %s: "
+			"done, %lu entries indexed\n",
+			be->be_suffix[0].bv_val, st->os_count, 0 );
+	}
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, st->os_task );
+	mdb->mi_index_task = NULL;
+	mdb->mi_oi_state = NULL;
+	ldap_pvt_runqueue_remove( &slapd_rq, st->os_task );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	ldap_pvt_thread_mutex_destroy( &st->os_wmutex );
+	ldap_pvt_thread_mutex_destroy( &st->os_mutex );
+	ch_free( st );
+}
+
 static void *
-mdb_online_index( void *ctx, void *arg )
+mdb_oi_worker( void *ctx, void *arg )
 {
-	struct re_s *rtask = arg;
-	BackendDB *be = rtask->arg;
+	mdb_oi_state *st = arg;
+	BackendDB *be = st->os_be;
 	struct mdb_info *mdb = be->be_private;
 
 	Connection conn = {0};
@@ -143,24 +348,55 @@ mdb_online_index( void *ctx, void *arg )
 	MDB_cursor *curs;
 	MDB_val key, data;
 	MDB_txn *txn;
-	ID id;
+	struct timeval t0, t1;
+	ID *ids, id, end, pos;
 	Entry *e;
-	int rc, getnext = 1;
-	int i;
+	int slot, i, n, last, rc = 0;
+	int maxsize = mdb->mi_oi_txnsize, size = maxsize;
+	long wait;
 
 	connection_fake_init( &conn, &opbuf, ctx );
 	op = &opbuf.ob_op;
-
 	op->o_bd = be;
 
-	id = 1;
-	key.mv_size = sizeof(ID);
+	ids = ch_malloc( maxsize * sizeof( ID ));
+
+	ldap_pvt_thread_mutex_lock( &st->os_mutex );
+	slot = st->os_started++;
+	ldap_pvt_thread_mutex_unlock( &st->os_mutex );
 
-	while ( 1 ) {
-		if ( slapd_shutdown )
+	while ( !slapd_shutdown ) {
+		ldap_pvt_thread_pool_pausecheck( &connection_pool );
+
+		ldap_pvt_thread_mutex_lock( &st->os_mutex );
+		if ( st->os_error ) {
+			ldap_pvt_thread_mutex_unlock( &st->os_mutex );
 			break;
+		}
+		if ( st->os_restart ) {
+			st->os_restart = 0;
+			st->os_next = 1;
+			st->os_eof = 0;
+			st->os_save = 1;
+		}
+		if ( !st->os_pos[slot] ) {
+			if ( st->os_eof ) {
+				ldap_pvt_thread_mutex_unlock( &st->os_mutex );
+				break;
+			}
+			st->os_pos[slot] = st->os_next;
+			st->os_end[slot] = st->os_next + MDB_OI_CHUNK;
+			st->os_next += MDB_OI_CHUNK;
+		}
+		pos = st->os_pos[slot];
+		end = st->os_end[slot];
+		ldap_pvt_thread_mutex_unlock( &st->os_mutex );
 
-		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+		/* Collect the next batch of this chunk in a read txn. Other
+		 * workers may hold the write txn meanwhile.
+		 */
+		n = 0;
+		rc = mdb_txn_begin( mdb->mi_dbenv, NULL, MDB_RDONLY, &txn );
 		if ( rc )
 			break;
 		rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
@@ -168,67 +404,305 @@ mdb_online_index( void *ctx, void *arg )
 			mdb_txn_abort( txn );
 			break;
 		}
-		if ( getnext ) {
-			getnext = 0;
-			key.mv_data = &id;
-			rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+		id = pos;
+		key.mv_size = sizeof(ID);
+		key.mv_data = &id;
+		rc = mdb_cursor_get( curs, &key, &data, MDB_SET_RANGE );
+		while ( rc == 0 ) {
+			memcpy( &id, key.mv_data, sizeof( id ));
+			if ( id >= end )
+				break;
+			mdb_oi_touch( &data );
+			ids[n++] = id;
+			if ( n == size )
+				break;
+			rc = mdb_cursor_get( curs, &key, &data, MDB_NEXT );
+		}
+		mdb_cursor_close( curs );
+		mdb_txn_abort( txn );
+		last = rc == MDB_NOTFOUND;
+		if ( rc && !last )
+			break;
+		rc = 0;
+
+		/* Done with the chunk unless the batch was cut short */
+		if ( n == size && ids[n-1] + 1 < end )
+			pos = ids[n-1] + 1;
+		else
+			pos = 0;
+
+		if ( n ) {
+			ldap_pvt_thread_mutex_lock( &st->os_wmutex );
+			gettimeofday( &t0, NULL );
+			rc = mdb_txn_begin( mdb->mi_dbenv, NULL, 0, &txn );
+			gettimeofday( &t1, NULL );
 			if ( rc ) {
+				ldap_pvt_thread_mutex_unlock( &st->os_wmutex );
+				break;
+			}
+			wait = ( t1.tv_sec - t0.tv_sec ) * 1000 +
+				( t1.tv_usec - t0.tv_usec ) / 1000;
+
+			rc = mdb_cursor_open( txn, mdb->mi_id2entry, &curs );
+			if ( rc == 0 ) {
+				for ( i = 0; i < n; i++ ) {
+					rc = mdb_id2entry( op, curs, ids[i], &e );
+					if ( rc == MDB_NOTFOUND ) {
+						/* deleted meanwhile */
+						rc = 0;
+						continue;
+					}
+					if ( rc )
+						break;
+					rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
+					mdb_entry_return( op, e );
+					if ( rc )
+						break;
+				}
+				mdb_cursor_close( curs );
+			}
+			if ( rc == 0 )
+				rc = mdb_oi_save_progress( mdb, txn, st, slot,
+					pos ? pos : end );
+			if ( rc == 0 ) {
+				rc = mdb_txn_commit( txn );
+			} else {
 				mdb_txn_abort( txn );
-				if ( rc == MDB_NOTFOUND )
-					rc = 0;
+			}
+			ldap_pvt_thread_mutex_unlock( &st->os_wmutex );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_online_index) ": database %s: "
+					"txn_commit failed: %s (%d)\n",
+					be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
 				break;
 			}
-			memcpy( &id, key.mv_data, sizeof( id ));
-		}
 
-		rc = mdb_id2entry( op, curs, id, &e );
-		mdb_cursor_close( curs );
-		if ( rc ) {
-			mdb_txn_abort( txn );
-			if ( rc == MDB_NOTFOUND ) {
-				id++;
-				getnext = 1;
-				continue;
+			/* Back off while foreground writes wait for the lock,
+			 * with smaller write txns and a pause between them.
+			 */
+			if ( mdb->mi_oi_throttle ) {
+				if ( wait > mdb->mi_oi_throttle ) {
+					struct timeval tv;
+					size = size > 1 ? size / 2 : 1;
+					tv.tv_sec = mdb->mi_oi_throttle / 1000;
+					tv.tv_usec = ( mdb->mi_oi_throttle % 1000 ) * 1000;
+					select( 0, NULL, NULL, NULL, &tv );
+				} else if ( size < maxsize ) {
+					size += ( maxsize + 7 ) / 8;
+					if ( size > maxsize )
+						size = maxsize;
+				}
 			}
-			break;
 		}
-		rc = mdb_index_entry( op, txn, MDB_INDEX_UPDATE_OP, e );
-		mdb_entry_return( op, e );
-		if ( rc == 0 ) {
-			rc = mdb_txn_commit( txn );
-			txn = NULL;
-		} else {
-			mdb_txn_abort( txn );
-			txn = NULL;
-		}
-		if ( rc ) {
-			Debug( LDAP_DEBUG_ANY,
+
+		ldap_pvt_thread_mutex_lock( &st->os_mutex );
+		st->os_pos[slot] = pos;
+		if ( last && !pos )
+			st->os_eof = 1;
+		st->os_count += n;
+		if ( slap_get_time() - st->os_logtime >= 60 ) {
+			st->os_logtime = slap_get_time();
+			Debug( LDAP_DEBUG_STATS,
 				LDAP_XSTRING(mdb_online_index) ": database %s: "
-				"txn_commit failed: %s (%d)\n",
-				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
-			break;
+				"%lu entries indexed, at ID %lu\n",
+				be->be_suffix[0].bv_val, st->os_count,
+				(unsigned long) st->os_next );
 		}
-		id++;
-		getnext = 1;
+		ldap_pvt_thread_mutex_unlock( &st->os_mutex );
 	}
 
-	for ( i = 0; i < mdb->mi_nattrs; i++ ) {
-		if ( mdb->mi_attrs[ i ]->ai_indexmask & MDB_INDEX_DELETING
-			|| mdb->mi_attrs[ i ]->ai_newmask == 0 )
+	ch_free( ids );
+
+	ldap_pvt_thread_mutex_lock( &st->os_mutex );
+	if ( rc )
+		st->os_error = rc;
+	i = --st->os_active;
+	ldap_pvt_thread_mutex_unlock( &st->os_mutex );
+
+	if ( i == 0 )
+		mdb_oi_finish( st );
+
+	return NULL;
+}
+
+/* Reindex entries on the fly. The IDs are handed out in chunks to
+ * several workers. LMDB allows one writer at a time, so the workers
+ * overlap reading their next batch with another worker's write txn.
+ */
+static void *
+mdb_online_index( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	BackendDB *be = rtask->arg;
+	struct mdb_info *mdb = be->be_private;
+	mdb_oi_state *st;
+	int i, n = mdb->mi_oi_workers;
+
+	st = ch_calloc( 1, sizeof( mdb_oi_state ) + 2 * n * sizeof( ID ));
+	st->os_pos = (ID *)( st + 1 );
+	st->os_end = st->os_pos + n;
+	ldap_pvt_thread_mutex_init( &st->os_mutex );
+	ldap_pvt_thread_mutex_init( &st->os_wmutex );
+	st->os_be = be;
+	st->os_task = rtask;
+	st->os_nworkers = n;
+	st->os_active = n;
+	st->os_save = 1;
+	st->os_logtime = slap_get_time();
+
+	/* pick up a pass interrupted by a restart */
+	st->os_next = mdb->mi_oi_resume ? mdb->mi_oi_resume : 1;
+	mdb->mi_oi_resume = 0;
+
+	Debug( LDAP_DEBUG_STATS,
+		LDAP_XSTRING(mdb_online_index) ": database %s: "
+		"starting at ID %lu with %d workers\n",
+		be->be_suffix[0].bv_val, (unsigned long) st->os_next, n );
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	mdb->mi_oi_state = st;
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+
+	for ( i = 1; i < n; i++ ) {
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			mdb_oi_worker, st ) )
 		{
+			ldap_pvt_thread_mutex_lock( &st->os_mutex );
+			st->os_active--;
+			ldap_pvt_thread_mutex_unlock( &st->os_mutex );
+		}
+	}
+
+	return mdb_oi_worker( ctx, st );
+}
+
+/* A new index was configured while a pass is running */
+void
+mdb_online_index_restart( struct mdb_info *mdb )
+{
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( mdb->mi_oi_state ) {
+		ldap_pvt_thread_mutex_lock( &mdb->mi_oi_state->os_mutex );
+		mdb->mi_oi_state->os_restart = 1;
+		ldap_pvt_thread_mutex_unlock( &mdb->mi_oi_state->os_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Called on open: restore the state of an interrupted indexing pass
+ * and schedule it to continue.
+ */
+int
+mdb_online_index_resume( BackendDB *be, MDB_txn *txn )
+{
+	struct mdb_info *mdb = be->be_private;
+	MDB_cursor *mc;
+	MDB_val key, data;
+	slap_mask_t mask;
+	int i, rc, pending = 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_idxstate, &mc );
+	if ( rc )
+		return rc;
+
+	while (( rc = mdb_cursor_get( mc, &key, &data, MDB_NEXT )) == 0 ) {
+		struct berval name;
+		AttributeDescription *ad = NULL;
+		const char *text;
+
+		name.bv_val = key.mv_data;
+		name.bv_len = key.mv_size;
+		if ( ber_bvcmp( &name, &mdb_oi_nextkey ) == 0 ) {
+			memcpy( &mdb->mi_oi_resume, data.mv_data, sizeof( ID ));
 			continue;
 		}
-		mdb->mi_attrs[ i ]->ai_indexmask = mdb->mi_attrs[ i ]->ai_newmask;
-		mdb->mi_attrs[ i ]->ai_newmask = 0;
+		if ( data.mv_size != sizeof( mask ))
+			continue;
+		memcpy( &mask, data.mv_data, sizeof( mask ));
+
+		/* back off to the mask that was complete */
+		for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+			CompInfo *ci = mdb->mi_comps[i];
+			if ( ber_bvstrcasecmp( &ci->ci_name, &name ) == 0 ) {
+				if ( ci->ci_indexmask & ~mask ) {
+					ci->ci_newmask = ci->ci_indexmask;
+					ci->ci_indexmask &= mask;
+					pending++;
+				}
+				break;
+			}
+		}
+		if ( i < mdb->mi_ncomps )
+			continue;
+		if ( slap_bv2ad( &name, &ad, &text ) == LDAP_SUCCESS ) {
+			AttrInfo *ai = mdb_attr_mask( mdb, ad );
+			if ( ai && ai->ai_indexmask & ~mask ) {
+				ai->ai_newmask = ai->ai_indexmask;
+				ai->ai_indexmask &= mask;
+				pending++;
+			}
+		}
+	}
+	mdb_cursor_close( mc );
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+
+	if ( !pending ) {
+		/* nothing left to do, forget it */
+		mdb->mi_oi_resume = 0;
+		return mdb_drop( txn, mdb->mi_idxstate, 0 );
 	}
 
+	Debug( LDAP_DEBUG_ANY,
+		LDAP_XSTRING(mdb_online_index_resume) ": database %s: "
+		"%d indexes incomplete, resuming at ID %lu\n",
+		be->be_suffix[0].bv_val, pending, (unsigned long) mdb->mi_oi_resume );
+
 	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
-	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
-	mdb->mi_index_task = NULL;
-	ldap_pvt_runqueue_remove( &slapd_rq, rtask );
+	if ( !mdb->mi_index_task ) {
+		mdb->mi_index_task = ldap_pvt_runqueue_insert( &slapd_rq, 36000,
+			mdb_online_index, be,
+			LDAP_XSTRING(mdb_online_index), be->be_suffix[0].bv_val );
+	}
 	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return 0;
+}
 
-	return NULL;
+/* Pre-fault the branch pages of the map, so that searches after a
+ * restart don't wait for the page cache to fill, and optionally lock
+ * them in memory. Failing to lock is not fatal.
+ */
+void
+mdb_db_warmup( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+	struct timeval start, end;
+	int rc;
+
+	if ( !( mdb->mi_dbenv_flags & MDB_ENVF_LOCAL ))
+		return;
+
+	gettimeofday( &start, NULL );
+	rc = mdb_env_warmup( mdb->mi_dbenv,
+		( mdb->mi_dbenv_flags & MDB_ENVF_MLOCK ) ? MDB_WARMLOCK : 0 );
+	gettimeofday( &end, NULL );
+	if ( end.tv_usec < start.tv_usec ) {
+		end.tv_usec += 1000000;
+		end.tv_sec--;
+	}
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_warmup) ": database %s: "
+			"mdb_env_warmup failed: %s (%d)\n",
+			be->be_suffix[0].bv_val, mdb_strerror( rc ), rc );
+	} else {
+		Debug( LDAP_DEBUG_STATS,
+			LDAP_XSTRING(mdb_db_warmup) ": database %s: "
+			"warmed up in %ld ms\n",
+			be->be_suffix[0].bv_val, (long)( end.tv_sec - start.tv_sec ) * 1000
+			+ ( end.tv_usec - start.tv_usec ) / 1000, 0 );
+	}
 }
 
 /* Cleanup loose ends after Modify completes */
@@ -239,6 +713,7 @@ mdb_cf_cleanup( ConfigArgs *c )
 	int rc = 0;
 
 	if ( mdb->mi_flags & MDB_DEL_INDEX ) {
+		mdb_comp_drop( mdb );
 		mdb_attr_flush( mdb );
 		mdb->mi_flags ^= MDB_DEL_INDEX;
 	}
@@ -318,6 +793,11 @@ mdb_cf_gen( ConfigArgs *c )
 				c->value_int = 1;
 			break;
 
+		case MDB_DNHASH_CF:
+			if ( mdb->mi_flags & MDB_DNHASH )
+				c->value_int = 1;
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( mdb->mi_dbenv_flags ) {
 				mask_to_verbs( mdb_envflags, mdb->mi_dbenv_flags, &c->rvalue_vals );
@@ -330,6 +810,68 @@ mdb_cf_gen( ConfigArgs *c )
 			if ( !c->rvalue_vals ) rc = 1;
 			break;
 
+		case MDB_ONLINEINDEX:
+			if ( mdb->mi_oi_workers != DEFAULT_ONLINEINDEX_WORKERS ||
+				mdb->mi_oi_txnsize != DEFAULT_ONLINEINDEX_TXNSIZE ||
+				mdb->mi_oi_throttle != DEFAULT_ONLINEINDEX_THROTTLE ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%d %d %d",
+					mdb->mi_oi_workers, mdb->mi_oi_txnsize,
+					mdb->mi_oi_throttle );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_SUBDBPREFIX:
+			if ( !BER_BVISEMPTY( &mdb->mi_prefix )) {
+				c->value_string = ch_strdup( mdb->mi_prefix.bv_val );
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_WARMSTART:
+			if ( mdb->mi_ws_min ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%d %d",
+					mdb->mi_ws_min, mdb->mi_ws_threads );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
+		case MDB_PAGEDCACHE:
+			if ( mdb->mi_pc_max ) {
+				char buf[64];
+				struct berval bv;
+				bv.bv_len = snprintf( buf, sizeof(buf), "%d %d",
+					mdb->mi_pc_max, mdb->mi_pc_ttl );
+				if ( bv.bv_len > 0 && bv.bv_len < sizeof(buf) ) {
+					bv.bv_val = buf;
+					value_add_one( &c->rvalue_vals, &bv );
+				} else {
+					rc = 1;
+				}
+			} else {
+				rc = 1;
+			}
+			break;
+
 		case MDB_SSTACK:
 			c->value_int = mdb->mi_search_stack_depth;
 			break;
@@ -368,6 +910,35 @@ mdb_cf_gen( ConfigArgs *c )
 			mdb->mi_maxentrysize = 0;
 			break;
 
+		case MDB_ONLINEINDEX:
+			/* takes effect with the next indexing pass */
+			mdb->mi_oi_workers = DEFAULT_ONLINEINDEX_WORKERS;
+			mdb->mi_oi_txnsize = DEFAULT_ONLINEINDEX_TXNSIZE;
+			mdb->mi_oi_throttle = DEFAULT_ONLINEINDEX_THROTTLE;
+			break;
+
+		case MDB_PAGEDCACHE:
+			mdb->mi_pc_max = 0;
+			mdb->mi_pc_ttl = DEFAULT_PAGEDCACHE_TTL;
+			mdb_pagedcache_flush( mdb, NULL );
+			break;
+
+		case MDB_SUBDBPREFIX:
+			ch_free( mdb->mi_prefix.bv_val );
+			BER_BVZERO( &mdb->mi_prefix );
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+			break;
+
+		case MDB_WARMSTART:
+			/* the last record is left in place, but no longer read */
+			mdb_warmstart_stop( mdb );
+			mdb->mi_ws_min = 0;
+			mdb->mi_ws_threads = DEFAULT_WARMSTART_THREADS;
+			break;
+
 		case MDB_CHKPT:
 			if ( mdb->mi_txn_cp_task ) {
 				struct re_s *re = mdb->mi_txn_cp_task;
@@ -392,11 +963,24 @@ mdb_cf_gen( ConfigArgs *c )
 			mdb->mi_dbenv_flags &= ~MDB_NOSYNC;
 			break;
 
+		case MDB_DNHASH_CF:
+			/* the table is dropped when the database is reopened */
+			if ( mdb->mi_flags & MDB_DNHASH ) {
+				mdb->mi_flags ^= MDB_DNHASH;
+				if ( mdb->mi_flags & MDB_IS_OPEN ) {
+					mdb->mi_flags |= MDB_RE_OPEN;
+					c->cleanup = mdb_cf_cleanup;
+				}
+			}
+			break;
+
 		case MDB_ENVFLAGS:
 			if ( c->valx == -1 ) {
 				int i;
 				for ( i=0; mdb_envflags[i].mask; i++) {
-					if ( mdb->mi_dbenv_flags & mdb_envflags[i].mask ) {
+					if ( mdb_envflags[i].mask & MDB_ENVF_LOCAL ) {
+						mdb->mi_dbenv_flags &= ~mdb_envflags[i].mask;
+					} else if ( mdb->mi_dbenv_flags & mdb_envflags[i].mask ) {
 						/* not all flags are runtime resettable */
 						rc = mdb_env_set_flags( mdb->mi_dbenv, mdb_envflags[i].mask, 0 );
 						if ( rc ) {
@@ -409,7 +993,11 @@ mdb_cf_gen( ConfigArgs *c )
 				}
 			} else {
 				int i = verb_to_mask( c->line, mdb_envflags );
-				if ( mdb_envflags[i].mask & mdb->mi_dbenv_flags ) {
+				if ( mdb_envflags[i].mask & MDB_ENVF_LOCAL ) {
+					/* pages already locked stay so until the map is closed */
+					mdb->mi_dbenv_flags &= ~mdb_envflags[i].mask;
+					break;
+				} else if ( mdb_envflags[i].mask & mdb->mi_dbenv_flags ) {
 					rc = mdb_env_set_flags( mdb->mi_dbenv, mdb_envflags[i].mask, 0 );
 					if ( rc ) {
 						mdb->mi_flags |= MDB_RE_OPEN;
@@ -435,6 +1023,9 @@ mdb_cf_gen( ConfigArgs *c )
 				for ( i = 0; i < mdb->mi_nattrs; i++ ) {
 					mdb->mi_attrs[i]->ai_indexmask |= MDB_INDEX_DELETING;
 				}
+				for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+					mdb->mi_comps[i]->ci_indexmask |= MDB_INDEX_DELETING;
+				}
 				mdb->mi_flags |= MDB_DEL_INDEX;
 				c->cleanup = mdb_cf_cleanup;
 
@@ -463,6 +1054,25 @@ mdb_cf_gen( ConfigArgs *c )
 						const char *text;
 						AttrInfo *ai;
 
+						if ( strchr( attrs[ i ], '+' ) ) {
+							AttributeDescription *descs[MDB_COMP_MAXATTRS];
+							CompInfo *ci;
+							int n;
+
+							n = mdb_comp_parse( attrs[ i ], descs, &text );
+							/* if we got here... */
+							assert( n > 0 );
+
+							ci = mdb_comp_find( mdb, descs, n );
+							/* if we got here... */
+							assert( ci != NULL );
+
+							ci->ci_indexmask |= MDB_INDEX_DELETING;
+							mdb->mi_flags |= MDB_DEL_INDEX;
+							c->cleanup = mdb_cf_cleanup;
+							continue;
+						}
+
 						slap_str2ad( attrs[ i ], &ad, &text );
 						/* if we got here... */
 						assert( ad != NULL );
@@ -607,11 +1217,26 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_DNHASH_CF:
+		if ( !c->value_int != !( mdb->mi_flags & MDB_DNHASH )) {
+			mdb->mi_flags ^= MDB_DNHASH;
+			if ( mdb->mi_flags & MDB_IS_OPEN ) {
+				mdb->mi_flags |= MDB_RE_OPEN;
+				c->cleanup = mdb_cf_cleanup;
+			}
+		}
+		break;
+
 	case MDB_ENVFLAGS: {
 		int i, j;
 		for ( i=1; i<c->argc; i++ ) {
 			j = verb_to_mask( c->argv[i], mdb_envflags );
-			if ( mdb_envflags[j].mask ) {
+			if ( mdb_envflags[j].mask & MDB_ENVF_LOCAL ) {
+				mdb->mi_dbenv_flags |= mdb_envflags[j].mask;
+				/* warm a running database right away */
+				if ( mdb->mi_flags & MDB_IS_OPEN )
+					mdb_db_warmup( c->be );
+			} else if ( mdb_envflags[j].mask ) {
 				if ( mdb->mi_flags & MDB_IS_OPEN )
 					rc = mdb_env_set_flags( mdb->mi_dbenv, mdb_envflags[j].mask, 1 );
 				else
@@ -641,7 +1266,10 @@ mdb_cf_gen( ConfigArgs *c )
 		mdb->mi_flags |= MDB_OPEN_INDEX;
 		if ( mdb->mi_flags & MDB_IS_OPEN ) {
 			c->cleanup = mdb_cf_cleanup;
-			if ( !mdb->mi_index_task ) {
+			if ( mdb->mi_index_task ) {
+				/* a pass is under way, it must cover the new index too */
+				mdb_online_index_restart( mdb );
+			} else {
 				/* Start the task as soon as we finish here. Set a long
 				 * interval (10 hours) so that it only gets scheduled once.
 				 */
@@ -660,6 +1288,98 @@ mdb_cf_gen( ConfigArgs *c )
 		}
 		break;
 
+	case MDB_ONLINEINDEX: {
+		int workers, txnsize, throttle = DEFAULT_ONLINEINDEX_THROTTLE;
+		if ( lutil_atoi( &workers, c->argv[1] ) != 0 || workers <= 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid workers \"%s\"", c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( lutil_atoi( &txnsize, c->argv[2] ) != 0 || txnsize <= 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid entries \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( c->argc > 3 && ( lutil_atoi( &throttle, c->argv[3] ) != 0 || throttle < 0 )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid msec \"%s\"", c->argv[0], c->argv[3] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_oi_workers = workers;
+		mdb->mi_oi_txnsize = txnsize;
+		mdb->mi_oi_throttle = throttle;
+		}
+		break;
+
+	case MDB_PAGEDCACHE: {
+		int num, ttl = DEFAULT_PAGEDCACHE_TTL;
+		if ( lutil_atoi( &num, c->argv[1] ) != 0 || num < 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid number \"%s\"", c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( c->argc > 2 && ( lutil_atoi( &ttl, c->argv[2] ) != 0 || ttl <= 0 )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid seconds \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_pc_max = num;
+		mdb->mi_pc_ttl = ttl;
+		/* shrinking is taken care of as new lists are saved */
+		if ( !num )
+			mdb_pagedcache_flush( mdb, NULL );
+		}
+		break;
+
+	case MDB_SUBDBPREFIX: {
+		struct berval bv;
+
+		ber_str2bv( c->value_string, 0, 0, &bv );
+		/* when configured from scratch, checked as the databases open */
+		if (( mdb->mi_flags & MDB_IS_OPEN ) &&
+			mdb_subdb_inuse( mdb, mdb->mi_dbenv_home, &bv )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: already used by another database in \"%s\"",
+				c->argv[0], mdb->mi_dbenv_home );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			ch_free( c->value_string );
+			return 1;
+		}
+		ch_free( mdb->mi_prefix.bv_val );
+		mdb->mi_prefix = bv;
+		if ( mdb->mi_flags & MDB_IS_OPEN ) {
+			mdb->mi_flags |= MDB_RE_OPEN;
+			c->cleanup = mdb_cf_cleanup;
+		}
+		} break;
+
+	case MDB_WARMSTART: {
+		int min, threads = DEFAULT_WARMSTART_THREADS;
+		if ( lutil_atoi( &min, c->argv[1] ) != 0 || min <= 0 ) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid minutes \"%s\"", c->argv[0], c->argv[1] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		if ( c->argc > 2 && ( lutil_atoi( &threads, c->argv[2] ) != 0 || threads < 0 )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"%s: invalid threads \"%s\"", c->argv[0], c->argv[2] );
+			Debug( LDAP_DEBUG_ANY, "%s %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		mdb->mi_ws_min = min;
+		mdb->mi_ws_threads = threads;
+		/* otherwise mdb_db_open() schedules it */
+		if (( slapMode & SLAP_SERVER_MODE ) && ( mdb->mi_flags & MDB_IS_OPEN ))
+			mdb_warmstart_start( c->be );
+		}
+		break;
+
 	case MDB_SSTACK:
 		if ( c->value_int < MINIMUM_SEARCH_STACK_DEPTH ) {
 			fprintf( stderr,
@@ -22,6 +22,90 @@
 #include "lutil.h"
 #include "back-mdb.h"
 
+/* Tree Delete: check access to, and drop the index values of,
+ * the entries below the target.
+ */
+static int
+mdb_tree_index_del( Operation *op, SlapReply *rs, MDB_txn *txn, ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *mc;
+	Entry *e;
+	ID i;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_id2entry, &mc );
+	if ( rc ) {
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "internal error";
+		return rc;
+	}
+	for ( i = 1; i <= ids[0]; i++ ) {
+		rc = mdb_id2entry( op, mc, ids[i], &e );
+		if ( rc ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "internal error";
+			break;
+		}
+		if ( !access_allowed( op, e, slap_schema.si_ad_entry,
+				NULL, ACL_WDEL, NULL ) ||
+			!access_allowed( op, e, slap_schema.si_ad_children,
+				NULL, ACL_WDEL, NULL ))
+		{
+			Debug( LDAP_DEBUG_TRACE,
+				"<=- " LDAP_XSTRING(mdb_delete) ": no write "
+				"access to subordinate %s\n", e->e_name.bv_val, 0, 0 );
+			mdb_entry_return( op, e );
+			rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+			rs->sr_text = "no write access to subordinate entry";
+			rc = -1;
+			break;
+		}
+		rc = mdb_index_entry_del( op, txn, e );
+		if ( rc == 0 )
+			rc = mdb_dnhash_delete( op, txn, &e->e_nname, e->e_id );
+		mdb_entry_return( op, e );
+		if ( rc ) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "entry index delete failed";
+			break;
+		}
+	}
+	mdb_cursor_close( mc );
+	return rc;
+}
+
+/* Tree Delete: drop the dn2id and id2entry records of the entries
+ * below the target, dropping whole pages for each run of
+ * consecutive IDs.
+ */
+static int
+mdb_tree_drop( Operation *op, MDB_txn *txn, ID id, ID *ids )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_val key, hi;
+	ID lo, next, i;
+	int rc;
+
+	/* our children's nodes */
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	rc = mdb_del( txn, mdb->mi_dn2id, &key, NULL );
+
+	key.mv_data = &lo;
+	hi.mv_size = sizeof(ID);
+	hi.mv_data = &next;
+	for ( i = 1; rc == 0 && i <= ids[0]; ) {
+		lo = ids[i];
+		for ( i++; i <= ids[0] && ids[i] == ids[i-1] + 1; i++ ) ;
+		next = ids[i-1] + 1;
+		rc = mdb_del_range( txn, mdb->mi_dn2id, &key, &hi, NULL );
+		if ( rc == 0 )
+			rc = mdb_del_range( txn, mdb->mi_id2entry, &key, &hi, NULL );
+	}
+	return rc;
+}
+
 int
 mdb_delete( Operation *op, SlapReply *rs )
 {
@@ -43,6 +127,8 @@ mdb_delete( Operation *op, SlapReply *rs )
 	int	parent_is_glue = 0;
 	int parent_is_leaf = 0;
 
+	ID	*subs = NULL, nsubs = 1;
+
 	Debug( LDAP_DEBUG_ARGS, "==> " LDAP_XSTRING(mdb_delete) ": %s\n",
 		op->o_req_dn.bv_val, 0, 0 );
 
@@ -271,9 +357,24 @@ mdb_delete( Operation *op, SlapReply *rs )
 
 	rs->sr_text = NULL;
 
-	/* Can't do it if we have kids */
+	/* Can't do it if we have kids, unless they go too */
 	rs->sr_err = mdb_dn2id_children( op, txn, e );
-	if( rs->sr_err != MDB_NOTFOUND ) {
+	if ( rs->sr_err == 0 && get_treeDelete( op )) {
+		if ( !access_allowed( op, e, children, NULL, ACL_WDEL, NULL )) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<=- " LDAP_XSTRING(mdb_delete) ": no write "
+				"access to children\n", 0, 0, 0 );
+			rs->sr_err = LDAP_INSUFFICIENT_ACCESS;
+			rs->sr_text = "no write access to children";
+			goto return_results;
+		}
+		rs->sr_err = mdb_dn2id_subtree( op, txn, e->e_id, &subs );
+		if ( rs->sr_err == 0 &&
+			mdb_tree_index_del( op, rs, txn, subs ))
+			goto return_results;
+		nsubs += subs[0];
+	}
+	if( rs->sr_err != MDB_NOTFOUND && !subs ) {
 		switch( rs->sr_err ) {
 		case 0:
 			Debug(LDAP_DEBUG_ARGS,
@@ -295,8 +396,10 @@ mdb_delete( Operation *op, SlapReply *rs )
 	}
 
 	/* delete from dn2id */
-	rs->sr_err = mdb_dn2id_delete( op, mc, e->e_id, 1 );
+	rs->sr_err = mdb_dn2id_delete( op, mc, e, nsubs );
 	mdb_cursor_close( mc );
+	if ( rs->sr_err == 0 && subs )
+		rs->sr_err = mdb_tree_drop( op, txn, e->e_id, subs );
 	if ( rs->sr_err != 0 ) {
 		Debug(LDAP_DEBUG_TRACE,
 			"<=- " LDAP_XSTRING(mdb_delete) ": dn2id failed: "
@@ -367,6 +470,11 @@ mdb_delete( Operation *op, SlapReply *rs )
 	}
 
 	if( moi == &opinfo ) {
+		if ( !op->o_noop && overlay_precommit( op, rs )) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "overlay pre-commit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
@@ -395,6 +503,11 @@ mdb_delete( Operation *op, SlapReply *rs )
 		LDAP_XSTRING(mdb_delete) ": deleted%s id=%08lx dn=\"%s\"\n",
 		op->o_noop ? " (no-op)" : "",
 		e->e_id, op->o_req_dn.bv_val );
+	if ( subs ) {
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_delete) ": with %lu subordinates\n",
+			(unsigned long) subs[0], 0, 0 );
+	}
 	rs->sr_err = LDAP_SUCCESS;
 	rs->sr_text = NULL;
 	if( num_ctrls ) rs->sr_ctrls = ctrls;
@@ -408,6 +521,8 @@ return_results:
 		mdb_entry_return( op, p );
 	}
 
+	ch_free( subs );
+
 	/* free entry */
 	if( e != NULL ) {
 		mdb_entry_return( op, e );
@@ -22,6 +22,7 @@
 #include "back-mdb.h"
 #include "idl.h"
 #include "lutil.h"
+#include "lutil_hash.h"
 
 /* Management routines for a hierarchically structured database.
  *
@@ -75,6 +76,208 @@ mdb_dup_compare(
 	return strncmp( un->nrdn, cn->nrdn, nrlen );
 }
 
+/* The optional dnhash database maps the full normalized DN of an
+ * entry directly to its ID, so that exact DN lookups need a single
+ * B-tree descent instead of one per RDN. Keys are a hash of the DN
+ * followed by the big-endian entry ID, so colliding DNs just sort
+ * next to each other. The data holds the normalized and the pretty
+ * DN, and the normalized DN is compared on every lookup. The table
+ * is never authoritative: on a miss we fall back to walking dn2id.
+ */
+#define DNHASH_KEYLEN	(LUTIL_HASH_BYTES + sizeof(ID))
+
+static void
+mdb_dnhash_key(
+	struct berval *ndn,
+	ID id,
+	unsigned char *buf )
+{
+	lutil_HASH_CTX ctx;
+
+	lutil_HASHInit( &ctx );
+	lutil_HASHUpdate( &ctx, (unsigned char *)ndn->bv_val, ndn->bv_len );
+	lutil_HASHFinal( buf, &ctx );
+	MDB_ID2DISK( id, buf + LUTIL_HASH_BYTES );
+}
+
+int
+mdb_dnhash_add(
+	Operation	*op,
+	MDB_txn *txn,
+	struct berval	*ndn,
+	struct berval	*dn,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned char kbuf[DNHASH_KEYLEN];
+	MDB_val key, data;
+	char *ptr;
+	int rc;
+
+	if ( !mdb->mi_dnhash || !ndn->bv_len )
+		return 0;
+
+	mdb_dnhash_key( ndn, id, kbuf );
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	data.mv_size = ndn->bv_len + dn->bv_len + 2;
+	rc = mdb_put( txn, mdb->mi_dnhash, &key, &data, MDB_RESERVE );
+	if ( rc == 0 ) {
+		ptr = lutil_strncopy( data.mv_data, ndn->bv_val, ndn->bv_len );
+		*ptr++ = '\0';
+		ptr = lutil_strncopy( ptr, dn->bv_val, dn->bv_len );
+		*ptr = '\0';
+	}
+	return rc;
+}
+
+int
+mdb_dnhash_delete(
+	Operation	*op,
+	MDB_txn *txn,
+	struct berval	*ndn,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned char kbuf[DNHASH_KEYLEN];
+	MDB_val key;
+	int rc;
+
+	if ( !mdb->mi_dnhash || !ndn->bv_len )
+		return 0;
+
+	mdb_dnhash_key( ndn, id, kbuf );
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	rc = mdb_del( txn, mdb->mi_dnhash, &key, NULL );
+	/* the table may have been enabled after this entry was added */
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
+/* Look up an exact normalized DN. On success the pretty DN is
+ * returned in dn, pointing into the database; it is only valid
+ * for the lifetime of txn.
+ */
+static int
+mdb_dnhash_get(
+	Operation	*op,
+	MDB_txn *txn,
+	struct berval	*ndn,
+	ID	*id,
+	struct berval	*dn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	unsigned char kbuf[DNHASH_KEYLEN];
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	char *ptr;
+	int rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dnhash, &cursor );
+	if ( rc )
+		return rc;
+
+	mdb_dnhash_key( ndn, 0, kbuf );
+	key.mv_data = kbuf;
+	key.mv_size = sizeof(kbuf);
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET_RANGE );
+	while ( rc == 0 ) {
+		if ( key.mv_size != DNHASH_KEYLEN ||
+			memcmp( key.mv_data, kbuf, LUTIL_HASH_BYTES )) {
+			rc = MDB_NOTFOUND;
+			break;
+		}
+		ptr = data.mv_data;
+		if ( data.mv_size > ndn->bv_len + 1 && ptr[ndn->bv_len] == '\0' &&
+			!memcmp( ptr, ndn->bv_val, ndn->bv_len )) {
+			MDB_DISK2ID( (char *)key.mv_data + LUTIL_HASH_BYTES, id );
+			dn->bv_val = ptr + ndn->bv_len + 1;
+			dn->bv_len = data.mv_size - ndn->bv_len - 2;
+			break;
+		}
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT );
+	}
+	mdb_cursor_close( cursor );
+	return rc;
+}
+
+/* After a subtree was moved or renamed, replace the dnhash records
+ * of all entries below id. The children are still listed under id
+ * in dn2id, with their RDNs unchanged.
+ */
+int
+mdb_dnhash_rename(
+	Operation	*op,
+	MDB_txn *txn,
+	ID id,
+	struct berval	*ondn,
+	struct berval	*nndn,
+	struct berval	*ndn )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_cursor *cursor;
+	MDB_val key, data;
+	diskNode *d;
+	struct berval ocn, ncn, nc;
+	char *ptr;
+	ID cid, csubs;
+	int rc, nrlen, rlen;
+
+	if ( !mdb->mi_dnhash )
+		return 0;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dn2id, &cursor );
+	if ( rc )
+		return rc;
+
+	key.mv_size = sizeof(ID);
+	key.mv_data = &id;
+	/* our own node sorts first, the children follow it */
+	rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+	while ( rc == 0 ) {
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
+		if ( rc )
+			break;
+		d = data.mv_data;
+		nrlen = ((d->nrdnlen[0] & 0x7f) << 8) | d->nrdnlen[1];
+		rlen = data.mv_size - sizeof(diskNode) - nrlen - sizeof(ID);
+		ptr = (char *)data.mv_data + data.mv_size - 2*sizeof(ID);
+		memcpy( &cid, ptr, sizeof(ID) );
+		memcpy( &csubs, ptr + sizeof(ID), sizeof(ID) );
+
+		ocn.bv_len = nrlen + 1 + ondn->bv_len;
+		ncn.bv_len = nrlen + 1 + nndn->bv_len;
+		nc.bv_len = rlen + 1 + ndn->bv_len;
+		ocn.bv_val = op->o_tmpalloc( ocn.bv_len + ncn.bv_len + nc.bv_len + 3,
+			op->o_tmpmemctx );
+		ncn.bv_val = ocn.bv_val + ocn.bv_len + 1;
+		nc.bv_val = ncn.bv_val + ncn.bv_len + 1;
+
+		ptr = lutil_strncopy( ocn.bv_val, d->nrdn, nrlen );
+		*ptr++ = ',';
+		ptr = lutil_strcopy( ptr, ondn->bv_val );
+		ptr = lutil_strncopy( ncn.bv_val, d->nrdn, nrlen );
+		*ptr++ = ',';
+		ptr = lutil_strcopy( ptr, nndn->bv_val );
+		ptr = lutil_strncopy( nc.bv_val, d->nrdn + nrlen + 1, rlen );
+		*ptr++ = ',';
+		ptr = lutil_strcopy( ptr, ndn->bv_val );
+
+		rc = mdb_dnhash_delete( op, txn, &ocn, cid );
+		if ( rc == 0 )
+			rc = mdb_dnhash_add( op, txn, &ncn, &nc, cid );
+		if ( rc == 0 && csubs > 1 )
+			rc = mdb_dnhash_rename( op, txn, cid, &ocn, &ncn, &nc );
+		op->o_tmpfree( ocn.bv_val, op->o_tmpmemctx );
+	}
+	mdb_cursor_close( cursor );
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	return rc;
+}
+
 /* We add two elements to the DN2ID database - a data item under the parent's
  * entryID containing the child's RDN and entryID, and an item under the
  * child's entryID containing the parent's entryID.
@@ -156,6 +359,10 @@ mdb_dn2id_add(
 	}
 	op->o_tmpfree( d, op->o_tmpmemctx );
 
+	if ( rc == 0 )
+		rc = mdb_dnhash_add( op, mdb_cursor_txn( mcd ), &e->e_nname,
+			&e->e_name, e->e_id );
+
 	/* Add our subtree count to all superiors */
 	if ( rc == 0 && upsub && pid ) {
 		ID subs;
@@ -204,9 +411,10 @@ int
 mdb_dn2id_delete(
 	Operation	*op,
 	MDB_cursor *mc,
-	ID id,
+	Entry	*e,
 	ID nsubs )
 {
+	ID id = e->e_id;
 	ID nid;
 	char *ptr;
 	int rc;
@@ -234,6 +442,9 @@ mdb_dn2id_delete(
 			rc = mdb_cursor_del( mc, 0 );
 	}
 
+	if ( rc == 0 )
+		rc = mdb_dnhash_delete( op, mdb_cursor_txn( mc ), &e->e_nname, id );
+
 	/* Delete our subtree count from all superiors */
 	if ( rc == 0 && nsubs && nid ) {
 		MDB_val key, data;
@@ -325,6 +536,21 @@ mdb_dn2id(
 		goto done;
 	}
 
+	/* An exact match needs no cursor positioning or subtree count,
+	 * try the direct lookup first.
+	 */
+	if ( mdb->mi_dnhash && !mc && !nsubs ) {
+		rc = mdb_dnhash_get( op, txn, in, &nid, &tmp );
+		if ( rc == 0 ) {
+			*id = nid;
+			if ( matched )
+				*matched = tmp;
+			if ( nmatched )
+				nmatched->bv_val = in->bv_val;
+			goto done;
+		}
+	}
+
 	tmp = *in;
 
 	if ( op->o_bd->be_nsuffix[0].bv_len ) {
@@ -549,6 +775,65 @@ mdb_dn2id_children(
 	return rc;
 }
 
+/* Collect the IDs of all the entries below id into a sorted list,
+ * allocated with ch_malloc, with the count in ids[0].
+ */
+int
+mdb_dn2id_subtree(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	ID **idsp )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	MDB_val		key, data;
+	MDB_cursor	*cursor;
+	ID		*ids, tmp[128];
+	ID		size = 1024, i = 0;
+	char	*ptr;
+	int		rc;
+
+	rc = mdb_cursor_open( txn, mdb->mi_dn2id, &cursor );
+	if ( rc ) return rc;
+
+	ids = ch_malloc( size * sizeof(ID) );
+	ids[0] = 0;
+	key.mv_size = sizeof(ID);
+
+	/* Breadth first, the list itself is the queue of parents */
+	for (;;) {
+		key.mv_data = &id;
+		rc = mdb_cursor_get( cursor, &key, &data, MDB_SET );
+		/* Skip our own node, the children follow it */
+		while ( rc == 0 ) {
+			rc = mdb_cursor_get( cursor, &key, &data, MDB_NEXT_DUP );
+			if ( rc )
+				break;
+			if ( ids[0] + 1 >= size ) {
+				size *= 2;
+				ids = ch_realloc( ids, size * sizeof(ID) );
+			}
+			ptr = (char *)data.mv_data + data.mv_size - 2*sizeof(ID);
+			memcpy( &ids[++ids[0]], ptr, sizeof(ID) );
+		}
+		if ( rc != MDB_NOTFOUND )
+			break;
+		rc = 0;
+		if ( i == ids[0] )
+			break;
+		id = ids[++i];
+	}
+	mdb_cursor_close( cursor );
+
+	if ( rc ) {
+		ch_free( ids );
+		return rc;
+	}
+	mdb_idl_sort( ids, tmp );
+	*idsp = ids;
+	return 0;
+}
+
 int
 mdb_id2name(
 	Operation *op,
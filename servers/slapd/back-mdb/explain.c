@@ -0,0 +1,357 @@
+/* explain.c - back-mdb search plan reporting */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/stdarg.h>
+#include <ac/string.h>
+#include <ac/time.h>
+
+#include "back-mdb.h"
+#include "idl.h"
+
+/* The explain control asks for the search plan to be returned in
+ * a response control of the same OID. The request has no value;
+ * the response value is a human readable, multi-line text plan.
+ * While a search runs, op->o_controls[mdb_explain_cid] points to
+ * the mdb_explain being filled in.
+ */
+
+int mdb_explain_cid;
+
+/* Bound the plan of searches that walk many aliases */
+#define MDB_EXPLAIN_MAXSTEPS	256
+#define MDB_EXPLAIN_MAXFILTER	256
+
+static int
+mdb_explain_parse(
+	Operation *op,
+	SlapReply *rs,
+	LDAPControl *ctrl )
+{
+	if ( op->o_ctrlflag[mdb_explain_cid] != SLAP_CONTROL_NONE ) {
+		rs->sr_text = "explain control specified multiple times";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	if ( !BER_BVISNULL( &ctrl->ldctl_value )) {
+		rs->sr_text = "explain control value not absent";
+		return LDAP_PROTOCOL_ERROR;
+	}
+
+	op->o_ctrlflag[mdb_explain_cid] = ctrl->ldctl_iscritical
+		? SLAP_CONTROL_CRITICAL
+		: SLAP_CONTROL_NONCRITICAL;
+
+	return LDAP_SUCCESS;
+}
+
+int
+mdb_explain_init( void )
+{
+	int rc;
+
+	rc = register_supported_control( LDAP_CONTROL_X_EXPLAIN,
+		SLAP_CTRL_SEARCH, NULL, mdb_explain_parse, &mdb_explain_cid );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"mdb_explain_init: failed to register control (%d)\n",
+			rc, 0, 0 );
+	}
+	return rc;
+}
+
+mdb_explain *
+mdb_explain_get( Operation *op )
+{
+	if ( op->o_ctrlflag[mdb_explain_cid] <= SLAP_CONTROL_IGNORED )
+		return NULL;
+	return op->o_controls[mdb_explain_cid];
+}
+
+static unsigned long
+mdb_explain_usec( struct timeval *tv )
+{
+	struct timeval now;
+	unsigned long usec;
+
+	gettimeofday( &now, NULL );
+	usec = ( now.tv_sec - tv->tv_sec ) * 1000000L +
+		now.tv_usec - tv->tv_usec;
+	*tv = now;
+	return usec;
+}
+
+/* Charge the time since the last phase change to the current phase
+ * and switch to the given one.
+ */
+void
+mdb_explain_phase( mdb_explain *ex, int phase )
+{
+	unsigned long usec = mdb_explain_usec( &ex->me_tv );
+
+	if ( ex->me_phase < MDB_EXPLAIN_NPHASES )
+		ex->me_usec[ex->me_phase] += usec;
+	ex->me_phase = phase;
+}
+
+/* Bracket one scope check of the candidate loop */
+void
+mdb_explain_scope_begin( mdb_explain *ex )
+{
+	gettimeofday( &ex->me_scopetv, NULL );
+}
+
+void
+mdb_explain_scope_end( mdb_explain *ex )
+{
+	ex->me_scopechecks++;
+	ex->me_scopeusec += mdb_explain_usec( &ex->me_scopetv );
+}
+
+void
+mdb_explain_start( Operation *op, mdb_explain *ex )
+{
+	memset( ex, 0, sizeof( *ex ));
+	ex->me_cur = -1;
+	ex->me_last = -1;
+	ex->me_phase = MDB_EXPLAIN_BASE;
+	gettimeofday( &ex->me_tv, NULL );
+}
+
+void
+mdb_explain_end( Operation *op, mdb_explain *ex )
+{
+	int i;
+
+	for ( i = 0; i < ex->me_nsteps; i++ )
+		op->o_tmpfree( ex->me_steps[i].es_filter.bv_val, op->o_tmpmemctx );
+	if ( ex->me_steps )
+		op->o_tmpfree( ex->me_steps, op->o_tmpmemctx );
+	ex->me_steps = NULL;
+	ex->me_nsteps = 0;
+}
+
+/* Start a step for filter f, or for a pseudo-component named by
+ * label. Returns the slot to pass to mdb_explain_leave(), -1 if
+ * the step is not recorded.
+ */
+int
+mdb_explain_enter( Operation *op, Filter *f, const char *label )
+{
+	mdb_explain *ex = mdb_explain_get( op );
+	mdb_explain_step *es;
+	struct berval bv;
+	int list = 0;
+
+	if ( !ex )
+		return -1;
+	if ( ex->me_nsteps >= MDB_EXPLAIN_MAXSTEPS ) {
+		ex->me_depth++;
+		ex->me_cur = -1;
+		return -1;
+	}
+
+	if ( ex->me_nsteps == ex->me_maxsteps ) {
+		ex->me_maxsteps = ex->me_maxsteps ? ex->me_maxsteps * 2 : 16;
+		ex->me_steps = op->o_tmprealloc( ex->me_steps,
+			ex->me_maxsteps * sizeof( mdb_explain_step ), op->o_tmpmemctx );
+	}
+
+	if ( label ) {
+		ber_str2bv_x( label, 0, 1, &bv, op->o_tmpmemctx );
+	} else {
+		switch ( f->f_choice ) {
+		case LDAP_FILTER_AND:
+			ber_str2bv_x( "AND", STRLENOF("AND"), 1, &bv, op->o_tmpmemctx );
+			list = 1;
+			break;
+		case LDAP_FILTER_OR:
+			ber_str2bv_x( "OR", STRLENOF("OR"), 1, &bv, op->o_tmpmemctx );
+			list = 1;
+			break;
+		case LDAP_FILTER_NOT:
+			ber_str2bv_x( "NOT", STRLENOF("NOT"), 1, &bv, op->o_tmpmemctx );
+			list = 1;
+			break;
+		default:
+			filter2bv_x( op, f, &bv );
+			if ( bv.bv_len > MDB_EXPLAIN_MAXFILTER ) {
+				bv.bv_len = MDB_EXPLAIN_MAXFILTER;
+				strcpy( bv.bv_val + bv.bv_len - STRLENOF("..."), "..." );
+				bv.bv_val[bv.bv_len] = '\0';
+			}
+			break;
+		}
+	}
+
+	es = &ex->me_steps[ex->me_nsteps];
+	memset( es, 0, sizeof( *es ));
+	es->es_depth = ex->me_depth++;
+	es->es_filter = bv;
+	es->es_list = list;
+	ex->me_cur = ex->me_nsteps;
+	return ex->me_nsteps++;
+}
+
+/* Record the candidates produced by the step in slot */
+void
+mdb_explain_leave( Operation *op, int slot, ID *ids )
+{
+	mdb_explain *ex = mdb_explain_get( op );
+	mdb_explain_step *es;
+
+	if ( !ex )
+		return;
+	ex->me_depth--;
+	ex->me_last = slot;
+	if ( slot < 0 )
+		return;
+
+	es = &ex->me_steps[slot];
+	es->es_range = MDB_IDL_IS_RANGE( ids );
+	es->es_count = MDB_IDL_N( ids );
+	es->es_first = MDB_IDL_FIRST( ids );
+	es->es_last = MDB_IDL_LAST( ids );
+	if ( es->es_range && es->es_last == NOID )
+		es->es_count = NOID;
+}
+
+/* Note which index the current step read */
+void
+mdb_explain_index( Operation *op, const char *index )
+{
+	mdb_explain *ex = mdb_explain_get( op );
+
+	if ( ex && ex->me_cur >= 0 )
+		ex->me_steps[ex->me_cur].es_index = index;
+}
+
+/* Note the candidates of a list after the last step was merged in */
+void
+mdb_explain_merge( Operation *op, ID *ids )
+{
+	mdb_explain *ex = mdb_explain_get( op );
+
+	if ( ex && ex->me_last >= 0 ) {
+		ex->me_steps[ex->me_last].es_after = MDB_IDL_N( ids );
+		ex->me_steps[ex->me_last].es_merged = 1;
+	}
+}
+
+static void
+mdb_explain_cat( Operation *op, struct berval *bv, const char *fmt, ... )
+{
+	char buf[MDB_EXPLAIN_MAXFILTER + 256];
+	va_list ap;
+	int len;
+
+	va_start( ap, fmt );
+	len = vsnprintf( buf, sizeof( buf ), fmt, ap );
+	va_end( ap );
+	if ( len < 0 )
+		return;
+	if ( len >= sizeof( buf ))
+		len = sizeof( buf ) - 1;
+
+	bv->bv_val = op->o_tmprealloc( bv->bv_val, bv->bv_len + len + 1,
+		op->o_tmpmemctx );
+	AC_MEMCPY( bv->bv_val + bv->bv_len, buf, len + 1 );
+	bv->bv_len += len;
+}
+
+static void
+mdb_explain_count( char *buf, size_t len, ID n )
+{
+	if ( n == NOID )
+		snprintf( buf, len, "all" );
+	else
+		snprintf( buf, len, "%lu", (unsigned long) n );
+}
+
+/* Add the plan to the controls of the response about to be sent */
+void
+mdb_explain_response( Operation *op, SlapReply *rs, mdb_explain *ex )
+{
+	LDAPControl *ctrls[2], *ctrl;
+	struct berval bv = BER_BVNULL;
+	char cnt[32], after[32], index[32];
+	unsigned long total = 0;
+	int i;
+
+	mdb_explain_phase( ex, MDB_EXPLAIN_NPHASES );
+
+	if ( ex->me_reused ) {
+		mdb_explain_cat( op, &bv, "filter: candidates reused from "
+			"the previous page\n" );
+	} else if ( ex->me_nsteps ) {
+		mdb_explain_cat( op, &bv, "filter:\n" );
+	}
+	for ( i = 0; i < ex->me_nsteps; i++ ) {
+		mdb_explain_step *es = &ex->me_steps[i];
+
+		mdb_explain_count( cnt, sizeof( cnt ), es->es_count );
+		after[0] = '\0';
+		if ( es->es_merged ) {
+			strcpy( after, " after=" );
+			mdb_explain_count( after + STRLENOF(" after="),
+				sizeof( after ) - STRLENOF(" after="), es->es_after );
+		}
+		index[0] = '\0';
+		if ( !es->es_list ) {
+			snprintf( index, sizeof( index ), " index=%s",
+				es->es_index ? es->es_index : "none" );
+		}
+		mdb_explain_cat( op, &bv, "%*s%s%s candidates=%s%s%s\n",
+			2 * ( es->es_depth + 1 ), "", es->es_filter.bv_val,
+			index, cnt,
+			es->es_range && es->es_count != NOID ? " range" : "",
+			after );
+	}
+	if ( ex->me_nsteps == MDB_EXPLAIN_MAXSTEPS )
+		mdb_explain_cat( op, &bv, "  ...\n" );
+
+	mdb_explain_count( cnt, sizeof( cnt ), ex->me_ncand );
+	mdb_explain_cat( op, &bv, "candidates: %s%s\n", cnt,
+		ex->me_crange ? " range" : "" );
+	mdb_explain_cat( op, &bv, "scope: %s checks=%lu time=%luus\n",
+		ex->me_scope ? ex->me_scope : "none",
+		ex->me_scopechecks, ex->me_scopeusec );
+	mdb_explain_cat( op, &bv, "entries: decoded=%lu matched=%lu returned=%d\n",
+		ex->me_decoded, ex->me_matched, rs->sr_nentries );
+	for ( i = 0; i < MDB_EXPLAIN_NPHASES; i++ )
+		total += ex->me_usec[i];
+	mdb_explain_cat( op, &bv, "time: base=%luus candidates=%luus "
+		"entries=%luus total=%luus\n",
+		ex->me_usec[MDB_EXPLAIN_BASE],
+		ex->me_usec[MDB_EXPLAIN_CANDIDATES],
+		ex->me_usec[MDB_EXPLAIN_ENTRIES], total );
+
+	/* control and value in one block, freed with the response */
+	ctrl = op->o_tmpalloc( sizeof( LDAPControl ) + bv.bv_len + 1,
+		op->o_tmpmemctx );
+	ctrl->ldctl_oid = LDAP_CONTROL_X_EXPLAIN;
+	ctrl->ldctl_iscritical = 0;
+	ctrl->ldctl_value.bv_val = (char *)( ctrl + 1 );
+	ctrl->ldctl_value.bv_len = bv.bv_len;
+	AC_MEMCPY( ctrl->ldctl_value.bv_val, bv.bv_val, bv.bv_len + 1 );
+	op->o_tmpfree( bv.bv_val, op->o_tmpmemctx );
+
+	ctrls[0] = ctrl;
+	ctrls[1] = NULL;
+	slap_add_ctrls( op, rs, ctrls );
+}
@@ -36,7 +36,8 @@ static int equality_candidates(
 	MDB_txn *rtxn,
 	AttributeAssertion *ava,
 	ID *ids,
-	ID *tmp );
+	ID *tmp,
+	ID *stack );
 static int inequality_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -49,7 +50,8 @@ static int approx_candidates(
 	MDB_txn *rtxn,
 	AttributeAssertion *ava,
 	ID *ids,
-	ID *tmp );
+	ID *tmp,
+	ID *stack );
 static int substring_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
@@ -106,12 +108,14 @@ mdb_filter_candidates(
 	ID *tmp,
 	ID *stack )
 {
-	int rc = 0;
+	int rc = 0, slot;
 #ifdef LDAP_COMP_MATCH
 	AttributeAliasing *aa;
 #endif
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_filter_candidates\n", 0, 0, 0 );
 
+	slot = mdb_explain_enter( op, f, NULL );
+
 	if ( f->f_choice & SLAPD_FILTER_UNDEFINED ) {
 		MDB_IDL_ZERO( ids );
 		goto out;
@@ -150,13 +154,13 @@ mdb_filter_candidates(
 		else
 #endif
 		{
-			rc = equality_candidates( op, rtxn, f->f_ava, ids, tmp );
+			rc = equality_candidates( op, rtxn, f->f_ava, ids, tmp, stack );
 		}
 		break;
 
 	case LDAP_FILTER_APPROX:
 		Debug( LDAP_DEBUG_FILTER, "\tAPPROX\n", 0, 0, 0 );
-		rc = approx_candidates( op, rtxn, f->f_ava, ids, tmp );
+		rc = approx_candidates( op, rtxn, f->f_ava, ids, tmp, stack );
 		break;
 
 	case LDAP_FILTER_SUBSTRINGS:
@@ -238,6 +242,8 @@ mdb_filter_candidates(
 	}
 
 out:
+	mdb_explain_leave( op, slot, ids );
+
 	Debug( LDAP_DEBUG_FILTER,
 		"<= mdb_filter_candidates: id=%ld first=%ld last=%ld\n",
 		(long) ids[0],
@@ -558,6 +564,121 @@ base:
 	return 0;
 }
 
+/* Look for a composite index covering equality terms of an AND
+ * list. If one applies, ids gets its candidates, used gets the
+ * covered terms, and the number of covered terms is returned.
+ */
+static int
+composite_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	Filter	*flist,
+	ID *ids,
+	ID *tmp,
+	Filter **used )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	CompInfo *ci = NULL;
+	Filter *terms[MDB_COMP_MAXATTRS];
+	BerVarray ckeys[MDB_COMP_MAXATTRS];
+	struct berval *keys = NULL;
+	Filter *f;
+	int i, j, rc, slot, nused = 0;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *c2 = mdb->mi_comps[i];
+
+		if ( !IS_SLAP_INDEX( c2->ci_indexmask, SLAP_INDEX_EQUALITY ) ||
+			( ci && ci->ci_nattrs >= c2->ci_nattrs ))
+			continue;
+
+		for ( j = 0; j < c2->ci_nattrs; j++ ) {
+			for ( f = flist; f != NULL; f = f->f_next ) {
+				if ( f->f_choice == LDAP_FILTER_EQUALITY &&
+					f->f_av_desc == c2->ci_descs[j] )
+					break;
+			}
+			if ( !f )
+				break;
+			terms[j] = f;
+		}
+		if ( j == c2->ci_nattrs ) {
+			ci = c2;
+			for ( j = 0; j < ci->ci_nattrs; j++ )
+				used[j] = terms[j];
+		}
+	}
+	if ( !ci )
+		return 0;
+
+	for ( j = 0; j < ci->ci_nattrs; j++ )
+		ckeys[j] = NULL;
+
+	for ( j = 0; j < ci->ci_nattrs; j++ ) {
+		AttributeDescription *ad = ci->ci_descs[j];
+		MatchingRule *mr = ad->ad_type->sat_equality;
+
+		rc = (mr->smr_filter)(
+			LDAP_FILTER_EQUALITY,
+			SLAP_INDEX_EQUALITY,
+			ad->ad_type->sat_syntax,
+			mr,
+			&ad->ad_cname,
+			&used[j]->f_av_value,
+			&ckeys[j], op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || ckeys[j] == NULL )
+			goto done;
+	}
+
+	rc = mdb_comp_keys( op, ci, ckeys, &keys );
+	if ( rc != LDAP_SUCCESS || keys == NULL )
+		goto done;
+
+	slot = mdb_explain_enter( op, NULL, ci->ci_name.bv_val );
+	mdb_explain_index( op, "composite" );
+
+	for ( i = 0; keys[i].bv_val != NULL; i++ ) {
+		rc = mdb_key_read( op->o_bd, rtxn, ci->ci_dbi, &keys[i], tmp, NULL, 0 );
+
+		if ( rc == MDB_NOTFOUND ) {
+			MDB_IDL_ZERO( ids );
+			rc = 0;
+			break;
+		} else if ( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= mdb_composite_candidates: (%s) "
+				"key read failed (%d)\n",
+				ci->ci_name.bv_val, rc, 0 );
+			break;
+		}
+
+		if ( i == 0 ) {
+			MDB_IDL_CPY( ids, tmp );
+		} else {
+			mdb_idl_intersection( ids, tmp );
+		}
+
+		if( MDB_IDL_IS_ZERO( ids ) )
+			break;
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc == LDAP_SUCCESS )
+		nused = ci->ci_nattrs;
+	mdb_explain_leave( op, slot, ids );
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_composite_candidates: (%s) id=%ld, first=%ld\n",
+		ci->ci_name.bv_val, (long) ids[0],
+		(long) MDB_IDL_FIRST(ids) );
+
+done:
+	for ( j = 0; j < ci->ci_nattrs; j++ ) {
+		if ( ckeys[j] )
+			ber_bvarray_free_x( ckeys[j], op->o_tmpmemctx );
+	}
+	return nused;
+}
+
 static int
 list_candidates(
 	Operation *op,
@@ -570,14 +691,28 @@ list_candidates(
 {
 	int rc = 0;
 	Filter	*f;
+	Filter	*used[MDB_COMP_MAXATTRS];
+	int i, nused = 0;
 
 	Debug( LDAP_DEBUG_FILTER, "=> mdb_list_candidates 0x%x\n", ftype, 0, 0 );
+
+	/* One composite key lookup replaces several equality lookups */
+	if ( ftype == LDAP_FILTER_AND ) {
+		nused = composite_candidates( op, rtxn, flist, ids, tmp, used );
+		if ( nused && MDB_IDL_IS_ZERO( ids ))
+			goto done;
+	}
+
 	for ( f = flist; f != NULL; f = f->f_next ) {
 		/* ignore precomputed scopes */
 		if ( f->f_choice == SLAPD_FILTER_COMPUTED &&
 		     f->f_result == LDAP_SUCCESS ) {
 			continue;
 		}
+		/* skip terms already covered by a composite index */
+		for ( i = 0; i < nused && used[i] != f; i++ ) ;
+		if ( i < nused )
+			continue;
 		MDB_IDL_ZERO( save );
 		rc = mdb_filter_candidates( op, rtxn, f, save, tmp,
 			save+MDB_IDL_UM_SIZE );
@@ -592,11 +727,12 @@ list_candidates(
 
 		
 		if ( ftype == LDAP_FILTER_AND ) {
-			if ( f == flist ) {
+			if ( f == flist && !nused ) {
 				MDB_IDL_CPY( ids, save );
 			} else {
 				mdb_idl_intersection( ids, save );
 			}
+			mdb_explain_merge( op, ids );
 			if( MDB_IDL_IS_ZERO( ids ) )
 				break;
 		} else {
@@ -605,9 +741,11 @@ list_candidates(
 			} else {
 				mdb_idl_union( ids, save );
 			}
+			mdb_explain_merge( op, ids );
 		}
 	}
 
+done:
 	if( rc == LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_FILTER,
 			"<= mdb_list_candidates: id=%ld first=%ld last=%ld\n",
@@ -671,6 +809,7 @@ presence_candidates(
 		return -1;
 	}
 
+	mdb_explain_index( op, "pres" );
 	rc = mdb_key_read( op->o_bd, rtxn, dbi, &prefix, ids, NULL, 0 );
 
 	if( rc == MDB_NOTFOUND ) {
@@ -694,13 +833,73 @@ done:
 	return rc;
 }
 
+/* Narrow the hashed candidates in ids to the entries keyed by the ID
+ * of the entry named by dn, plus those keyed under ID 0 because a DN
+ * they hold did not name an entry when they were indexed or has been
+ * deleted or renamed since. Together these cover every entry holding
+ * dn, so the result stays a superset of the real matches. Nothing is
+ * narrowed once a subtree rename has marked the index stale.
+ */
+static int
+entryid_candidates(
+	Operation *op,
+	MDB_txn *rtxn,
+	MDB_dbi dbi,
+	struct berval *dn,
+	ID *ids,
+	ID *tmp,
+	ID *stack )
+{
+	struct berval key;
+	char kbuf[MDB_ENTRYID_KEYLEN];
+	ID rid;
+	int rc;
+
+	if ( MDB_IDL_IS_ZERO( ids ) )
+		return 0;
+
+	mdb_entryid_key( NOID, kbuf, &key );
+	rc = mdb_key_read( op->o_bd, rtxn, dbi, &key, tmp, NULL, 0 );
+	if ( rc != MDB_NOTFOUND )
+		return rc;
+
+	mdb_entryid_key( 0, kbuf, &key );
+	rc = mdb_key_read( op->o_bd, rtxn, dbi, &key, tmp, NULL, 0 );
+	if ( rc == MDB_NOTFOUND )
+		MDB_IDL_ZERO( tmp );
+	else if ( rc != LDAP_SUCCESS )
+		return rc;
+
+	rc = mdb_dn2id( op, rtxn, NULL, dn, &rid, NULL, NULL, NULL );
+	if ( rc == MDB_SUCCESS ) {
+		mdb_entryid_key( rid, kbuf, &key );
+		rc = mdb_key_read( op->o_bd, rtxn, dbi, &key, stack, NULL, 0 );
+		if ( rc == LDAP_SUCCESS )
+			mdb_idl_union( tmp, stack );
+	}
+	if ( rc == MDB_NOTFOUND )
+		rc = 0;
+	if ( rc != LDAP_SUCCESS )
+		return rc;
+
+	mdb_idl_intersection( ids, tmp );
+
+	Debug( LDAP_DEBUG_TRACE,
+		"<= mdb_entryid_candidates: id=%ld, first=%ld, last=%ld\n",
+		(long) ids[0],
+		(long) MDB_IDL_FIRST(ids),
+		(long) MDB_IDL_LAST(ids) );
+	return rc;
+}
+
 static int
 equality_candidates(
 	Operation *op,
 	MDB_txn *rtxn,
 	AttributeAssertion *ava,
 	ID *ids,
-	ID *tmp )
+	ID *tmp,
+	ID *stack )
 {
 	MDB_dbi	dbi;
 	int i;
@@ -715,6 +914,7 @@ equality_candidates(
 
 	if ( ava->aa_desc == slap_schema.si_ad_entryDN ) {
 		ID id;
+		mdb_explain_index( op, "dn2id" );
 		rc = mdb_dn2id( op, rtxn, NULL, &ava->aa_value, &id, NULL, NULL, NULL );
 		if ( rc == LDAP_SUCCESS ) {
 			/* exactly one ID can match */
@@ -781,6 +981,8 @@ equality_candidates(
 		return 0;
 	}
 
+	mdb_explain_index( op, ( mask & MDB_INDEX_ENTRYID ) ? "eq,entryid" : "eq" );
+
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
 
@@ -816,6 +1018,9 @@ equality_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == LDAP_SUCCESS && ( mask & MDB_INDEX_ENTRYID ))
+		rc = entryid_candidates( op, rtxn, dbi, &ava->aa_value, ids, tmp, stack );
+
 	Debug( LDAP_DEBUG_TRACE,
 		"<= mdb_equality_candidates: id=%ld, first=%ld, last=%ld\n",
 		(long) ids[0],
@@ -831,7 +1036,8 @@ approx_candidates(
 	MDB_txn *rtxn,
 	AttributeAssertion *ava,
 	ID *ids,
-	ID *tmp )
+	ID *tmp,
+	ID *stack )
 {
 	MDB_dbi	dbi;
 	int i;
@@ -902,6 +1108,8 @@ approx_candidates(
 		return 0;
 	}
 
+	mdb_explain_index( op, "approx" );
+
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
 
@@ -937,6 +1145,9 @@ approx_candidates(
 
 	ber_bvarray_free_x( keys, op->o_tmpmemctx );
 
+	if ( rc == LDAP_SUCCESS && ( mask & MDB_INDEX_ENTRYID ))
+		rc = entryid_candidates( op, rtxn, dbi, &ava->aa_value, ids, tmp, stack );
+
 	Debug( LDAP_DEBUG_TRACE, "<= mdb_approx_candidates %ld, first=%ld, last=%ld\n",
 		(long) ids[0],
 		(long) MDB_IDL_FIRST(ids),
@@ -1017,6 +1228,8 @@ substring_candidates(
 		return 0;
 	}
 
+	mdb_explain_index( op, "sub" );
+
 	for ( i= 0; keys[i].bv_val != NULL; i++ ) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[i], tmp, NULL, 0 );
 
@@ -1132,6 +1345,7 @@ inequality_candidates(
 		return 0;
 	}
 
+	mdb_explain_index( op, "ordered" );
 	MDB_IDL_ZERO( ids );
 	while(1) {
 		rc = mdb_key_read( op->o_bd, rtxn, dbi, &keys[0], tmp, &cursor, gtorlt );
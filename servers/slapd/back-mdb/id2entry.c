@@ -280,7 +280,7 @@ int mdb_entry_release(
 		OpExtra *oex;
 		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
 			release = 0;
-			if ( oex->oe_key == mdb ) {
+			if ( oex->oe_key == mdb->mi_dbenv ) {
 				mdb_entry_return( op, e );
 				moi = (mdb_op_info *)oex;
 				/* If it was setup by entry_get we should probably free it */
@@ -427,9 +427,12 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 		ctx = ldap_pvt_thread_pool_context();
 	}
 
+	/* Keyed by environment: databases sharing one must also share
+	 * the txn, LMDB allows only one per thread.
+	 */
 	if ( op ) {
 		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
-			if ( oex->oe_key == mdb ) break;
+			if ( oex->oe_key == mdb->mi_dbenv ) break;
 		}
 		moi = (mdb_op_info *)oex;
 	}
@@ -447,7 +450,7 @@ mdb_opinfo_get( Operation *op, struct mdb_info *mdb, int rdonly, mdb_op_info **m
 			*moip = moi;
 		}
 		LDAP_SLIST_INSERT_HEAD( &op->o_extra, &moi->moi_oe, oe_next );
-		moi->moi_oe.oe_key = mdb;
+		moi->moi_oe.oe_key = mdb->mi_dbenv;
 		moi->moi_ref = 0;
 		moi->moi_txn = NULL;
 	}
@@ -536,9 +539,24 @@ ok:
 int mdb_txn( Operation *op, int txnop, OpExtra **ptr )
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
-	mdb_op_info **moip = (mdb_op_info **)ptr, *moi = *moip;
+	mdb_op_info **moip = (mdb_op_info **)ptr, *moi;
+	OpExtra *oex;
 	int rc;
 
+	if ( txnop == SLAP_TXN_JOIN ) {
+		/* Databases sharing our environment share the op's write txn */
+		LDAP_SLIST_FOREACH( oex, &op->o_extra, oe_next ) {
+			if ( oex->oe_key == mdb->mi_dbenv ) {
+				moi = (mdb_op_info *)oex;
+				if ( moi->moi_txn && !( moi->moi_flag & MOI_READER ))
+					return 0;
+				break;
+			}
+		}
+		return LDAP_OTHER;
+	}
+
+	moi = *moip;
 	switch( txnop ) {
 	case SLAP_TXN_BEGIN:
 		return mdb_opinfo_get( op, mdb, 0, moip );
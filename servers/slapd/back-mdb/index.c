@@ -23,6 +23,7 @@
 
 #include "slap.h"
 #include "back-mdb.h"
+#include "idl.h"
 #include "lutil_hash.h"
 
 static char presence_keyval[] = {0,0,0,0,0};
@@ -161,6 +162,127 @@ done:
 	return LDAP_SUCCESS;
 }
 
+/* Build the equality key for a referenced entry's ID */
+void mdb_entryid_key( ID id, char *buf, struct berval *key )
+{
+	memset( buf, 0, sizeof(ID) );
+	buf[0] = MDB_ENTRYID_PREFIX;
+	MDB_ID2DISK( id, buf+sizeof(ID) );
+	key->bv_val = buf;
+	key->bv_len = MDB_ENTRYID_KEYLEN;
+}
+
+/* Key DN values by the ID of the entry they name. Values that don't
+ * name an entry of this database go under the ID 0 key, so that the
+ * ID keys and the ID 0 key together cover every entry holding a
+ * value. The values are hashed as usual by the caller as well.
+ */
+static int entryid_indexer(
+	Operation *op,
+	MDB_txn *txn,
+	MDB_cursor *mc,
+	mdb_idl_keyfunc *keyfunc,
+	BerVarray vals,
+	ID id )
+{
+	struct berval key[2];
+	char kbuf[MDB_ENTRYID_KEYLEN];
+	int i, rc;
+
+	BER_BVZERO( &key[1] );
+	for ( i = 0; !BER_BVISNULL( &vals[i] ); i++ ) {
+		ID rid;
+
+		if ( mdb_dn2id( op, txn, NULL, &vals[i], &rid,
+			NULL, NULL, NULL ) != MDB_SUCCESS )
+			rid = 0;
+		mdb_entryid_key( rid, kbuf, &key[0] );
+		rc = keyfunc( op->o_bd, mc, key, id );
+		if ( rc )
+			return rc;
+	}
+	return 0;
+}
+
+/* An entry that is deleted or renamed no longer owns its DN, so the
+ * entries referring to it are moved from its ID key to the ID 0 key.
+ * If that is not feasible (a range IDL, or a subtree rename changing
+ * the DNs of all the descendants too) the index is marked stale
+ * instead, and entryid candidates fall back to the hashed keys until
+ * the attribute is reindexed.
+ */
+int
+mdb_entryid_release(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	int stale )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	struct berval key[2];
+	char kbuf[MDB_ENTRYID_KEYLEN], zbuf[MDB_ENTRYID_KEYLEN];
+	MDB_cursor *mc;
+	MDB_val mkey;
+	ID *ids = NULL, i;
+	int j, rc = 0;
+
+	BER_BVZERO( &key[1] );
+	for ( j = 0; j < mdb->mi_nattrs; j++ ) {
+		AttrInfo *ai = mdb->mi_attrs[j];
+		slap_mask_t mask = ai->ai_newmask ? ai->ai_newmask : ai->ai_indexmask;
+
+		if ( !( mask & MDB_INDEX_ENTRYID ) || !ai->ai_dbi )
+			continue;
+
+		rc = mdb_cursor_open( txn, ai->ai_dbi, &mc );
+		if ( rc )
+			break;
+
+		if ( !stale ) {
+			if ( !ids )
+				ids = op->o_tmpalloc( MDB_IDL_DB_SIZE * sizeof(ID),
+					op->o_tmpmemctx );
+			mdb_entryid_key( id, kbuf, &key[0] );
+			rc = mdb_key_read( op->o_bd, txn, ai->ai_dbi, &key[0], ids, NULL, 0 );
+			if ( rc == MDB_NOTFOUND ) {
+				rc = 0;
+				mdb_cursor_close( mc );
+				continue;
+			}
+			if ( rc == 0 && !MDB_IDL_IS_RANGE( ids )) {
+				mdb_entryid_key( 0, zbuf, &key[0] );
+				for ( i = 1; i <= ids[0] && !rc; i++ )
+					rc = mdb_idl_insert_keys( op->o_bd, mc, key, ids[i] );
+				if ( rc == 0 ) {
+					mkey.mv_data = kbuf;
+					mkey.mv_size = sizeof(kbuf);
+					rc = mdb_del( txn, ai->ai_dbi, &mkey, NULL );
+				}
+				mdb_cursor_close( mc );
+				if ( rc )
+					break;
+				continue;
+			}
+			if ( rc ) {
+				mdb_cursor_close( mc );
+				break;
+			}
+		}
+
+		Debug( LDAP_DEBUG_TRACE, "mdb_entryid_release: "
+			"marking %s index stale for id=%ld\n",
+			ai->ai_desc->ad_cname.bv_val, (long) id, 0 );
+		mdb_entryid_key( NOID, kbuf, &key[0] );
+		rc = mdb_idl_insert_keys( op->o_bd, mc, key, id );
+		mdb_cursor_close( mc );
+		if ( rc )
+			break;
+	}
+	if ( ids )
+		op->o_tmpfree( ids, op->o_tmpmemctx );
+	return rc;
+}
+
 static int indexer(
 	Operation *op,
 	MDB_txn *txn,
@@ -209,6 +331,14 @@ static int indexer(
 		}
 	}
 
+	if ( mask & MDB_INDEX_ENTRYID ) {
+		rc = entryid_indexer( op, txn, mc, keyfunc, vals, id );
+		if ( rc ) {
+			err = "entryid";
+			goto done;
+		}
+	}
+
 	if( IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ) ) {
 		rc = ad->ad_type->sat_equality->smr_indexer(
 			LDAP_FILTER_EQUALITY,
@@ -282,6 +412,224 @@ done:
 	return rc;
 }
 
+/* Composite keys longer than this are hashed down */
+#define MDB_COMP_MAXKEYLEN	64
+
+/* Build the keys for a composite index: the cartesian product of the
+ * per-attribute equality keys in ckeys, each product concatenated in
+ * configured attribute order.
+ */
+int mdb_comp_keys(
+	Operation *op,
+	CompInfo *ci,
+	BerVarray *ckeys,
+	BerVarray *keysp )
+{
+	int i, n[MDB_COMP_MAXATTRS], pos[MDB_COMP_MAXATTRS];
+	unsigned long k, nkeys = 1;
+	BerVarray keys;
+
+	*keysp = NULL;
+	for ( i = 0; i < ci->ci_nattrs; i++ ) {
+		if ( ckeys[i] == NULL )
+			return LDAP_SUCCESS;
+		for ( n[i] = 0; !BER_BVISNULL( &ckeys[i][n[i]] ); n[i]++ ) ;
+		if ( !n[i] )
+			return LDAP_SUCCESS;
+		nkeys *= n[i];
+		pos[i] = 0;
+	}
+
+	keys = op->o_tmpalloc( ( nkeys + 1 ) * sizeof(struct berval),
+		op->o_tmpmemctx );
+	for ( k = 0; k < nkeys; k++ ) {
+		ber_len_t len = 0;
+		char *ptr;
+
+		for ( i = 0; i < ci->ci_nattrs; i++ )
+			len += ckeys[i][pos[i]].bv_len;
+		ptr = op->o_tmpalloc( len + 1, op->o_tmpmemctx );
+		keys[k].bv_val = ptr;
+		for ( i = 0; i < ci->ci_nattrs; i++ ) {
+			AC_MEMCPY( ptr, ckeys[i][pos[i]].bv_val, ckeys[i][pos[i]].bv_len );
+			ptr += ckeys[i][pos[i]].bv_len;
+		}
+		if ( len > MDB_COMP_MAXKEYLEN ) {
+			lutil_HASH_CTX ctx;
+			unsigned char digest[LUTIL_HASH_BYTES];
+
+			lutil_HASHInit( &ctx );
+			lutil_HASHUpdate( &ctx, (unsigned char *)keys[k].bv_val, len );
+			lutil_HASHFinal( digest, &ctx );
+			AC_MEMCPY( keys[k].bv_val, digest, sizeof(digest) );
+			len = sizeof(digest);
+		}
+		keys[k].bv_len = len;
+
+		/* next combination */
+		for ( i = ci->ci_nattrs - 1; i >= 0; i-- ) {
+			if ( ++pos[i] < n[i] )
+				break;
+			pos[i] = 0;
+		}
+	}
+	BER_BVZERO( &keys[nkeys] );
+	*keysp = keys;
+	return LDAP_SUCCESS;
+}
+
+static int comp_indexer(
+	Operation *op,
+	MDB_txn *txn,
+	CompInfo *ci,
+	Attribute *attrs,
+	ID id,
+	int opid )
+{
+	BerVarray ckeys[MDB_COMP_MAXATTRS];
+	struct berval *keys = NULL;
+	MDB_cursor *mc;
+	int i, rc = LDAP_SUCCESS;
+
+	for ( i = 0; i < ci->ci_nattrs; i++ )
+		ckeys[i] = NULL;
+
+	for ( i = 0; i < ci->ci_nattrs; i++ ) {
+		AttributeDescription *ad = ci->ci_descs[i];
+		MatchingRule *mr = ad->ad_type->sat_equality;
+		Attribute *a;
+		BerVarray vals;
+		int nvals = 0;
+
+		/* Subtypes and tagged values match the filter too */
+		for ( a = attrs_find( attrs, ad ); a; a = attrs_find( a->a_next, ad ))
+			nvals += a->a_numvals;
+		if ( !nvals )
+			goto done;
+
+		vals = op->o_tmpalloc( ( nvals + 1 ) * sizeof(struct berval),
+			op->o_tmpmemctx );
+		nvals = 0;
+		for ( a = attrs_find( attrs, ad ); a; a = attrs_find( a->a_next, ad )) {
+			AC_MEMCPY( &vals[nvals], a->a_nvals,
+				a->a_numvals * sizeof(struct berval) );
+			nvals += a->a_numvals;
+		}
+		BER_BVZERO( &vals[nvals] );
+
+		rc = mr->smr_indexer( LDAP_FILTER_EQUALITY, SLAP_INDEX_EQUALITY,
+			ad->ad_type->sat_syntax, mr, &ad->ad_cname,
+			vals, &ckeys[i], op->o_tmpmemctx );
+		op->o_tmpfree( vals, op->o_tmpmemctx );
+		if ( rc != LDAP_SUCCESS || ckeys[i] == NULL ) {
+			rc = LDAP_SUCCESS;
+			goto done;
+		}
+	}
+
+	rc = mdb_comp_keys( op, ci, ckeys, &keys );
+	if ( rc || keys == NULL )
+		goto done;
+
+	rc = mdb_cursor_open( txn, ci->ci_dbi, &mc );
+	if ( rc == 0 ) {
+		if ( opid == SLAP_INDEX_ADD_OP )
+			rc = mdb_idl_insert_keys( op->o_bd, mc, keys, id );
+		else
+			rc = mdb_idl_delete_keys( op->o_bd, mc, keys, id );
+		mdb_cursor_close( mc );
+	}
+	ber_bvarray_free_x( keys, op->o_tmpmemctx );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "comp_indexer: %s failed: %s (%d)\n",
+			ci->ci_name.bv_val, mdb_strerror(rc), rc );
+		rc = LDAP_OTHER;
+	}
+
+done:
+	for ( i = 0; i < ci->ci_nattrs; i++ ) {
+		if ( ckeys[i] )
+			ber_bvarray_free_x( ckeys[i], op->o_tmpmemctx );
+	}
+	return rc;
+}
+
+/* Maintain all composite indexes for the given attributes */
+int mdb_index_comps(
+	Operation *op,
+	MDB_txn *txn,
+	Attribute *attrs,
+	ID id,
+	int opid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	int i, rc;
+	int ixop = opid;
+
+	if ( opid == MDB_INDEX_UPDATE_OP )
+		ixop = SLAP_INDEX_ADD_OP;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		slap_mask_t mask;
+
+		if ( opid == MDB_INDEX_UPDATE_OP )
+			mask = ci->ci_newmask & ~ci->ci_indexmask;
+		else
+			mask = ci->ci_newmask ? ci->ci_newmask : ci->ci_indexmask;
+		if ( !IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ))
+			continue;
+
+		rc = comp_indexer( op, txn, ci, attrs, id, ixop );
+		if ( rc )
+			return rc;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* Rebuild the composite keys of an entry whose attributes were modified.
+ * Only composites that contain a modified attribute are touched.
+ */
+int mdb_index_comps_mods(
+	Operation *op,
+	MDB_txn *txn,
+	Modifications *modlist,
+	Attribute *oldattrs,
+	Attribute *newattrs,
+	ID id )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	Modifications *ml;
+	int i, j, rc;
+
+	for ( i = 0; i < mdb->mi_ncomps; i++ ) {
+		CompInfo *ci = mdb->mi_comps[i];
+		slap_mask_t mask;
+
+		mask = ci->ci_newmask ? ci->ci_newmask : ci->ci_indexmask;
+		if ( !IS_SLAP_INDEX( mask, SLAP_INDEX_EQUALITY ))
+			continue;
+
+		for ( ml = modlist; ml != NULL; ml = ml->sml_next ) {
+			for ( j = 0; j < ci->ci_nattrs; j++ ) {
+				if ( is_ad_subtype( ml->sml_desc, ci->ci_descs[j] ))
+					break;
+			}
+			if ( j < ci->ci_nattrs )
+				break;
+		}
+		if ( !ml )
+			continue;
+
+		rc = comp_indexer( op, txn, ci, oldattrs, id, SLAP_INDEX_DELETE_OP );
+		if ( rc == LDAP_SUCCESS )
+			rc = comp_indexer( op, txn, ci, newattrs, id, SLAP_INDEX_ADD_OP );
+		if ( rc )
+			return rc;
+	}
+	return LDAP_SUCCESS;
+}
+
 static int index_at_values(
 	Operation *op,
 	MDB_txn *txn,
@@ -569,6 +917,26 @@ mdb_index_entry(
 		}
 	}
 
+	rc = mdb_index_comps( op, txn, e->e_attrs, e->e_id, opid );
+	if( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_TRACE,
+			"<= index_entry_%s( %ld, \"%s\" ) composite failure\n",
+			opid == SLAP_INDEX_ADD_OP ? "add" : "del",
+			(long) e->e_id, e->e_dn );
+		return rc;
+	}
+
+	/* A deleted entry's referrers no longer match through its ID */
+	if ( opid == SLAP_INDEX_DELETE_OP ) {
+		rc = mdb_entryid_release( op, txn, e->e_id, 0 );
+		if( rc != LDAP_SUCCESS ) {
+			Debug( LDAP_DEBUG_TRACE,
+				"<= index_entry_del( %ld, \"%s\" ) entryid failure\n",
+				(long) e->e_id, e->e_dn, 0 );
+			return rc;
+		}
+	}
+
 	Debug( LDAP_DEBUG_TRACE, "<= index_entry_%s( %ld, \"%s\" ) success\n",
 		opid == SLAP_INDEX_DELETE_OP ? "del" : "add",
 		(long) e->e_id, e->e_dn ? e->e_dn : "" );
@@ -34,6 +34,115 @@ static const struct berval mdmi_databases[] = {
 	BER_BVNULL
 };
 
+static const struct berval mdmi_dnhash = BER_BVC("dnhs");
+static const struct berval mdmi_idxstate = BER_BVC("ixst");
+
+/* All mdb databases, to find the ones configured in the same directory.
+ * They share one environment, each of them with its own set of subdbs.
+ */
+static struct mdb_info *mdb_dbs;
+static ldap_pvt_thread_mutex_t mdb_dbs_mutex;
+
+/* Do both paths name the same directory? "db", "./db" and "db/"
+ * all do, and so does a symlink to it.
+ */
+static int
+mdb_same_home( const char *h1, const char *h2 )
+{
+#ifndef _WIN32
+	struct stat st1, st2;
+#endif
+
+	if ( !strcmp( h1, h2 ))
+		return 1;
+#ifndef _WIN32
+	if ( stat( h1, &st1 ) == 0 && stat( h2, &st2 ) == 0 )
+		return st1.st_dev == st2.st_dev && st1.st_ino == st2.st_ino;
+#endif
+	return 0;
+}
+
+/* The environment-wide settings of a database sharing an environment
+ * opened by another one cannot be applied, say so if they differ.
+ */
+static void
+mdb_env_conflicts( BackendDB *be, unsigned int flags )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	MDB_envinfo mei;
+	unsigned int envflags;
+	const unsigned int mask = MDB_NOSYNC|MDB_NOMETASYNC|MDB_WRITEMAP|
+		MDB_MAPASYNC|MDB_NORDAHEAD|MDB_HUGEPAGE;
+
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	if ( mdb->mi_mapsize > mei.me_mapsize ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+			"maxsize exceeds the %lu bytes of the environment shared "
+			"in %s, not applied.\n",
+			be->be_suffix[0].bv_val, (unsigned long) mei.me_mapsize,
+			mdb->mi_dbenv_home );
+	}
+	if ( mdb->mi_readers > mei.me_maxreaders ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+			"maxreaders exceeds the %u of the environment shared "
+			"in %s, not applied.\n",
+			be->be_suffix[0].bv_val, mei.me_maxreaders,
+			mdb->mi_dbenv_home );
+	}
+	mdb_env_get_flags( mdb->mi_dbenv, &envflags );
+	if (( flags ^ envflags ) & mask ) {
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+			"envflags differ from those of the environment shared "
+			"in %s, which apply.\n",
+			be->be_suffix[0].bv_val, mdb->mi_dbenv_home, 0 );
+	}
+}
+
+/* Is there another database using these subdbs? */
+int
+mdb_subdb_inuse(
+	struct mdb_info *mdb,
+	const char *home,
+	struct berval *prefix )
+{
+	struct mdb_info *mi;
+
+	ldap_pvt_thread_mutex_lock( &mdb_dbs_mutex );
+	for ( mi = mdb_dbs; mi; mi = mi->mi_next ) {
+		if ( mi != mdb && mi->mi_dbenv_home &&
+			mdb_same_home( mi->mi_dbenv_home, home ) &&
+			!ber_bvcmp( &mi->mi_prefix, prefix ))
+			break;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_dbs_mutex );
+	return mi != NULL;
+}
+
+/* Open one of our subdbs, under our prefix if we have one */
+int
+mdb_subdb_open(
+	struct mdb_info *mdb,
+	MDB_txn *txn,
+	const char *name,
+	unsigned int flags,
+	MDB_dbi *dbi )
+{
+	char *path;
+	int rc;
+
+	if ( BER_BVISEMPTY( &mdb->mi_prefix ))
+		return mdb_dbi_open( txn, name, flags, dbi );
+
+	path = ch_malloc( mdb->mi_prefix.bv_len + strlen( name ) + 2 );
+	sprintf( path, "%s/%s", mdb->mi_prefix.bv_val, name );
+	rc = mdb_dbi_open( txn, path, flags, dbi );
+	ch_free( path );
+	return rc;
+}
+
 static int
 mdb_id_compare( const MDB_val *a, const MDB_val *b )
 {
@@ -63,6 +172,18 @@ mdb_db_init( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_mapsize = DEFAULT_MAPSIZE;
 
+	mdb->mi_pc_ttl = DEFAULT_PAGEDCACHE_TTL;
+	mdb->mi_oi_workers = DEFAULT_ONLINEINDEX_WORKERS;
+	mdb->mi_oi_txnsize = DEFAULT_ONLINEINDEX_TXNSIZE;
+	mdb->mi_oi_throttle = DEFAULT_ONLINEINDEX_THROTTLE;
+	mdb->mi_ws_threads = DEFAULT_WARMSTART_THREADS;
+	ldap_pvt_thread_mutex_init( &mdb->mi_pc_mutex );
+
+	ldap_pvt_thread_mutex_lock( &mdb_dbs_mutex );
+	mdb->mi_next = mdb_dbs;
+	mdb_dbs = mdb;
+	ldap_pvt_thread_mutex_unlock( &mdb_dbs_mutex );
+
 	be->be_private = mdb;
 	be->be_cf_ocs = be->bd_info->bi_cf_ocs;
 
@@ -81,12 +202,15 @@ mdb_db_close( BackendDB *be, ConfigReply *cr );
 static int
 mdb_db_open( BackendDB *be, ConfigReply *cr )
 {
-	int rc, i;
+	int rc, i, nshare = 1;
 	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	struct mdb_info *mi;
 	struct stat stat1;
 	uint32_t flags;
 	char *dbhome;
 	MDB_txn *txn;
+	size_t mapsize = mdb->mi_mapsize;
+	int readers = mdb->mi_readers;
 
 	if ( be->be_suffix == NULL ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -112,6 +236,53 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 	/* mdb is always clean */
 	be->be_flags |= SLAP_DBFLAG_CLEAN;
 
+	flags = mdb->mi_dbenv_flags & ~MDB_ENVF_LOCAL;
+
+	if ( slapMode & SLAP_TOOL_QUICK )
+		flags |= MDB_NOSYNC|MDB_WRITEMAP;
+
+	if ( slapMode & SLAP_TOOL_READONLY)
+		flags |= MDB_RDONLY;
+
+	/* Find the other databases in this directory. The environment
+	 * is sized for all of them and opened by the first one.
+	 */
+	ldap_pvt_thread_mutex_lock( &mdb_dbs_mutex );
+	for ( mi = mdb_dbs; mi; mi = mi->mi_next ) {
+		if ( mi == mdb || !mi->mi_dbenv_home ||
+			!mdb_same_home( mi->mi_dbenv_home, mdb->mi_dbenv_home ))
+			continue;
+		if ( !ber_bvcmp( &mi->mi_prefix, &mdb->mi_prefix ))
+			break;
+		if ( mi->mi_dbenv )
+			mdb->mi_dbenv = mi->mi_dbenv;
+		if ( mi->mi_mapsize > mapsize )
+			mapsize = mi->mi_mapsize;
+		if ( mi->mi_readers > readers )
+			readers = mi->mi_readers;
+		nshare++;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_dbs_mutex );
+	if ( mi ) {
+		mdb->mi_dbenv = NULL;
+		snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+			"directory \"%s\" is used by another database with the same "
+			"subdbprefix.", be->be_suffix[0].bv_val, mdb->mi_dbenv_home );
+		Debug( LDAP_DEBUG_ANY,
+			LDAP_XSTRING(mdb_db_open) ": %s\n",
+			cr->msg, 0, 0 );
+		return -1;
+	}
+
+	if ( mdb->mi_dbenv ) {
+		Debug( LDAP_DEBUG_TRACE,
+			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+			"sharing environment in %s.\n",
+			be->be_suffix[0].bv_val, mdb->mi_dbenv_home, 0 );
+		mdb_env_conflicts( be, flags );
+		goto opened;
+	}
+
 	rc = mdb_env_create( &mdb->mi_dbenv );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -121,8 +292,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
-	if ( mdb->mi_readers ) {
-		rc = mdb_env_set_maxreaders( mdb->mi_dbenv, mdb->mi_readers );
+	if ( readers ) {
+		rc = mdb_env_set_maxreaders( mdb->mi_dbenv, readers );
 		if( rc != 0 ) {
 			Debug( LDAP_DEBUG_ANY,
 				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
@@ -132,7 +303,7 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
-	rc = mdb_env_set_mapsize( mdb->mi_dbenv, mdb->mi_mapsize );
+	rc = mdb_env_set_mapsize( mdb->mi_dbenv, mapsize );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
 			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
@@ -141,7 +312,7 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
-	rc = mdb_env_set_maxdbs( mdb->mi_dbenv, MDB_INDICES );
+	rc = mdb_env_set_maxdbs( mdb->mi_dbenv, MDB_INDICES * nshare );
 	if( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
 			LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
@@ -163,14 +334,6 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		"dbenv_open(%s).\n",
 		be->be_suffix[0].bv_val, mdb->mi_dbenv_home, 0);
 
-	flags = mdb->mi_dbenv_flags;
-
-	if ( slapMode & SLAP_TOOL_QUICK )
-		flags |= MDB_NOSYNC|MDB_WRITEMAP;
-
-	if ( slapMode & SLAP_TOOL_READONLY)
-		flags |= MDB_RDONLY;
-
 	rc = mdb_env_open( mdb->mi_dbenv, dbhome,
 			flags, mdb->mi_dbenv_mode );
 
@@ -182,6 +345,8 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		goto fail;
 	}
 
+
+opened:
 	rc = mdb_txn_begin( mdb->mi_dbenv, NULL, flags & MDB_RDONLY, &txn );
 	if ( rc ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -204,7 +369,7 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 				flags |= MDB_CREATE;
 		}
 
-		rc = mdb_dbi_open( txn,
+		rc = mdb_subdb_open( mdb, txn,
 			mdmi_databases[i].bv_val,
 			flags,
 			&mdb->mi_dbis[i] );
@@ -259,6 +424,39 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 		}
 	}
 
+	/* The DN hash table must never hold stale records. If it is not
+	 * enabled, it is not maintained either, so get rid of any leftover.
+	 */
+	if ( mdb->mi_flags & MDB_DNHASH ) {
+		flags = 0;
+		if ( !(slapMode & SLAP_TOOL_READONLY) )
+			flags |= MDB_CREATE;
+		rc = mdb_subdb_open( mdb, txn, mdmi_dnhash.bv_val, flags, &mdb->mi_dnhash );
+		if ( rc == MDB_NOTFOUND ) {
+			mdb->mi_dnhash = 0;
+		} else if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
+				be->be_suffix[0].bv_val, 
+				mdb->mi_dbenv_home, mdmi_dnhash.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": %s\n",
+				cr->msg, 0, 0 );
+			mdb_txn_abort( txn );
+			goto fail;
+		}
+	} else if ( !(slapMode & SLAP_TOOL_READONLY) ) {
+		MDB_dbi dbi;
+		if ( mdb_subdb_open( mdb, txn, mdmi_dnhash.bv_val, 0, &dbi ) == 0 ) {
+			Debug( LDAP_DEBUG_TRACE,
+				LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+				"dropping unused DN hash table.\n",
+				be->be_suffix[0].bv_val, 0, 0 );
+			mdb_drop( txn, dbi, 1 );
+		}
+	}
+
 	rc = mdb_ad_read( mdb, txn );
 	if ( rc ) {
 		mdb_txn_abort( txn );
@@ -274,6 +472,24 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 			mdb_txn_abort( txn );
 			goto fail;
 		}
+
+		/* state of an online indexing pass, if one was interrupted */
+		rc = mdb_subdb_open( mdb, txn, mdmi_idxstate.bv_val, MDB_CREATE,
+			&mdb->mi_idxstate );
+		if ( rc == 0 && ( slapMode & SLAP_SERVER_MODE ))
+			rc = mdb_online_index_resume( be, txn );
+		if ( rc ) {
+			snprintf( cr->msg, sizeof(cr->msg), "database \"%s\": "
+				"mdb_dbi_open(%s/%s) failed: %s (%d).", 
+				be->be_suffix[0].bv_val, 
+				mdb->mi_dbenv_home, mdmi_idxstate.bv_val,
+				mdb_strerror(rc), rc );
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_db_open) ": %s\n",
+				cr->msg, 0, 0 );
+			mdb_txn_abort( txn );
+			goto fail;
+		}
 	}
 
 	rc = mdb_txn_commit(txn);
@@ -293,6 +509,20 @@ mdb_db_open( BackendDB *be, ConfigReply *cr )
 
 	mdb->mi_flags |= MDB_IS_OPEN;
 
+	if ( slapMode & SLAP_SERVER_MODE ) {
+		if ( mdb->mi_ws_min ) {
+			rc = mdb_warmstart_load( be );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_db_open) ": database \"%s\": "
+					"reading hot pages failed: %s (%d)\n",
+					be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			}
+			mdb_warmstart_start( be );
+		}
+		mdb_db_warmup( be );
+	}
+
 	return 0;
 
 fail:
@@ -305,10 +535,19 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 {
 	int rc;
 	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	struct mdb_info *mi;
 
 	/* monitor handling */
 	(void)mdb_monitor_db_close( be );
 
+	/* the task must not outlive the environment */
+	mdb_warmstart_stop( mdb );
+
+	/* so that the next start finds what is hot now */
+	if ( mdb->mi_ws_min && ( mdb->mi_flags & MDB_IS_OPEN ) &&
+		( slapMode & SLAP_SERVER_MODE ))
+		mdb_warmstart_save( mdb );
+
 	mdb->mi_flags &= ~MDB_IS_OPEN;
 
 	if( mdb->mi_dbenv ) {
@@ -320,8 +559,18 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 			int i;
 
 			mdb_attr_dbs_close( mdb );
-			for ( i=0; i<MDB_NDB; i++ )
+			for ( i=0; i<MDB_NDB; i++ ) {
 				mdb_dbi_close( mdb->mi_dbenv, mdb->mi_dbis[i] );
+				mdb->mi_dbis[i] = 0;
+			}
+			if ( mdb->mi_dnhash ) {
+				mdb_dbi_close( mdb->mi_dbenv, mdb->mi_dnhash );
+				mdb->mi_dnhash = 0;
+			}
+			if ( mdb->mi_idxstate ) {
+				mdb_dbi_close( mdb->mi_dbenv, mdb->mi_idxstate );
+				mdb->mi_idxstate = 0;
+			}
 
 			/* force a sync, but not if we were ReadOnly,
 			 * and not in Quick mode.
@@ -337,8 +586,16 @@ mdb_db_close( BackendDB *be, ConfigReply *cr )
 			}
 		}
 
-		mdb_env_close( mdb->mi_dbenv );
+		/* the last one in the directory closes the environment */
+		ldap_pvt_thread_mutex_lock( &mdb_dbs_mutex );
+		for ( mi = mdb_dbs; mi; mi = mi->mi_next ) {
+			if ( mi != mdb && mi->mi_dbenv == mdb->mi_dbenv )
+				break;
+		}
+		if ( !mi )
+			mdb_env_close( mdb->mi_dbenv );
 		mdb->mi_dbenv = NULL;
+		ldap_pvt_thread_mutex_unlock( &mdb_dbs_mutex );
 	}
 
 	return 0;
@@ -348,6 +605,7 @@ static int
 mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 {
 	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+	struct mdb_info **mip;
 
 	/* stop and remove checkpoint task */
 	if ( mdb->mi_txn_cp_task ) {
@@ -359,14 +617,28 @@ mdb_db_destroy( BackendDB *be, ConfigReply *cr )
 		ldap_pvt_runqueue_remove( &slapd_rq, re );
 		ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
 	}
+	mdb_warmstart_stop( mdb );
 
 	/* monitor handling */
 	(void)mdb_monitor_db_destroy( be );
 
 	if( mdb->mi_dbenv_home ) ch_free( mdb->mi_dbenv_home );
+	if( mdb->mi_prefix.bv_val ) ch_free( mdb->mi_prefix.bv_val );
 
 	mdb_attr_index_destroy( mdb );
 
+	mdb_pagedcache_flush( mdb, NULL );
+	ldap_pvt_thread_mutex_destroy( &mdb->mi_pc_mutex );
+
+	ldap_pvt_thread_mutex_lock( &mdb_dbs_mutex );
+	for ( mip = &mdb_dbs; *mip; mip = &(*mip)->mi_next ) {
+		if ( *mip == mdb ) {
+			*mip = mdb->mi_next;
+			break;
+		}
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb_dbs_mutex );
+
 	ch_free( mdb );
 	be->be_private = NULL;
 
@@ -388,6 +660,10 @@ mdb_back_initialize(
 		LDAP_CONTROL_POST_READ,
 		LDAP_CONTROL_SUBENTRIES,
 		LDAP_CONTROL_X_PERMISSIVE_MODIFY,
+		LDAP_CONTROL_X_EXPLAIN,
+#ifdef SLAP_CONTROL_X_TREE_DELETE
+		SLAP_CONTROL_X_TREE_DELETE,
+#endif
 #ifdef LDAP_X_TXN
 		LDAP_CONTROL_X_TXN_SPEC,
 #endif
@@ -436,6 +712,8 @@ mdb_back_initialize(
 			": %s\n", version, 0, 0 );
 	}
 
+	ldap_pvt_thread_mutex_init( &mdb_dbs_mutex );
+
 	bi->bi_open = 0;
 	bi->bi_close = 0;
 	bi->bi_config = 0;
@@ -483,7 +761,11 @@ mdb_back_initialize(
 	bi->bi_tool_entry_modify = mdb_tool_entry_modify;
 
 	bi->bi_connection_init = 0;
-	bi->bi_connection_destroy = 0;
+	bi->bi_connection_destroy = mdb_connection_destroy;
+
+	rc = mdb_explain_init();
+	if ( rc )
+		return rc;
 
 	rc = mdb_back_init_cf( bi );
 
@@ -438,6 +438,17 @@ int mdb_modify_internal(
 		}
 	}
 
+	/* rebuild composite index keys touched by the modifications */
+	rc = mdb_index_comps_mods( op, tid, modlist, save_attrs,
+		e->e_attrs, e->e_id );
+	if ( rc != LDAP_SUCCESS ) {
+		Debug( LDAP_DEBUG_ANY,
+			"%s: composite index update failure\n",
+			op->o_log_prefix, 0, 0 );
+		attrs_free( e->e_attrs );
+		e->e_attrs = save_attrs;
+	}
+
 	return rc;
 }
 
@@ -632,6 +643,11 @@ mdb_modify( Operation *op, SlapReply *rs )
 	/* Only free attrs if they were dup'd.  */
 	if ( dummy.e_attrs == e->e_attrs ) dummy.e_attrs = NULL;
 	if( moi == &opinfo ) {
+		if ( !op->o_noop && overlay_precommit( op, rs )) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "overlay pre-commit failed";
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
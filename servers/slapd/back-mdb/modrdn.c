@@ -436,7 +436,7 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 	 * If moving to a new parent, must delete current subtree count,
 	 * otherwise leave it unchanged since we'll be adding it right back.
 	 */
-	rs->sr_err = mdb_dn2id_delete( op, mc, e->e_id, np ? nsubs : 0 );
+	rs->sr_err = mdb_dn2id_delete( op, mc, e, np ? nsubs : 0 );
 	if ( rs->sr_err != 0 ) {
 		Debug(LDAP_DEBUG_TRACE,
 			"<=- " LDAP_XSTRING(mdb_modrdn)
@@ -466,6 +466,33 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 		goto return_results;
 	}
 
+	/* the DNs of all our descendants have changed too */
+	if ( nsubs > 1 ) {
+		rs->sr_err = mdb_dnhash_rename( op, txn, e->e_id,
+			&e->e_nname, &new_ndn, &new_dn );
+		if ( rs->sr_err != 0 ) {
+			Debug(LDAP_DEBUG_TRACE,
+				"<=- " LDAP_XSTRING(mdb_modrdn)
+				": dnhash rename failed: %s (%d)\n",
+				mdb_strerror(rs->sr_err), rs->sr_err, 0 );
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "DN hash update failed";
+			goto return_results;
+		}
+	}
+
+	/* referrers to the old DN(s) no longer match through the ID keys */
+	rs->sr_err = mdb_entryid_release( op, txn, e->e_id, nsubs > 1 );
+	if ( rs->sr_err != 0 ) {
+		Debug(LDAP_DEBUG_TRACE,
+			"<=- " LDAP_XSTRING(mdb_modrdn)
+			": entryid release failed: %s (%d)\n",
+			mdb_strerror(rs->sr_err), rs->sr_err, 0 );
+		rs->sr_err = LDAP_OTHER;
+		rs->sr_text = "entry index update failed";
+		goto return_results;
+	}
+
 	dummy.e_attrs = e->e_attrs;
 
 	/* modify entry */
@@ -540,6 +567,12 @@ mdb_modrdn( Operation	*op, SlapReply *rs )
 	}
 
 	if( moi == &opinfo ) {
+		if ( !op->o_noop && overlay_precommit( op, rs )) {
+			rs->sr_err = LDAP_OTHER;
+			rs->sr_text = "overlay pre-commit failed";
+			if ( dummy.e_attrs == e->e_attrs ) dummy.e_attrs = NULL;
+			goto return_results;
+		}
 		LDAP_SLIST_REMOVE( &op->o_extra, &opinfo.moi_oe, OpExtra, oe_next );
 		opinfo.moi_oe.oe_key = NULL;
 		if( op->o_noop ) {
@@ -28,6 +28,7 @@ AttrInfo *mdb_attr_mask( struct mdb_info *mdb,
 	AttributeDescription *desc );
 
 void mdb_attr_flush( struct mdb_info *mdb );
+void mdb_comp_drop( struct mdb_info *mdb );
 
 int mdb_attr_slot( struct mdb_info *mdb,
 	AttributeDescription *desc, int *insert );
@@ -46,6 +47,12 @@ void mdb_attr_index_free LDAP_P(( struct mdb_info *mdb,
 
 void mdb_attr_info_free( AttrInfo *ai );
 
+int mdb_comp_parse( const char *name, AttributeDescription **descs,
+	const char **text );
+CompInfo *mdb_comp_find( struct mdb_info *mdb,
+	AttributeDescription **descs, int ndescs );
+void mdb_comp_info_free( CompInfo *ci );
+
 int mdb_ad_read( struct mdb_info *mdb, MDB_txn *txn );
 int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
 
@@ -54,6 +61,9 @@ int mdb_ad_get( struct mdb_info *mdb, MDB_txn *txn, AttributeDescription *ad );
  */
 
 int mdb_back_init_cf( BackendInfo *bi );
+void mdb_online_index_restart( struct mdb_info *mdb );
+int mdb_online_index_resume( BackendDB *be, MDB_txn *txn );
+void mdb_db_warmup( BackendDB *be );
 
 /*
  * dn2entry.c
@@ -88,14 +98,41 @@ int mdb_dn2id_add(
 int mdb_dn2id_delete(
 	Operation *op,
 	MDB_cursor *mc,
-	ID id,
+	Entry *e,
 	ID nsubs );
 
+int mdb_dnhash_add(
+	Operation *op,
+	MDB_txn *txn,
+	struct berval *ndn,
+	struct berval *dn,
+	ID id );
+
+int mdb_dnhash_delete(
+	Operation *op,
+	MDB_txn *txn,
+	struct berval *ndn,
+	ID id );
+
+int mdb_dnhash_rename(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	struct berval *ondn,
+	struct berval *nndn,
+	struct berval *ndn );
+
 int mdb_dn2id_children(
 	Operation *op,
 	MDB_txn *tid,
 	Entry *e );
 
+int mdb_dn2id_subtree(
+	Operation *op,
+	MDB_txn *txn,
+	ID id,
+	ID **idsp );
+
 int mdb_dn2sups (
 	Operation *op,
 	MDB_txn *tid,
@@ -148,6 +185,25 @@ int mdb_dn2id_walk(
 
 MDB_cmp_func mdb_dup_compare;
 
+/*
+ * explain.c
+ */
+
+extern int mdb_explain_cid;
+
+int mdb_explain_init( void );
+mdb_explain *mdb_explain_get( Operation *op );
+void mdb_explain_start( Operation *op, mdb_explain *ex );
+void mdb_explain_end( Operation *op, mdb_explain *ex );
+void mdb_explain_phase( mdb_explain *ex, int phase );
+void mdb_explain_scope_begin( mdb_explain *ex );
+void mdb_explain_scope_end( mdb_explain *ex );
+int mdb_explain_enter( Operation *op, Filter *f, const char *label );
+void mdb_explain_leave( Operation *op, int slot, ID *ids );
+void mdb_explain_index( Operation *op, const char *index );
+void mdb_explain_merge( Operation *op, ID *ids );
+void mdb_explain_response( Operation *op, SlapReply *rs, mdb_explain *ex );
+
 /*
  * filterentry.c
  */
@@ -294,11 +350,33 @@ mdb_index_recrun LDAP_P((
 
 int mdb_index_entry LDAP_P(( Operation *op, MDB_txn *t, int r, Entry *e ));
 
+void mdb_entryid_key LDAP_P(( ID id, char *buf, struct berval *key ));
+int mdb_entryid_release LDAP_P(( Operation *op, MDB_txn *txn,
+	ID id, int stale ));
+
+int mdb_comp_keys LDAP_P(( Operation *op, CompInfo *ci,
+	BerVarray *ckeys, BerVarray *keys ));
+
+int mdb_index_comps LDAP_P(( Operation *op, MDB_txn *txn,
+	Attribute *attrs, ID id, int opid ));
+
+int mdb_index_comps_mods LDAP_P(( Operation *op, MDB_txn *txn,
+	Modifications *ml, Attribute *oldattrs, Attribute *newattrs, ID id ));
+
 #define mdb_index_entry_add(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_ADD_OP,(e))
 #define mdb_index_entry_del(op,t,e) \
 	mdb_index_entry((op),(t),SLAP_INDEX_DELETE_OP,(e))
 
+/*
+ * init.c
+ */
+
+int mdb_subdb_inuse( struct mdb_info *mdb, const char *home,
+	struct berval *prefix );
+int mdb_subdb_open( struct mdb_info *mdb, MDB_txn *txn,
+	const char *name, unsigned int flags, MDB_dbi *dbi );
+
 /*
  * key.c
  */
@@ -349,6 +427,22 @@ mdb_monitor_idx_add(
 	slap_mask_t		type );
 #endif /* MDB_MONITOR_IDX */
 
+/*
+ * search.c
+ */
+
+void mdb_pagedcache_flush( struct mdb_info *mdb, Connection *c );
+
+/*
+ * warmstart.c
+ */
+
+int mdb_warmstart_save( struct mdb_info *mdb );
+int mdb_warmstart_load( BackendDB *be );
+void *mdb_warmstart_task( void *ctx, void *arg );
+void mdb_warmstart_start( BackendDB *be );
+void mdb_warmstart_stop( struct mdb_info *mdb );
+
 /*
  * former external.h
  */
@@ -372,6 +466,8 @@ extern BI_operational			mdb_operational;
 
 extern BI_has_subordinates 		mdb_hasSubordinates;
 
+extern BI_connection_destroy		mdb_connection_destroy;
+
 /* tools.c */
 extern BI_tool_entry_open		mdb_tool_entry_open;
 extern BI_tool_entry_close		mdb_tool_entry_close;
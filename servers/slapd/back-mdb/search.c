@@ -21,6 +21,7 @@
 
 #include "back-mdb.h"
 #include "idl.h"
+#include "lutil.h"
 
 static int base_candidate(
 	BackendDB	*be,
@@ -404,6 +405,121 @@ mdb_waitfixup( Operation *op, ww_ctx *ww, MDB_cursor *mci, MDB_cursor *mcd, ID2
 	return rc;
 }
 
+/* Every page of a paged search restarts from the cookie and would
+ * recompute the whole candidate list. Keep the list of a search
+ * whose next page is still outstanding, keyed on the connection and
+ * the cookie we handed out. Candidates are still checked against
+ * scope and filter when they are returned, so a list that has aged
+ * a little can only miss entries that were added in the meantime.
+ */
+static mdb_pagedcache *
+mdb_pc_take( Operation *op, PagedResultsCookie cookie )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_pagedcache *pc, **prev, *ret = NULL;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pc_mutex );
+	for ( prev = &mdb->mi_pc_list; ( pc = *prev ) != NULL; ) {
+		if ( !ret && pc->pc_connid == op->o_connid &&
+			pc->pc_cookie == cookie ) {
+			ret = pc;
+		} else if ( op->o_time - pc->pc_time > mdb->mi_pc_ttl ) {
+			/* expired, drop it while we're here */
+		} else {
+			prev = &pc->pc_next;
+			continue;
+		}
+		*prev = pc->pc_next;
+		mdb->mi_pc_num--;
+		if ( pc != ret )
+			ch_free( pc );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pc_mutex );
+
+	if ( ret && ( ret->pc_scope != op->ors_scope ||
+		op->o_time - ret->pc_time > mdb->mi_pc_ttl ||
+		!dn_match( &ret->pc_base, &op->o_req_ndn ) ||
+		!bvmatch( &ret->pc_filter, &op->ors_filterstr ))) {
+		ch_free( ret );
+		ret = NULL;
+	}
+	return ret;
+}
+
+static void
+mdb_pc_save( Operation *op, mdb_pagedcache *pc, ID *ids, ID lastid )
+{
+	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
+	mdb_pagedcache **prev;
+
+	if ( !pc ) {
+		size_t len = MDB_IDL_SIZEOF( ids );
+		char *ptr;
+
+		pc = ch_malloc( sizeof( mdb_pagedcache ) + len +
+			op->o_req_ndn.bv_len + op->ors_filterstr.bv_len + 2 );
+		AC_MEMCPY( pc->pc_ids, ids, len );
+		ptr = (char *)pc->pc_ids + len;
+		pc->pc_base.bv_val = ptr;
+		pc->pc_base.bv_len = op->o_req_ndn.bv_len;
+		ptr = lutil_strncopy( ptr, op->o_req_ndn.bv_val,
+			op->o_req_ndn.bv_len ) + 1;
+		pc->pc_filter.bv_val = ptr;
+		pc->pc_filter.bv_len = op->ors_filterstr.bv_len;
+		ptr = lutil_strncopy( ptr, op->ors_filterstr.bv_val,
+			op->ors_filterstr.bv_len );
+		pc->pc_base.bv_val[pc->pc_base.bv_len] = '\0';
+		*ptr = '\0';
+		pc->pc_connid = op->o_connid;
+		pc->pc_scope = op->ors_scope;
+	}
+	pc->pc_cookie = (PagedResultsCookie)lastid;
+	pc->pc_time = op->o_time;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pc_mutex );
+	pc->pc_next = mdb->mi_pc_list;
+	mdb->mi_pc_list = pc;
+	mdb->mi_pc_num++;
+	while ( mdb->mi_pc_num > mdb->mi_pc_max ) {
+		/* drop the oldest one */
+		for ( prev = &mdb->mi_pc_list; (*prev)->pc_next;
+			prev = &(*prev)->pc_next ) ;
+		ch_free( *prev );
+		*prev = NULL;
+		mdb->mi_pc_num--;
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pc_mutex );
+}
+
+/* Drop the saved lists of a connection, or all of them if c is NULL */
+void
+mdb_pagedcache_flush( struct mdb_info *mdb, Connection *c )
+{
+	mdb_pagedcache *pc, **prev;
+
+	ldap_pvt_thread_mutex_lock( &mdb->mi_pc_mutex );
+	for ( prev = &mdb->mi_pc_list; ( pc = *prev ) != NULL; ) {
+		if ( c && pc->pc_connid != c->c_connid ) {
+			prev = &pc->pc_next;
+			continue;
+		}
+		*prev = pc->pc_next;
+		mdb->mi_pc_num--;
+		ch_free( pc );
+	}
+	ldap_pvt_thread_mutex_unlock( &mdb->mi_pc_mutex );
+}
+
+int
+mdb_connection_destroy( BackendDB *be, Connection *c )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+
+	if ( mdb->mi_pc_list )
+		mdb_pagedcache_flush( mdb, c );
+	return 0;
+}
+
 int
 mdb_search( Operation *op, SlapReply *rs )
 {
@@ -425,6 +541,9 @@ mdb_search( Operation *op, SlapReply *rs )
 	MDB_cursor	*mci, *mcd;
 	ww_ctx wwctx;
 	slap_callback cb = { 0 };
+	mdb_pagedcache	*pc = NULL;
+	mdb_explain	explain, *mex = NULL;
+	void	*oexplain = NULL;
 
 	mdb_op_info	opinfo = {{{0}}}, *moi = &opinfo;
 	MDB_txn			*ltid = NULL;
@@ -458,6 +577,14 @@ mdb_search( Operation *op, SlapReply *rs )
 		return rs->sr_err;
 	}
 
+	/* collect the search plan if asked for */
+	if ( op->o_ctrlflag[mdb_explain_cid] > SLAP_CONTROL_IGNORED ) {
+		mex = &explain;
+		mdb_explain_start( op, mex );
+		oexplain = op->o_controls[mdb_explain_cid];
+		op->o_controls[mdb_explain_cid] = mex;
+	}
+
 	scopes = scope_chunk_get( op );
 	stack = search_stack( op );
 	isc.mt = ltid;
@@ -470,8 +597,14 @@ mdb_search( Operation *op, SlapReply *rs )
 		MDB_IDL_ZERO(candidates);
 	}
 dn2entry_retry:
-	/* get entry with reader lock */
-	rs->sr_err = mdb_dn2entry( op, ltid, mcd, &op->o_req_ndn, &e, &nsubs, 1 );
+	/* get entry with reader lock. A base search needs neither the
+	 * cursor context nor the subtree count, which allows the exact
+	 * DN lookup to be used.
+	 */
+	if ( op->ors_scope == LDAP_SCOPE_BASE )
+		rs->sr_err = mdb_dn2entry( op, ltid, NULL, &op->o_req_ndn, &e, NULL, 1 );
+	else
+		rs->sr_err = mdb_dn2entry( op, ltid, mcd, &op->o_req_ndn, &e, &nsubs, 1 );
 
 	switch(rs->sr_err) {
 	case MDB_NOTFOUND:
@@ -632,10 +765,13 @@ dn2entry_retry:
 	e = NULL;
 
 	/* select candidates */
+	if ( mex )
+		mdb_explain_phase( mex, MDB_EXPLAIN_CANDIDATES );
 	if ( op->oq_search.rs_scope == LDAP_SCOPE_BASE ) {
 		rs->sr_err = base_candidate( op->o_bd, base, candidates );
 		scopes[0].mid = 0;
 		ncand = 1;
+		nsubs = ncand;
 	} else {
 		if ( op->ors_scope == LDAP_SCOPE_ONELEVEL ) {
 			size_t nkids;
@@ -657,9 +793,38 @@ dn2entry_retry:
 		scopes[0].mid = 1;
 		scopes[1].mid = base->e_id;
 		scopes[1].mval.mv_data = NULL;
-		rs->sr_err = search_candidates( op, rs, base,
-			&isc, mci, candidates, stack );
+		/* Reuse the candidates of the previous page, unless
+		 * alias dereferencing needs the scopes recomputed.
+		 */
+		if ( mdb->mi_pc_max &&
+			get_pagedresults( op ) > SLAP_CONTROL_IGNORED &&
+			!( op->ors_deref & LDAP_DEREF_SEARCHING ))
+		{
+			PagedResultsState *ps = op->o_pagedresults_state;
+			PagedResultsCookie reqcookie;
+
+			if ( ps->ps_cookieval.bv_len == sizeof( reqcookie )) {
+				AC_MEMCPY( &reqcookie, ps->ps_cookieval.bv_val,
+					sizeof( reqcookie ));
+				pc = mdb_pc_take( op, reqcookie );
+			}
+		}
+		if ( pc ) {
+			Debug( LDAP_DEBUG_TRACE,
+				LDAP_XSTRING(mdb_search) ": reusing paged candidates\n",
+				0, 0, 0 );
+			MDB_IDL_CPY( candidates, pc->pc_ids );
+			rs->sr_err = LDAP_SUCCESS;
+		} else {
+			rs->sr_err = search_candidates( op, rs, base,
+				&isc, mci, candidates, stack );
+		}
 		ncand = MDB_IDL_N( candidates );
+		if ( mex ) {
+			mex->me_reused = pc != NULL;
+			mex->me_ncand = ncand;
+			mex->me_crange = MDB_IDL_IS_RANGE( candidates );
+		}
 		if ( !base->e_id || ncand == NOID ) {
 			/* grab entry count from id2entry stat
 			 */
@@ -672,6 +837,19 @@ dn2entry_retry:
 		}
 	}
 
+	if ( mex ) {
+		if ( op->oq_search.rs_scope == LDAP_SCOPE_BASE ) {
+			mex->me_ncand = 1;
+			mex->me_scope = "base";
+		} else if ( nsubs < ncand &&
+			get_pagedresults( op ) <= SLAP_CONTROL_IGNORED ) {
+			mex->me_scope = "walk";
+		} else {
+			mex->me_scope = "idscopes";
+		}
+		mdb_explain_phase( mex, MDB_EXPLAIN_ENTRIES );
+	}
+
 	/* start cursor at beginning of candidates.
 	 */
 	cursor = 0;
@@ -734,6 +912,8 @@ dn2entry_retry:
 				LDAP_XSTRING(mdb_search)
 				": no paged results candidates\n",
 				0, 0, 0 );
+			if ( mex )
+				mdb_explain_response( op, rs, mex );
 			send_paged_response( op, rs, &lastid, 0 );
 
 			rs->sr_err = LDAP_OTHER;
@@ -853,7 +1033,11 @@ loop_begin:
 			if ( id == base->e_id ) break;
 			isc.id = id;
 			isc.nscope = 0;
+			if ( mex )
+				mdb_explain_scope_begin( mex );
 			rs->sr_err = mdb_idscopes( op, &isc );
+			if ( mex )
+				mdb_explain_scope_end( mex );
 			if ( rs->sr_err == MDB_SUCCESS ) {
 				if ( isc.nscope )
 					scopeok = 1;
@@ -922,6 +1106,8 @@ notfound:
 				send_ldap_result( op, rs );
 				goto done;
 			}
+			if ( mex )
+				mex->me_decoded++;
 			e->e_id = id;
 			e->e_name.bv_val = NULL;
 			e->e_nname.bv_val = NULL;
@@ -1063,11 +1249,22 @@ notfound:
 		rs->sr_err = test_filter( op, e, op->oq_search.rs_filter );
 
 		if ( rs->sr_err == LDAP_COMPARE_TRUE ) {
+			if ( mex )
+				mex->me_matched++;
 			/* check size limit */
 			if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
 				if ( rs->sr_nentries >= ((PagedResultsState *)op->o_pagedresults_state)->ps_size ) {
 					mdb_entry_return( op, e );
 					e = NULL;
+					if ( mdb->mi_pc_max && op->ors_scope != LDAP_SCOPE_BASE &&
+						!( op->ors_deref & LDAP_DEREF_SEARCHING )) {
+						mdb_pc_save( op, pc, candidates, lastid );
+						pc = NULL;
+					}
+					if ( mex ) {
+						mex->me_matched--;
+						mdb_explain_response( op, rs, mex );
+					}
 					send_paged_response( op, rs, &lastid, tentries );
 					goto done;
 				}
@@ -1102,6 +1299,8 @@ notfound:
 				case LDAP_SIZELIMIT_EXCEEDED:
 					if ( rs->sr_err == LDAP_SIZELIMIT_EXCEEDED ) {
 						rs->sr_ref = rs->sr_v2ref;
+						if ( mex )
+							mdb_explain_response( op, rs, mex );
 						send_ldap_result( op, rs );
 						rs->sr_err = LDAP_SUCCESS;
 
@@ -1136,7 +1335,12 @@ loop_continue:
 		}
 
 		if ( nsubs < ncand ) {
-			int rc = mdb_dn2id_walk( op, &isc );
+			int rc;
+			if ( mex )
+				mdb_explain_scope_begin( mex );
+			rc = mdb_dn2id_walk( op, &isc );
+			if ( mex )
+				mdb_explain_scope_end( mex );
 			if (rc) {
 				id = NOID;
 				/* We got to the end of a subtree. If there are any
@@ -1172,6 +1376,8 @@ nochange:
 	rs->sr_ref = rs->sr_v2ref;
 	rs->sr_err = (rs->sr_v2ref == NULL) ? LDAP_SUCCESS : LDAP_REFERRAL;
 	rs->sr_rspoid = NULL;
+	if ( mex )
+		mdb_explain_response( op, rs, mex );
 	if ( get_pagedresults(op) > SLAP_CONTROL_IGNORED ) {
 		send_paged_response( op, rs, NULL, 0 );
 	} else {
@@ -1206,6 +1412,12 @@ done:
 	}
 	if (base)
 		mdb_entry_return( op, base );
+	if ( pc )
+		ch_free( pc );
+	if ( mex ) {
+		op->o_controls[mdb_explain_cid] = oexplain;
+		mdb_explain_end( op, mex );
+	}
 	scope_chunk_ret( op, scopes );
 
 	return rs->sr_err;
@@ -209,6 +209,18 @@ int mdb_tool_entry_close(
 		}
 		mdb_tool_txn = NULL;
 	}
+	if( txi ) {
+		int rc;
+		MDB_TOOL_IDL_FLUSH( be, txi );
+		if (( rc = mdb_txn_commit( txi ))) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_close) ": database %s: "
+				"txn_commit failed: %s (%d)\n",
+				be->be_suffix[0].bv_val, mdb_strerror(rc), rc );
+			return -1;
+		}
+		txi = NULL;
+	}
 
 	if( nholes ) {
 		unsigned i;
@@ -555,7 +567,7 @@ mdb_tool_index_add(
 {
 	struct mdb_info *mdb = (struct mdb_info *) op->o_bd->be_private;
 
-	if ( !mdb->mi_nattrs )
+	if ( !mdb->mi_nattrs && !mdb->mi_ncomps )
 		return 0;
 
 	if ( mdb_tool_threads > 1 ) {
@@ -596,7 +608,11 @@ mdb_tool_index_add(
 		ldap_pvt_thread_cond_broadcast( &mdb_tool_index_cond_work );
 		ldap_pvt_thread_mutex_unlock( &mdb_tool_index_mutex );
 
-		return mdb_index_recrun( op, txn, mdb, ir, e->e_id, 0 );
+		rc = mdb_index_recrun( op, txn, mdb, ir, e->e_id, 0 );
+		if ( rc == 0 )
+			rc = mdb_index_comps( op, txn, e->e_attrs, e->e_id,
+				SLAP_INDEX_ADD_OP );
+		return rc;
 	} else
 	{
 		return mdb_index_entry_add( op, txn, e );
@@ -805,7 +821,7 @@ int mdb_tool_entry_reindex(
 	/* No indexes configured, nothing to do. Could return an
 	 * error here to shortcut things.
 	 */
-	if (!mi->mi_attrs) {
+	if (!mi->mi_attrs && !mi->mi_comps && !mi->mi_dnhash) {
 		return 0;
 	}
 
@@ -813,6 +829,21 @@ int mdb_tool_entry_reindex(
 	if ( adv ) {
 		int i, j, n;
 
+		if ( !mi->mi_nattrs )
+			return 0;
+
+		/* Composite indexes and the DN hash table are only
+		 * rebuilt by a full reindex
+		 */
+		if ( mi->mi_ncomps ) {
+			for ( i = 0; i < mi->mi_ncomps; i++ )
+				mdb_comp_info_free( mi->mi_comps[i] );
+			ch_free( mi->mi_comps );
+			mi->mi_comps = NULL;
+			mi->mi_ncomps = 0;
+		}
+		mi->mi_dnhash = 0;
+
 		if ( mi->mi_attrs[0]->ai_desc != adv[0] ) {
 			/* count */
 			for ( n = 0; adv[n]; n++ ) ;
@@ -884,9 +915,43 @@ int mdb_tool_entry_reindex(
 				return -1;
 			}
 		}
+		for ( i=0; i < mi->mi_ncomps; i++ ) {
+			rc = mdb_drop( txi, mi->mi_comps[i]->ci_dbi, 0 );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_drop(%s) failed: %s (%d)\n",
+					mi->mi_comps[i]->ci_name.bv_val,
+					mdb_strerror(rc), rc );
+				return -1;
+			}
+		}
+		if ( mi->mi_dnhash ) {
+			rc = mdb_drop( txi, mi->mi_dnhash, 0 );
+			if ( rc ) {
+				Debug( LDAP_DEBUG_ANY,
+					LDAP_XSTRING(mdb_tool_entry_reindex)
+					": (Truncate) mdb_drop(dnhash) failed: %s (%d)\n",
+					mdb_strerror(rc), rc, 0 );
+				return -1;
+			}
+		}
 		slapMode ^= SLAP_TRUNCATE_MODE;
 	}
 
+	/* Reindexing all attributes supersedes an unfinished online pass */
+	if ( !adv && mi->mi_idxstate ) {
+		rc = mdb_drop( txi, mi->mi_idxstate, 0 );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_reindex)
+				": mdb_drop(idxstate) failed: %s (%d)\n",
+				mdb_strerror(rc), rc, 0 );
+			return -1;
+		}
+		mi->mi_idxstate = 0;
+	}
+
 	/*
 	 * just (re)add them for now
 	 * Use truncate mode to empty/reset index databases
@@ -901,6 +966,27 @@ int mdb_tool_entry_reindex(
 	op.o_tmpmemctx = NULL;
 	op.o_tmpmfuncs = &ch_mfuncs;
 
+	/* before the index threads get to work on this txn */
+	if ( mi->mi_dnhash ) {
+		struct berval dn, ndn;
+		MDB_cursor *mc = NULL;
+
+		rc = mdb_id2name( &op, txi, &mc, id, &dn, &ndn );
+		if ( rc == 0 ) {
+			rc = mdb_dnhash_add( &op, txi, &ndn, &dn, id );
+			ch_free( dn.bv_val );
+			ch_free( ndn.bv_val );
+		}
+		mdb_cursor_close( mc );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_tool_entry_reindex)
+				": DN hash update for id=%ld failed: %s (%d)\n",
+				(long) id, mdb_strerror(rc), rc );
+			goto done;
+		}
+	}
+
 	rc = mdb_tool_index_add( &op, txi, e );
 
 done:
@@ -0,0 +1,387 @@
+/* warmstart.c - back-mdb page cache warm start */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 2000-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+#include <ac/string.h>
+#include <ac/errno.h>
+#include <ac/time.h>
+#include <ac/unistd.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#include "back-mdb.h"
+#include "lutil.h"
+#include "ldap_rq.h"
+
+/* Which pages of the data file are in the page cache is saved now
+ * and then, and at shutdown, in a sidecar file next to it: a header
+ * followed by a bitmap with one bit per page. On open these pages are
+ * read back before the server starts answering.
+ */
+
+#define MDB_WS_DATA		"/data.mdb"
+#define MDB_WS_FILE		"/hotpages"
+#define MDB_WS_TMP		"/hotpages.tmp"
+#define MDB_WS_MAGIC	0x4d445750	/* "MDWP" */
+
+/* Largest single read when prefetching */
+#define MDB_WS_IOSIZE	(1024*1024)
+
+typedef struct mdb_ws_hdr {
+	uint32_t	wh_magic;
+	uint32_t	wh_psize;
+	uint64_t	wh_npages;	/* bits in the bitmap */
+} mdb_ws_hdr;
+
+#ifndef _WIN32
+
+static char *
+mdb_ws_path( struct mdb_info *mdb, const char *name )
+{
+	size_t len = strlen( mdb->mi_dbenv_home );
+	char *path = ch_malloc( len + strlen( name ) + 1 );
+
+	strcpy( path, mdb->mi_dbenv_home );
+	strcpy( path + len, name );
+	return path;
+}
+
+/* Record which pages in use are resident */
+int
+mdb_warmstart_save( struct mdb_info *mdb )
+{
+	mdb_ws_hdr hdr;
+	MDB_envinfo mei;
+	struct stat st;
+	unsigned char *vec = NULL, *bits = NULL;
+	void *map = MAP_FAILED;
+	char *path, *tmp = NULL;
+	size_t len, i, nbytes;
+	long psize;
+	int fd, wfd, rc = 0;
+	FILE *f;
+
+	psize = sysconf( _SC_PAGESIZE );
+	path = mdb_ws_path( mdb, MDB_WS_DATA );
+	fd = open( path, O_RDONLY );
+	ch_free( path );
+	if ( fd < 0 )
+		return errno;
+	if ( fstat( fd, &st ) ) {
+		rc = errno;
+		goto done;
+	}
+	mdb_env_info( mdb->mi_dbenv, &mei );
+	len = ( mei.me_last_pgno + 1 ) * psize;
+	if ( len > st.st_size )
+		len = st.st_size;
+	if ( !len )
+		goto done;
+
+	/* Residency is a property of the file's pages, a mapping
+	 * of our own tells as much as LMDB's.
+	 */
+	map = mmap( NULL, len, PROT_READ, MAP_SHARED, fd, 0 );
+	if ( map == MAP_FAILED ) {
+		rc = errno;
+		goto done;
+	}
+	hdr.wh_magic = MDB_WS_MAGIC;
+	hdr.wh_psize = psize;
+	hdr.wh_npages = ( len + psize - 1 ) / psize;
+	nbytes = ( hdr.wh_npages + 7 ) / 8;
+	vec = ch_malloc( hdr.wh_npages );
+	bits = ch_calloc( 1, nbytes );
+	if ( mincore( map, len, (void *)vec )) {
+		rc = errno;
+		goto done;
+	}
+	for ( i = 0; i < hdr.wh_npages; i++ ) {
+		if ( vec[i] & 1 )
+			bits[i >> 3] |= 1 << ( i & 7 );
+	}
+
+	/* write a new file and move it in place, so that a crash never
+	 * leaves a truncated one
+	 */
+	tmp = mdb_ws_path( mdb, MDB_WS_TMP );
+	wfd = open( tmp, O_WRONLY|O_CREAT|O_TRUNC, mdb->mi_dbenv_mode );
+	f = wfd >= 0 ? fdopen( wfd, "wb" ) : NULL;
+	if ( !f ) {
+		rc = errno;
+		if ( wfd >= 0 )
+			close( wfd );
+		goto done;
+	}
+	if ( fwrite( &hdr, sizeof( hdr ), 1, f ) != 1 ||
+		fwrite( bits, nbytes, 1, f ) != 1 )
+		rc = errno ? errno : EIO;
+	if ( fclose( f ) && !rc )
+		rc = errno;
+	if ( !rc ) {
+		path = mdb_ws_path( mdb, MDB_WS_FILE );
+		if ( rename( tmp, path ))
+			rc = errno;
+		ch_free( path );
+	}
+	if ( rc )
+		unlink( tmp );
+
+done:
+	if ( map != MAP_FAILED )
+		munmap( map, len );
+	close( fd );
+	ch_free( tmp );
+	ch_free( bits );
+	ch_free( vec );
+	return rc;
+}
+
+typedef struct mdb_ws_reader {
+	int			wr_fd;
+	int			wr_nthreads;
+	int			wr_num;
+	unsigned char	*wr_bits;
+	size_t		wr_npages;
+	long		wr_psize;
+	size_t		wr_pages;	/* pages read */
+} mdb_ws_reader;
+
+/* Call func on each run of set bits of the bitmap. Runs are cut to
+ * MDB_WS_IOSIZE, and the num'th of every nthreads of them is taken.
+ */
+static void
+mdb_ws_runs( mdb_ws_reader *wr, void (*func)( mdb_ws_reader *, off_t, size_t ))
+{
+	size_t i = 0, start, max = MDB_WS_IOSIZE / wr->wr_psize;
+	int n = 0;
+
+	while ( i < wr->wr_npages ) {
+		if ( !( wr->wr_bits[i >> 3] & ( 1 << ( i & 7 )))) {
+			i++;
+			continue;
+		}
+		start = i;
+		while ( i < wr->wr_npages && i - start < max &&
+			( wr->wr_bits[i >> 3] & ( 1 << ( i & 7 ))))
+			i++;
+		if ( n++ % wr->wr_nthreads == wr->wr_num ) {
+			func( wr, (off_t)start * wr->wr_psize, ( i - start ) * wr->wr_psize );
+			wr->wr_pages += i - start;
+		}
+	}
+}
+
+static void
+mdb_ws_pread( mdb_ws_reader *wr, off_t off, size_t len )
+{
+	static char buf[MDB_WS_IOSIZE];
+
+	/* the contents don't matter, every thread may use the same buffer */
+	(void)pread( wr->wr_fd, buf, len, off );
+}
+
+static void *
+mdb_ws_thread( void *arg )
+{
+	mdb_ws_runs( arg, mdb_ws_pread );
+	return NULL;
+}
+
+#ifdef POSIX_FADV_WILLNEED
+static void
+mdb_ws_advise( mdb_ws_reader *wr, off_t off, size_t len )
+{
+	posix_fadvise( wr->wr_fd, off, len, POSIX_FADV_WILLNEED );
+}
+#endif
+
+/* Read back the pages recorded by mdb_warmstart_save(), in parallel.
+ * Without threads, only ask the OS to read them in the background.
+ */
+int
+mdb_warmstart_load( BackendDB *be )
+{
+	struct mdb_info *mdb = be->be_private;
+	mdb_ws_hdr hdr;
+	mdb_ws_reader *wr;
+	ldap_pvt_thread_t *thr;
+	struct stat st;
+	struct timeval start, end;
+	unsigned char *bits;
+	char *path;
+	size_t nbytes, pages = 0;
+	int i, fd, nthreads, rc = 0;
+	FILE *f;
+
+	path = mdb_ws_path( mdb, MDB_WS_FILE );
+	f = fopen( path, "rb" );
+	ch_free( path );
+	if ( !f )
+		return errno == ENOENT ? 0 : errno;
+	if ( fread( &hdr, sizeof( hdr ), 1, f ) != 1 ||
+		hdr.wh_magic != MDB_WS_MAGIC ||
+		hdr.wh_psize != sysconf( _SC_PAGESIZE )) {
+		fclose( f );
+		return MDB_INVALID;
+	}
+	path = mdb_ws_path( mdb, MDB_WS_DATA );
+	fd = open( path, O_RDONLY );
+	ch_free( path );
+	if ( fd < 0 || fstat( fd, &st )) {
+		rc = errno;
+		fclose( f );
+		if ( fd >= 0 )
+			close( fd );
+		return rc;
+	}
+	/* the file may have shrunk since, by a restore */
+	if ( hdr.wh_npages > st.st_size / hdr.wh_psize )
+		hdr.wh_npages = st.st_size / hdr.wh_psize;
+	nbytes = ( hdr.wh_npages + 7 ) / 8;
+	bits = ch_malloc( nbytes + 1 );
+	if ( nbytes && fread( bits, nbytes, 1, f ) != 1 ) {
+		fclose( f );
+		close( fd );
+		ch_free( bits );
+		return MDB_INVALID;
+	}
+	fclose( f );
+
+	gettimeofday( &start, NULL );
+	nthreads = mdb->mi_ws_threads;
+	wr = ch_calloc( nthreads ? nthreads : 1, sizeof( mdb_ws_reader ));
+	for ( i = 0; i < ( nthreads ? nthreads : 1 ); i++ ) {
+		wr[i].wr_fd = fd;
+		wr[i].wr_nthreads = nthreads ? nthreads : 1;
+		wr[i].wr_num = i;
+		wr[i].wr_bits = bits;
+		wr[i].wr_npages = hdr.wh_npages;
+		wr[i].wr_psize = hdr.wh_psize;
+	}
+	if ( nthreads ) {
+		thr = ch_malloc( nthreads * sizeof( ldap_pvt_thread_t ));
+		for ( i = 0; i < nthreads; i++ )
+			ldap_pvt_thread_create( &thr[i], 0, mdb_ws_thread, &wr[i] );
+		for ( i = 0; i < nthreads; i++ ) {
+			ldap_pvt_thread_join( thr[i], NULL );
+			pages += wr[i].wr_pages;
+		}
+		ch_free( thr );
+	} else {
+#ifdef POSIX_FADV_WILLNEED
+		mdb_ws_runs( wr, mdb_ws_advise );
+		pages = wr->wr_pages;
+#endif
+	}
+	gettimeofday( &end, NULL );
+	if ( end.tv_usec < start.tv_usec ) {
+		end.tv_usec += 1000000;
+		end.tv_sec--;
+	}
+	Debug( LDAP_DEBUG_STATS,
+		LDAP_XSTRING(mdb_warmstart_load) ": database %s: "
+		"%lu hot pages in %ld ms\n",
+		be->be_suffix[0].bv_val, (unsigned long) pages,
+		(long)( end.tv_sec - start.tv_sec ) * 1000
+		+ ( end.tv_usec - start.tv_usec ) / 1000 );
+
+	ch_free( wr );
+	ch_free( bits );
+	close( fd );
+	return 0;
+}
+
+#else /* _WIN32 */
+
+int
+mdb_warmstart_save( struct mdb_info *mdb )
+{
+	return 0;
+}
+
+int
+mdb_warmstart_load( BackendDB *be )
+{
+	return 0;
+}
+
+#endif /* _WIN32 */
+
+/* Schedule the periodic save for an open database, or pick up a
+ * new interval.
+ */
+void
+mdb_warmstart_start( BackendDB *be )
+{
+	struct mdb_info *mdb = (struct mdb_info *) be->be_private;
+
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( mdb->mi_ws_task ) {
+		mdb->mi_ws_task->interval.tv_sec = mdb->mi_ws_min * 60;
+	} else {
+		mdb->mi_ws_task = ldap_pvt_runqueue_insert( &slapd_rq,
+			mdb->mi_ws_min * 60, mdb_warmstart_task, mdb,
+			LDAP_XSTRING(mdb_warmstart_task), be->be_suffix[0].bv_val );
+	}
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* Stop and remove the periodic save */
+void
+mdb_warmstart_stop( struct mdb_info *mdb )
+{
+	struct re_s *re = mdb->mi_ws_task;
+
+	if ( !re )
+		return;
+
+	mdb->mi_ws_task = NULL;
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	if ( ldap_pvt_runqueue_isrunning( &slapd_rq, re ) )
+		ldap_pvt_runqueue_stoptask( &slapd_rq, re );
+	ldap_pvt_runqueue_remove( &slapd_rq, re );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+}
+
+/* periodically record the hot pages */
+void *
+mdb_warmstart_task( void *ctx, void *arg )
+{
+	struct re_s *rtask = arg;
+	struct mdb_info *mdb = rtask->arg;
+	int rc;
+
+	if ( mdb->mi_flags & MDB_IS_OPEN ) {
+		rc = mdb_warmstart_save( mdb );
+		if ( rc ) {
+			Debug( LDAP_DEBUG_ANY,
+				LDAP_XSTRING(mdb_warmstart_task) ": %s: "
+				"saving hot pages failed: %s (%d)\n",
+				mdb->mi_dbenv_home, mdb_strerror( rc ), rc );
+		}
+	}
+	ldap_pvt_thread_mutex_lock( &slapd_rq.rq_mutex );
+	ldap_pvt_runqueue_stoptask( &slapd_rq, rtask );
+	ldap_pvt_thread_mutex_unlock( &slapd_rq.rq_mutex );
+	return NULL;
+}
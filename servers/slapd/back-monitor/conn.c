@@ -195,6 +195,45 @@ monitor_subsys_conn_init(
 	*ep = e;
 	ep = &mp->mp_next;
 
+	/*
+	 * Operations refused by rate and concurrency limits
+	 */
+	BER_BVSTR( &bv, "cn=Rate Limits" );
+	e = monitor_entry_stub( &ms->mss_dn, &ms->mss_ndn, &bv,
+		mi->mi_oc_monitorCounterObject, NULL, NULL );
+
+	if ( e == NULL ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_conn_init: "
+			"unable to create entry \"cn=Rate Limits,%s\"\n",
+			ms->mss_ndn.bv_val, 0, 0 );
+		return( -1 );
+	}
+
+	BER_BVSTR( &bv, "0" );
+	attr_merge_one( e, mi->mi_ad_monitorCounter, &bv, NULL );
+
+	mp = monitor_entrypriv_create();
+	if ( mp == NULL ) {
+		return -1;
+	}
+	e->e_private = ( void * )mp;
+	mp->mp_info = ms;
+	mp->mp_flags = ms->mss_flags \
+		| MONITOR_F_SUB | MONITOR_F_PERSISTENT;
+	mp->mp_flags &= ~MONITOR_F_VOLATILE_CH;
+
+	if ( monitor_cache_add( mi, e ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"monitor_subsys_conn_init: "
+			"unable to add entry \"cn=Rate Limits,%s\"\n",
+			ms->mss_ndn.bv_val, 0, 0 );
+		return( -1 );
+	}
+
+	*ep = e;
+	ep = &mp->mp_next;
+
 	monitor_cache_release( mi, e_conn );
 
 	return( 0 );
@@ -210,7 +249,8 @@ monitor_subsys_conn_update(
 
 	long 			n = -1;
 	static struct berval	total_bv = BER_BVC( "cn=total" ),
-				current_bv = BER_BVC( "cn=current" );
+				current_bv = BER_BVC( "cn=current" ),
+				limits_bv = BER_BVC( "cn=rate limits" );
 	struct berval		rdn;
 
 	assert( mi != NULL );
@@ -232,6 +272,18 @@ monitor_subsys_conn_update(
 			/* No Op */ ;
 		}
 		connection_done( c );
+
+	} else if ( dn_match( &rdn, &limits_bv ) ) {
+		/* clients being held to quotas, one value each */
+		BerVarray	vals = NULL;
+		unsigned long	rejected;
+
+		attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+		if ( limits_client_info( &vals, &rejected ) ) {
+			attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+			ber_bvarray_free( vals );
+		}
+		n = rejected;
 	}
 
 	if ( n != -1 ) {
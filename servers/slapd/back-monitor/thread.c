@@ -34,6 +34,8 @@ typedef enum {
 	MT_UNKNOWN,
 	MT_RUNQUEUE,
 	MT_TASKLIST,
+	MT_DAEMON,
+	MT_QUEUES,
 
 	MT_LAST
 } monitor_thread_t;
@@ -87,6 +89,12 @@ static struct {
 	{ BER_BVC( "cn=Tasklist" ),
 		BER_BVC("List of running plus standby threads - besides those handling operations"),
 		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_TASKLIST },
+	{ BER_BVC( "cn=Daemon" ),
+		BER_BVC("Sessions and event rate of each listener thread"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_DAEMON },
+	{ BER_BVC( "cn=Queues" ),
+		BER_BVC("Depth, tasks and average wait in milliseconds of each thread pool queue"),
+		BER_BVNULL,	LDAP_PVT_THREAD_POOL_PARAM_UNKNOWN,	MT_QUEUES },
 
 	{ BER_BVNULL }
 };
@@ -318,6 +326,83 @@ monitor_subsys_thread_update(
 			}
 			break;
 
+		case MT_DAEMON:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			bv.bv_val = buf;
+			for ( i = 0; i < slapd_daemon_threads; i++ ) {
+				long		nactives;
+				unsigned long	nevents, rate, nmoved;
+
+				if ( slapd_daemon_stats( i, &nactives, &nevents,
+					&rate, &nmoved ) )
+				{
+					break;
+				}
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}sessions=%ld events=%lu rate=%lu migrated=%lu",
+					i, nactives, nevents, rate, nmoved );
+				if ( bv.bv_len < sizeof( buf ) ) {
+					value_add_one( &vals, &bv );
+				}
+			}
+
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			break;
+
+		case MT_QUEUES:
+			if ( a != NULL ) {
+				if ( a->a_nvals != a->a_vals ) {
+					ber_bvarray_free( a->a_nvals );
+				}
+				ber_bvarray_free( a->a_vals );
+				a->a_vals = NULL;
+				a->a_nvals = NULL;
+				a->a_numvals = 0;
+			}
+
+			bv.bv_val = buf;
+			for ( i = 0; ; i++ ) {
+				ldap_pvt_thread_poolq_stats_t	qs;
+
+				if ( ldap_pvt_thread_pool_qstats( &connection_pool,
+					i, &qs ) )
+				{
+					break;
+				}
+				bv.bv_len = snprintf( buf, sizeof( buf ),
+					"{%d}open=%d active=%d pending=%d tasks=%lu stolen=%lu wait=%.3f",
+					i, qs.lpq_open, qs.lpq_active, qs.lpq_pending,
+					qs.lpq_tasks, qs.lpq_stolen,
+					qs.lpq_tasks ? qs.lpq_wait * 1000 / qs.lpq_tasks : 0.0 );
+				if ( bv.bv_len < sizeof( buf ) ) {
+					value_add_one( &vals, &bv );
+				}
+			}
+
+			if ( vals ) {
+				attr_merge_normalize( e, mi->mi_ad_monitoredInfo, vals, NULL );
+				ber_bvarray_free( vals );
+
+			} else {
+				attr_delete( &e->e_attrs, mi->mi_ad_monitoredInfo );
+			}
+			break;
+
 		default:
 			assert( 0 );
 		}
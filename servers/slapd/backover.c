@@ -640,6 +640,39 @@ overlay_callback_after_backover( Operation *op, slap_callback *sc, int append )
 	return 1;
 }
 
+/* Called by backends right before they commit the txn of an update,
+ * so that overlays can write in it too: see SLAP_TXN_JOIN. A nonzero
+ * result aborts the update.
+ */
+int
+overlay_precommit( Operation *op, SlapReply *rs )
+{
+	slap_callback *sc;
+	slap_overinfo *oi;
+	slap_overinst *on;
+	BackendDB *be = op->o_bd, db = *op->o_bd;
+	int rc = LDAP_SUCCESS;
+
+	db.be_flags |= SLAP_DBFLAG_OVERLAY;
+	op->o_bd = &db;
+	for ( sc = op->o_callback; sc && !rc; sc = sc->sc_next ) {
+		if ( sc->sc_response != over_back_response )
+			continue;
+		oi = sc->sc_private;
+		for ( on = oi->oi_list; on; on = on->on_next ) {
+			if ( on->on_bi.bi_flags & SLAPO_BFLAG_DISABLED )
+				continue;
+			if ( on->on_precommit ) {
+				db.bd_info = (BackendInfo *)on;
+				rc = on->on_precommit( op, rs );
+				if ( rc ) break;
+			}
+		}
+	}
+	op->o_bd = be;
+	return rc;
+}
+
 /*
  * default return code in case of missing backend function
  * and overlay stack returning SLAP_CB_CONTINUE
@@ -144,6 +144,8 @@ static ConfigDriver config_tls_option;
 static ConfigDriver config_tls_config;
 #endif
 extern ConfigDriver syncrepl_config;
+extern ConfigDriver qos_config;
+extern ConfigDriver qos_weight_config;
 
 enum {
 	CFG_ACL = 1,
@@ -522,6 +524,25 @@ static ConfigTable config_back_cf_table[] = {
 #endif
 		"( OLcfgGlAt:39 NAME 'olcPluginLogFile' "
 			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
+	{ "qos", "who> <class", 3, 3, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_MAGIC, &qos_config,
+#endif
+		"( OLcfgGlAt:97 NAME 'olcQoS' "
+			"DESC 'Thread pool scheduling class of clients' "
+			"EQUALITY caseIgnoreMatch "
+			"SYNTAX OMsDirectoryString X-ORDERED 'VALUES' )", NULL, NULL },
+	{ "qosweight", "class=weight", 2, 0, 0,
+#ifdef NO_THREADS
+		ARG_IGNORED, NULL,
+#else
+		ARG_MAGIC, &qos_weight_config,
+#endif
+		"( OLcfgGlAt:98 NAME 'olcQoSWeight' "
+			"DESC 'Thread pool scheduling weights of classes' "
+			"SYNTAX OMsDirectoryString SINGLE-VALUE )", NULL, NULL },
 	{ "readonly", "on|off", 2, 2, 0, ARG_MAY_DB|ARG_ON_OFF|ARG_MAGIC|CFG_RO,
 		&config_generic, "( OLcfgGlAt:40 NAME 'olcReadOnly' "
 			"SYNTAX OMsBoolean SINGLE-VALUE )", NULL, NULL },
@@ -856,7 +877,8 @@ static ConfigOCs cf_ocs[] = {
 		 "olcIndexIntLen $ "
 		 "olcListenerThreads $ olcLocalSSF $ olcLogFile $ olcLogLevel $ "
 		 "olcPasswordCryptSaltFormat $ olcPasswordHash $ olcPidFile $ "
-		 "olcPluginLogFile $ olcReadOnly $ olcReferral $ "
+		 "olcPluginLogFile $ olcQoS $ olcQoSWeight $ "
+		 "olcReadOnly $ olcReferral $ "
 		 "olcReplogFile $ olcRequires $ olcRestrict $ olcReverseLookup $ "
 		 "olcRootDSE $ "
 		 "olcSaslAuxprops $ olcSaslAuxpropsDontUseCopy $ olcSaslAuxpropsDontUseCopyIgnore $ "
@@ -47,15 +47,43 @@
 #include "slapi/slapi.h"
 #endif
 
-/* protected by connections_mutex */
-static ldap_pvt_thread_mutex_t connections_mutex;
+/* The table is indexed by descriptor and allocated once, so a slot
+ * never moves or goes away while slapd runs.  c_struct_state is only
+ * changed with the slot's c_mutex held, and is published with release
+ * semantics so connection_next() can skip unused slots without taking
+ * any lock, then confirm its pick under c_mutex.
+ */
 static Connection *connections = NULL;
 
+#ifdef __ATOMIC_ACQUIRE
+#define CONN_STRUCT_STATE(c) \
+	__atomic_load_n( &(c)->c_struct_state, __ATOMIC_ACQUIRE )
+#define CONN_SET_STRUCT_STATE(c, st) \
+	__atomic_store_n( &(c)->c_struct_state, (st), __ATOMIC_RELEASE )
+#else
+#define CONN_STRUCT_STATE(c)	(*(volatile enum sc_struct_state *)&(c)->c_struct_state)
+#define CONN_SET_STRUCT_STATE(c, st)	(CONN_STRUCT_STATE(c) = (st))
+#endif
+
 static ldap_pvt_thread_mutex_t conn_nextid_mutex;
 static unsigned long conn_nextid = SLAPD_SYNC_SYNCCONN_OFFSET;
 
 static const char conn_lost_str[] = "connection lost";
 
+/* Once a client pipelines requests, its connection gets a readahead
+ * buffer of this size so one read() can pull many PDUs off the socket.
+ */
+#ifndef SLAP_READAHEAD
+#define SLAP_READAHEAD	16384
+#endif
+
+/* Max number of ops decoded in one read pass that are handed to
+ * the thread pool together.
+ */
+#ifndef SLAP_INPUT_BATCH
+#define SLAP_INPUT_BATCH	64
+#endif
+
 const char *
 connection_state2str( int state )
 {
@@ -79,12 +107,20 @@ typedef struct conn_readinfo {
 	void *arg;
 	void *ctx;
 	int nullop;
+	int opclass;
+	int nbatch;
+	void *batch[SLAP_INPUT_BATCH];
+	int bclass[SLAP_INPUT_BATCH];
+	int nbusy;
+	Operation *busy[SLAP_INPUT_BATCH];	/* over quota, to be refused */
 } conn_readinfo;
 
 static int connection_input( Connection *c, conn_readinfo *cri );
 static void connection_close( Connection *c );
 
 static int connection_op_activate( Operation *op );
+static void connection_op_batch( conn_readinfo *cri, Operation *op,
+	int qclass );
 static void connection_op_queue( Operation *op );
 static int connection_resched( Connection *conn );
 static void connection_abandon( Connection *conn );
@@ -108,8 +144,8 @@ int connections_init(void)
 	}
 
 	/* should check return of every call */
-	ldap_pvt_thread_mutex_init( &connections_mutex );
 	ldap_pvt_thread_mutex_init( &conn_nextid_mutex );
+	slap_timer_init();
 
 	connections = (Connection *) ch_calloc( dtblsize, sizeof(Connection) );
 
@@ -167,8 +203,8 @@ int connections_destroy(void)
 	free( connections );
 	connections = NULL;
 
-	ldap_pvt_thread_mutex_destroy( &connections_mutex );
 	ldap_pvt_thread_mutex_destroy( &conn_nextid_mutex );
+	slap_timer_destroy();
 	return 0;
 }
 
@@ -202,11 +238,44 @@ int connections_shutdown(void)
 }
 
 /*
- * Timeout idle connections.
+ * Idle timeout of one connection.  Activity only bumps c_activitytime;
+ * the timer is moved forward when it fires early.
  */
-int connections_timeout_idle(time_t now)
+static void
+connection_idle_timer( SlapTimer *t, time_t now )
+{
+	Connection *c = t->st_arg;
+
+	ldap_pvt_thread_mutex_lock( &c->c_mutex );
+
+	/* the slot may have been closed or reused since the timer fired */
+	if ( c->c_struct_state == SLAP_C_USED &&
+		c->c_conn_state != SLAP_C_CLIENT &&
+		global_idletimeout > 0 )
+	{
+		/* Don't timeout a slow-running request */
+		if ( c->c_n_ops_executing && !c->c_writewaiter ) {
+			slap_timer_set( t, now + global_idletimeout );
+
+		} else if ( difftime( c->c_activitytime+global_idletimeout, now) < 0 ) {
+			/* close it */
+			connection_closing( c, "idletimeout" );
+			connection_close( c );
+
+		} else {
+			slap_timer_set( t, c->c_activitytime + global_idletimeout + 1 );
+		}
+	}
+
+	ldap_pvt_thread_mutex_unlock( &c->c_mutex );
+}
+
+/*
+ * Re-arm or cancel the idle timers of all connections, after
+ * idletimeout was changed.
+ */
+void connections_idle_reset(void)
 {
-	int i = 0, writers = 0;
 	ber_socket_t connindex;
 	Connection* c;
 
@@ -214,26 +283,19 @@ int connections_timeout_idle(time_t now)
 		c != NULL;
 		c = connection_next( c, &connindex ) )
 	{
-		/* Don't timeout a slow-running request or a persistent
-		 * outbound connection.
-		 */
-		if(( c->c_n_ops_executing && !c->c_writewaiter)
-			|| c->c_conn_state == SLAP_C_CLIENT ) {
+		if ( c->c_conn_state == SLAP_C_CLIENT )
 			continue;
-		}
 
-		if( global_idletimeout && 
-			difftime( c->c_activitytime+global_idletimeout, now) < 0 ) {
-			/* close it */
-			connection_closing( c, "idletimeout" );
-			connection_close( c );
-			i++;
-			continue;
+		if ( global_idletimeout > 0 ) {
+			if ( !c->c_activitytime )
+				c->c_activitytime = slap_get_time();
+			slap_timer_set( &c->c_idletimer,
+				c->c_activitytime + global_idletimeout + 1 );
+		} else {
+			slap_timer_cancel( &c->c_idletimer );
 		}
 	}
 	connection_done( c );
-
-	return i;
 }
 
 /* Drop all client connections */
@@ -397,7 +459,13 @@ Connection * connection_init(
 			ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_MAX_INCOMING, &max );
 		}
 
+		c->c_idletimer.st_func = connection_idle_timer;
+		c->c_idletimer.st_arg = c;
+
 		c->c_currentber = NULL;
+		c->c_wber = NULL;
+		c->c_wpending = 0;
+		c->c_wbatch = 0;
 
 		/* should check status of thread calls */
 		ldap_pvt_thread_mutex_init( &c->c_mutex );
@@ -442,10 +510,8 @@ Connection * connection_init(
 
 	if ( flags & CONN_IS_CLIENT ) {
 		c->c_connid = 0;
-		ldap_pvt_thread_mutex_lock( &connections_mutex );
 		c->c_conn_state = SLAP_C_CLIENT;
-		c->c_struct_state = SLAP_C_USED;
-		ldap_pvt_thread_mutex_unlock( &connections_mutex );
+		CONN_SET_STRUCT_STATE( c, SLAP_C_USED );
 		c->c_close_reason = "?";			/* should never be needed */
 		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_FD, &sfd );
 		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
@@ -510,6 +576,7 @@ Connection * connection_init(
 #endif
 		ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_tcp,
 			LBER_SBIOD_LEVEL_PROVIDER, (void *)&sfd );
+		slapd_sockbuf_io( c->c_sb, s );
 	}
 
 #ifdef LDAP_DEBUG
@@ -529,12 +596,15 @@ Connection * connection_init(
 	id = c->c_connid = conn_nextid++;
 	ldap_pvt_thread_mutex_unlock( &conn_nextid_mutex );
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
 	c->c_conn_state = SLAP_C_INACTIVE;
-	c->c_struct_state = SLAP_C_USED;
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+	CONN_SET_STRUCT_STATE( c, SLAP_C_USED );
 	c->c_close_reason = "?";			/* should never be needed */
 
+	if ( global_idletimeout > 0 ) {
+		slap_timer_set( &c->c_idletimer,
+			c->c_activitytime + global_idletimeout + 1 );
+	}
+
 	c->c_ssf = c->c_transport_ssf = ssf;
 	c->c_tls_ssf = 0;
 
@@ -623,15 +693,14 @@ connection_destroy( Connection *c )
 	connid = c->c_connid;
 	close_reason = c->c_close_reason;
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
-	c->c_struct_state = SLAP_C_PENDING;
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
+	CONN_SET_STRUCT_STATE( c, SLAP_C_PENDING );
 
 	backend_connection_destroy(c);
 
 	c->c_protocol = 0;
 	c->c_connid = -1;
 
+	slap_timer_cancel( &c->c_idletimer );
 	c->c_activitytime = c->c_starttime = 0;
 
 	connection2anonymous( c );
@@ -659,6 +728,14 @@ connection_destroy( Connection *c )
 		c->c_currentber = NULL;
 	}
 
+	/* responses of a connection lost on write */
+	if ( c->c_wber != NULL ) {
+		ber_free( c->c_wber, 1 );
+		c->c_wber = NULL;
+	}
+	c->c_wpending = 0;
+	c->c_wbatch = 0;
+
 
 #ifdef LDAP_SLAPI
 	/* call destructors, then constructors; avoids unnecessary allocation */
@@ -678,7 +755,7 @@ connection_destroy( Connection *c )
 		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_MAX_INCOMING, &max );
 	}
 	c->c_conn_state = SLAP_C_INVALID;
-	c->c_struct_state = SLAP_C_UNUSED;
+	CONN_SET_STRUCT_STATE( c, SLAP_C_UNUSED );
 
 	/* c must be fully reset by this point; when we call slapd_remove
 	 * it may get immediately reused by a new connection.
@@ -864,14 +941,7 @@ Connection* connection_first( ber_socket_t *index )
 	assert( connections != NULL );
 	assert( index != NULL );
 
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
-	for( *index = 0; *index < dtblsize; (*index)++) {
-		if( connections[*index].c_struct_state != SLAP_C_UNINITIALIZED ) {
-			break;
-		}
-	}
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
-
+	*index = 0;
 	return connection_next(NULL, index);
 }
 
@@ -884,44 +954,26 @@ Connection* connection_next( Connection *c, ber_socket_t *index )
 
 	if( c != NULL ) ldap_pvt_thread_mutex_unlock( &c->c_mutex );
 
-	c = NULL;
-
-	ldap_pvt_thread_mutex_lock( &connections_mutex );
 	for(; *index < dtblsize; (*index)++) {
-		int c_struct;
-		if( connections[*index].c_struct_state == SLAP_C_UNINITIALIZED ) {
-			/* FIXME: accessing c_conn_state without locking c_mutex */
-			assert( connections[*index].c_conn_state == SLAP_C_INVALID );
+		c = &connections[*index];
+
+		/* unlocked peek; the mutex of a slot that was ever USED
+		 * is initialized and stays valid until connections_destroy()
+		 */
+		if( CONN_STRUCT_STATE( c ) != SLAP_C_USED ) {
 			continue;
 		}
 
-		if( connections[*index].c_struct_state == SLAP_C_USED ) {
-			c = &connections[(*index)++];
-			if ( ldap_pvt_thread_mutex_trylock( &c->c_mutex )) {
-				/* avoid deadlock */
-				ldap_pvt_thread_mutex_unlock( &connections_mutex );
-				ldap_pvt_thread_mutex_lock( &c->c_mutex );
-				ldap_pvt_thread_mutex_lock( &connections_mutex );
-				if ( c->c_struct_state != SLAP_C_USED ) {
-					ldap_pvt_thread_mutex_unlock( &c->c_mutex );
-					c = NULL;
-					continue;
-				}
-			}
+		ldap_pvt_thread_mutex_lock( &c->c_mutex );
+		if( c->c_struct_state == SLAP_C_USED ) {
+			(*index)++;
 			assert( c->c_conn_state != SLAP_C_INVALID );
-			break;
+			return c;
 		}
-
-		c_struct = connections[*index].c_struct_state;
-		if ( c_struct == SLAP_C_PENDING )
-			continue;
-		assert( c_struct == SLAP_C_UNUSED );
-		/* FIXME: accessing c_conn_state without locking c_mutex */
-		assert( connections[*index].c_conn_state == SLAP_C_INVALID );
+		ldap_pvt_thread_mutex_unlock( &c->c_mutex );
 	}
 
-	ldap_pvt_thread_mutex_unlock( &connections_mutex );
-	return c;
+	return NULL;
 }
 
 /* End connection loop, see connection_first() */
@@ -1093,6 +1145,12 @@ connection_operation( void *ctx, void *arg_v )
 		goto operations_error;
 	}
 
+	if ( op->o_lbusy ) {
+		send_ldap_error( op, &rs, LDAP_BUSY, op->o_lbusy );
+		rc = LDAP_BUSY;
+		goto operations_error;
+	}
+
 #ifdef LDAP_X_TXN
 	if (( conn->c_txn == CONN_TXN_SPECIFY ) && (
 		( tag == LDAP_REQ_ADD ) ||
@@ -1251,7 +1309,7 @@ void connection_client_stop(
 		ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_SET_MAX_INCOMING, &max );
 	}
 	c->c_conn_state = SLAP_C_INVALID;
-	c->c_struct_state = SLAP_C_UNUSED;
+	CONN_SET_STRUCT_STATE( c, SLAP_C_UNUSED );
 	slapd_remove( s, sb, 0, 1, 0 );
 
 	connection_return( c );
@@ -1262,7 +1320,8 @@ static int connection_read( ber_socket_t s, conn_readinfo *cri );
 static void* connection_read_thread( void* ctx, void* argv )
 {
 	int rc ;
-	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0 };
+	conn_readinfo cri = { NULL, NULL, NULL, NULL, 0, 0, 0 };
+	int i;
 	ber_socket_t s = (long)argv;
 
 	/*
@@ -1275,6 +1334,11 @@ static void* connection_read_thread( void* ctx, void* argv )
 		return (void*)(long)rc;
 	}
 
+	/* refuse the ops that were over quota, they are quick */
+	for ( i = 0; i < cri.nbusy; i++ ) {
+		connection_operation( ctx, cri.busy[i] );
+	}
+
 	/* execute a single queued request in the same thread */
 	if( cri.op && !cri.nullop ) {
 		rc = (long)connection_operation( ctx, cri.op );
@@ -1313,7 +1377,7 @@ int connection_read_activate( ber_socket_t s )
 static int
 connection_read( ber_socket_t s, conn_readinfo *cri )
 {
-	int rc = 0;
+	int rc = 0, npdus = 0;
 	Connection *c;
 
 	assert( connections != NULL );
@@ -1451,6 +1515,17 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	do {
 		/* How do we do this without getting into a busy loop ? */
 		rc = connection_input( c, cri );
+
+		/* The client is pipelining; read ahead from now on so the
+		 * rest of its PDUs come off the socket a buffer at a time.
+		 */
+		if ( !rc && ++npdus == 2 && !ber_sockbuf_ctrl( c->c_sb,
+			LBER_SB_OPT_HAS_IO, &ber_sockbuf_io_readahead ) )
+		{
+			int size = SLAP_READAHEAD;
+			ber_sockbuf_add_io( c->c_sb, &ber_sockbuf_io_readahead,
+				LBER_SBIOD_LEVEL_PROVIDER, (void *)&size );
+		}
 	}
 #ifdef DATA_READY_LOOP
 	while( !rc && ber_sockbuf_ctrl( c->c_sb, LBER_SB_OPT_DATA_READY, NULL ));
@@ -1460,6 +1535,9 @@ connection_read( ber_socket_t s, conn_readinfo *cri )
 	while(0);
 #endif
 
+	/* hand everything decoded in this pass to the pool */
+	connection_op_batch( cri, NULL, 0 );
+
 	if( rc < 0 ) {
 		Debug( LDAP_DEBUG_CONNS,
 			"connection_read(%d): input error=%d id=%lu, closing.\n",
@@ -1491,6 +1569,7 @@ connection_input( Connection *conn , conn_readinfo *cri )
 	ber_int_t	msgid;
 	BerElement	*ber;
 	int 		rc;
+	int		qclass;
 #ifdef LDAP_CONNECTIONLESS
 	Sockaddr	peeraddr;
 	char 		*cdn = NULL;
@@ -1660,6 +1739,21 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 	rc = 0;
 
+	/* Charge the op to its client's rate and concurrency quotas.
+	 * An op over quota is refused right away, by this thread,
+	 * instead of waiting for a turn in the pool.
+	 */
+	if ( limits_admit( op ) != LDAP_SUCCESS ) {
+		conn->c_n_ops_executing++;
+		connection_op_queue( op );
+		if ( cri->nbusy < SLAP_INPUT_BATCH ) {
+			cri->busy[cri->nbusy++] = op;
+		} else {
+			connection_op_batch( cri, op, SLAP_QOS_INTERNAL );
+		}
+		goto done;
+	}
+
 	/* Don't process requests when the conn is in the middle of a
 	 * Bind, or if it's closing. Also, don't let any single conn
 	 * use up all the available threads, and don't execute if we're
@@ -1712,24 +1806,26 @@ connection_input( Connection *conn , conn_readinfo *cri )
 
 		/*
 		 * The first op will be processed in the same thread context,
-		 * as long as there is only one op total.
-		 * Subsequent ops will be submitted to the pool by
-		 * calling connection_op_activate()
+		 * as long as there is only one op total and its class is not
+		 * weighted below connection I/O.
+		 * Otherwise all of them are collected and submitted to the
+		 * pool together by connection_op_batch()
 		 */
-		if ( cri->op == NULL ) {
+		connection_op_queue( op );
+		qclass = qos_class( op );
+		if ( cri->op == NULL && !cri->nullop && qos_inline( qclass )) {
 			/* the first incoming request */
-			connection_op_queue( op );
 			cri->op = op;
+			cri->opclass = qclass;
 		} else {
-			if ( !cri->nullop ) {
-				cri->nullop = 1;
-				rc = ldap_pvt_thread_pool_submit( &connection_pool,
-					connection_operation, (void *) cri->op );
-			}
-			connection_op_activate( op );
+			if ( cri->op != NULL && !cri->nullop )
+				connection_op_batch( cri, cri->op, cri->opclass );
+			cri->nullop = 1;
+			connection_op_batch( cri, op, qclass );
 		}
 	}
 
+done:
 #ifdef NO_THREADS
 	if ( conn->c_struct_state != SLAP_C_USED ) {
 		/* connection must have got closed underneath us */
@@ -1914,8 +2010,8 @@ static int connection_op_activate( Operation *op )
 
 	connection_op_queue( op );
 
-	rc = ldap_pvt_thread_pool_submit( &connection_pool,
-		connection_operation, (void *) op );
+	rc = ldap_pvt_thread_pool_submit_class( &connection_pool,
+		qos_class( op ), connection_operation, (void *) op );
 
 	if ( rc != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -1927,6 +2023,36 @@ static int connection_op_activate( Operation *op )
 	return rc;
 }
 
+/* Collect ops for the pool; submit them when the batch is full,
+ * or when called with a NULL op.
+ */
+static void connection_op_batch( conn_readinfo *cri, Operation *op,
+	int qclass )
+{
+	int i, rc;
+
+	if ( op != NULL ) {
+		cri->bclass[cri->nbatch] = qclass;
+		cri->batch[cri->nbatch++] = op;
+		if ( cri->nbatch < SLAP_INPUT_BATCH )
+			return;
+	}
+	if ( cri->nbatch == 0 )
+		return;
+
+	rc = ldap_pvt_thread_pool_submit_batch( &connection_pool,
+		connection_operation, cri->batch, cri->bclass, cri->nbatch );
+
+	for ( i = rc < 0 ? 0 : rc; i < cri->nbatch; i++ ) {
+		op = cri->batch[i];
+		Debug( LDAP_DEBUG_ANY,
+			"connection_op_batch: submit failed for conn=%lu op=%lu\n",
+			op->o_connid, op->o_opid, 0 );
+		/* should move op to pending list */
+	}
+	cri->nbatch = 0;
+}
+
 int connection_write(ber_socket_t s)
 {
 	Connection *c;
@@ -45,7 +45,13 @@
 #include <poll.h>
 #endif
 
-#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
+#if defined(HAVE_IO_URING)
+# include <poll.h>
+# include <sys/mman.h>
+# include <sys/syscall.h>
+# include <linux/io_uring.h>
+# include <sys/eventfd.h>
+#elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL)
 # include <sys/epoll.h>
 #elif defined(SLAP_X_DEVPOLL) && defined(HAVE_SYS_DEVPOLL_H) && defined(HAVE_DEVPOLL)
 # include <sys/types.h>
@@ -82,6 +88,7 @@ struct runqueue_s slapd_rq;
 #endif
 int slapd_daemon_threads = 1;
 int slapd_daemon_mask;
+int slapd_reuseport;
 
 #ifdef LDAP_TCP_BUFFER
 int slapd_tcp_rmem;
@@ -96,7 +103,33 @@ static ldap_pvt_thread_t *listener_tid;
 #define SLAPD_LISTEN_BACKLOG 1024
 #endif /* ! SLAPD_LISTEN_BACKLOG */
 
-#define	DAEMON_ID(fd)	(fd & slapd_daemon_mask)
+/* The daemon thread watching each descriptor. Listeners are spread
+ * by descriptor number; sessions go to the least loaded thread and
+ * may be migrated later on, see slapd_balance().
+ */
+typedef struct slap_fd_st {
+	unsigned char		sf_daemon;
+	unsigned char		sf_active;	/* counted in sd_nactives */
+	unsigned char		sf_movable;	/* a session, may be migrated */
+	unsigned		sf_events;	/* since the last balance */
+} slap_fd_st;
+
+static slap_fd_st *slap_fds;
+static ber_socket_t slap_fds_max;	/* highest descriptor seen, plus one */
+
+#define	DAEMON_ID(fd)	(slap_fds ? slap_fds[fd].sf_daemon : \
+	((fd) & slapd_daemon_mask))
+
+#define SLAPD_EVENT_COUNT(t,fd)	do { \
+	slap_daemon[t].sd_nevents++; \
+	slap_fds[fd].sf_events++; \
+} while (0)
+
+#ifndef SLAPD_BALANCE_INTERVAL
+#define SLAPD_BALANCE_INTERVAL	4	/* seconds */
+#endif
+#define SLAPD_BALANCE_MIN	64	/* events per second worth a move */
+#define SLAPD_BALANCE_MAX	8	/* sessions moved per interval */
 
 static ber_socket_t wake_sds[SLAPD_MAX_DAEMON_THREADS][2];
 static int emfile;
@@ -133,6 +166,84 @@ SOCKET *slapd_ws_sockets;
 static ldap_pvt_thread_mutex_t	sd_tcpd_mutex;
 #endif /* TCP Wrappers */
 
+#if defined(HAVE_IO_URING)
+/* The rings shared with the kernel, see io_uring_setup(2) */
+typedef struct slap_uring {
+	int			ur_fd;
+	void			*ur_ring;
+	size_t			ur_ringlen;
+	struct io_uring_sqe	*ur_sqes;
+	size_t			ur_sqeslen;
+	unsigned		ur_sqentries;
+	unsigned		ur_sqmask;
+	unsigned		*ur_sqhead;
+	unsigned		*ur_sqtail;
+	unsigned		ur_cqmask;
+	unsigned		*ur_cqhead;
+	unsigned		*ur_cqtail;
+	struct io_uring_cqe	*ur_cqes;
+	/* serializes the submission ring, sessions send from any thread */
+	ldap_pvt_thread_mutex_t	ur_mutex;
+} slap_uring;
+
+/* Per descriptor state */
+typedef struct slap_ufd {
+	Listener		*uf_l;
+	unsigned		uf_gen;		/* tags requests, see SLAP_URING_UDATA */
+	short			uf_want;	/* POLLIN/POLLOUT and SLAP_URING_ACTIVE */
+	short			uf_armed;	/* events of the outstanding request */
+} slap_ufd;
+
+/* Work the daemon thread does once it has released sd_mutex */
+typedef struct slap_udefer {
+	Listener		*ud_l;		/* accept result, else a handoff */
+	int			ud_res;		/* accepted fd or -errno, or the fd */
+} slap_udefer;
+
+#ifndef SLAP_URING_RECVBUF
+#define SLAP_URING_RECVBUF	4096
+#endif
+#ifndef SLAP_URING_SENDBUF
+#define SLAP_URING_SENDBUF	65536
+#endif
+
+/*
+ * A TCP session whose reads and writes go through the ring, see
+ * slap_sockbuf_io_uring. Its receive and send requests are tagged with
+ * the address of this structure, so they complete on whichever ring
+ * they were submitted to, even after the session has moved elsewhere.
+ * Lock order is sd_mutex, then io_mutex, then ur_mutex.
+ */
+typedef struct slap_uring_io {
+	ldap_pvt_thread_mutex_t	io_mutex;
+	ber_socket_t		io_sd;
+	char			io_closed;	/* descriptor is going away */
+	char			io_gone;	/* Sockbuf freed, free once idle */
+
+	char			io_rbusy;	/* IORING_OP_RECV outstanding */
+	char			io_rcancel;	/* ... and cancelled */
+	char			io_rfull;	/* last receive filled io_rbuf */
+	char			io_reof;
+	int			io_rerr;
+	int			io_rring;	/* ring of the receive */
+	unsigned		io_rlen, io_roff;
+
+	char			io_sbusy;	/* IORING_OP_SEND outstanding */
+	char			io_sneed;	/* a write was refused */
+	char			io_swait;	/* slapd_wait_writer() is waiting */
+	int			io_serr;
+	int			io_sring;	/* ring of the send */
+	int			io_wfd;		/* eventfd for slapd_wait_writer() */
+	unsigned		io_slen, io_soff;
+	char			*io_sbuf;	/* SLAP_URING_SENDBUF bytes */
+
+	char			io_rbuf[SLAP_URING_RECVBUF];
+} slap_uring_io;
+
+/* Indexed by fd, the sessions doing their I/O through a ring */
+static slap_uring_io **slap_uring_ios;
+#endif /* HAVE_IO_URING */
+
 typedef struct slap_daemon_st {
 	ldap_pvt_thread_mutex_t	sd_mutex;
 
@@ -140,7 +251,23 @@ typedef struct slap_daemon_st {
 	int			sd_nwriters;
 	int			sd_nfds;
 
-#if defined(HAVE_EPOLL)
+	/* event rate accounting, see slapd_balance() */
+	unsigned long		sd_nevents;	/* events dispatched */
+	unsigned long		sd_balevents;	/* sd_nevents at the last balance */
+	time_t			sd_baltime;
+	unsigned long		sd_rate;	/* events per second, smoothed */
+	unsigned long		sd_nmoved;	/* sessions migrated away */
+
+#if defined(HAVE_IO_URING)
+	slap_uring		sd_uring;
+	slap_ufd		*sd_ufds;
+	struct pollfd		*sd_uevents;
+	int			sd_unevents;
+	int			sd_upollaccept;
+	slap_udefer		*sd_udefer;
+	int			sd_undefer;
+	char			sd_uwake[BUFSIZ];
+#elif defined(HAVE_EPOLL)
 	struct epoll_event	*sd_epolls;
 	int			*sd_index;
 	int			sd_epfd;
@@ -171,11 +298,136 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
  *   with file descriptors and events respectively
  *
  * - SLAP_<type>_* for private interface; type by now is one of
- *   EPOLL, DEVPOLL, SELECT
+ *   URING, EPOLL, DEVPOLL, SELECT
  *
  * private interface should not be used in the code.
  */
-#if defined(HAVE_EPOLL)
+#if defined(HAVE_IO_URING)
+/*************************************************
+ * Use io_uring infrastructure - io_uring(7)     *
+ *************************************************/
+# define SLAP_EVENT_FNAME		"io_uring"
+# define SLAP_EVENTS_ARE_INDEXED	0
+/*
+ * TCP sessions do their I/O through the ring: an IORING_OP_RECV is
+ * kept outstanding while a session wants to read, and the data it
+ * brings back is handed out by the session's Sockbuf layer, so a read
+ * event costs neither a poll nor a read(2). Writes are copied to a
+ * send buffer and go out with IORING_OP_SEND, see slap_sockbuf_io_uring.
+ * Other descriptors are tracked with one-shot IORING_OP_POLL_ADD
+ * requests. Either way the level-triggered behaviour of the other
+ * mechanisms is kept: a request is re-armed only once its event has
+ * been dispatched, and data left over is signalled again by an
+ * IORING_OP_NOP. Interest changes are queued in the submission ring
+ * and reach the kernel along with the next wait, in a single
+ * io_uring_enter(2). Stream listeners use a multishot IORING_OP_ACCEPT,
+ * and the wake descriptor is drained by an IORING_OP_READ, so neither
+ * costs a system call of its own.
+ *
+ * - sd_ufds	is indexed by the fd itself
+ * - sd_uevents	holds the events reaped by the last wait; the next
+ *		wait re-arms those descriptors still wanting events
+ * - user_data	of a request tells its kind in the low two bits
+ */
+# define SLAP_URING_ACTIVE		0x4000
+# define SLAP_URING_CANCEL		(~(__u64)0)
+# define SLAP_URING_POLL		0	/* poll, accept or wake read */
+# define SLAP_URING_RECV		1
+# define SLAP_URING_SEND		2
+# define SLAP_URING_READY		3	/* session has data left over */
+# define SLAP_URING_KIND(u)		((unsigned)(u) & 3)
+# define SLAP_URING_SOCK_UF(t,s)	(slap_daemon[t].sd_ufds[(s)])
+# define SLAP_URING_UDATA(t,s,k)	\
+	(((__u64)SLAP_URING_SOCK_UF(t,s).uf_gen << 32) | \
+	((unsigned)(s) << 2) | (k))
+# define SLAP_URING_IODATA(io,k)	((__u64)(uintptr_t)(io) | (k))
+# ifdef LDAP_CONNECTIONLESS
+#  define SLAP_URING_ACCEPTS(t,l)	\
+	(!(l)->sl_is_udp && !slap_daemon[t].sd_upollaccept)
+# else
+#  define SLAP_URING_ACCEPTS(t,l)	(!slap_daemon[t].sd_upollaccept)
+# endif
+
+# define SLAP_SOCK_IS_ACTIVE(t,s)	\
+	(SLAP_URING_SOCK_UF(t,s).uf_want & SLAP_URING_ACTIVE)
+# define SLAP_SOCK_NOT_ACTIVE(t,s)	(!SLAP_SOCK_IS_ACTIVE(t,s))
+# define SLAP_URING_SOCK_IS_SET(t,s, mode)	(SLAP_URING_SOCK_UF(t,s).uf_want & (mode))
+
+# define SLAP_SOCK_IS_READ(t,s)		SLAP_URING_SOCK_IS_SET(t,(s), POLLIN)
+# define SLAP_SOCK_IS_WRITE(t,s)		SLAP_URING_SOCK_IS_SET(t,(s), POLLOUT)
+
+# define SLAP_URING_SOCK_SET(t,s, mode)	do { \
+	SLAP_URING_SOCK_UF(t,s).uf_want |= (mode); \
+	slap_uring_arm( (t), (s) ); \
+} while (0)
+
+/* A request left outstanding for a cleared interest is not cancelled,
+ * its event is dropped when reaped; listeners must really stop accepting.
+ */
+# define SLAP_URING_SOCK_CLR(t,s, mode)	do { \
+	SLAP_URING_SOCK_UF(t,s).uf_want &= ~(mode); \
+	if ( SLAP_URING_SOCK_UF(t,s).uf_l ) slap_uring_arm( (t), (s) ); \
+} while (0)
+
+# define SLAP_SOCK_SET_READ(t,s)		SLAP_URING_SOCK_SET(t,s, POLLIN)
+# define SLAP_SOCK_SET_WRITE(t,s)		SLAP_URING_SOCK_SET(t,s, POLLOUT)
+
+# define SLAP_SOCK_CLR_READ(t,s)		SLAP_URING_SOCK_CLR(t,(s), POLLIN)
+# define SLAP_SOCK_CLR_WRITE(t,s)		SLAP_URING_SOCK_CLR(t,(s), POLLOUT)
+
+# define SLAP_URING_EVENT_CLR(i, mode)	(revents[(i)].revents &= ~(mode))
+
+# define SLAP_EVENT_MAX(t)			slap_daemon[t].sd_nfds
+
+# define SLAP_SOCK_ADD(t, s, l)		do { \
+	SLAP_URING_SOCK_UF(t,(s)).uf_l = (l); \
+	SLAP_URING_SOCK_UF(t,(s)).uf_want = SLAP_URING_ACTIVE|POLLIN; \
+	slap_daemon[t].sd_nfds++; \
+	slap_uring_arm( (t), (s) ); \
+} while (0)
+
+/* The cancellation is submitted right away: an outstanding request
+ * holds a reference on the file, which would keep the session open
+ * after the descriptor is closed.
+ */
+# define SLAP_SOCK_DEL(t,s)		do { \
+	if ( SLAP_SOCK_NOT_ACTIVE(t,(s)) ) break; \
+	SLAP_URING_SOCK_UF(t,(s)).uf_want = 0; \
+	slap_uring_arm( (t), (s) ); \
+	slap_uring_enter( &slap_daemon[t].sd_uring, 0, 0, NULL ); \
+	SLAP_URING_SOCK_UF(t,(s)).uf_l = NULL; \
+	slap_daemon[t].sd_nfds--; \
+} while (0)
+
+# define SLAP_EVENT_CLR_READ(i)		SLAP_URING_EVENT_CLR((i), POLLIN)
+# define SLAP_EVENT_CLR_WRITE(i)	SLAP_URING_EVENT_CLR((i), POLLOUT)
+
+# define SLAP_URING_EVENT_CHK(i, mode)	(revents[(i)].revents & (mode))
+
+# define SLAP_EVENT_FD(t,i)		(revents[(i)].fd)
+
+# define SLAP_EVENT_IS_READ(i)		SLAP_URING_EVENT_CHK((i), POLLIN)
+# define SLAP_EVENT_IS_WRITE(i)		SLAP_URING_EVENT_CHK((i), POLLOUT)
+# define SLAP_EVENT_IS_LISTENER(t,i)	(SLAP_URING_SOCK_UF(t,SLAP_EVENT_FD(t,(i))).uf_l != NULL)
+# define SLAP_EVENT_LISTENER(t,i)		(SLAP_URING_SOCK_UF(t,SLAP_EVENT_FD(t,(i))).uf_l)
+
+# define SLAP_SOCK_INIT(t)		do { \
+	if ( slap_uring_init( (t) ) ) return -1; \
+} while (0)
+
+# define SLAP_SOCK_DESTROY(t)		slap_uring_destroy( (t) )
+
+# define SLAP_EVENT_DECL		struct pollfd *revents
+
+# define SLAP_EVENT_INIT(t)		do { \
+	revents = slap_daemon[t].sd_uevents; \
+} while (0)
+
+# define SLAP_EVENT_WAIT(t, tvp, nsp)	do { \
+	*(nsp) = slap_uring_wait( (t), (tvp) ); \
+} while (0)
+
+#elif defined(HAVE_EPOLL)
 /***************************************
  * Use epoll infrastructure - epoll(4) *
  ***************************************/
@@ -678,6 +930,823 @@ static slap_daemon_st slap_daemon[SLAPD_MAX_DAEMON_THREADS];
 # endif /* !HAVE_WINSOCK */
 #endif /* ! epoll && ! /dev/poll */
 
+#ifdef HAVE_IO_URING
+static void *slap_accepted_thread( void *ctx, void *ptr );
+static int slapd_lock_fd( ber_socket_t s );
+
+/* A connection accepted by the daemon thread, set up by a pool thread */
+typedef struct slap_accepted {
+	Listener	*sa_l;
+	ber_socket_t	sa_sd;
+} slap_accepted;
+
+/* Submit everything queued, optionally waiting for completions */
+static int
+slap_uring_enter(
+	slap_uring *ur,
+	unsigned min_complete,
+	unsigned flags,
+	struct io_uring_getevents_arg *arg )
+{
+	return syscall( __NR_io_uring_enter, ur->ur_fd, ur->ur_sqentries,
+		min_complete, flags, arg, arg ? sizeof( *arg ) : 0 );
+}
+
+/* Get the next free submission entry. Returns with ur_mutex held
+ * unless NULL, slap_uring_push() releases it.
+ */
+static struct io_uring_sqe *
+slap_uring_sqe( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_uring;
+	unsigned tail;
+	struct io_uring_sqe *sqe;
+
+	ldap_pvt_thread_mutex_lock( &ur->ur_mutex );
+	tail = *ur->ur_sqtail;
+	if ( tail - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE )
+		>= ur->ur_sqentries )
+	{
+		/* ring is full, flush it to the kernel */
+		slap_uring_enter( ur, 0, 0, NULL );
+		if ( tail - __atomic_load_n( ur->ur_sqhead, __ATOMIC_ACQUIRE )
+			>= ur->ur_sqentries )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: " SLAP_EVENT_FNAME ": submission ring full, "
+				"errno=%d, shutting down\n", errno, 0, 0 );
+			slapd_shutdown = 2;
+			ldap_pvt_thread_mutex_unlock( &ur->ur_mutex );
+			return NULL;
+		}
+	}
+	sqe = &ur->ur_sqes[tail & ur->ur_sqmask];
+	memset( sqe, 0, sizeof( *sqe ) );
+	return sqe;
+}
+
+static void
+slap_uring_push( int t )
+{
+	slap_uring *ur = &slap_daemon[t].sd_uring;
+
+	__atomic_store_n( ur->ur_sqtail, *ur->ur_sqtail + 1, __ATOMIC_RELEASE );
+	ldap_pvt_thread_mutex_unlock( &ur->ur_mutex );
+}
+
+static void
+slap_uring_cancel( int t, __u64 udata )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( t );
+
+	if ( sqe == NULL ) return;
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = udata;
+	sqe->user_data = SLAP_URING_CANCEL;
+	slap_uring_push( t );
+}
+
+/* Events session io can be given right away. Must hold io_mutex. */
+static short
+slap_uring_io_ready( slap_uring_io *io )
+{
+	short events = 0;
+
+	if ( io->io_roff < io->io_rlen || io->io_reof || io->io_rerr )
+		events |= POLLIN;
+	if ( io->io_slen < SLAP_URING_SENDBUF || io->io_serr )
+		events |= POLLOUT;
+	return events;
+}
+
+/* Send what io has buffered on ring t. Must hold io_mutex, so the
+ * request is submitted before the descriptor can be closed.
+ */
+static void
+slap_uring_send( int t, slap_uring_io *io )
+{
+	struct io_uring_sqe *sqe = slap_uring_sqe( t );
+
+	if ( sqe == NULL ) return;
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = io->io_sd;
+	sqe->addr = (__u64)(uintptr_t)( io->io_sbuf + io->io_soff );
+	sqe->len = io->io_slen - io->io_soff;
+	sqe->msg_flags = MSG_NOSIGNAL;
+	sqe->user_data = SLAP_URING_IODATA( io, SLAP_URING_SEND );
+	slap_uring_push( t );
+	slap_uring_enter( &slap_daemon[t].sd_uring, 0, 0, NULL );
+	io->io_sbusy = 1;
+	io->io_sring = t;
+}
+
+static void
+slap_uring_io_free( slap_uring_io *io )
+{
+	ldap_pvt_thread_mutex_destroy( &io->io_mutex );
+	if ( io->io_wfd >= 0 )
+		close( io->io_wfd );
+	if ( io->io_sbuf != NULL )
+		ch_free( io->io_sbuf );
+	ch_free( io );
+}
+
+/* Bring the requests of session s, doing its I/O through the ring, in
+ * line with its interest. Must hold sd_mutex.
+ */
+static void
+slap_uring_io_arm( int t, ber_socket_t s, slap_uring_io *io )
+{
+	slap_ufd *uf = &slap_daemon[t].sd_ufds[s];
+	struct io_uring_sqe *sqe;
+	short want = uf->uf_want & ( POLLIN | POLLOUT ), ready;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( !( uf->uf_want & SLAP_URING_ACTIVE ) ) {
+		/* the receive holds a reference on the file */
+		if ( io->io_rbusy && !io->io_rcancel ) {
+			slap_uring_cancel( io->io_rring,
+				SLAP_URING_IODATA( io, SLAP_URING_RECV ) );
+			io->io_rcancel = 1;
+		}
+		if ( uf->uf_armed ) {
+			uf->uf_armed = 0;
+			uf->uf_gen++;
+		}
+		goto done;
+	}
+
+	ready = slap_uring_io_ready( io ) & want;
+	if ( ready ) {
+		/* a notice still outstanding reports the current state too */
+		if ( uf->uf_armed ) goto done;
+		sqe = slap_uring_sqe( t );
+		if ( sqe == NULL ) goto done;
+		sqe->opcode = IORING_OP_NOP;
+		sqe->fd = -1;
+		sqe->user_data = SLAP_URING_UDATA( t, s, SLAP_URING_READY );
+		slap_uring_push( t );
+		uf->uf_armed = ready;
+
+	} else if ( ( want & POLLIN ) && !io->io_rbusy ) {
+		sqe = slap_uring_sqe( t );
+		if ( sqe == NULL ) goto done;
+		sqe->opcode = IORING_OP_RECV;
+		sqe->fd = s;
+		sqe->addr = (__u64)(uintptr_t)io->io_rbuf;
+		sqe->len = sizeof( io->io_rbuf );
+		sqe->user_data = SLAP_URING_IODATA( io, SLAP_URING_RECV );
+		slap_uring_push( t );
+		io->io_rbusy = 1;
+		io->io_rcancel = 0;
+		io->io_rring = t;
+	}
+	/* else a full send buffer, the send completion tells */
+
+done:
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+}
+
+/* Bring the outstanding request of s in line with its interest.
+ * Must hold sd_mutex.
+ */
+static void
+slap_uring_arm( int t, ber_socket_t s )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_ufd *uf = &sd->sd_ufds[s];
+	struct io_uring_sqe *sqe;
+	short want = 0;
+
+	if ( !uf->uf_l && slap_uring_ios[s] != NULL ) {
+		slap_uring_io_arm( t, s, slap_uring_ios[s] );
+		return;
+	}
+
+	if ( uf->uf_want & SLAP_URING_ACTIVE )
+		want = uf->uf_want & ( POLLIN | POLLOUT );
+
+	if ( uf->uf_armed ) {
+		if ( want ? !( want & ~uf->uf_armed ) :
+			( ( uf->uf_want & SLAP_URING_ACTIVE ) && !uf->uf_l ) )
+		{
+			return;
+		}
+		slap_uring_cancel( t, SLAP_URING_UDATA( t, s, SLAP_URING_POLL ) );
+		uf->uf_armed = 0;
+		uf->uf_gen++;
+	}
+	if ( !want ) return;
+
+	sqe = slap_uring_sqe( t );
+	if ( sqe == NULL ) return;
+	sqe->fd = s;
+	if ( uf->uf_l && SLAP_URING_ACCEPTS( t, uf->uf_l ) ) {
+		sqe->opcode = IORING_OP_ACCEPT;
+		sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	} else if ( s == wake_sds[t][0] ) {
+		sqe->opcode = IORING_OP_READ;
+		sqe->addr = (__u64)(uintptr_t)sd->sd_uwake;
+		sqe->len = sizeof( sd->sd_uwake );
+	} else {
+		sqe->opcode = IORING_OP_POLL_ADD;
+#ifdef WORDS_BIGENDIAN
+		sqe->poll32_events = (__u32)want << 16;
+#else
+		sqe->poll32_events = want;
+#endif
+	}
+	sqe->user_data = SLAP_URING_UDATA( t, s, SLAP_URING_POLL );
+	slap_uring_push( t );
+	uf->uf_armed = want;
+}
+
+/* Account for a completed receive or send of session io. Returns the
+ * session to notify and the events it can be given, or
+ * AC_SOCKET_INVALID. Must hold sd_mutex of ring t.
+ */
+static ber_socket_t
+slap_uring_io_done( int t, slap_uring_io *io, int kind, int res,
+	short *events )
+{
+	ber_socket_t s = AC_SOCKET_INVALID;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( kind == SLAP_URING_RECV ) {
+		io->io_rbusy = 0;
+		if ( res > 0 ) {
+			io->io_rlen = res;
+			io->io_roff = 0;
+			io->io_rfull = ( res == sizeof( io->io_rbuf ) );
+		} else if ( res == 0 ) {
+			io->io_reof = 1;
+		} else if ( res != -ECANCELED ) {
+			io->io_rerr = -res;
+		}
+		if ( !io->io_closed ) s = io->io_sd;
+
+	} else {
+		io->io_sbusy = 0;
+		if ( res < 0 ) {
+			io->io_serr = -res;
+			io->io_slen = io->io_soff = 0;
+		} else {
+			io->io_soff += res;
+		}
+		if ( io->io_soff == io->io_slen ) {
+			io->io_slen = io->io_soff = 0;
+			if ( io->io_sbuf != NULL ) {
+				ch_free( io->io_sbuf );
+				io->io_sbuf = NULL;
+			}
+		} else if ( !io->io_closed ) {
+			/* short send, the kernel is done with the buffer */
+			io->io_slen -= io->io_soff;
+			AC_MEMCPY( io->io_sbuf, io->io_sbuf + io->io_soff, io->io_slen );
+			io->io_soff = 0;
+			slap_uring_send( t, io );
+		}
+		if ( io->io_swait )
+			eventfd_write( io->io_wfd, 1 );
+		if ( io->io_sneed && !io->io_closed ) {
+			io->io_sneed = 0;
+			s = io->io_sd;
+		}
+	}
+	*events = slap_uring_io_ready( io );
+
+	if ( io->io_gone && !io->io_rbusy && !io->io_sbusy ) {
+		ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+		slap_uring_io_free( io );
+		return AC_SOCKET_INVALID;
+	}
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+	return s;
+}
+
+/* Hand a connection accepted on sl to the thread pool */
+static void
+slap_uring_accepted( int t, Listener *sl, int res )
+{
+	slap_accepted *sa;
+	int err;
+
+	if ( res >= 0 ) {
+		sa = ch_malloc( sizeof( slap_accepted ) );
+		sa->sa_l = sl;
+		sa->sa_sd = res;
+		if ( ldap_pvt_thread_pool_submit( &connection_pool,
+			slap_accepted_thread, (void *) sa ) != 0 )
+		{
+			Debug( LDAP_DEBUG_ANY,
+				"daemon: " SLAP_EVENT_FNAME ": "
+				"submit of new connection %d failed\n", res, 0, 0 );
+			ch_free( sa );
+			tcp_close( res );
+		}
+		return;
+	}
+
+	err = -res;
+	if ( err == EINVAL && !slap_daemon[t].sd_upollaccept ) {
+		/* multishot accept not supported by this kernel;
+		 * fall back to polling the listeners */
+		Debug( LDAP_DEBUG_ANY,
+			"daemon: " SLAP_EVENT_FNAME ": "
+			"multishot accept unavailable, polling listeners\n", 0, 0, 0 );
+		ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+		slap_daemon[t].sd_upollaccept = 1;
+		ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+		return;
+	}
+	if (
+#ifdef EMFILE
+		err == EMFILE ||
+#endif /* EMFILE */
+#ifdef ENFILE
+		err == ENFILE ||
+#endif /* ENFILE */
+		0 )
+	{
+		/* as in slap_listener(); the multishot accept may fail more
+		 * than once before the daemon loop stops it */
+		ldap_pvt_thread_mutex_lock( &slap_daemon[0].sd_mutex );
+		if ( !sl->sl_mute ) {
+			emfile++;
+			/* Stop listening until an existing session closes */
+			sl->sl_mute = 1;
+		}
+		ldap_pvt_thread_mutex_unlock( &slap_daemon[0].sd_mutex );
+	}
+	Debug( LDAP_DEBUG_ANY,
+		"daemon: accept(%ld) failed errno=%d (%s)\n",
+		(long) sl->sl_sd, err, sock_errstr(err) );
+}
+
+/* Finish what slap_uring_reap() left for after sd_mutex */
+static void
+slap_uring_deferred( int t, slap_udefer *ud )
+{
+	ber_socket_t s = ud->ud_res;
+	int id;
+
+	if ( ud->ud_l != NULL ) {
+		slap_uring_accepted( t, ud->ud_l, ud->ud_res );
+		return;
+	}
+
+	/* a session that moved to another thread since its request */
+	id = slapd_lock_fd( s );
+	if ( SLAP_SOCK_IS_ACTIVE( id, s ) ) slap_uring_arm( id, s );
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
+	if ( id != t ) WAKE_LISTENER( id, 1 );
+}
+
+/* Collect the completions into sd_uevents. Must hold sd_mutex. */
+static int
+slap_uring_reap( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring *ur = &sd->sd_uring;
+	unsigned head, tail;
+	int n = 0;
+
+	head = *ur->ur_cqhead;
+	tail = __atomic_load_n( ur->ur_cqtail, __ATOMIC_ACQUIRE );
+
+	for ( ; head != tail && n + sd->sd_undefer < dtblsize; head++ ) {
+		struct io_uring_cqe *cqe = &ur->ur_cqes[head & ur->ur_cqmask];
+		__u64 udata = cqe->user_data;
+		int kind = SLAP_URING_KIND( udata );
+		ber_socket_t s;
+		slap_ufd *uf;
+		short events;
+
+		if ( udata == SLAP_URING_CANCEL ) continue;
+
+		if ( kind == SLAP_URING_RECV || kind == SLAP_URING_SEND ) {
+			s = slap_uring_io_done( t,
+				(slap_uring_io *)(uintptr_t)( udata & ~(__u64)3 ),
+				kind, cqe->res, &events );
+			if ( s == AC_SOCKET_INVALID ) continue;
+			if ( DAEMON_ID( s ) != t ) {
+				sd->sd_udefer[sd->sd_undefer].ud_l = NULL;
+				sd->sd_udefer[sd->sd_undefer].ud_res = s;
+				sd->sd_undefer++;
+				continue;
+			}
+			if ( SLAP_SOCK_NOT_ACTIVE( t, s ) ) continue;
+			uf = &sd->sd_ufds[s];
+			events &= uf->uf_want;
+			if ( !events ) {
+				slap_uring_arm( t, s );
+				continue;
+			}
+			/* supersedes a notice still outstanding */
+			if ( uf->uf_armed ) {
+				uf->uf_armed = 0;
+				uf->uf_gen++;
+			}
+
+		} else {
+			s = (ber_socket_t)( ( udata & 0xffffffffU ) >> 2 );
+			uf = &sd->sd_ufds[s];
+			/* completion of a request cancelled since */
+			if ( (unsigned)( udata >> 32 ) != uf->uf_gen ) continue;
+			if ( !( cqe->flags & IORING_CQE_F_MORE ) ) uf->uf_armed = 0;
+
+			if ( uf->uf_l && SLAP_URING_ACCEPTS( t, uf->uf_l ) ) {
+				/* emfile is not ours to update here */
+				sd->sd_udefer[sd->sd_undefer].ud_l = uf->uf_l;
+				sd->sd_udefer[sd->sd_undefer].ud_res = cqe->res;
+				sd->sd_undefer++;
+				continue;
+			}
+
+			if ( s == wake_sds[t][0] ) {
+				waking = 0;
+				slap_uring_arm( t, s );
+				continue;
+			}
+
+			if ( kind == SLAP_URING_READY ) {
+				slap_uring_io *io = slap_uring_ios[s];
+
+				if ( io == NULL ) continue;
+				ldap_pvt_thread_mutex_lock( &io->io_mutex );
+				events = slap_uring_io_ready( io ) & uf->uf_want;
+				ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+				if ( !events ) {
+					slap_uring_arm( t, s );
+					continue;
+				}
+			} else {
+				if ( cqe->res < 0 ) {
+					events = POLLERR;
+				} else {
+					events = cqe->res;
+				}
+				/* hangups and errors surface through the read or write path */
+				if ( events & ( POLLERR | POLLHUP ) ) {
+					events |= ( uf->uf_want & POLLIN ) ? POLLIN : POLLOUT;
+				}
+				events &= uf->uf_want & ( POLLIN | POLLOUT );
+				if ( !events ) continue;
+			}
+		}
+
+		sd->sd_uevents[n].fd = s;
+		sd->sd_uevents[n].revents = events;
+		n++;
+	}
+	__atomic_store_n( ur->ur_cqhead, head, __ATOMIC_RELEASE );
+
+	return n;
+}
+
+static int
+slap_uring_wait( int t, struct timeval *tvp )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	int i, rc;
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	for ( i = 0; i < sd->sd_unevents; i++ ) {
+		ber_socket_t s = sd->sd_uevents[i].fd;
+		if ( SLAP_SOCK_IS_ACTIVE( t, s ) ) slap_uring_arm( t, s );
+	}
+	sd->sd_unevents = 0;
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	memset( &arg, 0, sizeof( arg ) );
+	if ( tvp ) {
+		ts.tv_sec = tvp->tv_sec;
+		ts.tv_nsec = tvp->tv_usec * 1000;
+		arg.ts = (__u64)(uintptr_t)&ts;
+	}
+	rc = slap_uring_enter( &sd->sd_uring, 1,
+		IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg );
+	if ( rc < 0 && errno != ETIME && errno != EBUSY ) {
+		return -1;
+	}
+
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	rc = sd->sd_unevents = slap_uring_reap( t );
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+
+	for ( i = 0; i < sd->sd_undefer; i++ )
+		slap_uring_deferred( t, &sd->sd_udefer[i] );
+	sd->sd_undefer = 0;
+
+	return rc;
+}
+
+static void
+slap_uring_destroy( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring *ur = &sd->sd_uring;
+
+	if ( sd->sd_ufds == NULL ) return;
+
+	if ( ur->ur_sqes != NULL && ur->ur_sqes != MAP_FAILED )
+		munmap( ur->ur_sqes, ur->ur_sqeslen );
+	if ( ur->ur_ring != NULL && ur->ur_ring != MAP_FAILED )
+		munmap( ur->ur_ring, ur->ur_ringlen );
+	if ( ur->ur_fd >= 0 )
+		close( ur->ur_fd );
+	ldap_pvt_thread_mutex_destroy( &ur->ur_mutex );
+	memset( ur, 0, sizeof( *ur ) );
+	ch_free( sd->sd_ufds );
+	sd->sd_ufds = NULL;
+	sd->sd_uevents = NULL;
+	sd->sd_unevents = 0;
+	sd->sd_udefer = NULL;
+	sd->sd_undefer = 0;
+	if ( t == 0 && slap_uring_ios != NULL ) {
+		ch_free( slap_uring_ios );
+		slap_uring_ios = NULL;
+	}
+}
+
+static int
+slap_uring_init( int t )
+{
+	slap_daemon_st *sd = &slap_daemon[t];
+	slap_uring *ur = &sd->sd_uring;
+	struct io_uring_params p;
+	unsigned entries, i;
+	char *ring;
+
+	sd->sd_ufds = ch_calloc( dtblsize, sizeof( slap_ufd ) +
+		sizeof( struct pollfd ) + sizeof( slap_udefer ) );
+	sd->sd_uevents = (struct pollfd *)&sd->sd_ufds[ dtblsize ];
+	sd->sd_unevents = 0;
+	sd->sd_udefer = (slap_udefer *)&sd->sd_uevents[ dtblsize ];
+	sd->sd_undefer = 0;
+	sd->sd_upollaccept = 0;
+	ldap_pvt_thread_mutex_init( &ur->ur_mutex );
+	if ( slap_uring_ios == NULL )
+		slap_uring_ios = ch_calloc( dtblsize, sizeof( slap_uring_io * ) );
+
+	/* a few requests outstanding per descriptor at most; the submission
+	 * ring only needs to hold what is queued between two waits */
+	for ( entries = 64; entries < 4096 &&
+		entries < dtblsize / slapd_daemon_threads; entries <<= 1 )
+		;
+	memset( &p, 0, sizeof( p ) );
+	p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+	p.cq_entries = entries * 4;
+	ur->ur_fd = syscall( __NR_io_uring_setup, entries, &p );
+	if ( ur->ur_fd < 0 ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+			"io_uring_setup failed errno=%d\n", errno, 0, 0 );
+		goto fail;
+	}
+	if ( ( p.features & ( IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG ) )
+		!= ( IORING_FEAT_SINGLE_MMAP | IORING_FEAT_EXT_ARG ) )
+	{
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+			"kernel lacks required features (0x%x)\n", p.features, 0, 0 );
+		goto fail;
+	}
+
+	ur->ur_ringlen = p.sq_off.array + p.sq_entries * sizeof( unsigned );
+	if ( ur->ur_ringlen < p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe ) )
+		ur->ur_ringlen = p.cq_off.cqes + p.cq_entries * sizeof( struct io_uring_cqe );
+	ur->ur_ring = mmap( NULL, ur->ur_ringlen, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ur->ur_fd, IORING_OFF_SQ_RING );
+	ur->ur_sqeslen = p.sq_entries * sizeof( struct io_uring_sqe );
+	ur->ur_sqes = mmap( NULL, ur->ur_sqeslen, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ur->ur_fd, IORING_OFF_SQES );
+	if ( ur->ur_ring == MAP_FAILED || ur->ur_sqes == MAP_FAILED ) {
+		Debug( LDAP_DEBUG_ANY, "daemon: " SLAP_EVENT_FNAME ": "
+			"mmap failed errno=%d\n", errno, 0, 0 );
+		goto fail;
+	}
+
+	ring = ur->ur_ring;
+	ur->ur_sqentries = p.sq_entries;
+	ur->ur_sqmask = *(unsigned *)( ring + p.sq_off.ring_mask );
+	ur->ur_sqhead = (unsigned *)( ring + p.sq_off.head );
+	ur->ur_sqtail = (unsigned *)( ring + p.sq_off.tail );
+	/* submission entries are always consumed in ring order */
+	for ( i = 0; i < p.sq_entries; i++ )
+		((unsigned *)( ring + p.sq_off.array ))[i] = i;
+	ur->ur_cqmask = *(unsigned *)( ring + p.cq_off.ring_mask );
+	ur->ur_cqhead = (unsigned *)( ring + p.cq_off.head );
+	ur->ur_cqtail = (unsigned *)( ring + p.cq_off.tail );
+	ur->ur_cqes = (struct io_uring_cqe *)( ring + p.cq_off.cqes );
+
+	return 0;
+
+fail:
+	slap_uring_destroy( t );
+	return -1;
+}
+
+/*
+ * Sockbuf layer of a TCP session doing its I/O through the ring. It
+ * sits above the plain TCP provider, which still sets up and closes
+ * the descriptor. Reads are served from what the last IORING_OP_RECV
+ * brought back; writes are copied to the send buffer and go out with
+ * IORING_OP_SEND. While that buffer is full writes would block, and
+ * slapd_wait_writer() waits for the send to complete.
+ */
+static int
+sb_uring_setup( Sockbuf_IO_Desc *sbiod, void *arg )
+{
+	sbiod->sbiod_pvt = arg;
+	return 0;
+}
+
+static int
+sb_uring_close( Sockbuf_IO_Desc *sbiod )
+{
+	slap_uring_io *io = sbiod->sbiod_pvt;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( slap_uring_ios[io->io_sd] == io )
+		slap_uring_ios[io->io_sd] = NULL;
+	io->io_closed = 1;
+	/* Outstanding requests hold a reference on the file. A send still
+	 * outstanding means the socket buffer is full, what write(2) would
+	 * have refused is lost as well.
+	 */
+	if ( io->io_sbusy ) {
+		slap_uring_cancel( io->io_sring,
+			SLAP_URING_IODATA( io, SLAP_URING_SEND ) );
+		slap_uring_enter( &slap_daemon[io->io_sring].sd_uring, 0, 0, NULL );
+	}
+	if ( io->io_rbusy && !io->io_rcancel ) {
+		slap_uring_cancel( io->io_rring,
+			SLAP_URING_IODATA( io, SLAP_URING_RECV ) );
+		slap_uring_enter( &slap_daemon[io->io_rring].sd_uring, 0, 0, NULL );
+		io->io_rcancel = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+	return 0;
+}
+
+static int
+sb_uring_remove( Sockbuf_IO_Desc *sbiod )
+{
+	slap_uring_io *io = sbiod->sbiod_pvt;
+
+	if ( !io->io_closed )
+		sb_uring_close( sbiod );
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	io->io_gone = 1;
+	if ( io->io_rbusy || io->io_sbusy ) {
+		/* the last completion frees it */
+		ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+		return 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+	slap_uring_io_free( io );
+	return 0;
+}
+
+static int
+sb_uring_ctrl( Sockbuf_IO_Desc *sbiod, int opt, void *arg )
+{
+	slap_uring_io *io = sbiod->sbiod_pvt;
+
+	if ( opt == LBER_SB_OPT_DATA_READY ) {
+		int ready;
+
+		ldap_pvt_thread_mutex_lock( &io->io_mutex );
+		ready = io->io_roff < io->io_rlen;
+		ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+		if ( ready ) return 1;
+	}
+	return LBER_SBIOD_CTRL_NEXT( sbiod, opt, arg );
+}
+
+static ber_slen_t
+sb_uring_read( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	slap_uring_io *io = sbiod->sbiod_pvt;
+	ber_slen_t ret;
+	int err = 0;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( io->io_roff < io->io_rlen ) {
+		ret = io->io_rlen - io->io_roff;
+		if ( ret > len ) ret = len;
+		AC_MEMCPY( buf, io->io_rbuf + io->io_roff, ret );
+		io->io_roff += ret;
+		if ( io->io_roff == io->io_rlen )
+			io->io_roff = io->io_rlen = 0;
+
+	} else if ( io->io_rerr ) {
+		err = io->io_rerr;
+		ret = -1;
+
+	} else if ( io->io_reof ) {
+		ret = 0;
+
+	} else if ( io->io_rfull && !io->io_rbusy ) {
+		/* the last receive filled the buffer, more is likely queued;
+		 * no receive is outstanding while the interest is cleared */
+		ret = read( io->io_sd, buf, len );
+		if ( ret < 0 ) err = errno;
+		if ( ret == 0 ) io->io_reof = 1;
+		io->io_rfull = ( ret > 0 && (ber_len_t)ret == len );
+
+	} else {
+		err = EWOULDBLOCK;
+		ret = -1;
+	}
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+
+	if ( ret < 0 ) sock_errset( err );
+	return ret;
+}
+
+static ber_slen_t
+sb_uring_write( Sockbuf_IO_Desc *sbiod, void *buf, ber_len_t len )
+{
+	slap_uring_io *io = sbiod->sbiod_pvt;
+	int err = 0;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( io->io_serr ) {
+		err = io->io_serr;
+
+	} else if ( io->io_slen == SLAP_URING_SENDBUF ) {
+		io->io_sneed = 1;
+		err = EWOULDBLOCK;
+
+	} else {
+		if ( io->io_sbuf == NULL )
+			io->io_sbuf = ch_malloc( SLAP_URING_SENDBUF );
+		if ( len > SLAP_URING_SENDBUF - io->io_slen )
+			len = SLAP_URING_SENDBUF - io->io_slen;
+		AC_MEMCPY( io->io_sbuf + io->io_slen, buf, len );
+		io->io_slen += len;
+		/* otherwise it goes along when the outstanding send completes */
+		if ( !io->io_sbusy )
+			slap_uring_send( DAEMON_ID( io->io_sd ), io );
+	}
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+
+	if ( err ) {
+		sock_errset( err );
+		return -1;
+	}
+	return len;
+}
+
+static Sockbuf_IO slap_sockbuf_io_uring = {
+	sb_uring_setup,		/* sbi_setup */
+	sb_uring_remove,	/* sbi_remove */
+	sb_uring_ctrl,		/* sbi_ctrl */
+	sb_uring_read,		/* sbi_read */
+	sb_uring_write,		/* sbi_write */
+	sb_uring_close		/* sbi_close */
+};
+
+/* Wait for room in the send buffer of io, see slapd_wait_writer() */
+static int
+slap_uring_wait_writer( slap_uring_io *io, int timeout )
+{
+	struct pollfd fds;
+	eventfd_t n;
+	int rc;
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	if ( io->io_slen < SLAP_URING_SENDBUF || io->io_serr ) {
+		ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+		return 1;
+	}
+	if ( io->io_wfd < 0 )
+		io->io_wfd = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+	if ( io->io_wfd < 0 ) {
+		ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+		return -1;
+	}
+	io->io_swait = 1;
+	fds.fd = io->io_wfd;
+	fds.events = POLLIN;
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+
+	/* a connection closing under us fails the send, see slapd_shutsock() */
+	rc = poll( &fds, 1, timeout );
+
+	ldap_pvt_thread_mutex_lock( &io->io_mutex );
+	io->io_swait = 0;
+	eventfd_read( io->io_wfd, &n );
+	ldap_pvt_thread_mutex_unlock( &io->io_mutex );
+
+	return rc;
+}
+#endif /* HAVE_IO_URING */
+
 #ifdef HAVE_SLP
 /*
  * SLP related functions
@@ -842,6 +1911,28 @@ slapd_sock2fd( ber_socket_t s )
 }
 #endif
 
+/* Load of a daemon thread, each session counts as one event per second */
+#define SLAPD_DAEMON_LOAD(t)	\
+	(slap_daemon[t].sd_rate + slap_daemon[t].sd_nactives)
+
+/*
+ * Lock the daemon thread watching s. The descriptor may be migrated
+ * while we wait for the mutex, so check again once we hold it.
+ */
+static int
+slapd_lock_fd( ber_socket_t s )
+{
+	int id;
+
+	for (;;) {
+		id = DAEMON_ID(s);
+		ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+		if ( DAEMON_ID(s) == id )
+			return id;
+		ldap_pvt_thread_mutex_unlock( &slap_daemon[id].sd_mutex );
+	}
+}
+
 /*
  * Add a descriptor to daemon control
  *
@@ -854,6 +1945,27 @@ slapd_sock2fd( ber_socket_t s )
 static void
 slapd_add( ber_socket_t s, int isactive, Listener *sl, int id )
 {
+	if ( slap_fds ) {
+		slap_fd_st *sf = &slap_fds[s];
+
+		sf->sf_active = isactive;
+		sf->sf_movable = ( sl == NULL && id < 0 );
+		sf->sf_events = 0;
+		if ( sf->sf_movable ) {
+			int t;
+
+			/* the counters are only read as a hint here */
+			id = sf->sf_daemon;
+			for ( t = 0; t < slapd_daemon_threads; t++ ) {
+				if ( SLAPD_DAEMON_LOAD( t ) < SLAPD_DAEMON_LOAD( id ) )
+					id = t;
+			}
+		}
+		if ( id >= 0 )
+			sf->sf_daemon = id;
+		if ( s >= slap_fds_max )
+			slap_fds_max = s + 1;
+	}
 	if (id < 0)
 		id = DAEMON_ID(s);
 	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
@@ -885,10 +1997,12 @@ slapd_remove(
 {
 	int waswriter;
 	int wasreader;
-	int id = DAEMON_ID(s);
+	int id;
 
 	if ( !locked )
-		ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+		id = slapd_lock_fd( s );
+	else
+		id = DAEMON_ID(s);
 
 	assert( SLAP_SOCK_IS_ACTIVE( id, s ));
 
@@ -940,8 +2054,7 @@ slapd_remove(
 void
 slapd_clr_write( ber_socket_t s, int wake )
 {
-	int id = DAEMON_ID(s);
-	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+	int id = slapd_lock_fd( s );
 
 	if ( SLAP_SOCK_IS_WRITE( id, s )) {
 		assert( SLAP_SOCK_IS_ACTIVE( id, s ));
@@ -957,8 +2070,7 @@ slapd_clr_write( ber_socket_t s, int wake )
 void
 slapd_set_write( ber_socket_t s, int wake )
 {
-	int id = DAEMON_ID(s);
-	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+	int id = slapd_lock_fd( s );
 
 	assert( SLAP_SOCK_IS_ACTIVE( id, s ));
 
@@ -975,8 +2087,7 @@ int
 slapd_clr_read( ber_socket_t s, int wake )
 {
 	int rc = 1;
-	int id = DAEMON_ID(s);
-	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+	int id = slapd_lock_fd( s );
 
 	if ( SLAP_SOCK_IS_ACTIVE( id, s )) {
 		SLAP_SOCK_CLR_READ( id, s );
@@ -992,8 +2103,7 @@ void
 slapd_set_read( ber_socket_t s, int wake )
 {
 	int do_wake = 1;
-	int id = DAEMON_ID(s);
-	ldap_pvt_thread_mutex_lock( &slap_daemon[id].sd_mutex );
+	int id = slapd_lock_fd( s );
 
 	if( SLAP_SOCK_IS_ACTIVE( id, s ) && !SLAP_SOCK_IS_READ( id, s )) {
 		SLAP_SOCK_SET_READ( id, s );
@@ -1005,6 +2115,151 @@ slapd_set_read( ber_socket_t s, int wake )
 		WAKE_LISTENER(id,wake);
 }
 
+/*
+ * Move session s, seeing about rate events per second, from the
+ * daemon thread from to the daemon thread to. Only called by from
+ * itself, between two waits, so none of its events are pending.
+ */
+static int
+slapd_migrate( ber_socket_t s, int from, int to, unsigned long rate )
+{
+	slap_daemon_st *sdf = &slap_daemon[from], *sdt = &slap_daemon[to];
+	int r, w;
+
+	/* lock in index order, other threads only ever hold one */
+	ldap_pvt_thread_mutex_lock( &slap_daemon[from < to ? from : to].sd_mutex );
+	ldap_pvt_thread_mutex_lock( &slap_daemon[from < to ? to : from].sd_mutex );
+
+	if ( DAEMON_ID(s) != from || SLAP_SOCK_NOT_ACTIVE( from, s )) {
+		ldap_pvt_thread_mutex_unlock( &sdt->sd_mutex );
+		ldap_pvt_thread_mutex_unlock( &sdf->sd_mutex );
+		return 0;
+	}
+
+	r = SLAP_SOCK_IS_READ( from, s ) ? 1 : 0;
+	w = SLAP_SOCK_IS_WRITE( from, s ) ? 1 : 0;
+
+	SLAP_SOCK_DEL( from, s );
+	slap_fds[s].sf_daemon = to;
+	SLAP_SOCK_ADD( to, s, NULL );
+	if ( !r ) SLAP_SOCK_CLR_READ( to, s );
+	if ( w ) SLAP_SOCK_SET_WRITE( to, s );
+
+	if ( slap_fds[s].sf_active ) {
+		sdf->sd_nactives--;
+		sdt->sd_nactives++;
+	}
+	sdf->sd_nwriters -= w;
+	sdt->sd_nwriters += w;
+	sdf->sd_rate -= rate < sdf->sd_rate ? rate : sdf->sd_rate;
+	sdt->sd_rate += rate;
+	sdf->sd_nmoved++;
+
+	ldap_pvt_thread_mutex_unlock( &sdt->sd_mutex );
+	ldap_pvt_thread_mutex_unlock( &sdf->sd_mutex );
+
+	Debug( LDAP_DEBUG_CONNS, "daemon: moved %ld to thread %d\n",
+		(long) s, to, 0 );
+	WAKE_LISTENER(to,1);
+	return 1;
+}
+
+/*
+ * Called by each daemon thread on every pass through its loop. Every
+ * SLAPD_BALANCE_INTERVAL seconds, update the event rate of the thread
+ * and of the sessions it watches. If the thread is well above the
+ * average load, hand some of its sessions over to the least loaded
+ * thread. Each move must shrink the gap between the two threads, so
+ * sessions never bounce back and forth.
+ */
+static void
+slapd_balance( int tid, time_t now )
+{
+	slap_daemon_st *sd = &slap_daemon[tid];
+	unsigned long rate, load, mean = 0, budget = 0;
+	double elapsed;
+	int t, dst = tid, nmoved = 0;
+	ber_socket_t s;
+
+	if ( sd->sd_baltime == 0 ) {
+		sd->sd_baltime = now;
+		return;
+	}
+	elapsed = difftime( now, sd->sd_baltime );
+	if ( elapsed < SLAPD_BALANCE_INTERVAL )
+		return;
+
+	rate = ( sd->sd_nevents - sd->sd_balevents ) / elapsed;
+	ldap_pvt_thread_mutex_lock( &sd->sd_mutex );
+	sd->sd_rate = ( sd->sd_rate + rate ) / 2;
+	ldap_pvt_thread_mutex_unlock( &sd->sd_mutex );
+	sd->sd_balevents = sd->sd_nevents;
+	sd->sd_baltime = now;
+
+	for ( t = 0; t < slapd_daemon_threads; t++ ) {
+		mean += SLAPD_DAEMON_LOAD( t );
+		if ( SLAPD_DAEMON_LOAD( t ) < SLAPD_DAEMON_LOAD( dst ) )
+			dst = t;
+	}
+	mean /= slapd_daemon_threads;
+	load = SLAPD_DAEMON_LOAD( tid );
+
+	if ( dst != tid && !slapd_gentle_shutdown &&
+		load - SLAPD_DAEMON_LOAD( dst ) >= SLAPD_BALANCE_MIN &&
+		load * 4 > mean * 5 )
+	{
+		budget = load - SLAPD_DAEMON_LOAD( dst );
+	}
+
+	/* Also restarts the rate of each session */
+	for ( s = 0; s < slap_fds_max; s++ ) {
+		slap_fd_st *sf = &slap_fds[s];
+
+		if ( sf->sf_daemon != tid || !sf->sf_events ) continue;
+		rate = sf->sf_events / elapsed;
+		sf->sf_events = 0;
+
+		if ( !sf->sf_movable || !rate || rate >= budget ||
+			nmoved >= SLAPD_BALANCE_MAX )
+			continue;
+		if ( slapd_migrate( s, tid, dst, rate ) ) {
+			/* the gap closes from both ends */
+			budget = budget > 2 * rate ? budget - 2 * rate : 0;
+			nmoved++;
+		}
+	}
+
+	if ( nmoved ) {
+		Debug( LDAP_DEBUG_CONNS,
+			"daemon: thread %d load %lu, moved %d sessions\n",
+			tid, load, nmoved );
+	}
+}
+
+/*
+ * Statistics of daemon thread t, for back-monitor
+ */
+int
+slapd_daemon_stats(
+	int t,
+	long *nactives,
+	unsigned long *nevents,
+	unsigned long *rate,
+	unsigned long *nmoved )
+{
+	if ( t < 0 || t >= slapd_daemon_threads || slap_fds == NULL )
+		return -1;
+
+	ldap_pvt_thread_mutex_lock( &slap_daemon[t].sd_mutex );
+	*nactives = slap_daemon[t].sd_nactives;
+	*nevents = slap_daemon[t].sd_nevents;
+	*rate = slap_daemon[t].sd_rate;
+	*nmoved = slap_daemon[t].sd_nmoved;
+	ldap_pvt_thread_mutex_unlock( &slap_daemon[t].sd_mutex );
+
+	return 0;
+}
+
 static void
 slapd_close( ber_socket_t s )
 {
@@ -1277,6 +2532,10 @@ slap_open_listener(
 	struct sockaddr **sal, **psal;
 	int socktype = SOCK_STREAM;	/* default to COTS */
 	ber_socket_t s;
+#ifdef SO_REUSEPORT
+	struct sockaddr **rsal = NULL;
+	int reuse = 0;
+#endif /* SO_REUSEPORT */
 
 #if defined(LDAP_PF_LOCAL) || defined(SLAP_X_LISTENER_MOD)
 	/*
@@ -1379,6 +2638,13 @@ slap_open_listener(
 	psal = sal;
 	while ( *sal != NULL ) {
 		char *af;
+#ifdef SO_REUSEPORT
+		if ( sal != rsal ) {
+			rsal = sal;
+			reuse = 0;
+		}
+#endif /* SO_REUSEPORT */
+		l.sl_reuse = -1;
 		switch( (*sal)->sa_family ) {
 		case AF_INET:
 			af = "IPv4";
@@ -1440,6 +2706,27 @@ slap_open_listener(
 					(long) l.sl_sd, err, sock_errstr(err) );
 			}
 #endif /* SO_REUSEADDR */
+#ifdef SO_REUSEPORT
+			if ( slapd_reuseport
+#ifdef LDAP_CONNECTIONLESS
+				&& !l.sl_is_udp
+#endif /* LDAP_CONNECTIONLESS */
+				)
+			{
+				/* let the kernel spread connections across sockets */
+				tmp = 1;
+				rc = setsockopt( s, SOL_SOCKET, SO_REUSEPORT,
+					(char *) &tmp, sizeof(tmp) );
+				if ( rc == AC_SOCKET_ERROR ) {
+					int err = sock_errno();
+					Debug( LDAP_DEBUG_ANY, "slapd(%ld): "
+						"setsockopt(SO_REUSEPORT) failed errno=%d (%s)\n",
+						(long) l.sl_sd, err, sock_errstr(err) );
+				} else {
+					l.sl_reuse = reuse;
+				}
+			}
+#endif /* SO_REUSEPORT */
 		}
 
 		switch( (*sal)->sa_family ) {
@@ -1567,6 +2854,19 @@ slap_open_listener(
 		*li = l;
 		slap_listeners[*cur] = li;
 		(*cur)++;
+#ifdef SO_REUSEPORT
+		/* Sockets must be bound now, before privileges are dropped,
+		 * but the number of daemon threads is only known once the
+		 * config is read. Bind one for each possible thread, and
+		 * let slapd_trim_listeners() close the unused ones.
+		 */
+		if ( l.sl_reuse >= 0 && ++reuse < SLAPD_MAX_DAEMON_THREADS ) {
+			(*listeners)++;
+			slap_listeners = ch_realloc( slap_listeners,
+				(*listeners + 1) * sizeof(Listener *) );
+			continue;
+		}
+#endif /* SO_REUSEPORT */
 		sal++;
 	}
 
@@ -1707,6 +3007,8 @@ slapd_daemon_destroy( void )
 			SLAP_SOCK_DESTROY(i);
 		}
 		daemon_inited = 0;
+		ch_free( slap_fds );
+		slap_fds = NULL;
 #ifdef HAVE_TCPD
 		ldap_pvt_thread_mutex_destroy( &sd_tcpd_mutex );
 #endif /* TCP Wrappers */
@@ -1724,6 +3026,43 @@ slapd_daemon_destroy( void )
 }
 
 
+/*
+ * Keep one socket of each SO_REUSEPORT group per daemon thread. They
+ * are picked so that DAEMON_ID() gives each to a different thread.
+ */
+void
+slapd_trim_listeners( void )
+{
+	Listener *lr;
+	int i, j, used = 0;
+
+	if ( !slapd_reuseport || slap_listeners == NULL )
+		return;
+
+	for ( i = 0, j = 0; slap_listeners[i] != NULL; i++ ) {
+		lr = slap_listeners[i];
+
+		if ( lr->sl_reuse == 0 ) used = 0;
+		if ( lr->sl_reuse >= 0 ) {
+			int id = DAEMON_ID( lr->sl_sd );
+
+			if ( used & ( 1 << id ) ) {
+				tcp_close( SLAP_FD2SOCK( lr->sl_sd ) );
+				ber_memfree( lr->sl_url.bv_val );
+				ber_memfree( lr->sl_name.bv_val );
+				free( lr );
+				continue;
+			}
+			used |= 1 << id;
+			Debug( LDAP_DEBUG_TRACE, "daemon: listener %s fd=%ld "
+				"for thread %d\n",
+				lr->sl_url.bv_val, (long) lr->sl_sd, id );
+		}
+		slap_listeners[j++] = lr;
+	}
+	slap_listeners[j] = NULL;
+}
+
 static void
 close_listeners(
 	int remove )
@@ -1777,13 +3116,18 @@ destroy_listeners( void )
 	slap_listeners = NULL;
 }
 
+/* Set up a new session on sl. If s is AC_SOCKET_INVALID the
+ * connection is accepted here, otherwise s was already accepted
+ * by the daemon thread.
+ */
 static int
 slap_listener(
-	Listener *sl )
+	Listener *sl,
+	ber_socket_t s )
 {
 	Sockaddr		from;
 
-	ber_socket_t s, sfd;
+	ber_socket_t sfd;
 	ber_socklen_t len = sizeof(from);
 	Connection *c;
 	slap_ssf_t ssf = 0;
@@ -1826,6 +3170,18 @@ slap_listener(
 	from.sa_un_addr.sun_path[0] = '\0';
 #  endif /* LDAP_PF_LOCAL */
 
+	if ( s != AC_SOCKET_INVALID ) {
+		if ( getpeername( s, (struct sockaddr *) &from, &len ) < 0 ) {
+			int err = sock_errno();
+			Debug( LDAP_DEBUG_CONNS,
+				"daemon: getpeername(%ld) failed errno=%d (%s)\n",
+				(long) s, err, sock_errstr(err) );
+			tcp_close( s );
+			return 0;
+		}
+		goto accepted;
+	}
+
 	s = accept( SLAP_FD2SOCK( sl->sl_sd ), (struct sockaddr *) &from, &len );
 
 	/* Resume the listener FD to allow concurrent-processing of
@@ -1859,6 +3215,8 @@ slap_listener(
 		ldap_pvt_thread_yield();
 		return 0;
 	}
+
+accepted:
 	sfd = SLAP_SOCKNEW( s );
 
 	/* make sure descriptor number isn't too great */
@@ -2072,7 +3430,7 @@ slap_listener_thread(
 	int		rc;
 	Listener	*sl = (Listener *)ptr;
 
-	rc = slap_listener( sl );
+	rc = slap_listener( sl, AC_SOCKET_INVALID );
 
 	if( rc != LDAP_SUCCESS ) {
 		Debug( LDAP_DEBUG_ANY,
@@ -2083,6 +3441,21 @@ slap_listener_thread(
 	return (void*)NULL;
 }
 
+#ifdef HAVE_IO_URING
+static void*
+slap_accepted_thread(
+	void* ctx,
+	void* ptr )
+{
+	slap_accepted	*sa = (slap_accepted *)ptr;
+
+	slap_listener( sa->sa_l, sa->sa_sd );
+	ch_free( sa );
+
+	return (void*)NULL;
+}
+#endif /* HAVE_IO_URING */
+
 static int
 slap_listener_activate(
 	Listener* sl )
@@ -2110,20 +3483,16 @@ slapd_daemon_task(
 	void *ptr )
 {
 	int l;
-	time_t last_idle_check = 0;
+	int idletimeout = global_idletimeout;
 	int ebadf = 0;
 	int tid = (ldap_pvt_thread_t *) ptr - listener_tid;
 
-#define SLAPD_IDLE_CHECK_LIMIT 4
-
 	slapd_add( wake_sds[tid][0], 0, NULL, tid );
 	if ( tid )
 		goto loop;
 
 	/* Init stuff done only by thread 0 */
 
-	last_idle_check = slap_get_time();
-
 	for ( l = 0; slap_listeners[l] != NULL; l++ ) {
 		if ( slap_listeners[l]->sl_sd == AC_SOCKET_INVALID ) continue;
 
@@ -2351,30 +3720,22 @@ loop:
 
 		now = slap_get_time();
 
-		if ( !tid && ( global_idletimeout > 0 )) {
-			int check = 0;
-			/* Set the select timeout.
-			 * Don't just truncate, preserve the fractions of
-			 * seconds to prevent sleeping for zero time.
-			 */
-			{
-				tv.tv_sec = global_idletimeout / SLAPD_IDLE_CHECK_LIMIT;
-				tv.tv_usec = global_idletimeout - \
-					( tv.tv_sec * SLAPD_IDLE_CHECK_LIMIT );
-				tv.tv_usec *= 1000000 / SLAPD_IDLE_CHECK_LIMIT;
-				if ( difftime( last_idle_check +
-					global_idletimeout/SLAPD_IDLE_CHECK_LIMIT, now ) < 0 )
-					check = 1;
-			}
-			if ( check ) {
-				connections_timeout_idle( now );
-				last_idle_check = now;
+		if ( slapd_daemon_threads > 1 )
+			slapd_balance( tid, now );
+
+		/* Only thread 0 runs the timer wheel */
+		if ( !tid ) {
+			if ( idletimeout != global_idletimeout ) {
+				/* changed via cn=config */
+				idletimeout = global_idletimeout;
+				connections_idle_reset();
 			}
-		} else {
-			tv.tv_sec = 0;
-			tv.tv_usec = 0;
+			slap_timer_run( now );
 		}
 
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+
 #ifdef SIGHUP
 		if ( slapd_gentle_shutdown ) {
 			ber_socket_t active;
@@ -2434,8 +3795,6 @@ loop:
 
 		nfds = SLAP_EVENT_MAX(tid);
 
-		if (( global_idletimeout ) && slap_daemon[tid].sd_nactives ) at = 1;
-
 		ldap_pvt_thread_mutex_unlock( &slap_daemon[tid].sd_mutex );
 
 		if ( at 
@@ -2483,6 +3842,19 @@ loop:
 					tvp = &tv;
 				}
 			}
+
+			cat.tv_sec = slap_timer_next();
+			if ( cat.tv_sec ) {
+				double diff = difftime( cat.tv_sec, now );
+				if ( diff <= 0 ) {
+					diff = tdelta;
+				}
+				if ( tvp == NULL || diff < tv.tv_sec ) {
+					tv.tv_sec = diff;
+					tv.tv_usec = 0;
+					tvp = &tv;
+				}
+			}
 		}
 
 		for ( l = 0; slap_listeners[l] != NULL; l++ ) {
@@ -2514,6 +3886,15 @@ loop:
 				lr->sl_sd, at, tvp == NULL ? "NULL" : "zero" );
 		}
 
+		/* Wake up to refresh the event rate even when idle */
+		if ( slapd_daemon_threads > 1 &&
+			( tvp == NULL || tv.tv_sec >= SLAPD_BALANCE_INTERVAL ))
+		{
+			tv.tv_sec = SLAPD_BALANCE_INTERVAL;
+			tv.tv_usec = 0;
+			tvp = &tv;
+		}
+
 		SLAP_EVENT_WAIT( tid, tvp, &ns );
 		switch ( ns ) {
 		case -1: {	/* failure - try again */
@@ -2634,6 +4015,7 @@ loop:
 
 			SLAP_EVENT_CLR_WRITE( wd );
 			nwfds--;
+			SLAPD_EVENT_COUNT( tid, wd );
 
 			Debug( LDAP_DEBUG_CONNS,
 				"daemon: write active on %d\n",
@@ -2662,6 +4044,7 @@ loop:
 			rd = i;
 			SLAP_EVENT_CLR_READ( rd );
 			nrfds--;
+			SLAPD_EVENT_COUNT( tid, rd );
 
 			Debug ( LDAP_DEBUG_CONNS,
 				"daemon: read activity on %d\n", rd, 0, 0 );
@@ -2742,6 +4125,7 @@ loop:
 					tcp_read( SLAP_FD2SOCK(wake_sds[tid][0]), c, sizeof(c) );
 					continue;
 				}
+				SLAPD_EVENT_COUNT( tid, fd );
 
 				if ( SLAP_EVENT_IS_WRITE( i ) ) {
 					Debug( LDAP_DEBUG_CONNS,
@@ -2771,7 +4155,7 @@ loop:
 					SLAP_EVENT_CLR_READ( i );
 					connection_read_activate( fd );
 				} else if ( !w ) {
-#ifdef HAVE_EPOLL
+#if defined(HAVE_EPOLL) && !defined(HAVE_IO_URING)
 					/* Don't keep reporting the hangup
 					 */
 					if ( SLAP_SOCK_IS_ACTIVE( tid, fd )) {
@@ -2877,6 +4261,11 @@ slapd_daemon( void )
 
 	listener_tid = ch_malloc(slapd_daemon_threads * sizeof(ldap_pvt_thread_t));
 
+	/* from now on sessions are placed by load, see slapd_add() */
+	slap_fds = ch_calloc( dtblsize, sizeof( slap_fd_st ));
+	for ( i=0; i<dtblsize; i++ )
+		slap_fds[i].sf_daemon = i & slapd_daemon_mask;
+
 	/* daemon_init only inits element 0 */
 	for ( i=1; i<slapd_daemon_threads; i++ )
 	{
@@ -3065,6 +4454,29 @@ slap_wake_listener()
 	WAKE_LISTENER(0,1);
 }
 
+/*
+ * Have TCP session s do its I/O through the ring of its daemon thread,
+ * when io_uring is in use. Called before the session is added to
+ * daemon control.
+ */
+void
+slapd_sockbuf_io( Sockbuf *sb, ber_socket_t s )
+{
+#ifdef HAVE_IO_URING
+	slap_uring_io *io;
+
+	if ( slap_uring_ios == NULL ) return;
+
+	io = ch_calloc( 1, sizeof( slap_uring_io ) );
+	ldap_pvt_thread_mutex_init( &io->io_mutex );
+	io->io_sd = s;
+	io->io_wfd = -1;
+	ber_sockbuf_add_io( sb, &slap_sockbuf_io_uring,
+		LBER_SBIOD_LEVEL_PROVIDER, (void *)io );
+	slap_uring_ios[s] = io;
+#endif /* HAVE_IO_URING */
+}
+
 /* return 0 on timeout, 1 on writer ready
  * -1 on general error
  */
@@ -3089,6 +4501,11 @@ slapd_wait_writer( ber_socket_t sd )
 	struct pollfd fds;
 	int timeout = global_writetimeout ? global_writetimeout * 1000 : -1;
 
+#ifdef HAVE_IO_URING
+	if ( slap_uring_ios != NULL && slap_uring_ios[sd] != NULL )
+		return slap_uring_wait_writer( slap_uring_ios[sd], timeout );
+#endif /* HAVE_IO_URING */
+
 	fds.fd = sd;
 	fds.events = POLLOUT;
 
@@ -398,11 +398,28 @@ entry2str_wrap(
 	Entry		*e,
 	int			*len,
 	ber_len_t	wrap )
+{
+	return entry2str_wrap_r( e, len, wrap, &ebuf, &emaxsize );
+}
+
+/* Like entry2str_wrap(), in a buffer of the caller's, so that several
+ * threads can convert entries at once.
+ */
+char *
+entry2str_wrap_r(
+	Entry		*e,
+	int			*len,
+	ber_len_t	wrap,
+	char		**bufp,
+	int			*sizep )
 {
 	Attribute	*a;
 	struct berval	*bv;
 	int		i;
 	ber_len_t tmplen;
+	char		*ebuf = *bufp;
+	char		*ecur;
+	int		emaxsize = *sizep;
 
 	assert( e != NULL );
 
@@ -438,6 +455,8 @@ entry2str_wrap(
 	*ecur = '\0';
 	*len = ecur - ebuf;
 
+	*bufp = ebuf;
+	*sizep = emaxsize;
 	return( ebuf );
 }
 
@@ -139,6 +139,9 @@ slap_init( int mode, const char *name )
 		ldap_pvt_thread_pool_init_q( &connection_pool,
 				connection_pool_max, 0, connection_pool_queues);
 
+		qos_init();
+		limits_client_init();
+
 		slap_counters_init( &slap_counters );
 
 		ldap_pvt_thread_mutex_init( &slapd_rq.rq_mutex );
@@ -261,6 +264,8 @@ int slap_destroy(void)
 	case SLAP_SERVER_MODE:
 	case SLAP_TOOL_MODE:
 		slap_counters_destroy( &slap_counters );
+		qos_destroy();
+		limits_client_destroy();
 		break;
 
 	default:
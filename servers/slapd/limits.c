@@ -1,4 +1,4 @@
-/* limits.c - routines to handle regex-based size and time limits */
+/* limits.c - routines to handle regex-based size, time and rate limits */
 /* $OpenLDAP$ */
 /* This work is part of OpenLDAP Software <http://www.openldap.org/>.
  *
@@ -20,6 +20,7 @@
 
 #include <ac/ctype.h>
 #include <ac/regex.h>
+#include <ac/socket.h>
 #include <ac/string.h>
 
 #include "slap.h"
@@ -37,7 +38,8 @@ static const struct berval lmpats[] = {
 	BER_BVC( "regex" ),
 	BER_BVC( "anonymous" ),
 	BER_BVC( "users" ),
-	BER_BVC( "*" )
+	BER_BVC( "*" ),
+	BER_BVC( "ip" )
 };
 
 #ifdef LDAP_DEBUG
@@ -51,7 +53,8 @@ static const char *const lmpats_out[] = {
 	"REGEX",
 	"ANONYMOUS",
 	"USERS",
-	"ANY"
+	"ANY",
+	"IP"
 };
 
 static const char *
@@ -62,6 +65,58 @@ limits2str( unsigned i )
 }
 #endif /* LDAP_DEBUG */
 
+static const struct berval limits_bv_ip_eq = BER_BVC( "IP=" );
+
+/* Copy the address part of an IPv4 peer name, without the port */
+static int
+limits_peer_ip( struct berval *peer, char *buf, ber_len_t len )
+{
+	struct berval	ip;
+	char		*port;
+
+	if ( peer->bv_len <= limits_bv_ip_eq.bv_len ||
+		strncasecmp( peer->bv_val, limits_bv_ip_eq.bv_val,
+			limits_bv_ip_eq.bv_len ) != 0 )
+		return -1;
+
+	ip.bv_val = peer->bv_val + limits_bv_ip_eq.bv_len;
+	ip.bv_len = peer->bv_len - limits_bv_ip_eq.bv_len;
+	port = strrchr( ip.bv_val, ':' );
+	if ( port )
+		ip.bv_len = port - ip.bv_val;
+	if ( ip.bv_len >= len )
+		return -1;
+
+	AC_MEMCPY( buf, ip.bv_val, ip.bv_len );
+	buf[ ip.bv_len ] = '\0';
+	return 0;
+}
+
+static int
+limits_peer_match( struct slap_limits *lm, struct berval *peer )
+{
+	char		buf[ STRLENOF( "255.255.255.255" ) + 1 ];
+	unsigned long	addr;
+
+	switch ( lm->lm_flags & SLAP_LIMITS_MASK ) {
+	case SLAP_LIMITS_EXACT:
+		return ber_bvstrcasecmp( &lm->lm_pat, peer ) == 0;
+
+	case SLAP_LIMITS_REGEX:
+		return regexec( &lm->lm_regex, peer->bv_val, 0, NULL, 0 ) == 0;
+
+	case SLAP_LIMITS_IP:
+		if ( limits_peer_ip( peer, buf, sizeof( buf ) ) )
+			return 0;
+		addr = inet_addr( buf );
+		if ( addr == (unsigned long)(-1) )
+			return 0;
+		return ( addr & lm->lm_mask ) == lm->lm_addr;
+	}
+
+	return 0;
+}
+
 static int
 limits_get( 
 	Operation		*op,
@@ -97,6 +152,20 @@ limits_get(
 		unsigned	isthis = type == SLAP_LIMITS_TYPE_THIS;
 		struct berval *ndn = ndns[isthis];
 
+		if ( type == SLAP_LIMITS_TYPE_PEER ) {
+			if ( op->o_conn != NULL &&
+				!BER_BVISNULL( &op->o_conn->c_peer_name ) &&
+				limits_peer_match( lm[0], &op->o_conn->c_peer_name ) )
+			{
+				Debug( LDAP_DEBUG_TRACE,
+					"<== limits_get: type=PEER match=%s peername=\"%s\"\n",
+					limits2str( style ), lm[0]->lm_pat.bv_val, 0 );
+				*limit = &lm[0]->lm_limits;
+				return( 0 );
+			}
+			continue;
+		}
+
 		if ( style == SLAP_LIMITS_ANY )
 			goto found_any;
 
@@ -241,7 +310,42 @@ limits_add(
 
 	lm = ( struct slap_limits * )ch_calloc( sizeof( struct slap_limits ), 1 );
 
-	switch ( style ) {
+	if ( type == SLAP_LIMITS_TYPE_PEER ) {
+		char *mask;
+
+		ber_str2bv( pattern, 0, 1, &lm->lm_pat );
+		switch ( style ) {
+		case SLAP_LIMITS_REGEX:
+			if ( regcomp( &lm->lm_regex, lm->lm_pat.bv_val,
+						REG_EXTENDED | REG_ICASE ) ) {
+				free( lm->lm_pat.bv_val );
+				ch_free( lm );
+				return( -1 );
+			}
+			break;
+
+		case SLAP_LIMITS_IP:
+			mask = strchr( lm->lm_pat.bv_val, '%' );
+			if ( mask != NULL )
+				*mask = '\0';
+			lm->lm_addr = inet_addr( lm->lm_pat.bv_val );
+			lm->lm_mask = mask == NULL ? (unsigned long)(-1)
+				: inet_addr( mask + 1 );
+			if ( mask != NULL )
+				*mask = '%';
+			if ( lm->lm_addr == (unsigned long)(-1) ||
+				( lm->lm_mask == (unsigned long)(-1) && mask != NULL &&
+					strcmp( mask + 1, "255.255.255.255" ) != 0 ) )
+			{
+				free( lm->lm_pat.bv_val );
+				ch_free( lm );
+				return( -1 );
+			}
+			lm->lm_addr &= lm->lm_mask;
+			break;
+		}
+
+	} else switch ( style ) {
 	case SLAP_LIMITS_UNDEFINED:
 		style = SLAP_LIMITS_EXACT;
 		/* continue to next cases */
@@ -361,11 +465,17 @@ limits_parse(
 	 *
 	 * "group[/objectClass[/attributeType]]" "=" "<dn pattern>"
 	 *
+	 * "peername" [ "." { "exact" | "regex" | "ip" } ] "=" <peer pattern>
+	 *
 	 * <limit>:
 	 *
 	 * "time" [ "." { "soft" | "hard" } ] "=" <integer>
 	 *
 	 * "size" [ "." { "soft" | "hard" | "unchecked" } ] "=" <integer>
+	 *
+	 * "rate" [ "." "burst" ] "=" <integer>
+	 *
+	 * "concurrent" "=" <integer>
 	 */
 	
 	pattern = argv[1];
@@ -484,6 +594,38 @@ limits_parse(
 			}
 		}
 
+	} else if ( STRSTART( pattern, "peername" ) ) {
+		pattern += STRLENOF( "peername" );
+		flags = SLAP_LIMITS_TYPE_PEER | SLAP_LIMITS_EXACT;
+		if ( pattern[0] == '.' ) {
+			pattern++;
+			if ( STRSTART( pattern, "exact" ) ) {
+				pattern += STRLENOF( "exact" );
+
+			} else if ( STRSTART( pattern, "regex" ) ) {
+				flags = SLAP_LIMITS_TYPE_PEER | SLAP_LIMITS_REGEX;
+				pattern += STRLENOF( "regex" );
+
+			} else if ( STRSTART( pattern, "ip" ) ) {
+				flags = SLAP_LIMITS_TYPE_PEER | SLAP_LIMITS_IP;
+				pattern += STRLENOF( "ip" );
+			}
+		}
+
+		if ( pattern[0] != '=' ) {
+			Debug( LDAP_DEBUG_ANY,
+				"%s : line %d: %s in "
+				"\"peername[.{exact|regex|ip}]=<pattern>\" in "
+				"\"limits <pattern> <limits>\" line.\n",
+				fname, lineno,
+				isalnum( (unsigned char)pattern[0] )
+				? "unknown peername modifier" : "missing '='" );
+			return( -1 );
+		}
+
+		/* skip '=' (required) */
+		pattern++;
+
 	} else if (STRSTART( pattern, "group" ) ) {
 		pattern += STRLENOF( "group" );
 
@@ -613,6 +755,17 @@ no_ad:;
 		limit.lms_s_pr = limit.lms_s_pr_total;
 	}
 
+	/*
+	 * operations are admitted before they are routed to a database
+	 */
+	if ( be != frontendDB &&
+			( limit.lms_r_rate || limit.lms_r_concurrent ) ) {
+		Debug( LDAP_DEBUG_ANY,
+			"%s : line %d: rate and concurrent limits are only "
+			"enforced in the global/frontend database.\n",
+			fname, lineno, 0 );
+	}
+
 	rc = limits_add( be, flags, pattern, group_oc, group_ad, &limit );
 	if ( rc ) {
 
@@ -869,6 +1022,47 @@ limits_parse_one(
 		} else {
 			return( 1 );
 		}
+
+	} else if ( STRSTART( arg, "rate" ) ) {
+		arg += STRLENOF( "rate" );
+
+		if ( STRSTART( arg, ".burst=" ) ) {
+			arg += STRLENOF( ".burst=" );
+			if ( lutil_atoi( &limit->lms_r_burst, arg ) != 0
+				|| limit->lms_r_burst < 0 )
+			{
+				return( 1 );
+			}
+
+		} else if ( arg[0] == '=' ) {
+			arg++;
+			if ( strcasecmp( arg, "unlimited" ) == 0
+				|| strcasecmp( arg, "none" ) == 0 )
+			{
+				limit->lms_r_rate = -1;
+
+			} else if ( lutil_atoi( &limit->lms_r_rate, arg ) != 0
+				|| limit->lms_r_rate < 0 )
+			{
+				return( 1 );
+			}
+
+		} else {
+			return( 1 );
+		}
+
+	} else if ( STRSTART( arg, "concurrent=" ) ) {
+		arg += STRLENOF( "concurrent=" );
+		if ( strcasecmp( arg, "unlimited" ) == 0
+			|| strcasecmp( arg, "none" ) == 0 )
+		{
+			limit->lms_r_concurrent = -1;
+
+		} else if ( lutil_atoi( &limit->lms_r_concurrent, arg ) != 0
+			|| limit->lms_r_concurrent < 0 )
+		{
+			return( 1 );
+		}
 	}
 
 	return 0;
@@ -910,6 +1104,11 @@ limits_unparse( struct slap_limits *lim, struct berval *bv, ber_len_t buflen )
 			lim->lm_group_oc->soc_cname.bv_val,
 			lim->lm_group_ad->ad_cname.bv_val,
 			lim->lm_pat.bv_val ));
+	} else if ( type == SLAP_LIMITS_TYPE_PEER ) {
+		style = lim->lm_flags & SLAP_LIMITS_MASK;
+		rc = ptr_APPEND_FMT(( ptr, WHATSLEFT, "peername.%s=\"%s\"",
+			style == SLAP_LIMITS_EXACT ? "exact" : lmpats[style].bv_val,
+			lim->lm_pat.bv_val ));
 	} else {
 		style = lim->lm_flags & SLAP_LIMITS_MASK;
 		switch( style ) {
@@ -935,7 +1134,7 @@ limits_unparse( struct slap_limits *lim, struct berval *bv, ber_len_t buflen )
 		btmp.bv_val = ptr;
 		btmp.bv_len = 0;
 		rc = limits_unparse_one( &lim->lm_limits,
-			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME,
+			SLAP_LIMIT_SIZE | SLAP_LIMIT_TIME | SLAP_LIMIT_RATE,
 			&btmp, WHATSLEFT );
 		if ( rc == 0 )
 			bv->bv_len += btmp.bv_len;
@@ -1047,6 +1246,27 @@ t_hard:
 				return -1;
 		}
 	}
+
+	if ( which & SLAP_LIMIT_RATE ) {
+		if ( lim->lms_r_rate ) {
+			if ( ptr_APPEND_LIT( " rate=" ) ) return -1;
+			if ( lim->lms_r_rate == -1
+					? ptr_APPEND_LIT( "unlimited " )
+					: ptr_APPEND_FMT1( "%d ", lim->lms_r_rate ) )
+				return -1;
+		}
+		if ( lim->lms_r_burst ) {
+			if ( ptr_APPEND_FMT1( " rate.burst=%d ", lim->lms_r_burst ) )
+				return -1;
+		}
+		if ( lim->lms_r_concurrent ) {
+			if ( ptr_APPEND_LIT( " concurrent=" ) ) return -1;
+			if ( lim->lms_r_concurrent == -1
+					? ptr_APPEND_LIT( "unlimited " )
+					: ptr_APPEND_FMT1( "%d ", lim->lms_r_concurrent ) )
+				return -1;
+		}
+	}
 	if ( ptr != bv->bv_val ) {
 		ptr--;
 		*ptr = '\0';
@@ -1353,3 +1573,364 @@ limits_destroy(
 
 	ch_free( lm );
 }
+
+/*
+ * Rate and concurrency quotas.  Each client matching a frontend limits
+ * rule that has a rate or concurrent limit gets a token bucket of its
+ * own: an identity, or for anonymous clients and peername rules, an
+ * address; all clients of a peername.ip network share one.  Operations
+ * are charged when they are read off the connection, before they are
+ * queued for a thread.
+ */
+typedef struct slap_limits_client {
+	struct slap_limits	*lc_limits;	/* rule; only compared, may be gone */
+	struct berval		lc_key;
+	double			lc_tokens;
+	struct timeval		lc_stamp;	/* last refill */
+	int			lc_rate;	/* of the rule, for sweeping */
+	int			lc_burst;
+	int			lc_active;	/* operations in progress */
+	unsigned long		lc_admitted;
+	unsigned long		lc_rejected;
+	struct slap_limits_client *lc_next;
+} slap_limits_client;
+
+/* idle clients are forgotten this often, in seconds */
+#ifndef SLAP_LIMITS_SWEEP
+#define SLAP_LIMITS_SWEEP	60
+#endif
+
+static ldap_pvt_thread_mutex_t	limits_client_mutex;
+static Avlnode			*limits_clients;
+static time_t			limits_swept;
+static unsigned long		limits_rejected;
+
+static int
+limits_client_cmp( const void *v1, const void *v2 )
+{
+	const slap_limits_client *lc1 = v1, *lc2 = v2;
+
+	if ( lc1->lc_limits != lc2->lc_limits )
+		return lc1->lc_limits < lc2->lc_limits ? -1 : 1;
+	if ( lc1->lc_key.bv_len != lc2->lc_key.bv_len )
+		return lc1->lc_key.bv_len < lc2->lc_key.bv_len ? -1 : 1;
+	return memcmp( lc1->lc_key.bv_val, lc2->lc_key.bv_val,
+		lc1->lc_key.bv_len );
+}
+
+static void
+limits_client_free( void *v )
+{
+	slap_limits_client *lc = v;
+
+	ch_free( lc->lc_key.bv_val );
+	ch_free( lc );
+}
+
+int
+limits_client_init( void )
+{
+	ldap_pvt_thread_mutex_init( &limits_client_mutex );
+	limits_swept = slap_get_time();
+	return 0;
+}
+
+void
+limits_client_destroy( void )
+{
+	avl_free( limits_clients, limits_client_free );
+	limits_clients = NULL;
+	ldap_pvt_thread_mutex_destroy( &limits_client_mutex );
+}
+
+struct limits_sweep {
+	slap_limits_client	*ls_victims;
+	struct timeval		*ls_now;
+};
+
+static int
+limits_client_idle( void *v, void *arg )
+{
+	slap_limits_client *lc = v;
+	struct limits_sweep *ls = arg;
+	double idle;
+
+	if ( lc->lc_active )
+		return 0;
+
+	/* forget it once its bucket would be full again */
+	idle = (double)( ls->ls_now->tv_sec - lc->lc_stamp.tv_sec );
+	if ( idle < SLAP_LIMITS_SWEEP ||
+		( lc->lc_rate && idle * lc->lc_rate < lc->lc_burst ) )
+		return 0;
+
+	lc->lc_next = ls->ls_victims;
+	ls->ls_victims = lc;
+	return 0;
+}
+
+/* limits_client_mutex must be held */
+static void
+limits_client_sweep( struct timeval *now )
+{
+	struct limits_sweep ls;
+	slap_limits_client *lc;
+
+	ls.ls_victims = NULL;
+	ls.ls_now = now;
+	avl_apply( limits_clients, limits_client_idle, &ls, -1, AVL_INORDER );
+
+	while ( ( lc = ls.ls_victims ) != NULL ) {
+		ls.ls_victims = lc->lc_next;
+		avl_delete( &limits_clients, lc, limits_client_cmp );
+		limits_client_free( lc );
+	}
+	limits_swept = now->tv_sec;
+}
+
+/* The first frontend rule matching op's client, or NULL.  Group and
+ * dn.this rules need the request decoded, and are skipped.  Fills in
+ * the client's key for the rule.
+ */
+static struct slap_limits *
+limits_client_rule( Operation *op, struct berval *key, char *buf,
+	ber_len_t len )
+{
+	Connection *c = op->o_conn;
+	struct slap_limits **lm;
+	struct berval ndn, *peer = &c->c_peer_name;
+
+	ndn = BER_BVISNULL( &c->c_sasl_authz_dn ) ? c->c_ndn : c->c_sasl_authz_dn;
+
+	for ( lm = frontendDB->be_limits; lm[0] != NULL; lm++ ) {
+		unsigned	style = lm[0]->lm_flags & SLAP_LIMITS_MASK;
+		unsigned	type = lm[0]->lm_flags & SLAP_LIMITS_TYPE_MASK;
+		int		match = 0;
+
+		if ( type == SLAP_LIMITS_TYPE_PEER ) {
+			if ( BER_BVISNULL( peer ) ||
+				!limits_peer_match( lm[0], peer ) )
+				continue;
+			if ( style == SLAP_LIMITS_IP ) {
+				*key = lm[0]->lm_pat;
+			} else if ( limits_peer_ip( peer, buf, len ) == 0 ) {
+				ber_str2bv( buf, 0, 0, key );
+			} else {
+				*key = *peer;
+			}
+			return lm[0];
+		}
+		if ( type != SLAP_LIMITS_TYPE_SELF )
+			continue;
+
+		switch ( style ) {
+		case SLAP_LIMITS_ANY:
+			match = 1;
+			break;
+
+		case SLAP_LIMITS_ANONYMOUS:
+			match = BER_BVISEMPTY( &ndn );
+			break;
+
+		case SLAP_LIMITS_USERS:
+			match = !BER_BVISEMPTY( &ndn );
+			break;
+
+		case SLAP_LIMITS_EXACT:
+			match = !BER_BVISEMPTY( &ndn ) && dn_match( &lm[0]->lm_pat, &ndn );
+			break;
+
+		case SLAP_LIMITS_ONE:
+		case SLAP_LIMITS_SUBTREE:
+		case SLAP_LIMITS_CHILDREN: {
+			ber_len_t d;
+
+			if ( BER_BVISEMPTY( &ndn ) || ndn.bv_len < lm[0]->lm_pat.bv_len )
+				break;
+			d = ndn.bv_len - lm[0]->lm_pat.bv_len;
+			if ( d == 0 ? style != SLAP_LIMITS_SUBTREE
+				: !DN_SEPARATOR( ndn.bv_val[d - 1] ) )
+				break;
+			if ( strcmp( lm[0]->lm_pat.bv_val, &ndn.bv_val[d] ) != 0 )
+				break;
+			match = style != SLAP_LIMITS_ONE ||
+				dn_rdnlen( NULL, &ndn ) == d - 1;
+			} break;
+
+		case SLAP_LIMITS_REGEX:
+			match = !BER_BVISEMPTY( &ndn ) &&
+				regexec( &lm[0]->lm_regex, ndn.bv_val, 0, NULL, 0 ) == 0;
+			break;
+		}
+
+		if ( match ) {
+			if ( !BER_BVISEMPTY( &ndn ) ) {
+				*key = ndn;
+			} else if ( BER_BVISNULL( peer ) ) {
+				BER_BVSTR( key, "" );
+			} else if ( limits_peer_ip( peer, buf, len ) == 0 ) {
+				ber_str2bv( buf, 0, 0, key );
+			} else {
+				*key = *peer;
+			}
+			return lm[0];
+		}
+	}
+
+	return NULL;
+}
+
+/* Charge op to its client's quotas.  Returns LDAP_BUSY, with the reason
+ * in op->o_lbusy, if the client has no token left or already has its
+ * maximum of operations in progress.  Called with the connection's
+ * c_mutex held.
+ */
+int
+limits_admit( Operation *op )
+{
+	struct slap_limits *lm;
+	struct slap_limits_set *ls;
+	slap_limits_client lc_tmp, *lc;
+	char buf[ STRLENOF( "255.255.255.255" ) + 1 ];
+	struct timeval now;
+	double elapsed;
+	int rate, concurrent, burst;
+
+	if ( frontendDB->be_limits == NULL ||
+		op->o_tag == LDAP_REQ_ABANDON || op->o_tag == LDAP_REQ_UNBIND )
+		return LDAP_SUCCESS;
+
+	lm = limits_client_rule( op, &lc_tmp.lc_key, buf, sizeof( buf ) );
+	if ( lm == NULL )
+		return LDAP_SUCCESS;
+	ls = &lm->lm_limits;
+	rate = ls->lms_r_rate > 0 ? ls->lms_r_rate : 0;
+	concurrent = ls->lms_r_concurrent > 0 ? ls->lms_r_concurrent : 0;
+	if ( !rate && !concurrent )
+		return LDAP_SUCCESS;
+
+	burst = ls->lms_r_burst ? ls->lms_r_burst : rate;
+	if ( burst < 1 )
+		burst = 1;
+
+	gettimeofday( &now, NULL );
+	lc_tmp.lc_limits = lm;
+
+	ldap_pvt_thread_mutex_lock( &limits_client_mutex );
+	if ( now.tv_sec - limits_swept >= SLAP_LIMITS_SWEEP )
+		limits_client_sweep( &now );
+
+	lc = avl_find( limits_clients, &lc_tmp, limits_client_cmp );
+	if ( lc == NULL ) {
+		lc = ch_calloc( 1, sizeof( slap_limits_client ));
+		lc->lc_limits = lm;
+		ber_dupbv( &lc->lc_key, &lc_tmp.lc_key );
+		lc->lc_tokens = burst;
+		lc->lc_stamp = now;
+		avl_insert( &limits_clients, lc, limits_client_cmp, avl_dup_error );
+	}
+	lc->lc_rate = rate;
+	lc->lc_burst = burst;
+
+	if ( rate ) {
+		elapsed = (double)( now.tv_sec - lc->lc_stamp.tv_sec ) +
+			( now.tv_usec - lc->lc_stamp.tv_usec ) / 1000000.0;
+		if ( elapsed > 0 ) {
+			lc->lc_tokens += elapsed * rate;
+			if ( lc->lc_tokens > burst )
+				lc->lc_tokens = burst;
+		}
+	}
+	lc->lc_stamp = now;
+
+	if ( rate && lc->lc_tokens < 1 ) {
+		op->o_lbusy = "rate limit exceeded";
+
+	} else if ( concurrent && lc->lc_active >= concurrent )
+	{
+		op->o_lbusy = "too many operations in progress";
+
+	} else {
+		if ( rate )
+			lc->lc_tokens -= 1;
+		lc->lc_active++;
+		lc->lc_admitted++;
+		op->o_lclient = lc;
+	}
+
+	if ( op->o_lbusy ) {
+		lc->lc_rejected++;
+		limits_rejected++;
+	}
+	ldap_pvt_thread_mutex_unlock( &limits_client_mutex );
+
+	if ( op->o_lbusy ) {
+		Debug( LDAP_DEBUG_STATS, "%s limits: client \"%s\" busy, %s\n",
+			op->o_log_prefix, lc_tmp.lc_key.bv_val, op->o_lbusy );
+		return LDAP_BUSY;
+	}
+	return LDAP_SUCCESS;
+}
+
+/* op is done, give back its slot */
+void
+limits_release( Operation *op )
+{
+	ldap_pvt_thread_mutex_lock( &limits_client_mutex );
+	op->o_lclient->lc_active--;
+	ldap_pvt_thread_mutex_unlock( &limits_client_mutex );
+	op->o_lclient = NULL;
+}
+
+struct limits_info {
+	BerVarray	li_vals;
+	int		li_n;
+};
+
+static int
+limits_client_describe( void *v, void *arg )
+{
+	slap_limits_client *lc = v;
+	struct limits_info *li = arg;
+	struct slap_limits **lm;
+	char buf[ SLAP_TEXT_BUFLEN ];
+	struct berval bv;
+	int i = -1;
+
+	/* the rule's index, unless it is gone */
+	if ( frontendDB->be_limits ) {
+		for ( lm = frontendDB->be_limits; lm[0] && lm[0] != lc->lc_limits; lm++ )
+			;
+		if ( lm[0] )
+			i = lm - frontendDB->be_limits;
+	}
+
+	bv.bv_val = buf;
+	bv.bv_len = snprintf( buf, sizeof( buf ),
+		"{%d}limits=%d client=\"%s\" active=%d admitted=%lu rejected=%lu",
+		li->li_n, i, lc->lc_key.bv_val, lc->lc_active,
+		lc->lc_admitted, lc->lc_rejected );
+	if ( bv.bv_len < sizeof( buf ) ) {
+		value_add_one( &li->li_vals, &bv );
+		li->li_n++;
+	}
+	return 0;
+}
+
+/* Describe each client being tracked, for back-monitor */
+int
+limits_client_info( BerVarray *vals, unsigned long *rejected )
+{
+	struct limits_info li;
+
+	li.li_vals = NULL;
+	li.li_n = 0;
+
+	ldap_pvt_thread_mutex_lock( &limits_client_mutex );
+	*rejected = limits_rejected;
+	avl_apply( limits_clients, limits_client_describe, &li, -1, AVL_INORDER );
+	ldap_pvt_thread_mutex_unlock( &limits_client_mutex );
+
+	*vals = li.li_vals;
+	return li.li_n;
+}
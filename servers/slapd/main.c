@@ -112,6 +112,29 @@ static int version = 0;
 void *slap_tls_ctx;
 LDAP *slap_tls_ld;
 
+static int
+slapd_opt_reuseport( const char *val, void *arg )
+{
+#ifdef SO_REUSEPORT
+	if ( val == NULL || strcasecmp( val, "on" ) == 0 ) {
+		slapd_reuseport = 1;
+
+	} else if ( strcasecmp( val, "off" ) == 0 ) {
+		slapd_reuseport = 0;
+
+	} else {
+		fprintf(stderr, "unrecognized value \"%s\" for reuseport option\n", val );
+		return -1;
+	}
+
+	return 0;
+
+#else
+	fputs( "slapd: SO_REUSEPORT is not available\n", stderr );
+	return 0;
+#endif
+}
+
 static int
 slapd_opt_slp( const char *val, void *arg )
 {
@@ -159,6 +182,7 @@ struct option_helper {
 	const char	*oh_usage;
 } option_helpers[] = {
 	{ BER_BVC("slp"),	slapd_opt_slp,	NULL, "slp[={on|off|(attrs)}] enable/disable SLP using (attrs)" },
+	{ BER_BVC("reuseport"),	slapd_opt_reuseport,	NULL, "reuseport[={on|off}] one SO_REUSEPORT socket per listener thread" },
 	{ BER_BVNULL, 0, NULL, NULL }
 };
 
@@ -844,6 +868,9 @@ unhandled_option:;
 		goto destroy;
 	}
 
+	/* listener-threads is known now */
+	slapd_trim_listeners();
+
 	if ( slap_schema_check( ) != 0 ) {
 		Debug( LDAP_DEBUG_ANY,
 		    "schema prep error\n",
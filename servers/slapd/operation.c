@@ -122,6 +122,10 @@ slap_op_free( Operation *op, void *ctx )
 		op->o_tmpfree( op->o_pagedresults_state, op->o_tmpmemctx );
 	}
 
+	if ( op->o_lclient != NULL ) {
+		limits_release( op );
+	}
+
 	/* Selectively zero out the struct. Ignore fields that will
 	 * get explicitly initialized later anyway. Keep o_abandon intact.
 	 */
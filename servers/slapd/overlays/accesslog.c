@@ -1450,14 +1450,23 @@ accesslog_op2logop( Operation *op )
 	return LOG_EN_UNKNOWN;
 }
 
-static int accesslog_response(Operation *op, SlapReply *rs) {
+/* How accesslog_log() was reached */
+#define LOG_RESPONSE	0	/* response to the op */
+#define LOG_CLEANUP		1	/* op ended without a response */
+#define LOG_PRECOMMIT	2	/* in the op's write txn, before it commits */
+
+/* Write the log entry of op. Before the commit, the entry is written in
+ * the op's own txn and the result of the write is returned, otherwise
+ * it is written after the fact and the result is ignored.
+ */
+static int accesslog_log(Operation *op, SlapReply *rs, int how) {
 	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
 	log_info *li = on->on_bi.bi_private;
 	Attribute *a, *last_attr;
 	Modifications *m;
 	struct berval *b, uuid = BER_BVNULL;
 	int i;
-	int logop, do_graduate = 0;
+	int logop, do_graduate = 0, rc = LDAP_SUCCESS;
 	slap_verbmasks *lo;
 	Entry *e = NULL, *old = NULL, *e_uuid = NULL;
 	char timebuf[LDAP_LUTIL_GENTIME_BUFSIZE+8];
@@ -1468,7 +1477,7 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	SlapReply rs2 = {REP_RESULT};
 
 	if ( rs->sr_type != REP_RESULT && rs->sr_type != REP_EXTENDED )
-		return SLAP_CB_CONTINUE;
+		return LDAP_SUCCESS;
 
 	logop = accesslog_op2logop( op );
 	lo = logops+logop+EN_OFFSET;
@@ -1482,7 +1491,7 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 				break;
 			}
 		if ( !i )
-			return SLAP_CB_CONTINUE;
+			return LDAP_SUCCESS;
 	}
 
 	/* mutex and so were only set for write operations;
@@ -1492,13 +1501,8 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 
 		/* These internal ops are not logged */
 		if ( op->o_dont_replicate && op->orm_no_opattrs )
-			return SLAP_CB_CONTINUE;
+			return LDAP_SUCCESS;
 
-		ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
-		old = li->li_old;
-		uuid = li->li_uuid;
-		li->li_old = NULL;
-		BER_BVZERO( &li->li_uuid );
 		/* Disarm mod_cleanup */
 		for ( cb = op->o_callback; cb; cb = cb->sc_next ) {
 			if ( cb->sc_private == (void *)on ) {
@@ -1506,12 +1510,25 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 				break;
 			}
 		}
+		/* Already disarmed before the commit: logged in the op's txn */
+		if ( !cb && how == LOG_RESPONSE )
+			return LDAP_SUCCESS;
+
+		/* The op's txn already orders the entries written in it, and
+		 * a writer holding li_log_mutex may be waiting for that txn.
+		 */
+		if ( how != LOG_PRECOMMIT )
+			ldap_pvt_thread_mutex_lock( &li->li_log_mutex );
+		old = li->li_old;
+		uuid = li->li_uuid;
+		li->li_old = NULL;
+		BER_BVZERO( &li->li_uuid );
 		ldap_pvt_thread_rmutex_unlock( &li->li_op_rmutex, op->o_tid );
 	}
 
 	/* ignore these internal reads */
 	if (( lo->mask & LOG_OP_READS ) && op->o_do_not_cache ) {
-		return SLAP_CB_CONTINUE;
+		return LDAP_SUCCESS;
 	}
 
 	if ( li->li_success && rs->sr_err != LDAP_SUCCESS )
@@ -1831,6 +1848,8 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	op2.o_req_ndn = e->e_nname;
 	op2.ora_e = e;
 	op2.o_callback = &nullsc;
+	if ( how == LOG_PRECOMMIT )
+		op2.o_extra = op->o_extra;
 
 	if (( lo->mask & LOG_OP_WRITES ) && !BER_BVISEMPTY( &op->o_csn )) {
 		slap_queue_csn( &op2, &op->o_csn );
@@ -1838,6 +1857,8 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	}
 
 	op2.o_bd->be_add( &op2, &rs2 );
+	if ( how == LOG_PRECOMMIT )
+		rc = rs2.sr_err;
 	if ( e == op2.ora_e ) entry_free( e );
 	e = NULL;
 	if ( do_graduate ) {
@@ -1847,12 +1868,53 @@ static int accesslog_response(Operation *op, SlapReply *rs) {
 	}
 
 done:
-	if ( lo->mask & LOG_OP_WRITES )
+	if (( lo->mask & LOG_OP_WRITES ) && how != LOG_PRECOMMIT )
 		ldap_pvt_thread_mutex_unlock( &li->li_log_mutex );
 	if ( old ) entry_free( old );
+	return rc;
+}
+
+static int accesslog_response(Operation *op, SlapReply *rs) {
+	accesslog_log( op, rs, LOG_RESPONSE );
 	return SLAP_CB_CONTINUE;
 }
 
+/* If the log database shares the write txn of op's database, write the
+ * log entry in it, so that both are committed at once.
+ */
+static int
+accesslog_precommit( Operation *op, SlapReply *rs )
+{
+	slap_overinst *on = (slap_overinst *)op->o_bd->bd_info;
+	log_info *li = on->on_bi.bi_private;
+	slap_callback *cb;
+	Operation op2;
+	SlapReply rs2 = {REP_RESULT};
+	int rc;
+
+	/* Only ops accesslog_op_mod() armed are logged */
+	for ( cb = op->o_callback; cb; cb = cb->sc_next ) {
+		if ( cb->sc_private == (void *)on )
+			break;
+	}
+	if ( !cb || !li->li_db->bd_info->bi_op_txn )
+		return LDAP_SUCCESS;
+	op2 = *op;
+	op2.o_bd = li->li_db;
+	if ( li->li_db->bd_info->bi_op_txn( &op2, SLAP_TXN_JOIN, NULL ))
+		return LDAP_SUCCESS;
+
+	/* The update is about to succeed */
+	rs2.sr_err = LDAP_SUCCESS;
+	rc = accesslog_log( op, &rs2, LOG_PRECOMMIT );
+	if ( rc ) {
+		Debug( LDAP_DEBUG_ANY, "accesslog_precommit: "
+			"log entry for \"%s\" failed (%d)\n",
+			op->o_req_dn.bv_val, rc, 0 );
+	}
+	return rc;
+}
+
 /* Since Bind success is sent by the frontend, it won't normally enter
  * the overlay response callback. Add another callback to make sure it
  * gets here.
@@ -1906,7 +1968,7 @@ accesslog_mod_cleanup( Operation *op, SlapReply *rs )
 	if ( on ) {
 		BackendInfo *bi = op->o_bd->bd_info;
 		op->o_bd->bd_info = (BackendInfo *)on;
-		accesslog_response( op, rs );
+		accesslog_log( op, rs, LOG_CLEANUP );
 		op->o_bd->bd_info = bi;
 	}
 	return 0;
@@ -2309,6 +2371,7 @@ int accesslog_initialize()
 	accesslog.on_bi.bi_op_abandon = accesslog_abandon;
 	accesslog.on_bi.bi_operational = accesslog_operational;
 	accesslog.on_response = accesslog_response;
+	accesslog.on_precommit = accesslog_precommit;
 
 	accesslog.on_bi.bi_cf_ocs = log_cfocs;
 
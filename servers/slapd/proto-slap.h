@@ -500,6 +500,8 @@ LDAP_SLAPD_F (void) overlay_unregister_control LDAP_P((
 #endif /* SLAP_CONFIG_DELETE */
 LDAP_SLAPD_F (int) overlay_callback_after_backover LDAP_P((
 	Operation *op, slap_callback *sc, int append ));
+LDAP_SLAPD_F (int) overlay_precommit LDAP_P((
+	Operation *op, SlapReply *rs ));
 
 /*
  * bconfig.c
@@ -771,7 +773,7 @@ LDAP_SLAPD_V (int) slapi_plugins_used;
 LDAP_SLAPD_F (int) connections_init LDAP_P((void));
 LDAP_SLAPD_F (int) connections_shutdown LDAP_P((void));
 LDAP_SLAPD_F (int) connections_destroy LDAP_P((void));
-LDAP_SLAPD_F (int) connections_timeout_idle LDAP_P((time_t));
+LDAP_SLAPD_F (void) connections_idle_reset LDAP_P((void));
 LDAP_SLAPD_F (void) connections_drop LDAP_P((void));
 
 LDAP_SLAPD_F (Connection *) connection_client_setup LDAP_P((
@@ -870,11 +872,14 @@ LDAP_SLAPD_F (void) slap_queue_csn LDAP_P(( Operation *, struct berval * ));
  */
 LDAP_SLAPD_F (void) slapd_add_internal(ber_socket_t s, int isactive);
 LDAP_SLAPD_F (int) slapd_daemon_init( const char *urls );
+LDAP_SLAPD_F (void) slapd_trim_listeners(void);
 LDAP_SLAPD_F (int) slapd_daemon_destroy(void);
 LDAP_SLAPD_F (int) slapd_daemon(void);
 LDAP_SLAPD_F (Listener **)	slapd_get_listeners LDAP_P((void));
 LDAP_SLAPD_F (void) slapd_remove LDAP_P((ber_socket_t s, Sockbuf *sb,
 	int wasactive, int wake, int locked ));
+LDAP_SLAPD_F (int) slapd_daemon_stats LDAP_P(( int t, long *nactives,
+	unsigned long *nevents, unsigned long *rate, unsigned long *nmoved ));
 
 LDAP_SLAPD_F (RETSIGTYPE) slap_sig_shutdown LDAP_P((int sig));
 LDAP_SLAPD_F (RETSIGTYPE) slap_sig_wake LDAP_P((int sig));
@@ -888,6 +893,7 @@ LDAP_SLAPD_F (void) slapd_clr_write LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (void) slapd_set_read LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (int) slapd_clr_read LDAP_P((ber_socket_t s, int wake));
 LDAP_SLAPD_F (int) slapd_wait_writer( ber_socket_t sd );
+LDAP_SLAPD_F (void) slapd_sockbuf_io LDAP_P((Sockbuf *sb, ber_socket_t s));
 LDAP_SLAPD_F (void) slapd_shutsock( ber_socket_t sd );
 
 LDAP_SLAPD_V (volatile sig_atomic_t) slapd_abrupt_shutdown;
@@ -898,6 +904,7 @@ LDAP_SLAPD_V (slap_ssf_t) local_ssf;
 LDAP_SLAPD_V (struct runqueue_s) slapd_rq;
 LDAP_SLAPD_V (int) slapd_daemon_threads;
 LDAP_SLAPD_V (int) slapd_daemon_mask;
+LDAP_SLAPD_V (int) slapd_reuseport;
 #ifdef LDAP_TCP_BUFFER
 LDAP_SLAPD_V (int) slapd_tcp_rmem;
 LDAP_SLAPD_V (int) slapd_tcp_wmem;
@@ -1022,6 +1029,8 @@ LDAP_SLAPD_F (Entry *) str2entry LDAP_P(( char	*s ));
 LDAP_SLAPD_F (Entry *) str2entry2 LDAP_P(( char	*s, int checkvals ));
 LDAP_SLAPD_F (char *) entry2str LDAP_P(( Entry *e, int *len ));
 LDAP_SLAPD_F (char *) entry2str_wrap LDAP_P(( Entry *e, int *len, ber_len_t wrap ));
+LDAP_SLAPD_F (char *) entry2str_wrap_r LDAP_P(( Entry *e, int *len, ber_len_t wrap,
+	char **bufp, int *sizep ));
 
 LDAP_SLAPD_F (ber_len_t) entry_flatsize LDAP_P(( Entry *e, int norm ));
 LDAP_SLAPD_F (void) entry_partsize LDAP_P(( Entry *e, ber_len_t *len,
@@ -1222,6 +1231,12 @@ LDAP_SLAPD_F (int) limits_unparse LDAP_P((
 LDAP_SLAPD_F (void) limits_free_one LDAP_P(( 
 	struct slap_limits	*lm ));
 LDAP_SLAPD_F (void) limits_destroy LDAP_P(( struct slap_limits **lm ));
+LDAP_SLAPD_F (int) limits_client_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) limits_client_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (int) limits_admit LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (void) limits_release LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (int) limits_client_info LDAP_P((
+	BerVarray *vals, unsigned long *rejected ));
 
 /*
  * lock.c
@@ -1548,6 +1563,14 @@ LDAP_SLAPD_F (void) slap_passwd_init (void);
  */
 LDAP_SLAPD_F (char *) phonetic LDAP_P(( char *s ));
 
+/*
+ * qos.c
+ */
+LDAP_SLAPD_F (int) qos_init LDAP_P(( void ));
+LDAP_SLAPD_F (void) qos_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (int) qos_class LDAP_P(( Operation *op ));
+LDAP_SLAPD_F (int) qos_inline LDAP_P(( int qclass ));
+
 /*
  * referral.c
  */
@@ -1619,6 +1642,7 @@ LDAP_SLAPD_F (void) slap_send_ldap_intermediate LDAP_P(( Operation *op, SlapRepl
 LDAP_SLAPD_F (void) slap_send_search_result LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_reference LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_send_search_entry LDAP_P(( Operation *op, SlapReply *rs ));
+LDAP_SLAPD_F (void) slap_write_batch LDAP_P(( Operation *op, int start ));
 LDAP_SLAPD_F (int) slap_null_cb LDAP_P(( Operation *op, SlapReply *rs ));
 LDAP_SLAPD_F (int) slap_freeself_cb LDAP_P(( Operation *op, SlapReply *rs ));
 
@@ -1916,6 +1940,16 @@ LDAP_SLAPD_F (void) syn_delete LDAP_P(( Syntax *at ));
 LDAP_SLAPD_F (void) syn_unparse LDAP_P((
 	BerVarray *bva, Syntax *start, Syntax *end, int system ));
 
+/*
+ * timer.c
+ */
+LDAP_SLAPD_F (int) slap_timer_init LDAP_P(( void ));
+LDAP_SLAPD_F (int) slap_timer_destroy LDAP_P(( void ));
+LDAP_SLAPD_F (void) slap_timer_set LDAP_P(( SlapTimer *t, time_t when ));
+LDAP_SLAPD_F (void) slap_timer_cancel LDAP_P(( SlapTimer *t ));
+LDAP_SLAPD_F (void) slap_timer_run LDAP_P(( time_t now ));
+LDAP_SLAPD_F (time_t) slap_timer_next LDAP_P(( void ));
+
 /*
  * user.c
  */
@@ -0,0 +1,604 @@
+/* qos.c - classify operations for thread pool scheduling */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Every operation is submitted to the thread pool in one of the
+ * SLAP_QOS_* classes.  By default the class follows from the kind of
+ * operation; "qos" rules move all operations of matching clients to
+ * another class.  When several classes have operations waiting, the
+ * pool starts them in proportion to the classes' "qosweight".
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include <ac/ctype.h>
+#include <ac/regex.h>
+#include <ac/socket.h>
+#include <ac/string.h>
+
+#include "slap.h"
+#include "lutil.h"
+#include "config.h"
+
+static const struct berval qos_names[] = {
+	BER_BVC( "internal" ),
+	BER_BVC( "bind" ),
+	BER_BVC( "read" ),
+	BER_BVC( "search" ),
+	BER_BVC( "write" ),
+	BER_BVC( "repl" ),
+	BER_BVNULL
+};
+
+/* qr_style */
+enum {
+	QOS_ANY = 0,
+	QOS_ANONYMOUS,
+	QOS_USERS,
+	QOS_DN_EXACT,
+	QOS_DN_ONE,
+	QOS_DN_SUBTREE,
+	QOS_DN_CHILDREN,
+	QOS_DN_REGEX,
+	QOS_PEER_EXACT,
+	QOS_PEER_IP,
+	QOS_PEER_REGEX
+};
+
+static const struct berval qos_styles[] = {
+	BER_BVC( "*" ),
+	BER_BVC( "anonymous" ),
+	BER_BVC( "users" ),
+	BER_BVC( "dn.exact" ),
+	BER_BVC( "dn.onelevel" ),
+	BER_BVC( "dn.subtree" ),
+	BER_BVC( "dn.children" ),
+	BER_BVC( "dn.regex" ),
+	BER_BVC( "peername.exact" ),
+	BER_BVC( "peername.ip" ),
+	BER_BVC( "peername.regex" )
+};
+
+typedef struct qos_rule {
+	int		qr_style;
+	int		qr_class;
+	struct berval	qr_pat;		/* normalized DN, or as configured */
+	regex_t		qr_regex;
+	unsigned long	qr_addr;	/* QOS_PEER_IP, network order */
+	unsigned long	qr_mask;
+} qos_rule;
+
+/* rules are only changed with the pool paused, but connection_write()
+ * may classify an operation from a listener thread
+ */
+static ldap_pvt_thread_rdwr_t	qos_rwlock;
+static qos_rule		**qos_rules;
+static int		qos_nrules;
+
+static int		qos_weight[SLAP_QOS_LAST];
+
+static const struct berval	qos_bv_ip_eq = BER_BVC( "IP=" );
+
+#define STRSTART( s, m ) (strncasecmp( s, m, STRLENOF( "" m "" )) == 0)
+
+int
+qos_init( void )
+{
+	int i;
+
+	ldap_pvt_thread_rdwr_init( &qos_rwlock );
+	for ( i = 0; i < SLAP_QOS_LAST; i++ )
+		qos_weight[i] = 1;
+
+	return 0;
+}
+
+static void
+qos_free_one( qos_rule *qr )
+{
+	if ( qr->qr_style == QOS_DN_REGEX || qr->qr_style == QOS_PEER_REGEX )
+		regfree( &qr->qr_regex );
+	if ( !BER_BVISNULL( &qr->qr_pat ) )
+		ch_free( qr->qr_pat.bv_val );
+	ch_free( qr );
+}
+
+/* Delete rule idx, or all of them if idx < 0 */
+static void
+qos_delete( int idx )
+{
+	int i;
+
+	for ( i = 0; i < qos_nrules; i++ ) {
+		if ( idx < 0 || i == idx )
+			qos_free_one( qos_rules[i] );
+	}
+	if ( idx < 0 || qos_nrules == 1 ) {
+		ch_free( qos_rules );
+		qos_rules = NULL;
+		qos_nrules = 0;
+
+	} else if ( idx < qos_nrules ) {
+		qos_nrules--;
+		AC_MEMCPY( &qos_rules[idx], &qos_rules[idx + 1],
+			( qos_nrules - idx ) * sizeof( qos_rule * ));
+	}
+}
+
+void
+qos_destroy( void )
+{
+	qos_delete( -1 );
+	ldap_pvt_thread_rdwr_destroy( &qos_rwlock );
+}
+
+static int
+qos_str2class( const char *s )
+{
+	int i;
+
+	for ( i = 0; !BER_BVISNULL( &qos_names[i] ); i++ ) {
+		if ( strcasecmp( s, qos_names[i].bv_val ) == 0 )
+			return i;
+	}
+	return -1;
+}
+
+static int
+qos_dn_match( qos_rule *qr, struct berval *ndn )
+{
+	ber_len_t d;
+
+	switch ( qr->qr_style ) {
+	case QOS_DN_EXACT:
+		return dn_match( &qr->qr_pat, ndn );
+
+	case QOS_DN_REGEX:
+		return regexec( &qr->qr_regex, ndn->bv_val, 0, NULL, 0 ) == 0;
+	}
+
+	/* ndn shorter than qr_pat */
+	if ( ndn->bv_len < qr->qr_pat.bv_len )
+		return 0;
+	d = ndn->bv_len - qr->qr_pat.bv_len;
+
+	if ( d == 0 ) {
+		/* allow exact match for SUBTREE only */
+		if ( qr->qr_style != QOS_DN_SUBTREE )
+			return 0;
+	} else {
+		/* check for unescaped rdn separator */
+		if ( !DN_SEPARATOR( ndn->bv_val[d - 1] ) )
+			return 0;
+	}
+
+	/* check that ndn ends with qr_pat */
+	if ( strcmp( qr->qr_pat.bv_val, &ndn->bv_val[d] ) != 0 )
+		return 0;
+
+	/* in case of ONE, require exactly one rdn below qr_pat */
+	if ( qr->qr_style == QOS_DN_ONE && dn_rdnlen( NULL, ndn ) != d - 1 )
+		return 0;
+
+	return 1;
+}
+
+static int
+qos_peer_match( qos_rule *qr, struct berval *peer )
+{
+	char		buf[STRLENOF("255.255.255.255") + 1];
+	struct berval	ip;
+	char		*port;
+	unsigned long	addr;
+
+	switch ( qr->qr_style ) {
+	case QOS_PEER_EXACT:
+		return ber_bvstrcasecmp( &qr->qr_pat, peer ) == 0;
+
+	case QOS_PEER_REGEX:
+		return regexec( &qr->qr_regex, peer->bv_val, 0, NULL, 0 ) == 0;
+	}
+
+	if ( strncasecmp( peer->bv_val, qos_bv_ip_eq.bv_val,
+			qos_bv_ip_eq.bv_len ) != 0 )
+		return 0;
+
+	ip.bv_val = peer->bv_val + qos_bv_ip_eq.bv_len;
+	ip.bv_len = peer->bv_len - qos_bv_ip_eq.bv_len;
+	port = strrchr( ip.bv_val, ':' );
+	if ( port )
+		ip.bv_len = port - ip.bv_val;
+	if ( ip.bv_len >= sizeof( buf ) )
+		return 0;
+
+	AC_MEMCPY( buf, ip.bv_val, ip.bv_len );
+	buf[ ip.bv_len ] = '\0';
+	addr = inet_addr( buf );
+	if ( addr == (unsigned long)(-1) )
+		return 0;
+
+	return ( addr & qr->qr_mask ) == qr->qr_addr;
+}
+
+/* The scope of a search request, peeked at without consuming it */
+static int
+qos_search_scope( Operation *op )
+{
+	BerElementBuffer berbuf;
+	BerElement *ber = (BerElement *)&berbuf;
+	struct berval bv;
+	ber_int_t scope;
+
+	if ( ber_peek_element( op->o_ber, &bv ) == LBER_DEFAULT )
+		return -1;
+
+	ber_init2( ber, &bv, 0 );
+	if ( ber_skip_element( ber, &bv ) == LBER_DEFAULT ||
+		ber_get_enum( ber, &scope ) == LBER_ERROR )
+		return -1;
+
+	return scope;
+}
+
+/* The class to schedule a received operation in.  Called once the
+ * operation has its connection's identity.
+ */
+int
+qos_class( Operation *op )
+{
+	int qclass, i;
+
+	switch ( op->o_tag ) {
+	case LDAP_REQ_BIND:
+		qclass = SLAP_QOS_BIND;
+		break;
+
+	case LDAP_REQ_SEARCH:
+		qclass = qos_search_scope( op ) == LDAP_SCOPE_BASE
+			? SLAP_QOS_READ : SLAP_QOS_SEARCH;
+		break;
+
+	case LDAP_REQ_ADD:
+	case LDAP_REQ_DELETE:
+	case LDAP_REQ_MODIFY:
+	case LDAP_REQ_MODRDN:
+		qclass = SLAP_QOS_WRITE;
+		break;
+
+	case LDAP_REQ_ABANDON:
+	case LDAP_REQ_UNBIND:
+		/* cheap, and they make room for others */
+		return SLAP_QOS_INTERNAL;
+
+	default:
+		qclass = SLAP_QOS_READ;
+		break;
+	}
+
+	if ( qos_nrules == 0 )
+		return qclass;
+
+	ldap_pvt_thread_rdwr_rlock( &qos_rwlock );
+	for ( i = 0; i < qos_nrules; i++ ) {
+		qos_rule *qr = qos_rules[i];
+		int match;
+
+		switch ( qr->qr_style ) {
+		case QOS_ANY:
+			match = 1;
+			break;
+		case QOS_PEER_EXACT:
+		case QOS_PEER_IP:
+		case QOS_PEER_REGEX:
+			match = !BER_BVISNULL( &op->o_conn->c_peer_name ) &&
+				qos_peer_match( qr, &op->o_conn->c_peer_name );
+			break;
+		default:
+			/* a Bind is about to replace the identity */
+			if ( qclass == SLAP_QOS_BIND ) {
+				match = 0;
+			} else if ( qr->qr_style == QOS_ANONYMOUS ) {
+				match = BER_BVISEMPTY( &op->o_ndn );
+			} else if ( qr->qr_style == QOS_USERS ) {
+				match = !BER_BVISEMPTY( &op->o_ndn );
+			} else {
+				match = !BER_BVISEMPTY( &op->o_ndn ) &&
+					qos_dn_match( qr, &op->o_ndn );
+			}
+			break;
+		}
+		if ( match ) {
+			qclass = qr->qr_class;
+			break;
+		}
+	}
+	ldap_pvt_thread_rdwr_runlock( &qos_rwlock );
+
+	return qclass;
+}
+
+/* Whether an operation of this class may run in the thread that read
+ * it, instead of queueing behind the other classes.
+ */
+int
+qos_inline( int qclass )
+{
+	return qos_weight[qclass] >= qos_weight[SLAP_QOS_INTERNAL];
+}
+
+static int
+qos_parse( ConfigArgs *c, qos_rule **qrp )
+{
+	qos_rule *qr;
+	char *pattern = c->argv[1];
+	int i, style = -1;
+
+	qr = ch_calloc( 1, sizeof( qos_rule ));
+	qr->qr_class = qos_str2class( c->argv[2] );
+	if ( qr->qr_class < 0 ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ),
+			"<%s> unknown class \"%s\"", c->argv[0], c->argv[2] );
+		goto fail;
+	}
+
+	if ( strcmp( pattern, "*" ) == 0 ) {
+		style = QOS_ANY;
+		pattern = NULL;
+
+	} else if ( strcasecmp( pattern, "anonymous" ) == 0 ) {
+		style = QOS_ANONYMOUS;
+		pattern = NULL;
+
+	} else if ( strcasecmp( pattern, "users" ) == 0 ) {
+		style = QOS_USERS;
+		pattern = NULL;
+
+	} else {
+		char *eq = strchr( pattern, '=' );
+
+		if ( eq != NULL ) {
+			struct berval bv;
+
+			bv.bv_val = pattern;
+			bv.bv_len = eq - pattern;
+			for ( i = QOS_DN_EXACT; i <= QOS_PEER_REGEX; i++ ) {
+				if ( ber_bvstrcasecmp( &bv, &qos_styles[i] ) == 0 ) {
+					style = i;
+					break;
+				}
+			}
+			/* the usual aliases */
+			if ( style < 0 ) {
+				if ( STRSTART( pattern, "dn=" ) ||
+					STRSTART( pattern, "dn.base=" ))
+					style = QOS_DN_EXACT;
+				else if ( STRSTART( pattern, "dn.one=" ))
+					style = QOS_DN_ONE;
+				else if ( STRSTART( pattern, "dn.sub=" ))
+					style = QOS_DN_SUBTREE;
+				else if ( STRSTART( pattern, "peername=" ))
+					style = QOS_PEER_EXACT;
+			}
+			pattern = eq + 1;
+		}
+	}
+
+	if ( style < 0 ) {
+		snprintf( c->cr_msg, sizeof( c->cr_msg ),
+			"<%s> unknown client pattern \"%s\"", c->argv[0], c->argv[1] );
+		goto fail;
+	}
+	qr->qr_style = style;
+
+	switch ( style ) {
+	case QOS_DN_EXACT:
+	case QOS_DN_ONE:
+	case QOS_DN_SUBTREE:
+	case QOS_DN_CHILDREN: {
+		struct berval bv;
+
+		ber_str2bv( pattern, 0, 0, &bv );
+		if ( dnNormalize( 0, NULL, NULL, &bv, &qr->qr_pat, NULL )
+			!= LDAP_SUCCESS )
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid DN \"%s\"", c->argv[0], pattern );
+			goto fail;
+		}
+		} break;
+
+	case QOS_DN_REGEX:
+	case QOS_PEER_REGEX:
+		ber_str2bv( pattern, 0, 1, &qr->qr_pat );
+		if ( regcomp( &qr->qr_regex, pattern, REG_EXTENDED | REG_ICASE )) {
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid regex \"%s\"", c->argv[0], pattern );
+			ch_free( qr->qr_pat.bv_val );
+			BER_BVZERO( &qr->qr_pat );
+			goto fail;
+		}
+		break;
+
+	case QOS_PEER_EXACT:
+		ber_str2bv( pattern, 0, 1, &qr->qr_pat );
+		break;
+
+	case QOS_PEER_IP: {
+		char *mask;
+
+		ber_str2bv( pattern, 0, 1, &qr->qr_pat );
+		mask = strchr( qr->qr_pat.bv_val, '%' );
+		if ( mask )
+			*mask++ = '\0';
+		qr->qr_addr = inet_addr( qr->qr_pat.bv_val );
+		qr->qr_mask = mask ? inet_addr( mask ) : (unsigned long)(-1);
+		if ( mask )
+			mask[-1] = '%';
+		if ( qr->qr_addr == (unsigned long)(-1) ||
+			( mask && qr->qr_mask == (unsigned long)(-1) &&
+				strcmp( mask, "255.255.255.255" ) != 0 ))
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid address \"%s\"", c->argv[0], pattern );
+			goto fail;
+		}
+		qr->qr_addr &= qr->qr_mask;
+		} break;
+	}
+
+	*qrp = qr;
+	return 0;
+
+fail:
+	Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+	qos_free_one( qr );
+	return 1;
+}
+
+static void
+qos_unparse( qos_rule *qr, int idx, struct berval *bv )
+{
+	char buf[ SLAP_TEXT_BUFLEN + 1024 ];
+	int len;
+
+	if ( BER_BVISNULL( &qr->qr_pat ) ) {
+		len = snprintf( buf, sizeof( buf ), SLAP_X_ORDERED_FMT "%s %s",
+			idx, qos_styles[qr->qr_style].bv_val,
+			qos_names[qr->qr_class].bv_val );
+	} else {
+		len = snprintf( buf, sizeof( buf ), SLAP_X_ORDERED_FMT "%s=\"%s\" %s",
+			idx, qos_styles[qr->qr_style].bv_val, qr->qr_pat.bv_val,
+			qos_names[qr->qr_class].bv_val );
+	}
+	if ( len >= sizeof( buf ) )
+		len = sizeof( buf ) - 1;
+	ber_str2bv( buf, len, 1, bv );
+}
+
+int
+qos_config( ConfigArgs *c )
+{
+	qos_rule *qr;
+	int i;
+
+	if ( c->op == SLAP_CONFIG_EMIT ) {
+		struct berval bv;
+
+		for ( i = 0; i < qos_nrules; i++ ) {
+			qos_unparse( qos_rules[i], i, &bv );
+			ber_bvarray_add( &c->rvalue_vals, &bv );
+		}
+		return qos_nrules ? 0 : 1;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		ldap_pvt_thread_rdwr_wlock( &qos_rwlock );
+		qos_delete( c->valx );
+		ldap_pvt_thread_rdwr_wunlock( &qos_rwlock );
+		return 0;
+	}
+
+	if ( qos_parse( c, &qr ))
+		return 1;
+
+	ldap_pvt_thread_rdwr_wlock( &qos_rwlock );
+	qos_rules = ch_realloc( qos_rules, ( qos_nrules + 1 ) * sizeof( qos_rule * ));
+	i = qos_nrules;
+	if ( c->valx >= 0 && c->valx < qos_nrules ) {
+		i = c->valx;
+		AC_MEMCPY( &qos_rules[i + 1], &qos_rules[i],
+			( qos_nrules - i ) * sizeof( qos_rule * ));
+	}
+	qos_rules[i] = qr;
+	qos_nrules++;
+	ldap_pvt_thread_rdwr_wunlock( &qos_rwlock );
+
+	return 0;
+}
+
+static void
+qos_weights_apply( void )
+{
+	int i;
+
+	for ( i = 0; i < SLAP_QOS_LAST; i++ )
+		ldap_pvt_thread_pool_classweight( &connection_pool, i, qos_weight[i] );
+}
+
+int
+qos_weight_config( ConfigArgs *c )
+{
+	int weight[SLAP_QOS_LAST];
+	int i;
+
+	if ( c->op == SLAP_CONFIG_EMIT ) {
+		char buf[ SLAP_TEXT_BUFLEN ], *ptr = buf;
+
+		for ( i = 0; i < SLAP_QOS_LAST; i++ ) {
+			if ( qos_weight[i] == 1 )
+				continue;
+			if ( ptr != buf )
+				*ptr++ = ' ';
+			ptr += sprintf( ptr, "%s=%d", qos_names[i].bv_val, qos_weight[i] );
+		}
+		if ( ptr == buf )
+			return 1;
+		c->value_bv.bv_len = ptr - buf;
+		c->value_bv.bv_val = ch_strdup( buf );
+		value_add_one( &c->rvalue_vals, &c->value_bv );
+		ch_free( c->value_bv.bv_val );
+		return 0;
+
+	} else if ( c->op == LDAP_MOD_DELETE ) {
+		for ( i = 0; i < SLAP_QOS_LAST; i++ )
+			qos_weight[i] = 1;
+		qos_weights_apply();
+		return 0;
+	}
+
+	for ( i = 0; i < SLAP_QOS_LAST; i++ )
+		weight[i] = 1;
+
+	for ( i = 1; i < c->argc; i++ ) {
+		char *eq = strchr( c->argv[i], '=' );
+		int qclass, w;
+
+		if ( eq == NULL ) {
+			qclass = -1;
+		} else {
+			*eq = '\0';
+			qclass = qos_str2class( c->argv[i] );
+			*eq = '=';
+		}
+		if ( qclass < 0 || lutil_atoi( &w, eq + 1 ) != 0 ||
+			w < 1 || w > LDAP_PVT_THREAD_POOL_MAXWEIGHT )
+		{
+			snprintf( c->cr_msg, sizeof( c->cr_msg ),
+				"<%s> invalid \"%s\", need <class>=<1..%d>",
+				c->argv[0], c->argv[i], LDAP_PVT_THREAD_POOL_MAXWEIGHT );
+			Debug( LDAP_DEBUG_ANY, "%s: %s\n", c->log, c->cr_msg, 0 );
+			return 1;
+		}
+		weight[qclass] = w;
+	}
+
+	for ( i = 0; i < SLAP_QOS_LAST; i++ )
+		qos_weight[i] = weight[i];
+	qos_weights_apply();
+
+	return 0;
+}
@@ -309,21 +309,36 @@ slap_writewait_play(
 	}
 }
 
+#ifndef SLAP_WRITE_BATCH
+#define SLAP_WRITE_BATCH	16384	/* bytes of responses per write */
+#endif
+
+/*
+ * Write ber to the connection. While a search runs on the connection,
+ * search responses with batch set are only appended to c_wber, which
+ * is written out once SLAP_WRITE_BATCH bytes are pending, along with
+ * the next other PDU, or when the last search ends. With a NULL ber,
+ * just write out what is pending.
+ */
 static long send_ldap_ber(
 	Operation *op,
-	BerElement *ber )
+	BerElement *ber,
+	int batch )
 {
 	Connection *conn = op->o_conn;
-	ber_len_t bytes;
+	BerElement *wber;
+	ber_len_t bytes = 0;
 	long ret = 0;
 	char *close_reason;
 
-	ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
+	if ( ber != NULL )
+		ber_get_option( ber, LBER_OPT_BER_BYTES_TO_WRITE, &bytes );
 
 	/* write only one pdu at a time - wait til it's our turn */
 	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
-	if (( op->o_abandon && !op->o_cancel ) || !connection_valid( conn ) ||
-		conn->c_writers < 0 ) {
+	if (( ber != NULL && op->o_abandon && !op->o_cancel ) ||
+		( ber == NULL && conn->c_wpending == 0 ) ||
+		!connection_valid( conn ) || conn->c_writers < 0 ) {
 		ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
 		return 0;
 	}
@@ -349,12 +364,44 @@ static long send_ldap_ber(
 	/* Our turn */
 	conn->c_writing = 1;
 
-	/* write the pdu */
+	/* anything going out after pending responses joins them */
+	if ( ber != NULL && bytes < SLAP_WRITE_BATCH &&
+		(( batch && conn->c_wbatch ) || conn->c_wpending ))
+	{
+		struct berval bv;
+
+		if ( conn->c_wber == NULL )
+			conn->c_wber = ber_alloc_t( LBER_USE_DER );
+		if ( conn->c_wber != NULL && ber_flatten2( ber, &bv, 0 ) == 0 &&
+			ber_write( conn->c_wber, bv.bv_val, bv.bv_len, 0 ) >= 0 )
+		{
+			conn->c_wpending += bytes;
+			ret = bytes;
+			ber = NULL;
+			if ( batch && conn->c_wbatch &&
+				conn->c_wpending < SLAP_WRITE_BATCH )
+				goto done;
+		}
+	}
+
+	/* write what is pending first, then the pdu */
+	wber = conn->c_wpending ? conn->c_wber : ber;
+	if ( wber == NULL )
+		goto done;
 	while( 1 ) {
 		int err;
 
-		if ( ber_flush2( conn->c_sb, ber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
-			ret = bytes;
+		if ( ber_flush2( conn->c_sb, wber, LBER_FLUSH_FREE_NEVER ) == 0 ) {
+			if ( wber == conn->c_wber ) {
+				ber_reset( wber, 1 );
+				conn->c_wpending = 0;
+				if ( ber != NULL ) {
+					wber = ber;
+					continue;
+				}
+			} else {
+				ret = bytes;
+			}
 			break;
 		}
 
@@ -407,6 +454,7 @@ fail:
 		}
 	}
 
+done:
 	conn->c_writing = 0;
 	if ( conn->c_writers < 0 ) {
 		conn->c_writers++;
@@ -421,6 +469,35 @@ fail:
 	return ret;
 }
 
+/*
+ * Search responses sent on the connection between a start and a stop
+ * are coalesced, see send_ldap_ber(). Whatever is still pending when
+ * the last search stops is written out.
+ */
+void
+slap_write_batch( Operation *op, int start )
+{
+	Connection *conn = op->o_conn;
+	int flush;
+
+#ifdef LDAP_CONNECTIONLESS
+	/* one PDU per datagram */
+	if ( conn->c_is_udp ) return;
+#endif
+
+	ldap_pvt_thread_mutex_lock( &conn->c_write1_mutex );
+	if ( start ) {
+		conn->c_wbatch++;
+	} else {
+		conn->c_wbatch--;
+	}
+	flush = !conn->c_wbatch && conn->c_wpending;
+	ldap_pvt_thread_mutex_unlock( &conn->c_write1_mutex );
+
+	if ( flush )
+		send_ldap_ber( op, NULL, 0 );
+}
+
 static int
 send_ldap_control( BerElement *ber, LDAPControl *c )
 {
@@ -727,7 +804,7 @@ send_ldap_response(
 	}
 
 	/* send BER */
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 0 );
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0)
 #endif
@@ -1452,7 +1529,7 @@ slap_send_search_entry( Operation *op, SlapReply *rs )
 	rs_flush_entry( op, rs, NULL );
 
 	if ( op->o_res_ber == NULL ) {
-		bytes = send_ldap_ber( op, ber );
+		bytes = send_ldap_ber( op, ber, 1 );
 		ber_free_buf( ber );
 
 		if ( bytes < 0 ) {
@@ -1620,7 +1697,7 @@ slap_send_search_reference( Operation *op, SlapReply *rs )
 #ifdef LDAP_CONNECTIONLESS
 	if (!op->o_conn || op->o_conn->c_is_udp == 0) {
 #endif
-	bytes = send_ldap_ber( op, ber );
+	bytes = send_ldap_ber( op, ber, 1 );
 	ber_free_buf( ber );
 
 	if ( bytes < 0 ) {
@@ -244,7 +244,9 @@ do_search(
 	}
 
 	op->o_bd = frontendDB;
+	slap_write_batch( op, 1 );
 	rs->sr_err = frontendDB->be_search( op, rs );
+	slap_write_batch( op, 0 );
 
 return_results:;
 	if ( !BER_BVISNULL( &op->o_req_dn ) ) {
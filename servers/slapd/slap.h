@@ -1671,6 +1671,7 @@ slap_cf_aux_table_parse_x LDAP_P((
 
 #define SLAP_LIMIT_TIME	1
 #define SLAP_LIMIT_SIZE	2
+#define SLAP_LIMIT_RATE	4
 
 struct slap_limits_set {
 	/* time limits */
@@ -1684,6 +1685,11 @@ struct slap_limits_set {
 	int	lms_s_pr;
 	int	lms_s_pr_hide;
 	int	lms_s_pr_total;
+
+	/* rate and concurrency quotas, 0 or -1 for none */
+	int	lms_r_rate;		/* operations per second */
+	int	lms_r_burst;		/* 0 => same as rate */
+	int	lms_r_concurrent;	/* operations in progress */
 };
 
 /* Note: this is different from LDAP_NO_LIMIT (0); slapd internal use only */
@@ -1703,22 +1709,29 @@ struct slap_limits {
 #define SLAP_LIMITS_ANONYMOUS		0x0006U
 #define SLAP_LIMITS_USERS		0x0007U
 #define SLAP_LIMITS_ANY			0x0008U
+#define SLAP_LIMITS_IP			0x0009U
 #define SLAP_LIMITS_MASK		0x000FU
 
 #define SLAP_LIMITS_TYPE_SELF		0x0000U
 #define SLAP_LIMITS_TYPE_DN		SLAP_LIMITS_TYPE_SELF
 #define SLAP_LIMITS_TYPE_GROUP		0x0010U
 #define SLAP_LIMITS_TYPE_THIS		0x0020U
+#define SLAP_LIMITS_TYPE_PEER		0x0040U
 #define SLAP_LIMITS_TYPE_MASK		0x00F0U
 
 	regex_t			lm_regex;	/* regex data for REGEX */
 
 	/*
 	 * normalized DN for EXACT, BASE, ONE, SUBTREE, CHILDREN;
-	 * pattern for REGEX; NULL for ANONYMOUS, USERS
+	 * pattern for REGEX; NULL for ANONYMOUS, USERS;
+	 * peer name or address for TYPE_PEER
 	 */
 	struct berval		lm_pat;
 
+	/* address and netmask for TYPE_PEER IP, network order */
+	unsigned long		lm_addr;
+	unsigned long		lm_mask;
+
 	/* if lm_flags & SLAP_LIMITS_TYPE_MASK == SLAP_LIMITS_GROUP,
 	 * lm_group_oc is objectClass and lm_group_at is attributeType
 	 * of member in oc for match; then lm_flags & SLAP_LIMITS_MASK
@@ -2190,6 +2203,7 @@ typedef int (BI_op_txn) LDAP_P(( Operation *op, int txnop, struct OpExtra **ptr
 #define SLAP_TXN_BEGIN	1
 #define SLAP_TXN_COMMIT	2
 #define SLAP_TXN_ABORT	3
+#define SLAP_TXN_JOIN	4	/* would op's writes join its open txn? */
 #endif
 
 typedef int (BI_conn_func) LDAP_P(( BackendDB *bd, Connection *c ));
@@ -2424,6 +2438,7 @@ typedef struct slap_overinst {
 	slap_response *on_response;
 	struct slap_overinfo *on_info;
 	struct slap_overinst *on_next;
+	slap_response *on_precommit;	/* see overlay_precommit() */
 } slap_overinst;
 
 typedef struct slap_overinfo {
@@ -2698,6 +2713,10 @@ struct Operation {
 	char o_no_subordinate_glue;
 #define get_no_subordinate_glue(op)		((op)->o_no_subordinate_glue)
 
+	/* the client's rate and concurrency accounting, see limits.c */
+	struct slap_limits_client *o_lclient;
+	const char *o_lbusy;	/* why the client is over quota */
+
 #define SLAP_CONTROL_NONE	0
 #define SLAP_CONTROL_IGNORED	1
 #define SLAP_CONTROL_NONCRITICAL 2
@@ -2844,10 +2863,37 @@ typedef void (SEND_LDAP_INTERMEDIATE)(
 
 typedef struct Listener Listener;
 
+/*
+ * thread pool scheduling classes of operations, see qos.c
+ */
+enum {
+	SLAP_QOS_INTERNAL = 0,	/* connection I/O, server tasks, abandon/unbind */
+	SLAP_QOS_BIND,
+	SLAP_QOS_READ,		/* base-scoped search, compare, extended */
+	SLAP_QOS_SEARCH,	/* one-level and subtree search */
+	SLAP_QOS_WRITE,
+	SLAP_QOS_REPL,		/* only assigned by qos rules */
+	SLAP_QOS_LAST
+};
+
+/*
+ * one-shot timer on the daemon's timer wheel, see timer.c
+ */
+typedef struct slap_timer SlapTimer;
+typedef void (SlapTimerFunc) LDAP_P(( SlapTimer *t, time_t now ));
+
+struct slap_timer {
+	LDAP_LIST_ENTRY(slap_timer) st_next;
+	time_t		st_expire;
+	int			st_armed;
+	SlapTimerFunc	*st_func;
+	void		*st_arg;
+};
+
 /*
  * represents a connection from an ldap client
  */
-/* structure state (protected by connections_mutex) */
+/* structure state (set under c_mutex, read locklessly by connection scans) */
 enum sc_struct_state {
 	SLAP_C_UNINITIALIZED = 0,	/* MUST BE ZERO (0) */
 	SLAP_C_UNUSED,
@@ -2877,6 +2923,7 @@ struct Connection {
 	/* only can be changed by connect_init */
 	time_t		c_starttime;	/* when the connection was opened */
 	time_t		c_activitytime;	/* when the connection was last used */
+	SlapTimer	c_idletimer;	/* idletimeout check, lazily re-armed */
 	unsigned long		c_connid;	/* id of this connection for stats*/
 
 	struct berval	c_peer_domain;	/* DNS name of client */
@@ -2917,6 +2964,10 @@ struct Connection {
 	int			c_writers;		/* number of writers waiting */
 	char		c_writing;		/* someone is writing */
 
+	BerElement	*c_wber;		/* search responses not written yet */
+	ber_len_t	c_wpending;		/* bytes in c_wber */
+	int			c_wbatch;		/* searches coalescing their responses */
+
 	char		c_sasl_bind_in_progress;	/* multi-op bind in progress */
 	char		c_writewaiter;	/* true if blocked on write */
 
@@ -3019,6 +3070,7 @@ struct Listener {
 #endif
 	int	sl_mute;	/* Listener is temporarily disabled due to emfile */
 	int	sl_busy;	/* Listener is busy (accept thread activated) */
+	int	sl_reuse;	/* index in a SO_REUSEPORT group, or -1 */
 	ber_socket_t sl_sd;
 	Sockaddr sl_sa;
 #define sl_addr	sl_sa.sa_in_addr
@@ -64,15 +64,29 @@ typedef struct Erec {
 	unsigned long nextline;
 } Erec;
 
-typedef struct Trec {
+/* A record on its way through the input pipeline */
+typedef struct Prec {
 	Entry *e;
 	unsigned long lineno;
 	unsigned long nextline;
 	int rc;
-	int ready;
-} Trec;
-
-static Trec trec;
+	int state;
+#define	PREC_FREE	0
+#define	PREC_READ	1
+#define	PREC_DONE	2
+	char *buf;
+	int lmax;
+} Prec;
+
+/* records queued per parser thread */
+#define	PREC_PER_THREAD	32
+
+static Prec *precs;
+static int nprecs;
+static unsigned long prec_read, prec_parse, prec_added;
+static int prec_eof;
+static int nparsers;
+static ldap_pvt_thread_t *parser_thr;
 static unsigned long sid = SLAP_SYNC_SID_MAX + 1;
 static int checkvals;
 static int enable_meter;
@@ -83,54 +97,66 @@ static char *buf;
 static int lmax;
 
 static ldap_pvt_thread_mutex_t add_mutex;
-static ldap_pvt_thread_cond_t add_cond;
+static ldap_pvt_thread_cond_t add_cond;		/* a record was added */
+static ldap_pvt_thread_cond_t read_cond;	/* a record was read */
+static ldap_pvt_thread_cond_t parse_cond;	/* a record was parsed */
 static int add_stop;
 
+static int ldif_threaded;
+
 /* returns:
  *	1: got a record
  *	0: EOF
  * -1: read failure
+ */
+static int
+getrec_read(Erec *erec, char **bufp, int *lmaxp)
+{
+	int ldifrc;
+
+	do {
+		erec->lineno = erec->nextline+1;
+		/* nextline is the line number of the end of the current entry */
+		ldifrc = ldif_read_record( ldiffp, &erec->nextline, bufp, lmaxp );
+		if (ldifrc < 1)
+			return ldifrc < 0 ? -1 : 0;
+	} while ( erec->lineno < jumpline );
+
+	if ( enable_meter )
+		lutil_meter_update( &meter,
+				 ftello( ldiffp->fp ),
+				 0);
+
+	return 1;
+}
+
+/* Parse and check a record, independently of the other records.
+ * returns:
+ *	1: got an entry
  * -2: parse failure
  */
 static int
-getrec0(Erec *erec)
+getrec_parse(Operation *op, Erec *erec, char *rbuf)
 {
 	const char *text;
-	int ldifrc;
 	char textbuf[SLAP_TEXT_BUFLEN] = { '\0' };
 	size_t textlen = sizeof textbuf;
-	struct berval csn;
-	Operation *op = &opbuf.ob_op;
-	op->o_hdr = &opbuf.ob_hdr;
 
-again:
-	erec->lineno = erec->nextline+1;
-	/* nextline is the line number of the end of the current entry */
-	ldifrc = ldif_read_record( ldiffp, &erec->nextline, &buf, &lmax );
-	if (ldifrc < 1)
-		return ldifrc < 0 ? -1 : 0;
 	{
 		BackendDB *bd;
 		Entry *e;
 		int prev_DN_strict;
 
-		if ( erec->lineno < jumpline )
-			goto again;
-
-		if ( !dbnum ) {
+		/* the pipeline relaxes DNs for its whole run */
+		if ( !dbnum && !ldif_threaded ) {
 			prev_DN_strict = slap_DN_strict;
 			slap_DN_strict = 0;
 		}
-		e = str2entry2( buf, checkvals );
-		if ( !dbnum ) {
+		e = str2entry2( rbuf, checkvals );
+		if ( !dbnum && !ldif_threaded ) {
 			slap_DN_strict = prev_DN_strict;
 		}
 
-		if ( enable_meter )
-			lutil_meter_update( &meter,
-					 ftello( ldiffp->fp ),
-					 0);
-
 		if( e == NULL ) {
 			fprintf( stderr, "%s: could not parse entry (line=%lu)\n",
 				progname, erec->lineno );
@@ -202,6 +228,22 @@ again:
 			return -2;
 		}
 
+		erec->e = e;
+	}
+	return 1;
+}
+
+/* Add the operational attributes. This must be done in input order,
+ * to keep the CSNs ordered.
+ */
+static void
+getrec_lastmod(Erec *erec)
+{
+	struct berval csn;
+
+	{
+		Entry *e = erec->e;
+
 		if ( SLAP_LASTMOD(be) ) {
 			time_t now = slap_get_time();
 			char uuidbuf[ LDAP_LUTIL_UUIDSTR_BUFSIZE ];
@@ -304,47 +346,135 @@ again:
 
 			sid = slap_tool_update_ctxcsn_check( progname, e );
 		}
-		erec->e = e;
 	}
-	return 1;
 }
 
+/* returns:
+ *	1: got a record
+ *	0: EOF
+ * -1: read failure
+ * -2: parse failure
+ */
+static int
+getrec0(Erec *erec)
+{
+	Operation *op = &opbuf.ob_op;
+	int rc;
+
+	op->o_hdr = &opbuf.ob_hdr;
+
+	rc = getrec_read( erec, &buf, &lmax );
+	if ( rc == 1 )
+		rc = getrec_parse( op, erec, buf );
+	return rc;
+}
+
+/* With several tool threads, records go through a pipeline: one
+ * thread reads the LDIF, the parser threads turn the records into
+ * checked entries, and the main thread adds them in input order.
+ */
 static void *
 getrec_thr(void *ctx)
 {
+	Erec erec;
+	Prec *pr;
+	int rc;
+
+	erec.nextline = 0;
 	ldap_pvt_thread_mutex_lock( &add_mutex );
-	while (!add_stop) {
-		trec.rc = getrec0((Erec *)&trec);
-		trec.ready = 1;
-		while (trec.ready)
+	while ( !add_stop ) {
+		if ( prec_read - prec_added >= nprecs ) {
 			ldap_pvt_thread_cond_wait( &add_cond, &add_mutex );
+			continue;
+		}
+		pr = &precs[ prec_read % nprecs ];
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		rc = getrec_read( &erec, &pr->buf, &pr->lmax );
+		pr->lineno = erec.lineno;
+		pr->nextline = erec.nextline;
+		pr->rc = rc;
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		pr->state = PREC_READ;
+		prec_read++;
+		ldap_pvt_thread_cond_signal( &read_cond );
 		/* eof or read failure */
-		if ( trec.rc == 0 || trec.rc == -1 )
+		if ( rc < 1 ) {
+			prec_eof = 1;
+			ldap_pvt_thread_cond_broadcast( &read_cond );
 			break;
+		}
 	}
 	ldap_pvt_thread_mutex_unlock( &add_mutex );
 	return NULL;
 }
 
-static int ldif_threaded;
+static void *
+parse_thr(void *ctx)
+{
+	OperationBuffer opb;
+	Operation *op = &opb.ob_op;
+	Erec erec;
+	Prec *pr;
+
+	memset( &opb, 0, sizeof( opb ));
+	op->o_hdr = &opb.ob_hdr;
+
+	ldap_pvt_thread_mutex_lock( &add_mutex );
+	while ( !add_stop ) {
+		if ( prec_parse == prec_read ) {
+			if ( prec_eof )
+				break;
+			ldap_pvt_thread_cond_wait( &read_cond, &add_mutex );
+			continue;
+		}
+		pr = &precs[ prec_parse % nprecs ];
+		prec_parse++;
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+
+		if ( pr->rc == 1 ) {
+			erec.lineno = pr->lineno;
+			erec.nextline = pr->nextline;
+			erec.e = NULL;
+			pr->rc = getrec_parse( op, &erec, pr->buf );
+			pr->e = erec.e;
+		}
+
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		pr->state = PREC_DONE;
+		ldap_pvt_thread_cond_broadcast( &parse_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &add_mutex );
+	return NULL;
+}
 
 static int
 getrec(Erec *erec)
 {
+	Prec *pr;
 	int rc;
-	if ( !ldif_threaded )
-		return getrec0(erec);
-
-	while (!trec.ready)
-		ldap_pvt_thread_yield();
-	erec->e = trec.e;
-	erec->lineno = trec.lineno;
-	erec->nextline = trec.nextline;
-	trec.ready = 0;
-	rc = trec.rc;
-	ldap_pvt_thread_mutex_lock( &add_mutex );
-	ldap_pvt_thread_mutex_unlock( &add_mutex );
-	ldap_pvt_thread_cond_signal( &add_cond );
+
+	if ( !ldif_threaded ) {
+		rc = getrec0(erec);
+	} else {
+		ldap_pvt_thread_mutex_lock( &add_mutex );
+		pr = &precs[ prec_added % nprecs ];
+		while ( pr->state != PREC_DONE )
+			ldap_pvt_thread_cond_wait( &parse_cond, &add_mutex );
+		rc = pr->rc;
+		if ( rc == 1 )
+			erec->e = pr->e;
+		erec->lineno = pr->lineno;
+		erec->nextline = pr->nextline;
+		pr->e = NULL;
+		pr->state = PREC_FREE;
+		prec_added++;
+		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_mutex_unlock( &add_mutex );
+	}
+	if ( rc == 1 )
+		getrec_lastmod( erec );
 	return rc;
 }
 
@@ -358,6 +488,7 @@ slapadd( int argc, char **argv )
 	ldap_pvt_thread_t thr;
 	ID id;
 	Entry *prev = NULL;
+	int i, prev_DN_strict = 0;
 
 	int ldifrc;
 	int rc = EXIT_SUCCESS;
@@ -428,10 +559,23 @@ slapadd( int argc, char **argv )
 	}
 
 	if ( slap_tool_thread_max > 1 ) {
+		/* the tool threads besides this one parse records */
+		nparsers = slap_tool_thread_max - 1;
+		nprecs = nparsers * PREC_PER_THREAD;
+		precs = ch_calloc( nprecs, sizeof( Prec ));
+		parser_thr = ch_malloc( nparsers * sizeof( ldap_pvt_thread_t ));
+		ldif_threaded = 1;
+		if ( !dbnum ) {
+			prev_DN_strict = slap_DN_strict;
+			slap_DN_strict = 0;
+		}
 		ldap_pvt_thread_mutex_init( &add_mutex );
 		ldap_pvt_thread_cond_init( &add_cond );
+		ldap_pvt_thread_cond_init( &read_cond );
+		ldap_pvt_thread_cond_init( &parse_cond );
 		ldap_pvt_thread_create( &thr, 0, getrec_thr, NULL );
-		ldif_threaded = 1;
+		for ( i = 0; i < nparsers; i++ )
+			ldap_pvt_thread_create( &parser_thr[i], 0, parse_thr, NULL );
 	}
 
 	erec.nextline = 0;
@@ -482,10 +626,20 @@ slapadd( int argc, char **argv )
 	if ( ldif_threaded ) {
 		ldap_pvt_thread_mutex_lock( &add_mutex );
 		add_stop = 1;
-		trec.ready = 0;
-		ldap_pvt_thread_cond_signal( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &add_cond );
+		ldap_pvt_thread_cond_broadcast( &read_cond );
 		ldap_pvt_thread_mutex_unlock( &add_mutex );
 		ldap_pvt_thread_join( thr, NULL );
+		for ( i = 0; i < nparsers; i++ )
+			ldap_pvt_thread_join( parser_thr[i], NULL );
+		for ( i = 0; i < nprecs; i++ ) {
+			if ( precs[i].e ) entry_free( precs[i].e );
+			ch_free( precs[i].buf );
+		}
+		ch_free( precs );
+		ch_free( parser_thr );
+		if ( !dbnum )
+			slap_DN_strict = prev_DN_strict;
 	}
 	if ( erec.e ) entry_free( erec.e );
 
@@ -40,6 +40,140 @@ slapcat_sig( int sig )
 	gotsig=1;
 }
 
+/* With several tool threads, the main thread fetches the entries and
+ * writes them out in ID order, while the other threads filter them and
+ * convert them to LDIF.
+ */
+typedef struct Crec {
+	Entry *e;
+	ID id;
+	int rc;
+#define	CREC_OK		0
+#define	CREC_SKIP	1
+#define	CREC_BAD	2
+	int state;
+#define	CREC_FREE	0
+#define	CREC_READY	1
+#define	CREC_DONE	2
+	char *data;
+	int len;
+	int size;
+} Crec;
+
+/* records queued per converter thread */
+#define	CREC_PER_THREAD	32
+
+static Crec *crecs;
+static int ncrecs;
+static unsigned long crec_get, crec_conv, crec_put;
+static int cat_stop;
+static int cat_doBSF;
+static ldap_pvt_thread_mutex_t cat_mutex;
+static ldap_pvt_thread_cond_t get_cond;	/* an entry was fetched */
+static ldap_pvt_thread_cond_t conv_cond;	/* an entry was converted */
+
+static int
+slapcat_conv( Entry *e, Crec *cr )
+{
+	if ( cat_doBSF ) {
+		if ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope ) )
+			return CREC_SKIP;
+
+		if ( filter != NULL &&
+			test_filter( NULL, e, filter ) != LDAP_COMPARE_TRUE )
+			return CREC_SKIP;
+	}
+
+	if ( entry2str_wrap_r( e, &cr->len, ldif_wrap, &cr->data, &cr->size ) == NULL )
+		return CREC_BAD;
+	return CREC_OK;
+}
+
+static void *
+slapcat_thr( void *ctx )
+{
+	Crec *cr;
+
+	ldap_pvt_thread_mutex_lock( &cat_mutex );
+	while ( !cat_stop ) {
+		if ( crec_conv == crec_get ) {
+			ldap_pvt_thread_cond_wait( &get_cond, &cat_mutex );
+			continue;
+		}
+		cr = &crecs[ crec_conv % ncrecs ];
+		crec_conv++;
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		cr->rc = slapcat_conv( cr->e, cr );
+
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cr->state = CREC_DONE;
+		ldap_pvt_thread_cond_broadcast( &conv_cond );
+	}
+	ldap_pvt_thread_mutex_unlock( &cat_mutex );
+	return NULL;
+}
+
+/* Write out a converted entry. Returns -1 if slapcat must stop. */
+static int
+slapcat_put( Operation *op, Crec *cr, const char *progname, int *rcp )
+{
+	int rc = 0;
+
+	if ( cr->rc != CREC_SKIP && verbose ) {
+		printf( "# id=%08lx\n", (long) cr->id );
+	}
+	be_entry_release_r( op, cr->e );
+	cr->e = NULL;
+
+	if ( cr->rc == CREC_SKIP )
+		return 0;
+
+	if ( cr->rc == CREC_BAD ) {
+		printf("# bad data for entry id=%08lx\n\n", (long) cr->id );
+		*rcp = EXIT_FAILURE;
+		return continuemode ? 0 : -1;
+	}
+
+	if ( fputs( cr->data, ldiffp->fp ) == EOF ||
+		fputs( "\n", ldiffp->fp ) == EOF ) {
+		fprintf(stderr, "%s: error writing output.\n",
+			progname);
+		*rcp = EXIT_FAILURE;
+		rc = -1;
+	}
+	return rc;
+}
+
+/* Write out the queued entries, all of them or just the oldest one */
+static int
+slapcat_flush( Operation *op, const char *progname, int *rcp, int all )
+{
+	Crec *cr;
+	int rc = 0;
+
+	while ( crec_put < crec_get ) {
+		cr = &crecs[ crec_put % ncrecs ];
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		while ( cr->state != CREC_DONE )
+			ldap_pvt_thread_cond_wait( &conv_cond, &cat_mutex );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+
+		/* after an error, just release the rest */
+		if ( rc == 0 ) {
+			rc = slapcat_put( op, cr, progname, rcp );
+		} else {
+			be_entry_release_r( op, cr->e );
+			cr->e = NULL;
+		}
+		cr->state = CREC_FREE;
+		crec_put++;
+		if ( !all && rc == 0 )
+			break;
+	}
+	return rc;
+}
+
 int
 slapcat( int argc, char **argv )
 {
@@ -49,6 +183,8 @@ slapcat( int argc, char **argv )
 	const char *progname = "slapcat";
 	int requestBSF;
 	int doBSF = 0;
+	int i, nthreads = 0;
+	ldap_pvt_thread_t *thr = NULL;
 
 	slap_tool_init( progname, SLAPCAT, argc, argv );
 
@@ -96,6 +232,19 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+	if ( slap_tool_thread_max > 1 ) {
+		nthreads = slap_tool_thread_max - 1;
+		ncrecs = nthreads * CREC_PER_THREAD;
+		crecs = ch_calloc( ncrecs, sizeof( Crec ));
+		thr = ch_malloc( nthreads * sizeof( ldap_pvt_thread_t ));
+		cat_doBSF = doBSF;
+		ldap_pvt_thread_mutex_init( &cat_mutex );
+		ldap_pvt_thread_cond_init( &get_cond );
+		ldap_pvt_thread_cond_init( &conv_cond );
+		for ( i = 0; i < nthreads; i++ )
+			ldap_pvt_thread_create( &thr[i], 0, slapcat_thr, NULL );
+	}
+
 	for ( ; id != NOID; id = be->be_entry_next( be ) )
 	{
 		char *data;
@@ -106,6 +255,11 @@ slapcat( int argc, char **argv )
 			break;
 
 		e = be->be_entry_get( be, id );
+		if ( e == NULL && nthreads ) {
+			/* keep the output in order */
+			if ( slapcat_flush( &op, progname, &rc, 1 ))
+				break;
+		}
 		if ( e == NULL ) {
 			printf("# no data for entry id=%08lx\n\n", (long) id );
 			rc = EXIT_FAILURE;
@@ -127,6 +281,26 @@ slapcat( int argc, char **argv )
 			if ( e == NULL ) break;
 		}
 
+		if ( nthreads ) {
+			Crec *cr;
+
+			if ( crec_get - crec_put == ncrecs &&
+				slapcat_flush( &op, progname, &rc, 0 ))
+			{
+				be_entry_release_r( &op, e );
+				break;
+			}
+			cr = &crecs[ crec_get % ncrecs ];
+			cr->e = e;
+			cr->id = id;
+			ldap_pvt_thread_mutex_lock( &cat_mutex );
+			cr->state = CREC_READY;
+			crec_get++;
+			ldap_pvt_thread_cond_signal( &get_cond );
+			ldap_pvt_thread_mutex_unlock( &cat_mutex );
+			continue;
+		}
+
 		if ( doBSF ) {
 			if ( sub_ndn.bv_len && !dnIsSuffixScope( &e->e_nname, &sub_ndn, scope ) )
 			{
@@ -167,6 +341,20 @@ slapcat( int argc, char **argv )
 		}
 	}
 
+	if ( nthreads ) {
+		slapcat_flush( &op, progname, &rc, 1 );
+		ldap_pvt_thread_mutex_lock( &cat_mutex );
+		cat_stop = 1;
+		ldap_pvt_thread_cond_broadcast( &get_cond );
+		ldap_pvt_thread_mutex_unlock( &cat_mutex );
+		for ( i = 0; i < nthreads; i++ )
+			ldap_pvt_thread_join( thr[i], NULL );
+		for ( i = 0; i < ncrecs; i++ )
+			ch_free( crecs[i].data );
+		ch_free( crecs );
+		ch_free( thr );
+	}
+
 	be->be_entry_close( be );
 
 	if ( slap_tool_destroy())
@@ -0,0 +1,235 @@
+/* timer.c - hierarchical timer wheel for daemon timeouts */
+/* $OpenLDAP$ */
+/* This work is part of OpenLDAP Software <http://www.openldap.org/>.
+ *
+ * Copyright 1998-2015 The OpenLDAP Foundation.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted only as authorized by the OpenLDAP
+ * Public License.
+ *
+ * A copy of this license is available in the file LICENSE in the
+ * top-level directory of the distribution or, alternatively, at
+ * <http://www.OpenLDAP.org/license.html>.
+ */
+
+/*
+ * Timers have a resolution of one second.  Level 0 of the wheel has
+ * one slot per second for the next TW_SLOTS seconds, each higher level
+ * has slots TW_SLOTS times as wide.  Whenever level 0 wraps, the next
+ * slot of level 1 is cascaded down into it, and so on up.  Arming,
+ * re-arming and cancelling are O(1); slap_timer_run() only touches
+ * timers that are due or being cascaded.
+ *
+ * Callbacks run without the wheel mutex, in the daemon thread that
+ * called slap_timer_run(), and may re-arm their own timer.  They must
+ * not block, and should hand real work to the thread pool.  A timer
+ * that is re-armed or cancelled before its callback got to run does
+ * not fire.
+ */
+
+#include "portable.h"
+
+#include <stdio.h>
+
+#include "slap.h"
+
+#define TW_BITS		6
+#define TW_SLOTS	(1 << TW_BITS)
+#define TW_MASK		(TW_SLOTS - 1)
+#define TW_LEVELS	4
+
+/* st_armed */
+#define TW_ARMED	1	/* linked into the wheel */
+#define TW_FIRING	2	/* due, linked into slap_timer_run()'s list */
+
+/* furthest a timer can be placed ahead of the wheel, ~194 days */
+#define TW_MAX_DELTA	(((time_t)1 << (TW_BITS * TW_LEVELS)) - 1)
+
+typedef LDAP_LIST_HEAD(tw_slot, slap_timer) tw_slot;
+
+static ldap_pvt_thread_mutex_t tw_mutex;
+static tw_slot tw_wheel[TW_LEVELS][TW_SLOTS];
+static time_t tw_base;		/* next second to be processed */
+static unsigned long tw_count;	/* number of armed timers */
+static time_t tw_wake;		/* when the daemon will next run us, 0 never */
+
+static void
+tw_insert( SlapTimer *t )
+{
+	time_t when = t->st_expire, delta;
+	int level;
+
+	if ( when < tw_base )
+		when = tw_base;
+	delta = when - tw_base;
+	if ( delta > TW_MAX_DELTA ) {
+		delta = TW_MAX_DELTA;
+		when = tw_base + delta;
+	}
+
+	for ( level = 0; level < TW_LEVELS - 1; level++ ) {
+		if ( delta < ((time_t)1 << (TW_BITS * (level + 1))) )
+			break;
+	}
+
+	LDAP_LIST_INSERT_HEAD(
+		&tw_wheel[level][(when >> (TW_BITS * level)) & TW_MASK],
+		t, st_next );
+}
+
+/* move the timers of the current slot of a level back into the wheel;
+ * returns nonzero if the next level up also wrapped
+ */
+static int
+tw_cascade( int level )
+{
+	int idx = (tw_base >> (TW_BITS * level)) & TW_MASK;
+	SlapTimer *t, *next;
+
+	t = LDAP_LIST_FIRST( &tw_wheel[level][idx] );
+	LDAP_LIST_INIT( &tw_wheel[level][idx] );
+	for ( ; t != NULL; t = next ) {
+		next = LDAP_LIST_NEXT( t, st_next );
+		tw_insert( t );
+	}
+
+	return idx == 0;
+}
+
+int
+slap_timer_init( void )
+{
+	int i, j;
+
+	ldap_pvt_thread_mutex_init( &tw_mutex );
+	for ( i = 0; i < TW_LEVELS; i++ )
+		for ( j = 0; j < TW_SLOTS; j++ )
+			LDAP_LIST_INIT( &tw_wheel[i][j] );
+	tw_base = slap_get_time();
+	tw_count = 0;
+	tw_wake = 0;
+
+	return 0;
+}
+
+int
+slap_timer_destroy( void )
+{
+	ldap_pvt_thread_mutex_destroy( &tw_mutex );
+	return 0;
+}
+
+/* (Re)arm t to fire at the given time */
+void
+slap_timer_set( SlapTimer *t, time_t when )
+{
+	int wake = 0;
+
+	ldap_pvt_thread_mutex_lock( &tw_mutex );
+	if ( t->st_armed ) {
+		/* in the wheel, or due and not yet fired */
+		LDAP_LIST_REMOVE( t, st_next );
+	}
+	if ( t->st_armed != TW_ARMED ) {
+		t->st_armed = TW_ARMED;
+		tw_count++;
+	}
+	t->st_expire = when;
+	tw_insert( t );
+	if ( tw_wake == 0 || when < tw_wake ) {
+		/* due before the daemon planned to look again */
+		tw_wake = when;
+		wake = 1;
+	}
+	ldap_pvt_thread_mutex_unlock( &tw_mutex );
+
+	if ( wake )
+		slap_wake_listener();
+}
+
+void
+slap_timer_cancel( SlapTimer *t )
+{
+	ldap_pvt_thread_mutex_lock( &tw_mutex );
+	if ( t->st_armed ) {
+		LDAP_LIST_REMOVE( t, st_next );
+		if ( t->st_armed == TW_ARMED )
+			tw_count--;
+		t->st_armed = 0;
+	}
+	ldap_pvt_thread_mutex_unlock( &tw_mutex );
+}
+
+/* Fire every timer due at or before now */
+void
+slap_timer_run( time_t now )
+{
+	tw_slot expired;
+	SlapTimer *t;
+	int level, idx;
+
+	LDAP_LIST_INIT( &expired );
+
+	ldap_pvt_thread_mutex_lock( &tw_mutex );
+	if ( tw_count == 0 && tw_base <= now ) {
+		/* nothing to walk through */
+		tw_base = now + 1;
+	}
+	for ( ; tw_base <= now; tw_base++ ) {
+		idx = tw_base & TW_MASK;
+		if ( idx == 0 ) {
+			for ( level = 1; level < TW_LEVELS && tw_cascade( level ); level++ )
+				;
+		}
+		while ( ( t = LDAP_LIST_FIRST( &tw_wheel[0][idx] ) ) != NULL ) {
+			LDAP_LIST_REMOVE( t, st_next );
+			if ( t->st_expire > now ) {
+				/* clamped to the top of the wheel, not due yet */
+				tw_insert( t );
+				continue;
+			}
+			t->st_armed = TW_FIRING;
+			tw_count--;
+			LDAP_LIST_INSERT_HEAD( &expired, t, st_next );
+		}
+	}
+
+	/* a timer re-armed or cancelled meanwhile leaves the list */
+	while ( ( t = LDAP_LIST_FIRST( &expired ) ) != NULL ) {
+		LDAP_LIST_REMOVE( t, st_next );
+		t->st_armed = 0;
+		ldap_pvt_thread_mutex_unlock( &tw_mutex );
+		t->st_func( t, now );
+		ldap_pvt_thread_mutex_lock( &tw_mutex );
+	}
+	ldap_pvt_thread_mutex_unlock( &tw_mutex );
+}
+
+/* When slap_timer_run() next needs to be called, or 0 if never.
+ * Called by the daemon before it goes to sleep.
+ */
+time_t
+slap_timer_next( void )
+{
+	time_t next = 0, when;
+	int i;
+
+	ldap_pvt_thread_mutex_lock( &tw_mutex );
+	if ( tw_count ) {
+		/* first busy second before level 0 wraps, else the wrap */
+		next = ( tw_base | TW_MASK ) + 1;
+		for ( when = tw_base; when < next; when++ ) {
+			i = when & TW_MASK;
+			if ( !LDAP_LIST_EMPTY( &tw_wheel[0][i] ) ) {
+				next = when;
+				break;
+			}
+		}
+	}
+	tw_wake = next;
+	ldap_pvt_thread_mutex_unlock( &tw_mutex );
+
+	return next;
+}